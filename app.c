@@ -22,11 +22,15 @@ The views and conclusions contained in the software and documentation are those
 
 */
 
-#include <io.h>
 #include "brtos.h"
 
-/* at least 32 bytes for this implementation */
-#define TASK_STACK_SIZE 40
+/* worst case on MSP430 (check with make stack): canary word, BRTOS_TaskEnd()
+   return address (4 bytes), task frame with ulLastWake (6), BRTOS_SleepUntil()
+   (10) and the tick interrupt frame (28), 48 bytes, plus some headroom.
+   BRTOS_TaskStackHighWater() gives the real usage */
+#define TASK_STACK_SIZE 64
+
+#ifndef BRTOS_STATIC_TASKS
 
 /* 
   Using unsigned short to force the alignment (it is necessary
@@ -34,30 +38,34 @@ The views and conclusions contained in the software and documentation are those
 */
 unsigned short usStack_a [TASK_STACK_SIZE/2];
 unsigned short usStack_b [TASK_STACK_SIZE/2];
+#endif
 
 void task_a(unsigned long ulArgc)
 {
 	int i = 0;
+	/* absolute wake up times: the loop period does not drift with the work */
+	BRTOS_TICKS ulLastWake = BRTOS_GetTicks();
     while(1)
     {
         while(i < 50)
         {
             i = i + 1;
         }
-        BRTOS_Sleep(5);
+        BRTOS_SleepUntil(&ulLastWake, 5);
     }
 }
 
 void task_b(unsigned long ulArgc)
 {
 	int i = 0;
+	BRTOS_TICKS ulLastWake = BRTOS_GetTicks();
     while(1)
     {
         while(i < 100)
         {
             i = i + 1;
         }
-        BRTOS_Sleep(10);
+        BRTOS_SleepUntil(&ulLastWake, 10);
     }
 }
 
@@ -65,12 +73,15 @@ void task_b(unsigned long ulArgc)
 /*
 Schedule implemented:
 - 10 ms running task a
--  5 ms waiting
+-  5 ms period
 - 20 ms running task b
-- 10 ms waiting
+- 10 ms period
 */
 void BRTOS_Application_Initialize(void)
 {
-	BRTOS_CreateTask(task_a,(unsigned short)&usStack_a [TASK_STACK_SIZE/2-1],10,BRTOS_TASK_PRIORITY_1);
-	BRTOS_CreateTask(task_b,(unsigned short)&usStack_b [TASK_STACK_SIZE/2-1],20,BRTOS_TASK_PRIORITY_1);
+	/* with a static task table, tasks are declared in app_tasks.h */
+#ifndef BRTOS_STATIC_TASKS
+	BRTOS_CreateTask(task_a,usStack_a,TASK_STACK_SIZE,10,BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_b,usStack_b,TASK_STACK_SIZE,20,BRTOS_TASK_PRIORITY_1);
+#endif
 }
@@ -0,0 +1,32 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   app_tasks.h
+
+Static task table of the demo application, used when building with
+-DBRTOS_STATIC_TASKS='"app_tasks.h"' (see BRTOS_STATIC_TASKS in brtos.h).
+Stacks are sized from the worst case of make stack, as in app.c.
+*/
+#ifndef __APP_TASKS_H__
+#define __APP_TASKS_H__
+
+/*      entry   stack  slice (ms)  priority */
+#define BRTOS_TASKS(TASK)                                  \
+	TASK(task_a,  64,    10,         BRTOS_TASK_PRIORITY_1) \
+	TASK(task_b,  64,    20,         BRTOS_TASK_PRIORITY_1)
+
+#endif /* __APP_TASKS_H__ */
@@ -0,0 +1,161 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench.c
+
+Benchmark helpers, see \ref bench.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+
+double dBenchCyclesPerUs = 1.0;
+
+/**
+Measure the cycle counter frequency against the monotonic clock.
+Called before starting the kernel.
+*/
+void BENCH_Calibrate(void)
+{
+	struct timespec    sBeg, sEnd;
+	unsigned long long ullBeg, ullEnd;
+	long long          llNs;
+
+	clock_gettime(CLOCK_MONOTONIC, &sBeg);
+	ullBeg = BRTOS_PortCycles();
+	do
+	{
+		clock_gettime(CLOCK_MONOTONIC, &sEnd);
+		llNs = (sEnd.tv_sec - sBeg.tv_sec)*1000000000LL + (sEnd.tv_nsec - sBeg.tv_nsec);
+	} while(llNs < 50000000LL);
+	ullEnd = BRTOS_PortCycles();
+
+	dBenchCyclesPerUs = (double)(ullEnd - ullBeg)*1000.0/llNs;
+}
+
+/**
+Add a sample. When the buffer is full only the worst case is updated.
+*/
+void BENCH_Add(BENCH_SAMPLES *psSamples, unsigned long long ullValue)
+{
+	if(ullValue > psSamples->ullWorst)
+		psSamples->ullWorst = ullValue;
+
+	if(psSamples->ulCount < psSamples->ulMax)
+		psSamples->pullSamples[psSamples->ulCount++] = ullValue;
+}
+
+static int BENCH_Compare(const void *pvA, const void *pvB)
+{
+	unsigned long long ullA = *(const unsigned long long *) pvA;
+	unsigned long long ullB = *(const unsigned long long *) pvB;
+
+	return (ullA > ullB) - (ullA < ullB);
+}
+
+/**
+Sort a sample set, so percentiles can be taken.
+*/
+void BENCH_Sort(BENCH_SAMPLES *psSamples)
+{
+	qsort(psSamples->pullSamples, psSamples->ulCount, sizeof(unsigned long long), BENCH_Compare);
+}
+
+/**
+Percentile of a sample set, it must be sorted (see \ref BENCH_Sort()).
+*/
+unsigned long long BENCH_Percentile(BENCH_SAMPLES *psSamples, int iPercent)
+{
+	unsigned long ulIdx;
+
+	if(psSamples->ulCount == 0)
+		return 0;
+
+	ulIdx = (psSamples->ulCount - 1)*iPercent/100;
+	return psSamples->pullSamples[ulIdx];
+}
+
+/**
+Print min/p50/p90/p99/max/mean of a sample set, in cycles and microseconds,
+and optionally a log2 histogram (in cycles).
+*/
+void BENCH_Report(BENCH_SAMPLES *psSamples, int iHistogram)
+{
+	unsigned long      aulBucket[64] = { 0 };
+	unsigned long      ulMaxBucket = 0;
+	unsigned long      i;
+	long double        ldSum = 0;
+	unsigned long long ullMean;
+	int                iBucket, iFirst = 64, iLast = 0, j;
+
+	if(psSamples->ulCount == 0)
+	{
+		printf("%-28s no samples\n", psSamples->pcName);
+		return;
+	}
+
+	BENCH_Sort(psSamples);
+
+	for(i = 0 ; i < psSamples->ulCount ; i++)
+	{
+		ldSum += psSamples->pullSamples[i];
+		iBucket = psSamples->pullSamples[i] ? 63 - __builtin_clzll(psSamples->pullSamples[i]) : 0;
+		aulBucket[iBucket]++;
+		if(iBucket < iFirst) iFirst = iBucket;
+		if(iBucket > iLast)  iLast  = iBucket;
+	}
+	ullMean = (unsigned long long)(ldSum/psSamples->ulCount);
+
+	printf("%-28s n=%-8lu min=%-7llu p50=%-7llu p90=%-7llu p99=%-7llu max=%-8llu mean=%-7llu cycles\n",
+	       psSamples->pcName, psSamples->ulCount,
+	       BENCH_Percentile(psSamples, 0),  BENCH_Percentile(psSamples, 50),
+	       BENCH_Percentile(psSamples, 90), BENCH_Percentile(psSamples, 99),
+	       psSamples->ullWorst, ullMean);
+	printf("%-28s            min=%-7.2f p50=%-7.2f p90=%-7.2f p99=%-7.2f max=%-8.2f mean=%-7.2f us\n", "",
+	       BENCH_Percentile(psSamples, 0)/dBenchCyclesPerUs,  BENCH_Percentile(psSamples, 50)/dBenchCyclesPerUs,
+	       BENCH_Percentile(psSamples, 90)/dBenchCyclesPerUs, BENCH_Percentile(psSamples, 99)/dBenchCyclesPerUs,
+	       psSamples->ullWorst/dBenchCyclesPerUs, ullMean/dBenchCyclesPerUs);
+
+	if(!iHistogram)
+		return;
+
+	for(j = iFirst ; j <= iLast ; j++)
+		if(aulBucket[j] > ulMaxBucket)
+			ulMaxBucket = aulBucket[j];
+
+	for(j = iFirst ; j <= iLast ; j++)
+	{
+		int iBar = (int)(aulBucket[j]*50/ulMaxBucket);
+		printf("    %10llu+ %8lu |", 1ULL << j, aulBucket[j]);
+		while(iBar-- > 0)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+/**
+Leave the benchmark: the tick is stopped (interrupts disabled) before exit.
+*/
+void BENCH_Exit(void)
+{
+	BRTOS_PortDisableInterrupts();
+	fflush(stdout);
+	exit(0);
+}
@@ -0,0 +1,51 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench.h
+
+Helpers for host benchmarks (POSIX port): sample collection and 
+statistics (percentiles and log2 histograms) in cycles and microseconds.
+*/
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "../brtos.h"
+#include "../port_posix.h"
+
+/** sample set */
+typedef struct {
+	const char         *pcName;       /* printed name                 */
+	unsigned long long *pullSamples;  /* sample buffer                */
+	unsigned long       ulMax;        /* buffer size                  */
+	unsigned long       ulCount;      /* samples taken                */
+	unsigned long long  ullWorst;     /* worst case, even if dropped  */
+} BENCH_SAMPLES;
+
+#define BENCH_SAMPLES_INIT(name, buf) { name, buf, sizeof(buf)/sizeof(buf[0]), 0, 0 }
+
+/** cycles per microsecond, see \ref BENCH_Calibrate() */
+extern double dBenchCyclesPerUs;
+
+void BENCH_Calibrate(void);
+void BENCH_Add(BENCH_SAMPLES *psSamples, unsigned long long ullValue);
+void BENCH_Sort(BENCH_SAMPLES *psSamples);
+void BENCH_Report(BENCH_SAMPLES *psSamples, int iHistogram);
+unsigned long long BENCH_Percentile(BENCH_SAMPLES *psSamples, int iPercent);
+void BENCH_Exit(void);
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,128 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_boot.c
+
+Boot benchmark (POSIX port): the same eight tasks (boot_tasks.h) are
+declared in a static task table (bench_boot_1) or created at run time in a
+TCB array with room for BRTOS_MAX_TASKS tasks (bench_boot_0). It reports:
+
+- the RAM used by the TCB array and the flash used by the task constants
+- the kernel initialization time (BRTOS_Initialize()), the task creation
+  time, the scheduler start and the time from main() to the first task
+  (the calibration done by BRTOS_Application_Initialize() is excluded)
+
+Times are taken once, at program start, so they include cold caches. Host
+stacks are BRTOS_PORT_STACK_SIZE bytes painted at initialization in both
+builds, which is most of the boot time here. On the MSP430 the static
+stacks and TCBs are copied from flash by the C startup instead.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#ifndef BRTOS_STATIC_TASKS
+#include "boot_tasks.h"
+#define BENCH_TASK_PROTO(entry, stack, slice, pri) void entry(unsigned long);
+BRTOS_TASKS(BENCH_TASK_PROTO)
+
+unsigned short usStack[BRTOS_MAX_TASKS][32];
+#endif
+
+/* task set size (BRTOS_MAX_TASKS may leave room for more tasks) */
+#define BENCH_TASK_COUNT(entry, stack, slice, pri) + 1
+#define BENCH_TASKS (0 BRTOS_TASKS(BENCH_TASK_COUNT))
+
+static unsigned long long ullMain;
+static unsigned long long ullInit;
+static unsigned long long ullCreate;
+static unsigned long long ullStart;
+static volatile int iWorkersRun;
+
+/* main() is the kernel one: the program start is taken just before it */
+static __attribute__((constructor)) void BENCH_Start(void)
+{
+	ullMain = BRTOS_PortCycles();
+}
+
+static void BENCH_Print(const char *pcName, unsigned long long ullCycles)
+{
+	printf("%-32s %10llu cycles %10.2f us\n", pcName, ullCycles, ullCycles/dBenchCyclesPerUs);
+}
+
+void boot_control(unsigned long ulArg)
+{
+	ullStart = BRTOS_PortCycles() - ullStart;
+
+	(void) ulArg;
+
+	while(iWorkersRun < BENCH_TASKS - 1)
+		BRTOS_Sleep(10);
+
+	DisableInterrupts();
+
+	printf("boot (%s, %d tasks)\n", 
+#ifdef BRTOS_STATIC_TASKS
+	       "static task table",
+#else
+	       "tasks created at run time",
+#endif
+	       BENCH_TASKS);
+	printf("TCB array: %d x %u = %u bytes RAM\n", BRTOS_MAX_TASKS, 
+	       (unsigned) sizeof(BRTOS_TCB), (unsigned)(BRTOS_MAX_TASKS*sizeof(BRTOS_TCB)));
+#ifdef BRTOS_STATIC_TASKS
+	printf("task constants: %d x %u = %u bytes flash\n", BRTOS_MAX_TASKS, 
+	       (unsigned) sizeof(BRTOS_TASK_CONST), (unsigned)(BRTOS_MAX_TASKS*sizeof(BRTOS_TASK_CONST)));
+#endif
+	BENCH_Print("kernel initialization", ullInit);
+	BENCH_Print("task creation", ullCreate);
+	BENCH_Print("scheduler start to first task", ullStart);
+	BENCH_Print("main to first task", ullInit + ullCreate + ullStart);
+
+	BENCH_Exit();
+}
+
+static void BENCH_Worker(void)
+{
+	iWorkersRun++;
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+#define BENCH_WORKER(n) void boot_worker_##n(unsigned long ulArg) { (void) ulArg; BENCH_Worker(); }
+BENCH_WORKER(1) BENCH_WORKER(2) BENCH_WORKER(3) BENCH_WORKER(4)
+BENCH_WORKER(5) BENCH_WORKER(6) BENCH_WORKER(7)
+
+void BRTOS_Application_Initialize(void)
+{
+	ullInit = BRTOS_PortCycles() - ullMain;
+
+	BENCH_Calibrate();
+
+	ullCreate = BRTOS_PortCycles();
+#ifndef BRTOS_STATIC_TASKS
+	{
+		int i = 0;
+#define BENCH_CREATE(entry, stack, slice, pri) \
+		BRTOS_CreateTask(entry, usStack[i], sizeof(usStack[i]), slice, pri); i++;
+		BRTOS_TASKS(BENCH_CREATE)
+	}
+#endif
+	ullStart  = BRTOS_PortCycles();
+	ullCreate = ullStart - ullCreate;
+}
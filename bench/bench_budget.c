@@ -0,0 +1,133 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_budget.c
+
+CPU budget benchmark (POSIX port in virtual time, see BRTOS_PORT_SIM), built
+without (bench_budget_0) and with (bench_budget_1) a budget for the best effort
+task. Work is simulated with BRTOS_PortSimRun(), so results are exact. A control loop with a 
+5 ms period and 1 ms of work runs below a logger task, which has the higher
+priority for low latency. The logger works 1 ms every 10 ms and, every 100 ms,
+compresses a block for 15 ms: 24% of the CPU on average, but a burst long 
+enough to make the control loop miss its deadlines.
+
+With a budget of 3 ms every 10 ms, the logger is throttled during its bursts:
+the control loop is delayed by 3 ms at most and keeps its deadlines, while 
+the logger still does all of its work, spread over a few more periods.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_RUN_MS       2000
+#define BENCH_LOOP_PERIOD  5
+#define BENCH_LOOP_WORK    1000
+#define BENCH_LOG_PERIOD   10
+#define BENCH_LOG_WORK     1000
+#define BENCH_LOG_BURST    15000
+#define BENCH_LOG_BURSTS   10
+
+static unsigned long ulLoopJobs;
+static unsigned long ulLogWork;
+static BRTOS_TICKS ulBurstWorst;
+#if BENCH_BUDGET
+static BRTOS_BUDGET sLogBudget;
+#endif
+
+unsigned short usStack[3][32];
+
+static void task_loop(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_PortSimRun(BENCH_LOOP_WORK);
+		ulLoopJobs++;
+		BRTOS_TaskWaitPeriod();
+	}
+}
+
+static void task_logger(unsigned long ulArg)
+{
+	BRTOS_TICKS ulLastWake = BRTOS_GetTicks();
+	BRTOS_TICKS ulStart;
+	unsigned long i;
+
+	(void) ulArg;
+
+	for(i = 1 ; ; i++)
+	{
+		if(i % BENCH_LOG_BURSTS == 0)
+		{
+			ulStart = BRTOS_GetTicks();
+			BRTOS_PortSimRun(BENCH_LOG_BURST);
+			if(BRTOS_GetTicks() - ulStart > ulBurstWorst)
+				ulBurstWorst = BRTOS_GetTicks() - ulStart;
+			ulLogWork += BENCH_LOG_BURST;
+		}
+		else
+		{
+			BRTOS_PortSimRun(BENCH_LOG_WORK);
+			ulLogWork += BENCH_LOG_WORK;
+		}
+		BRTOS_SleepUntil(&ulLastWake, BENCH_LOG_PERIOD);
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned short usMisses, usOverruns;
+#if BENCH_BUDGET
+	unsigned short usThrottles;
+	unsigned long ulUsed;
+#endif
+
+	(void) ulArg;
+
+	BRTOS_Sleep(BENCH_RUN_MS);
+	DisableInterrupts();
+
+	BRTOS_TaskPeriodStats(2, &usMisses, &usOverruns);
+
+#if BENCH_BUDGET
+	BRTOS_BudgetStats(&sLogBudget, &usThrottles, &ulUsed);
+	printf("logger with a budget of 3 ms every %d ms (%u throttles, %lu ticks used)\n",
+	       BENCH_LOG_PERIOD, usThrottles, ulUsed);
+#else
+	printf("logger without budget\n");
+#endif
+	printf("control loop: %4lu jobs, %3u deadline misses, %3u overruns\n", ulLoopJobs, usMisses, usOverruns);
+	printf("logger      : %4lu ms of work done, longest %d ms burst took %.1f ms\n",
+	       ulLogWork/1000, BENCH_LOG_BURST/1000, ulBurstWorst*1000.0/BRTOS_PORT_TICKS_PER_SECOND);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_logger, usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreatePeriodicTask(task_loop, usStack[2], sizeof(usStack[2]), 10, BENCH_LOOP_PERIOD, 0,
+	                         BRTOS_TASK_PRIORITY_3);
+
+#if BENCH_BUDGET
+	BRTOS_BudgetCreate(&sLogBudget, 3, BENCH_LOG_PERIOD);
+	BRTOS_TaskSetBudget(1, &sLogBudget);
+#endif
+}
@@ -0,0 +1,363 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_fleet.c
+
+Fleet simulation: many kernel instances (BRTOS_INSTANCES) in one process, 
+in virtual time (POSIX port with BRTOS_PORT_SIM and tickless idle), stepped 
+in parallel by a pool of worker threads.
+
+Each instance is a sensor node running the same application with its own
+data (BRTOS_InstanceData()) and seed:
+
+- a sampling task, periodic (BRTOS_SleepUntil(), 100 ms), simulating the 
+  conversion work and notifying the radio task every 10 samples
+- a radio task sending the samples (random air time, retries)
+- a device interrupt (5 s on average) giving a semaphore to an event task
+
+Instances and their stacks are allocated in separate page aligned blocks,
+so threads do not share cache lines. The work is a step of one instance
+(BENCH_FLEET_SLICE seconds of device time). Each worker keeps a queue of 
+instances: it takes work from its end (the instance just stepped, still in 
+its cache) and, when empty, steals from the other end of the queues of other
+workers. Instances move between threads only between steps.
+
+The fleet is run with 1, 2, 4 ... threads up to the amount of processors
+(or BENCH_FLEET_THREADS), reporting simulated device seconds per wall clock
+second. The run is deterministic: the hash of all nodes must be the same for
+any amount of threads, or the benchmark fails (exit status 1).
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../brtos.h"
+#include "../port_posix.h"
+
+#define BENCH_FLEET_NODES     1000
+#define BENCH_FLEET_SECONDS   3600
+#define BENCH_FLEET_SLICE     10
+#define BENCH_FLEET_MAX_THREADS 256
+#define BENCH_NSEC_PER_SEC    1000000000ULL
+
+/** Application data of each node */
+typedef struct {
+	unsigned long long ullHash;
+	unsigned long      ulSamples;
+	unsigned long      ulPackets;
+	unsigned long      ulRetries;
+	unsigned long      ulEvents;
+	BRTOS_SEM          sEventSem;
+	unsigned short     ausStack[3][32];
+} FLEET_NODE;
+
+/** Instance queue of a worker (a lock per queue, padded to a cache line) */
+typedef struct {
+	pthread_mutex_t sLock;
+	int            *piItems;
+	int             iHead;
+	int             iTail;
+} __attribute__((aligned(64))) FLEET_QUEUE;
+
+static BRTOS_INSTANCE *apsInstances[BENCH_FLEET_NODES];
+static FLEET_NODE     *apsNodes[BENCH_FLEET_NODES];
+static FLEET_QUEUE     asQueues[BENCH_FLEET_MAX_THREADS];
+static int             iThreads;
+static int             iRemaining;
+
+static void Hash(FLEET_NODE *psNode, unsigned long ulValue)
+{
+	int i;
+
+	for(i = 0 ; i < 4 ; i++)
+	{
+		psNode->ullHash ^= (ulValue >> (8*i)) & 0xFF;
+		psNode->ullHash *= 1099511628211ULL;
+	}
+}
+
+static void DeviceIsr(void)
+{
+	FLEET_NODE *psNode = BRTOS_InstanceData();
+
+	BRTOS_ISR_Enter();
+	BRTOS_SemGiveFromISR(&psNode->sEventSem);
+	BRTOS_ISR_Exit();
+}
+
+static void task_sample(unsigned long ulArg)
+{
+	FLEET_NODE *psNode     = BRTOS_InstanceData();
+	BRTOS_TICKS ulLastWake = BRTOS_GetTicks();
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_SleepUntil(&ulLastWake, 100);
+		BRTOS_PortSimRun(200 + BRTOS_PortSimRandom() % 100);
+		if(++psNode->ulSamples % 10 == 0)
+			BRTOS_TaskNotify(1, 1, BRTOS_NOTIFY_INCREMENT);
+	}
+}
+
+static void task_radio(unsigned long ulArg)
+{
+	FLEET_NODE   *psNode = BRTOS_InstanceData();
+	unsigned long ulRandom;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER);
+
+		/* air time, a retry after a random back off for one packet in 8 */
+		ulRandom = BRTOS_PortSimRandom();
+		BRTOS_PortSimRun(1000 + ulRandom % 4000);
+		if((ulRandom >> 16) % 8 == 0)
+		{
+			psNode->ulRetries++;
+			BRTOS_Sleep(1 + (ulRandom >> 20) % 50);
+			BRTOS_PortSimRun(1000 + ulRandom % 4000);
+		}
+
+		psNode->ulPackets++;
+		Hash(psNode, BRTOS_GetTicks());
+		Hash(psNode, psNode->ulSamples);
+	}
+}
+
+static void task_event(unsigned long ulArg)
+{
+	FLEET_NODE *psNode = BRTOS_InstanceData();
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_SemTake(&psNode->sEventSem, BRTOS_WAIT_FOREVER);
+		psNode->ulEvents++;
+		Hash(psNode, BRTOS_GetTicks());
+		BRTOS_PortSimRun(50);
+	}
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	FLEET_NODE *psNode = BRTOS_InstanceData();
+
+	BRTOS_SemCreate(&psNode->sEventSem, 0, 0xFFFF);
+	BRTOS_PortDeviceStart(DeviceIsr, 5000000);
+
+	BRTOS_CreateTask(task_sample, psNode->ausStack[0], sizeof(psNode->ausStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_radio,  psNode->ausStack[1], sizeof(psNode->ausStack[1]), 10, BRTOS_TASK_PRIORITY_3);
+	BRTOS_CreateTask(task_event,  psNode->ausStack[2], sizeof(psNode->ausStack[2]), 10, BRTOS_TASK_PRIORITY_2);
+}
+
+/*
+Next instance to step: the last one queued by this worker or, when its 
+queue is empty, the oldest one of another worker (-1: no work left).
+*/
+static int Take(int iWorker)
+{
+	FLEET_QUEUE *psQueue;
+	int          iNode = -1;
+	int          i;
+
+	psQueue = &asQueues[iWorker];
+	pthread_mutex_lock(&psQueue->sLock);
+	if(psQueue->iHead != psQueue->iTail)
+		iNode = psQueue->piItems[--psQueue->iTail];
+	pthread_mutex_unlock(&psQueue->sLock);
+
+	for(i = 1 ; iNode < 0 && i < iThreads ; i++)
+	{
+		psQueue = &asQueues[(iWorker + i) % iThreads];
+		pthread_mutex_lock(&psQueue->sLock);
+		if(psQueue->iHead != psQueue->iTail)
+			iNode = psQueue->piItems[psQueue->iHead++];
+		pthread_mutex_unlock(&psQueue->sLock);
+	}
+
+	return iNode;
+}
+
+static void Give(int iWorker, int iNode)
+{
+	FLEET_QUEUE *psQueue = &asQueues[iWorker];
+
+	pthread_mutex_lock(&psQueue->sLock);
+	/* stolen items leave room at the head */
+	if(psQueue->iTail == BENCH_FLEET_NODES)
+	{
+		memmove(psQueue->piItems, psQueue->piItems + psQueue->iHead, 
+		        (psQueue->iTail - psQueue->iHead)*sizeof(int));
+		psQueue->iTail -= psQueue->iHead;
+		psQueue->iHead  = 0;
+	}
+	psQueue->piItems[psQueue->iTail++] = iNode;
+	pthread_mutex_unlock(&psQueue->sLock);
+}
+
+static void *Worker(void *pvArg)
+{
+	int                iWorker = (int)(long) pvArg;
+	int                iNode;
+	unsigned long long ullEnd;
+
+	while(__atomic_load_n(&iRemaining, __ATOMIC_ACQUIRE) > 0)
+	{
+		iNode = Take(iWorker);
+		if(iNode < 0)
+		{
+			sched_yield();
+			continue;
+		}
+
+		ullEnd = apsInstances[iNode]->sPort.ullSimTime + BENCH_FLEET_SLICE*BENCH_NSEC_PER_SEC;
+		BRTOS_PortInstanceStep(apsInstances[iNode], ullEnd);
+
+		if(ullEnd < BENCH_FLEET_SECONDS*BENCH_NSEC_PER_SEC)
+			Give(iWorker, iNode);
+		else
+			__atomic_sub_fetch(&iRemaining, 1, __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+
+/*
+Run the whole fleet with iCount threads.
+
+@return hash of all nodes
+*/
+static unsigned long long RunFleet(int iCount, double *pdSeconds)
+{
+	pthread_t          asThreads[BENCH_FLEET_MAX_THREADS];
+	struct timespec    sBeg, sEnd;
+	unsigned long long ullHash = 1469598103934665603ULL;
+	int                i;
+
+	for(i = 0 ; i < BENCH_FLEET_NODES ; i++)
+	{
+		memset(apsNodes[i], 0, sizeof(FLEET_NODE));
+		apsNodes[i]->ullHash = 1469598103934665603ULL;
+		BRTOS_PortInstanceInit(apsInstances[i], apsNodes[i], i + 1);
+	}
+
+	iThreads   = iCount;
+	iRemaining = BENCH_FLEET_NODES;
+	for(i = 0 ; i < iCount ; i++)
+		asQueues[i].iHead = asQueues[i].iTail = 0;
+	for(i = 0 ; i < BENCH_FLEET_NODES ; i++)
+		Give(i % iCount, i);
+
+	clock_gettime(CLOCK_MONOTONIC, &sBeg);
+	for(i = 0 ; i < iCount ; i++)
+		pthread_create(&asThreads[i], 0, Worker, (void *)(long) i);
+	for(i = 0 ; i < iCount ; i++)
+		pthread_join(asThreads[i], 0);
+	clock_gettime(CLOCK_MONOTONIC, &sEnd);
+	*pdSeconds = (sEnd.tv_sec - sBeg.tv_sec) + (sEnd.tv_nsec - sBeg.tv_nsec)/1e9;
+
+	for(i = 0 ; i < BENCH_FLEET_NODES ; i++)
+	{
+		ullHash ^= apsNodes[i]->ullHash;
+		ullHash *= 1099511628211ULL;
+	}
+
+	return ullHash;
+}
+
+int main(void)
+{
+	unsigned long long ullHash, ullFirst = 0;
+	unsigned long      ulSamples = 0, ulPackets = 0, ulEvents = 0;
+	double             dSeconds, dSingle = 0;
+	int                iMax, iCount, i, iFail = 0;
+
+	iMax = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if(getenv("BENCH_FLEET_THREADS"))
+		iMax = atoi(getenv("BENCH_FLEET_THREADS"));
+	if(iMax < 1)
+		iMax = 1;
+	if(iMax > BENCH_FLEET_MAX_THREADS)
+		iMax = BENCH_FLEET_MAX_THREADS;
+
+	for(i = 0 ; i < BENCH_FLEET_NODES ; i++)
+	{
+		apsInstances[i] = aligned_alloc(4096, (sizeof(BRTOS_INSTANCE) + 4095) & ~4095UL);
+		apsNodes[i]     = aligned_alloc(64, (sizeof(FLEET_NODE) + 63) & ~63UL);
+		if(!apsInstances[i] || !apsNodes[i])
+		{
+			printf("FAIL: out of memory\n");
+			return 1;
+		}
+	}
+	for(i = 0 ; i < iMax ; i++)
+	{
+		pthread_mutex_init(&asQueues[i].sLock, 0);
+		asQueues[i].piItems = malloc(BENCH_FLEET_NODES*sizeof(int));
+	}
+
+	printf("%d nodes, %d s of device time each (%lu bytes of kernel, port and stacks per node)\n",
+	       BENCH_FLEET_NODES, BENCH_FLEET_SECONDS, (unsigned long) sizeof(BRTOS_INSTANCE));
+
+	for(iCount = 1 ; ; iCount = iCount*2 < iMax && iCount < iMax ? iCount*2 : iMax)
+	{
+		ullHash = RunFleet(iCount, &dSeconds);
+		if(iCount == 1)
+		{
+			ullFirst = ullHash;
+			dSingle  = dSeconds;
+		}
+
+		printf("%3d threads: %.2f s, %.0f device seconds per second, speed up %.2f, hash %016llx\n",
+		       iCount, dSeconds, BENCH_FLEET_NODES*(double) BENCH_FLEET_SECONDS/dSeconds,
+		       dSingle/dSeconds, ullHash);
+
+		if(ullHash != ullFirst)
+		{
+			printf("FAIL: the run depends on the amount of threads\n");
+			iFail = 1;
+		}
+		if(iCount == iMax)
+			break;
+	}
+
+	for(i = 0 ; i < BENCH_FLEET_NODES ; i++)
+	{
+		ulSamples += apsNodes[i]->ulSamples;
+		ulPackets += apsNodes[i]->ulPackets;
+		ulEvents  += apsNodes[i]->ulEvents;
+	}
+	printf("fleet: %lu samples, %lu packets, %lu device events\n", ulSamples, ulPackets, ulEvents);
+
+	/* the last release of each node is at the end of the run */
+	if(ulSamples + BENCH_FLEET_NODES < BENCH_FLEET_NODES*(BENCH_FLEET_SECONDS*10UL) || 
+	   ulPackets + BENCH_FLEET_NODES < ulSamples/10)
+	{
+		printf("FAIL: samples or packets missing\n");
+		iFail = 1;
+	}
+
+	return iFail;
+}
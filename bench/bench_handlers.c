@@ -0,0 +1,155 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_handlers.c
+
+Lightweight handler benchmark (POSIX port): the same ring of event handlers
+written as tasks (each with its TCB and stack, woken by notifications) and
+as jobs (BRTOS_JobPost(), run to completion on the deferred work task stack).
+Each handler passes the event to the next one. It reports:
+
+- hand off cost between handlers: a cooperative task switch against a job
+  function call (no context saved)
+- memory per handler: TCB plus stack against a job control block (host
+  sizes; on MSP430 a task also needs at least BRTOS_PORT_STACK_FRAME bytes
+  of stack plus its locals)
+- a protothread job sleeping with BRTOS_PT_SLEEP() between steps
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_HANDLERS     16
+#define BENCH_HOPS         200000
+#define BENCH_PT_STEPS     20
+
+/* task indexes: control task, deferred work task, then the handler tasks */
+#define BENCH_FIRST_HANDLER 2
+
+static BRTOS_JOB asJobs[BENCH_HANDLERS];
+static BRTOS_JOB sPtJob;
+static unsigned char ucControl;
+static volatile unsigned long ulHops;
+static unsigned long ulPtSteps;
+static unsigned long long aullPtStep[BENCH_PT_STEPS];
+static unsigned long long ullPtLast;
+
+static BENCH_SAMPLES sPtStep = BENCH_SAMPLES_INIT("protothread 1 ms sleep", aullPtStep);
+
+unsigned short usStack[2 + BENCH_HANDLERS][32];
+
+static void task_handler(unsigned long ulArg)
+{
+	unsigned char ucNext;
+
+	(void) ulArg;
+
+	ucNext = BRTOS_GetCurrentTask() + 1;
+	if(ucNext == BENCH_FIRST_HANDLER + BENCH_HANDLERS)
+		ucNext = BENCH_FIRST_HANDLER;
+
+	for(;;)
+	{
+		BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER);
+		if(++ulHops < BENCH_HOPS)
+			BRTOS_TaskNotify(ucNext, 0, BRTOS_NOTIFY_INCREMENT);
+		else
+			BRTOS_TaskNotify(ucControl, 0, BRTOS_NOTIFY_INCREMENT);
+	}
+}
+
+static void job_handler(BRTOS_JOB *psJob, unsigned short usEvents)
+{
+	(void) usEvents;
+
+	if(++ulHops < BENCH_HOPS)
+		BRTOS_JobPost(&asJobs[(psJob->ulArg + 1) % BENCH_HANDLERS], 1);
+	else
+		BRTOS_TaskNotify(ucControl, 0, BRTOS_NOTIFY_INCREMENT);
+}
+
+static void job_pt(BRTOS_JOB *psJob, unsigned short usEvents)
+{
+	BRTOS_PT_BEGIN(psJob);
+
+	ullPtLast = BRTOS_PortCycles();
+	while(ulPtSteps < BENCH_PT_STEPS)
+	{
+		BRTOS_PT_SLEEP(psJob, usEvents, 1);
+		BENCH_Add(&sPtStep, BRTOS_PortCycles() - ullPtLast);
+		ullPtLast = BRTOS_PortCycles();
+		ulPtSteps++;
+	}
+	BRTOS_TaskNotify(ucControl, 0, BRTOS_NOTIFY_INCREMENT);
+
+	BRTOS_PT_END(psJob);
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned long long ullBeg, ullTasks, ullJobs;
+	int i;
+
+	(void) ulArg;
+
+	ucControl = BRTOS_GetCurrentTask();
+
+	/* handler tasks */
+	ulHops = 0;
+	ullBeg = BRTOS_PortCycles();
+	BRTOS_TaskNotify(BENCH_FIRST_HANDLER, 0, BRTOS_NOTIFY_INCREMENT);
+	BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER);
+	ullTasks = BRTOS_PortCycles() - ullBeg;
+
+	/* handler jobs */
+	for(i = 0 ; i < BENCH_HANDLERS ; i++)
+		BRTOS_JobCreate(&asJobs[i], job_handler, i);
+	ulHops = 0;
+	ullBeg = BRTOS_PortCycles();
+	BRTOS_JobPost(&asJobs[0], 1);
+	BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER);
+	ullJobs = BRTOS_PortCycles() - ullBeg;
+
+	/* protothread */
+	BRTOS_JobCreate(&sPtJob, job_pt, 0);
+	BRTOS_JobPost(&sPtJob, 0);
+	BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER);
+
+	DisableInterrupts();
+
+	printf("%d handlers passing an event %d times\n", BENCH_HANDLERS, BENCH_HOPS);
+	printf("tasks: %7.1f cycles per hand off, %u bytes per handler (TCB) plus its stack\n",
+	       (double) ullTasks/BENCH_HOPS, (unsigned) sizeof(BRTOS_TCB));
+	printf("jobs : %7.1f cycles per hand off, %u bytes per handler (job), one shared stack\n",
+	       (double) ullJobs/BENCH_HOPS, (unsigned) sizeof(BRTOS_JOB));
+	printf("deferred work task stack used: %u bytes\n", BRTOS_TaskStackHighWater(1));
+	BENCH_Report(&sPtStep, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_3);
+	BRTOS_DeferInit(usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_1);
+	for(i = 0 ; i < BENCH_HANDLERS ; i++)
+		BRTOS_CreateTask(task_handler, usStack[BENCH_FIRST_HANDLER + i], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_2);
+}
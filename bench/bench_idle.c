@@ -0,0 +1,181 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_idle.c
+
+Idle governor benchmark (POSIX port in virtual time, see BRTOS_PORT_SIM, with
+tickless idle). Energy comes from the model of the MSP430 currents of the port
+(BRTOS_PortSimEnergy()). Built with idle always in LPM0 (bench_idle_0), always
+in LPM3 (bench_idle_1) and with the idle governor (bench_idle_2).
+
+A sensor node repeats three phases:
+
+- sensing: 1 ms of work every 10 ms, during 1 s
+- transfer: a report goes out by the UART, clocked by SMCLK, during 200 ms:
+  100 us of work every 1 ms, the UART must keep its clock (LPM0 at most, the
+  task constrains the governor)
+- dormant: the task waits for a button without timeout (device interrupt,
+  1 to 3 s later). Nothing is timed, so the governor takes LPM4
+
+Always LPM0 is the only safe choice without governor and wastes energy in
+the other phases. Always LPM3 stops the UART clock during the transfer 
+(reported as UART time without clock) and still spends energy while dormant.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_CYCLES          3
+#define BENCH_SENSE_MS        1000
+#define BENCH_SENSE_PERIOD    10
+#define BENCH_SENSE_WORK      1000
+#define BENCH_SEND_MS         200
+#define BENCH_SEND_PERIOD     1
+#define BENCH_SEND_WORK       100
+#define BENCH_BUTTON_US       2000000
+
+#define BENCH_PHASES          3
+
+static const char *apcPhase[BENCH_PHASES] = { "sensing", "transfer", "dormant" };
+static const char *apcMode[BRTOS_PORT_IDLE_MODES] = { "LPM0", "LPM3", "LPM4" };
+
+/** Virtual time (ns), energy (uJ) and time in each mode (ns) of each phase */
+static unsigned long long aullPhaseTime[BENCH_PHASES];
+static double adPhaseEnergy[BENCH_PHASES];
+static unsigned long long aullPhaseIdle[BENCH_PHASES][BRTOS_PORT_IDLE_MODES];
+
+static unsigned long long aullStartIdle[BRTOS_PORT_IDLE_MODES];
+static unsigned long long ullStartTime;
+static double dStartEnergy;
+
+static BRTOS_SEM sButton;
+
+unsigned short usStack[1][32];
+
+static void ButtonIsr(void)
+{
+	BRTOS_ISR_Enter();
+	BRTOS_SemGiveFromISR(&sButton);
+	BRTOS_ISR_Exit();
+}
+
+static void PhaseBegin(void)
+{
+	int i;
+
+	DisableInterrupts();
+	ullStartTime = ullPortSimTime;
+	dStartEnergy = BRTOS_PortSimEnergy();
+	for(i = 0 ; i < BRTOS_PORT_IDLE_MODES ; i++)
+		aullStartIdle[i] = aullPortSimIdle[i];
+	EnableInterrupts();
+}
+
+static void PhaseEnd(int iPhase)
+{
+	int i;
+
+	DisableInterrupts();
+	aullPhaseTime[iPhase] += ullPortSimTime - ullStartTime;
+	adPhaseEnergy[iPhase] += BRTOS_PortSimEnergy() - dStartEnergy;
+	for(i = 0 ; i < BRTOS_PORT_IDLE_MODES ; i++)
+		aullPhaseIdle[iPhase][i] += aullPortSimIdle[i] - aullStartIdle[i];
+	EnableInterrupts();
+}
+
+static void task_node(unsigned long ulArg)
+{
+	BRTOS_TICKS ulLastWake;
+	BRTOS_TICKS ulEnd;
+	double dTotal = 0;
+	unsigned long long ullTotal = 0;
+	int iCycle, iPhase, i;
+#if BRTOS_IDLE_GOVERNOR
+	unsigned long ulEntries, ulTime;
+#endif
+
+	(void) ulArg;
+
+	for(iCycle = 0 ; iCycle < BENCH_CYCLES ; iCycle++)
+	{
+		PhaseBegin();
+		ulLastWake = BRTOS_GetTicks();
+		ulEnd = ulLastWake + BENCH_SENSE_MS*BRTOS_PORT_TICKS_PER_SECOND/1000;
+		while(BRTOS_TICKS_BEFORE(BRTOS_GetTicks(), ulEnd))
+		{
+			BRTOS_PortSimRun(BENCH_SENSE_WORK);
+			BRTOS_SleepUntil(&ulLastWake, BENCH_SENSE_PERIOD);
+		}
+		PhaseEnd(0);
+
+		PhaseBegin();
+#if BRTOS_IDLE_GOVERNOR
+		BRTOS_IdleConstrain(BRTOS_PORT_IDLE_LPM0);
+#endif
+		ulLastWake = BRTOS_GetTicks();
+		ulEnd = ulLastWake + BENCH_SEND_MS*BRTOS_PORT_TICKS_PER_SECOND/1000;
+		while(BRTOS_TICKS_BEFORE(BRTOS_GetTicks(), ulEnd))
+		{
+			BRTOS_PortSimRun(BENCH_SEND_WORK);
+			BRTOS_SleepUntil(&ulLastWake, BENCH_SEND_PERIOD);
+		}
+#if BRTOS_IDLE_GOVERNOR
+		BRTOS_IdleRelease(BRTOS_PORT_IDLE_LPM0);
+#endif
+		PhaseEnd(1);
+
+		PhaseBegin();
+		BRTOS_PortDeviceStart(ButtonIsr, BENCH_BUTTON_US);
+		BRTOS_SemTake(&sButton, BRTOS_WAIT_FOREVER);
+		BRTOS_PortDeviceStop();
+		PhaseEnd(2);
+	}
+
+	DisableInterrupts();
+
+#if BRTOS_IDLE_GOVERNOR
+	printf("idle governor:");
+	for(i = 0 ; i < BRTOS_PORT_IDLE_MODES ; i++)
+	{
+		BRTOS_IdleStats(i, &ulEntries, &ulTime);
+		printf(" %s %lu sleeps %.1f ms%s", apcMode[i], ulEntries, ulTime/1e6, i < BRTOS_PORT_IDLE_MODES - 1 ? "," : "\n");
+	}
+#else
+	printf("idle always in %s:\n", apcMode[BRTOS_PORT_IDLE_DEFAULT]);
+#endif
+
+	for(iPhase = 0 ; iPhase < BENCH_PHASES ; iPhase++)
+	{
+		printf("  %-8s %7.1f ms %9.1f uJ %8.2f uW  idle", apcPhase[iPhase], aullPhaseTime[iPhase]/1e6,
+		       adPhaseEnergy[iPhase], adPhaseEnergy[iPhase]*1e9/aullPhaseTime[iPhase]);
+		for(i = 0 ; i < BRTOS_PORT_IDLE_MODES ; i++)
+			printf(" %s %5.1f%%", apcMode[i], aullPhaseIdle[iPhase][i]*100.0/aullPhaseTime[iPhase]);
+		printf("\n");
+		dTotal   += adPhaseEnergy[iPhase];
+		ullTotal += aullPhaseTime[iPhase];
+	}
+	printf("  total    %7.1f ms %9.1f uJ %8.2f uW, UART without clock %.1f ms\n", ullTotal/1e6, dTotal,
+	       dTotal*1e9/ullTotal, (aullPhaseIdle[1][BRTOS_PORT_IDLE_LPM3] + aullPhaseIdle[1][BRTOS_PORT_IDLE_LPM4])/1e6);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BRTOS_SemCreate(&sButton, 0, 1);
+	BRTOS_CreateTask(task_node, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+}
@@ -0,0 +1,170 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_isr.c
+
+Interrupt to task latency benchmark (POSIX port). A simulated ADC interrupt
+at 10 kHz (\ref BRTOS_PortDeviceStart()) hands each sample to a task. The 
+latency from the interrupt routine to the code using the sample is reported
+for:
+
+- BRTOS_ISR_Enter()/BRTOS_ISR_Exit() and a notification, while a low priority
+  task keeps the CPU busy (preemption) and while the CPU is idle (wake up)
+- a notification from a routine without BRTOS_ISR_Exit(): the task waits for
+  the next tick, as before
+- deferred work (\ref BRTOS_Defer()): the sample is processed by the
+  deferred work task
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_PHASE_MS     1000
+#define BENCH_NUM_SAMPLES  20000
+#define BENCH_PHASES       4
+#define BENCH_ADC_US       100
+#define BENCH_STAMPS       256
+
+static unsigned long long aaullLatency[BENCH_PHASES][BENCH_NUM_SAMPLES];
+static unsigned long long aullIsr[BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES asLatency[BENCH_PHASES] = {
+	BENCH_SAMPLES_INIT("ISR_Exit, CPU busy", aaullLatency[0]),
+	BENCH_SAMPLES_INIT("ISR_Exit, CPU idle", aaullLatency[1]),
+	BENCH_SAMPLES_INIT("no ISR_Exit (next tick)", aaullLatency[2]),
+	BENCH_SAMPLES_INIT("deferred work", aaullLatency[3]),
+};
+static BENCH_SAMPLES sIsr = BENCH_SAMPLES_INIT("ISR duration (Enter to Exit)", aullIsr);
+
+/* interrupt time of each sample (deferred work) and of the oldest sample not seen by the task */
+static unsigned long long aullStamp[BENCH_STAMPS];
+static unsigned long long ullOldest;
+static unsigned short     usSeq;
+static unsigned char      ucSampleTask;
+static volatile int       iPhase = -1;
+
+unsigned short usStack[4][32];
+
+static void Latency(unsigned long long ullStamp)
+{
+	unsigned long long ullNow = BRTOS_PortCycles();
+
+	if(iPhase >= 0 && iPhase < BENCH_PHASES && ullStamp)
+		BENCH_Add(&asLatency[iPhase], ullNow - ullStamp);
+}
+
+static void DeferredSample(unsigned long ulSample)
+{
+	Latency(aullStamp[ulSample % BENCH_STAMPS]);
+}
+
+static void AdcIsr(void)
+{
+	unsigned long long ullBeg;
+	int iNow = iPhase;
+
+	aullStamp[usSeq % BENCH_STAMPS] = BRTOS_PortCycles();
+	if(ullOldest == 0)
+		ullOldest = aullStamp[usSeq % BENCH_STAMPS];
+
+	if(iNow == 2)
+		BRTOS_TaskNotifyFromISR(ucSampleTask, usSeq, BRTOS_NOTIFY_OVERWRITE);
+	else if(iNow >= 0)
+	{
+		ullBeg = BRTOS_PortCycles();
+		BRTOS_ISR_Enter();
+		if(iNow == 3)
+			BRTOS_Defer(DeferredSample, usSeq);
+		else
+			BRTOS_TaskNotify(ucSampleTask, usSeq, BRTOS_NOTIFY_OVERWRITE);
+		BRTOS_ISR_Exit();
+		BENCH_Add(&sIsr, BRTOS_PortCycles() - ullBeg);
+	}
+
+	usSeq++;
+}
+
+static void task_sample(unsigned long ulArg)
+{
+	unsigned long long ullStamp;
+
+	(void) ulArg;
+
+	ucSampleTask = BRTOS_GetCurrentTask();
+
+	for(;;)
+	{
+		BRTOS_TaskNotifyWait(0, 0, BRTOS_WAIT_FOREVER);
+
+		DisableInterrupts();
+		ullStamp  = ullOldest;
+		ullOldest = 0;
+		EnableInterrupts();
+
+		Latency(ullStamp);
+	}
+}
+
+static void task_busy(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		while(iPhase == 0)
+			;
+		BRTOS_Sleep(1);
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	int i;
+
+	(void) ulArg;
+
+	BRTOS_Sleep(10);
+	BRTOS_PortDeviceStart(AdcIsr, BENCH_ADC_US);
+
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+	{
+		iPhase = i;
+		BRTOS_Sleep(BENCH_PHASE_MS);
+	}
+
+	iPhase = BENCH_PHASES;
+	BRTOS_PortDeviceStop();
+	DisableInterrupts();
+
+	printf("ADC interrupt every %d us, %lu interrupts:\n", BENCH_ADC_US, ulPortDeviceInterrupts);
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+		BENCH_Report(&asLatency[i], 0);
+	BENCH_Report(&sIsr, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_DeferInit(usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_sample,  usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_3);
+	BRTOS_CreateTask(task_busy,    usStack[3], sizeof(usStack[3]), 10, BRTOS_TASK_PRIORITY_8);
+}
@@ -0,0 +1,154 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_jobs.c
+
+Short lived task benchmark (POSIX port): jobs are created with stacks from
+a pool (BRTOS_TaskSpawn()), end by returning from their entry point and are
+joined (BRTOS_TaskJoin()), many more times than there are TCBs and stacks.
+It reports:
+
+- spawn latency: from the spawn call to the job running (higher priority job)
+- exit latency: from the job returning to its creator running again, for a 
+  higher priority job (the creator was preempted) and a lower priority one 
+  (the creator waits in BRTOS_TaskJoin())
+- delete: from deleting a sleeping job to its joiner running
+- TCB and stack usage at the end, which must be back to the idle state
+
+Host stacks are BRTOS_PORT_STACK_SIZE bytes painted at each creation, built
+smaller here so the spawn cost is mostly kernel work.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_ROUNDS       20000
+#define BENCH_STACKS       2
+#define BENCH_STACK_SIZE   64
+
+static unsigned long long aullSpawn[BENCH_ROUNDS];
+static unsigned long long aullExitHigh[BENCH_ROUNDS];
+static unsigned long long aullExitLow[BENCH_ROUNDS];
+static unsigned long long aullDelete[BENCH_ROUNDS];
+
+static BENCH_SAMPLES sSpawn    = BENCH_SAMPLES_INIT("spawn to job start", aullSpawn);
+static BENCH_SAMPLES sExitHigh = BENCH_SAMPLES_INIT("exit to creator (preempted)", aullExitHigh);
+static BENCH_SAMPLES sExitLow  = BENCH_SAMPLES_INIT("exit to creator (joining)", aullExitLow);
+static BENCH_SAMPLES sDelete   = BENCH_SAMPLES_INIT("delete to joiner", aullDelete);
+
+static BRTOS_POOL sStacks;
+static unsigned short ausStacks[BENCH_STACKS][BENCH_STACK_SIZE/2];
+static volatile unsigned long long ullStart;
+static volatile unsigned long long ullEnd;
+static unsigned char ucSleeper;
+static unsigned long ulJoins;
+static unsigned long ulErrors;
+
+unsigned short usStack[1][32];
+
+static void job(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	ullStart = BRTOS_PortCycles();
+	ullEnd   = BRTOS_PortCycles();
+}
+
+static void job_deleter(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	/* the control task is joining the sleeper */
+	ullEnd = BRTOS_PortCycles();
+	if(BRTOS_TaskDelete(ucSleeper) != BRTOS_SUCCESS)
+		ulErrors++;
+}
+
+static void job_sleeper(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+static void Check(int iRet)
+{
+	if(iRet != BRTOS_SUCCESS)
+		ulErrors++;
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned long long ullBeg;
+	unsigned char ucJob;
+	int i;
+
+	(void) ulArg;
+
+	/* higher priority job: it runs and ends inside the spawn call */
+	for(i = 0 ; i < BENCH_ROUNDS ; i++)
+	{
+		ullBeg = BRTOS_PortCycles();
+		Check(BRTOS_TaskSpawn(job, &sStacks, 10, BRTOS_TASK_PRIORITY_1, &ucJob));
+		BENCH_Add(&sExitHigh, BRTOS_PortCycles() - ullEnd);
+		BENCH_Add(&sSpawn, ullStart - ullBeg);
+		Check(BRTOS_TaskJoin(ucJob, BRTOS_WAIT_FOREVER));
+		ulJoins++;
+	}
+
+	/* lower priority job: it runs while the creator is joining */
+	for(i = 0 ; i < BENCH_ROUNDS ; i++)
+	{
+		Check(BRTOS_TaskSpawn(job, &sStacks, 10, BRTOS_TASK_PRIORITY_3, &ucJob));
+		Check(BRTOS_TaskJoin(ucJob, BRTOS_WAIT_FOREVER));
+		BENCH_Add(&sExitLow, BRTOS_PortCycles() - ullEnd);
+		ulJoins++;
+	}
+
+	/* sleeping job deleted by a lower priority one, while joined */
+	for(i = 0 ; i < BENCH_ROUNDS ; i++)
+	{
+		Check(BRTOS_TaskSpawn(job_sleeper, &sStacks, 10, BRTOS_TASK_PRIORITY_1, &ucSleeper));
+		Check(BRTOS_TaskSpawn(job_deleter, &sStacks, 10, BRTOS_TASK_PRIORITY_3, &ucJob));
+		Check(BRTOS_TaskJoin(ucSleeper, BRTOS_WAIT_FOREVER));
+		BENCH_Add(&sDelete, BRTOS_PortCycles() - ullEnd);
+		Check(BRTOS_TaskJoin(ucJob, BRTOS_WAIT_FOREVER));
+		ulJoins++;
+	}
+
+	DisableInterrupts();
+
+	printf("short lived tasks (%d TCBs, %d stacks of %d bytes)\n", 
+	       BRTOS_MAX_TASKS, BENCH_STACKS, BENCH_STACK_SIZE);
+	printf("%lu jobs joined, %lu errors, stacks in use %u (at most %u)\n", 
+	       ulJoins, ulErrors, sStacks.usUsed, sStacks.usMaxUsed);
+	BENCH_Report(&sSpawn, 0);
+	BENCH_Report(&sExitHigh, 0);
+	BENCH_Report(&sExitLow, 0);
+	BENCH_Report(&sDelete, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+
+	BRTOS_PoolCreate(&sStacks, ausStacks, BENCH_STACK_SIZE, BENCH_STACKS);
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_2);
+}
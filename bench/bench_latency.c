@@ -0,0 +1,331 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_latency.c
+
+Latency benchmark (POSIX port, kernel built with BRTOS_LATENCY_STATS). A task 
+with the highest priority wakes up every millisecond (BRTOS_SleepUntil()) while
+1, 8 or 32 other tasks sleep, lock a shared mutex and work, under three loads:
+
+- idle: nothing else
+- cpu: a task with the lowest priority calling kernel services all the time
+- isr: a device interrupt every BENCH_ISR_US giving a semaphore to a task
+
+For each case it reports:
+
+- tick to resume: from the tick interrupt (SIGALRM handler entry) to the
+  return of BRTOS_SleepUntil() in the measured task
+- wake jitter: difference between each wake up interval and the period
+- kernel wake: tick processing to dispatch, for all tasks woken by the tick
+  (BRTOS_LATENCY_WAKE)
+- critical: longest span with interrupts disabled by a kernel critical 
+  section and the brtos.c line where it started (BRTOS_LATENCY_CRITICAL)
+
+followed by the histograms of all cases. The kernel statistics are portable:
+on the board, an application reads them with BRTOS_LatencyStats() (Timer_A 
+units on MSP430).
+
+If BENCH_LATENCY_LIMIT_US is set in the environment, the benchmark fails 
+(exit status 1) when the worst tick to resume latency or the worst critical
+section is longer, so it can be used to catch regressions. Host results
+include the scheduling noise of the host, keep the limit loose.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define BENCH_PHASE_MS     400
+#define BENCH_PERIOD_MS    1
+#define BENCH_ISR_US       50
+#define BENCH_MAX_TASKS    32
+#define BENCH_LOADS        3
+#define BENCH_COUNTS       3
+#define BENCH_PHASES       (BENCH_LOADS*BENCH_COUNTS)
+#define BENCH_NUM_SAMPLES  1024
+#define BENCH_WORK_US      2
+
+static const char *apcLoad[BENCH_LOADS] = { "idle", "cpu", "isr" };
+static const int   aiCount[BENCH_COUNTS] = { 1, 8, BENCH_MAX_TASKS };
+
+static unsigned long long aaullResume[BENCH_PHASES][BENCH_NUM_SAMPLES];
+static unsigned long long aaullJitter[BENCH_PHASES][BENCH_NUM_SAMPLES];
+static unsigned long long aullAll[BENCH_PHASES*BENCH_NUM_SAMPLES];
+static BENCH_SAMPLES asResume[BENCH_PHASES];
+static BENCH_SAMPLES asJitter[BENCH_PHASES];
+static BENCH_SAMPLES sAll = BENCH_SAMPLES_INIT("tick to resume, all cases", aullAll);
+
+static BRTOS_LATENCY asCritical[BENCH_PHASES];
+static BRTOS_LATENCY asWake[BENCH_PHASES];
+
+static volatile int iPhase = -1;
+static volatile int iActive;
+static volatile int iLoad;
+static unsigned char aucWorker[BENCH_MAX_TASKS];
+static BRTOS_MUTEX sShared;
+static BRTOS_SEM sIsrSem;
+static BRTOS_SEM sLoadSem;
+static BRTOS_TIMER sLoadTimer;
+
+unsigned short usStack[BENCH_MAX_TASKS + 4][32];
+
+static void Work(unsigned long ulUs)
+{
+	unsigned long long ullEnd = BRTOS_PortCycles() + (unsigned long long)(ulUs*dBenchCyclesPerUs);
+
+	while(BRTOS_PortCycles() < ullEnd)
+		;
+}
+
+static void DeviceIsr(void)
+{
+	BRTOS_ISR_Enter();
+	BRTOS_SemGiveFromISR(&sIsrSem);
+	BRTOS_ISR_Exit();
+}
+
+static void LoadTimer(unsigned long ulArg)
+{
+	(void) ulArg;
+}
+
+static void task_measure(unsigned long ulArg)
+{
+	BRTOS_TICKS ulLastWake = BRTOS_GetTicks();
+	unsigned long long ullNow, ullLast = 0, ullPeriod;
+	int iSeen = -1, iNow;
+
+	(void) ulArg;
+
+	ullPeriod = (unsigned long long)(BENCH_PERIOD_MS*1000*dBenchCyclesPerUs);
+
+	for(;;)
+	{
+		BRTOS_SleepUntil(&ulLastWake, BENCH_PERIOD_MS);
+		ullNow = BRTOS_PortCycles();
+
+		iNow = iPhase;
+		if(iNow >= 0 && iNow < BENCH_PHASES)
+		{
+			BENCH_Add(&asResume[iNow], ullNow - ullPortTickCycles);
+			BENCH_Add(&sAll, ullNow - ullPortTickCycles);
+			if(iNow == iSeen)
+				BENCH_Add(&asJitter[iNow], ullNow - ullLast > ullPeriod ? ullNow - ullLast - ullPeriod : ullPeriod - (ullNow - ullLast));
+		}
+		iSeen   = iNow;
+		ullLast = ullNow;
+	}
+}
+
+static void task_worker(unsigned long ulArg)
+{
+	int i = BRTOS_GetCurrentTask() - aucWorker[0];
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		if(i >= iActive)
+			BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER);
+
+		BRTOS_Sleep(1 + i % 7);
+		BRTOS_MutexLock(&sShared, BRTOS_WAIT_FOREVER);
+		Work(BENCH_WORK_US);
+		BRTOS_MutexUnlock(&sShared);
+	}
+}
+
+static void task_load(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		while(iLoad != 1)
+			BRTOS_Sleep(1);
+
+		BRTOS_SemGive(&sLoadSem);
+		BRTOS_SemTake(&sLoadSem, BRTOS_NO_WAIT);
+		BRTOS_TimerStart(&sLoadTimer, 100, 0);
+		BRTOS_TimerStop(&sLoadTimer);
+	}
+}
+
+static void task_isr(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+		BRTOS_SemTake(&sIsrSem, BRTOS_WAIT_FOREVER);
+}
+
+static void PrintHistogram(const char *pcName, BRTOS_LATENCY *psStats)
+{
+	unsigned long ulMax = 0;
+	int j, iFirst = BRTOS_LATENCY_BUCKETS, iLast = 0, iBar;
+
+	for(j = 0 ; j < BRTOS_LATENCY_BUCKETS ; j++)
+	{
+		if(psStats->aulHistogram[j] == 0)
+			continue;
+		if(j < iFirst) iFirst = j;
+		if(j > iLast)  iLast  = j;
+		if(psStats->aulHistogram[j] > ulMax)
+			ulMax = psStats->aulHistogram[j];
+	}
+
+	printf("%s, worst %.2f us:\n", pcName, psStats->ulMax/dBenchCyclesPerUs);
+	for(j = iFirst ; j <= iLast ; j++)
+	{
+		iBar = (int)(psStats->aulHistogram[j]*50UL/ulMax);
+		printf("    %10lu+ %8lu |", 1UL << j, psStats->aulHistogram[j]);
+		while(iBar-- > 0)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+static void AddHistogram(BRTOS_LATENCY *psTotal, BRTOS_LATENCY *psStats)
+{
+	int j;
+
+	if(psStats->ulMax > psTotal->ulMax)
+	{
+		psTotal->ulMax   = psStats->ulMax;
+		psTotal->usWhere = psStats->usWhere;
+	}
+	for(j = 0 ; j < BRTOS_LATENCY_BUCKETS ; j++)
+		psTotal->aulHistogram[j] += psStats->aulHistogram[j];
+}
+
+static double Us(BENCH_SAMPLES *psSamples, int iPercent)
+{
+	return (iPercent < 100 ? BENCH_Percentile(psSamples, iPercent) : psSamples->ullWorst)/dBenchCyclesPerUs;
+}
+
+static void task_control(unsigned long ulArg)
+{
+	BRTOS_LATENCY sCritical = { 0 }, sWake = { 0 };
+	const char *pcLimit;
+	double dLimit = 0;
+	int i, iFail = 0;
+
+	(void) ulArg;
+
+	BRTOS_Sleep(10);
+
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+	{
+		int j;
+
+		iLoad   = i / BENCH_COUNTS;
+		iActive = aiCount[i % BENCH_COUNTS];
+		for(j = 0 ; j < iActive ; j++)
+			BRTOS_TaskNotify(aucWorker[j], 0, BRTOS_NOTIFY_INCREMENT);
+		if(iLoad == 2)
+			BRTOS_PortDeviceStart(DeviceIsr, BENCH_ISR_US);
+
+		BRTOS_Sleep(BENCH_PERIOD_MS*10);
+		BRTOS_LatencyStats(BRTOS_LATENCY_CRITICAL, &asCritical[i], 1);
+		BRTOS_LatencyStats(BRTOS_LATENCY_WAKE, &asWake[i], 1);
+
+		iPhase = i;
+		BRTOS_Sleep(BENCH_PHASE_MS);
+		iPhase = -1;
+
+		BRTOS_LatencyStats(BRTOS_LATENCY_CRITICAL, &asCritical[i], 1);
+		BRTOS_LatencyStats(BRTOS_LATENCY_WAKE, &asWake[i], 1);
+		if(iLoad == 2)
+			BRTOS_PortDeviceStop();
+	}
+
+	DisableInterrupts();
+
+	printf("task at highest priority waking up every %d ms, times in us (p50/p99/max)\n", BENCH_PERIOD_MS);
+	printf("load tasks | tick to resume          | wake jitter             | kernel wake | critical (line)\n");
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+	{
+		BENCH_Sort(&asResume[i]);
+		BENCH_Sort(&asJitter[i]);
+		printf("%-4s %5d | %6.2f %7.2f %8.2f | %6.2f %7.2f %8.2f | %11.2f | %8.2f (%u)\n",
+		       apcLoad[i / BENCH_COUNTS], aiCount[i % BENCH_COUNTS],
+		       Us(&asResume[i], 50), Us(&asResume[i], 99), Us(&asResume[i], 100),
+		       Us(&asJitter[i], 50), Us(&asJitter[i], 99), Us(&asJitter[i], 100),
+		       asWake[i].ulMax/dBenchCyclesPerUs, asCritical[i].ulMax/dBenchCyclesPerUs, asCritical[i].usWhere);
+		AddHistogram(&sCritical, &asCritical[i]);
+		AddHistogram(&sWake, &asWake[i]);
+	}
+
+	printf("\nhistograms of all cases (cycles):\n");
+	BENCH_Report(&sAll, 1);
+	PrintHistogram("kernel wake (tick processing to dispatch)", &sWake);
+	PrintHistogram("critical sections", &sCritical);
+
+	pcLimit = getenv("BENCH_LATENCY_LIMIT_US");
+	if(pcLimit)
+		dLimit = atof(pcLimit);
+	if(dLimit > 0)
+	{
+		if(sAll.ullWorst/dBenchCyclesPerUs > dLimit)
+		{
+			printf("FAIL: tick to resume %.2f us above %.2f us\n", sAll.ullWorst/dBenchCyclesPerUs, dLimit);
+			iFail = 1;
+		}
+		if(sCritical.ulMax/dBenchCyclesPerUs > dLimit)
+		{
+			printf("FAIL: critical section at brtos.c:%u %.2f us above %.2f us\n", 
+			       sCritical.usWhere, sCritical.ulMax/dBenchCyclesPerUs, dLimit);
+			iFail = 1;
+		}
+	}
+
+	if(iFail)
+	{
+		fflush(stdout);
+		exit(1);
+	}
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+	{
+		asResume[i] = (BENCH_SAMPLES) BENCH_SAMPLES_INIT("tick to resume", aaullResume[i]);
+		asJitter[i] = (BENCH_SAMPLES) BENCH_SAMPLES_INIT("wake jitter", aaullJitter[i]);
+	}
+
+	BRTOS_MutexCreate(&sShared);
+	BRTOS_SemCreate(&sIsrSem, 0, 0xFFFF);
+	BRTOS_SemCreate(&sLoadSem, 0, 1);
+	BRTOS_TimerCreate(&sLoadTimer, LoadTimer, 0, BRTOS_TASK_PRIORITY_8);
+
+	BRTOS_CreateTask(task_measure, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_control, usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_isr,     usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_5);
+	BRTOS_CreateTask(task_load,    usStack[3], sizeof(usStack[3]), 10, BRTOS_TASK_PRIORITY_8);
+	for(i = 0 ; i < BENCH_MAX_TASKS ; i++)
+	{
+		aucWorker[i] = 4 + i;
+		BRTOS_CreateTask(task_worker, usStack[4 + i], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_2 << (i % 3));
+	}
+}
@@ -0,0 +1,146 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_notify.c
+
+Task signalling benchmark (POSIX port): semaphores, task notifications and
+event flags. A low priority task signals a high priority one, which waits
+for it. For each mechanism it reports:
+
+- wake latency: from the signal call to the waiting task running again
+- signal and take without switch: the signal is pending when taken. Pairs
+  are timed in batches of BENCH_BATCH, below the cycle counter resolution
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_ROUNDS       20000
+#define BENCH_MODES        3
+#define BENCH_BATCH        64
+
+static unsigned long long aaullWake[BENCH_MODES][BENCH_ROUNDS];
+static unsigned long long aaullPair[BENCH_MODES][BENCH_ROUNDS];
+
+static BENCH_SAMPLES asWake[BENCH_MODES] = {
+	BENCH_SAMPLES_INIT("semaphore wake", aaullWake[0]),
+	BENCH_SAMPLES_INIT("notification wake", aaullWake[1]),
+	BENCH_SAMPLES_INIT("event flags wake", aaullWake[2]),
+};
+static BENCH_SAMPLES asPair[BENCH_MODES] = {
+	BENCH_SAMPLES_INIT("semaphore give+take", aaullPair[0]),
+	BENCH_SAMPLES_INIT("notify+wait", aaullPair[1]),
+	BENCH_SAMPLES_INIT("event flags set+wait", aaullPair[2]),
+};
+
+static BRTOS_SEM   sSem;
+static BRTOS_EVENT sEvent;
+static unsigned char ucWaiter;
+static volatile unsigned long long ullSignal;
+
+unsigned short usStack[2][32];
+
+static void Wait(int iMode)
+{
+	switch(iMode)
+	{
+		case 0: BRTOS_SemTake(&sSem, BRTOS_WAIT_FOREVER); break;
+		case 1: BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER); break;
+		case 2: BRTOS_EventWait(&sEvent, 0x0001, BRTOS_EVENT_WAIT_ANY | BRTOS_EVENT_CLEAR, 0, BRTOS_WAIT_FOREVER); break;
+	}
+}
+
+static void Signal(int iMode)
+{
+	switch(iMode)
+	{
+		case 0: BRTOS_SemGive(&sSem); break;
+		case 1: BRTOS_TaskNotify(ucWaiter, 0x0001, BRTOS_NOTIFY_SET_BITS); break;
+		case 2: BRTOS_EventSet(&sEvent, 0x0001); break;
+	}
+}
+
+static void task_waiter(unsigned long ulArg)
+{
+	unsigned long long ullBeg;
+	int iMode, i, j;
+
+	(void) ulArg;
+
+	ucWaiter = BRTOS_GetCurrentTask();
+
+	for(iMode = 0 ; iMode < BENCH_MODES ; iMode++)
+		for(i = 0 ; i < BENCH_ROUNDS ; i++)
+		{
+			Wait(iMode);
+			BENCH_Add(&asWake[iMode], BRTOS_PortCycles() - ullSignal);
+		}
+
+	/* no switches: the signal is pending when taken */
+	for(iMode = 0 ; iMode < BENCH_MODES ; iMode++)
+		for(i = 0 ; i < BENCH_ROUNDS/BENCH_BATCH ; i++)
+		{
+			ullBeg = BRTOS_PortCycles();
+			for(j = 0 ; j < BENCH_BATCH ; j++)
+			{
+				Signal(iMode);
+				Wait(iMode);
+			}
+			BENCH_Add(&asPair[iMode], (BRTOS_PortCycles() - ullBeg)/BENCH_BATCH);
+		}
+
+	DisableInterrupts();
+
+	printf("RAM: semaphore %u bytes, event flags %u bytes, notification %u bytes per task (host sizes)\n",
+	       (unsigned) sizeof(BRTOS_SEM), (unsigned) sizeof(BRTOS_EVENT), 
+	       (unsigned)(sizeof(unsigned short) + sizeof(unsigned char)));
+	for(iMode = 0 ; iMode < BENCH_MODES ; iMode++)
+		BENCH_Report(&asWake[iMode], 0);
+	for(iMode = 0 ; iMode < BENCH_MODES ; iMode++)
+		BENCH_Report(&asPair[iMode], 0);
+
+	BENCH_Exit();
+}
+
+static void task_signaller(unsigned long ulArg)
+{
+	int iMode, i;
+
+	(void) ulArg;
+
+	for(iMode = 0 ; iMode < BENCH_MODES ; iMode++)
+		for(i = 0 ; i < BENCH_ROUNDS ; i++)
+		{
+			ullSignal = BRTOS_PortCycles();
+			Signal(iMode);
+		}
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+
+	BRTOS_SemCreate(&sSem, 0, 1);
+	BRTOS_EventCreate(&sEvent, 0);
+
+	BRTOS_CreateTask(task_waiter,    usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_signaller, usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+}
@@ -0,0 +1,187 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_periodic.c
+
+Periodic task benchmark (POSIX port), built with BRTOS_PERIODIC_TASKS and
+with (bench_periodic_1) or without (bench_periodic_0) BRTOS_EDF. It reports:
+
+- drift: a 10 ms loop with 1 to 3 ms of work, sleeping with BRTOS_Sleep()
+  (relative) and BRTOS_SleepUntil() (absolute). Wake up times are compared 
+  with the ideal grid: relative sleeps drift by the work of each cycle
+- schedulability: three periodic tasks using 88% of the CPU, with rate 
+  monotonic priorities (EDF off) or all in the same level (EDF on). Their
+  set is not schedulable by rate monotonic (the 12 ms task misses its 
+  deadline) but it is with EDF. Deadline misses and overruns are counted
+  by the kernel (BRTOS_TaskPeriodStats()). The host may stop the process
+  for a few ms: with EDF this overload shows up as a burst of misses in all
+  tasks, while rate monotonic keeps the high priority tasks on time
+
+Work is done by a calibrated loop, so preempted jobs still do all of it.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_PERIOD       10
+#define BENCH_CYCLES       50
+#define BENCH_RUN_MS       2000
+#define BENCH_SET_SIZE     3
+
+/* task set: period and work (ms, work in us) */
+static const struct {
+	unsigned short usPeriod;
+	unsigned short usWorkUs;
+	int            iPri;
+} asSet[BENCH_SET_SIZE] = {
+#if BRTOS_EDF
+	{ 5,  2000, BRTOS_TASK_PRIORITY_2 },
+	{ 8,  2500, BRTOS_TASK_PRIORITY_2 },
+	{ 12, 2000, BRTOS_TASK_PRIORITY_2 },
+#else
+	{ 5,  2000, BRTOS_TASK_PRIORITY_2 },
+	{ 8,  2500, BRTOS_TASK_PRIORITY_3 },
+	{ 12, 2000, BRTOS_TASK_PRIORITY_4 },
+#endif
+};
+
+static unsigned long long aullSleep[BENCH_CYCLES];
+static unsigned long long aullUntil[BENCH_CYCLES];
+
+static BENCH_SAMPLES sSleep = BENCH_SAMPLES_INIT("BRTOS_Sleep() wake error", aullSleep);
+static BENCH_SAMPLES sUntil = BENCH_SAMPLES_INIT("BRTOS_SleepUntil() wake error", aullUntil);
+
+static double dLoopsPerUs;
+static unsigned long aulJobs[BENCH_SET_SIZE];
+static unsigned long ulSeed = 12345;
+
+unsigned short usStack[1 + BENCH_SET_SIZE][32];
+
+static void Work(unsigned long ulUs)
+{
+	unsigned long i, n = (unsigned long)(ulUs*dLoopsPerUs);
+
+	for(i = 0 ; i < n ; i++)
+		__asm__ volatile("");
+}
+
+static void WorkCalibrate(void)
+{
+	unsigned long long ullBeg = BRTOS_PortCycles();
+	unsigned long i;
+
+	for(i = 0 ; i < 10000000 ; i++)
+		__asm__ volatile("");
+
+	dLoopsPerUs = 10000000.0*dBenchCyclesPerUs/(BRTOS_PortCycles() - ullBeg);
+}
+
+/* 1 to 3 ms */
+static unsigned long RandomWork(void)
+{
+	ulSeed = ulSeed*1103515245 + 12345;
+	return 1000 + (ulSeed >> 8) % 2001;
+}
+
+static void task_periodic(unsigned long ulArg)
+{
+	/* task indexes follow the creation order, after the control task */
+	int iSet = BRTOS_GetCurrentTask() - 1;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		Work(asSet[iSet].usWorkUs);
+		aulJobs[iSet]++;
+		BRTOS_TaskWaitPeriod();
+	}
+}
+
+/* wake up error against the ideal grid, as an absolute value */
+static void AddWake(BENCH_SAMPLES *psSamples, unsigned long long ullStart, int i)
+{
+	long long llErr = (long long)(BRTOS_PortCycles() - ullStart) - 
+	                  (long long)(i*BENCH_PERIOD*1000.0*dBenchCyclesPerUs);
+
+	BENCH_Add(psSamples, llErr < 0 ? -llErr : llErr);
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned long long ullStart;
+	BRTOS_TICKS ulLastWake;
+	unsigned short usMisses, usOverruns;
+	int i;
+
+	(void) ulArg;
+
+	/* relative sleeps */
+	BRTOS_Sleep(1);
+	ullStart = BRTOS_PortCycles();
+	for(i = 1 ; i <= BENCH_CYCLES ; i++)
+	{
+		Work(RandomWork());
+		BRTOS_Sleep(BENCH_PERIOD);
+		AddWake(&sSleep, ullStart, i);
+	}
+
+	/* absolute wake up times */
+	BRTOS_Sleep(1);
+	ullStart   = BRTOS_PortCycles();
+	ulLastWake = BRTOS_GetTicks();
+	for(i = 1 ; i <= BENCH_CYCLES ; i++)
+	{
+		Work(RandomWork());
+		BRTOS_SleepUntil(&ulLastWake, BENCH_PERIOD);
+		AddWake(&sUntil, ullStart, i);
+	}
+
+	/* task set, released together */
+	for(i = 0 ; i < BENCH_SET_SIZE ; i++)
+	{
+		BRTOS_CreatePeriodicTask(task_periodic, usStack[1 + i], sizeof(usStack[0]), 100,
+		                         asSet[i].usPeriod, 0, asSet[i].iPri);
+	}
+	BRTOS_Sleep(BENCH_RUN_MS);
+
+	DisableInterrupts();
+
+	printf("periodic tasks, %s\n", BRTOS_EDF ? "EDF in one level" : "rate monotonic priorities");
+	printf("%d ms loop with 1 to 3 ms of work, %d cycles, wake up time against the ideal grid\n",
+	       BENCH_PERIOD, BENCH_CYCLES);
+	BENCH_Report(&sSleep, 0);
+	BENCH_Report(&sUntil, 0);
+
+	printf("task set for %d ms\n", BENCH_RUN_MS);
+	for(i = 0 ; i < BENCH_SET_SIZE ; i++)
+	{
+		BRTOS_TaskPeriodStats(1 + i, &usMisses, &usOverruns);
+		printf("task %d: period %2u ms, work %.1f ms: %4lu jobs, %4u deadline misses, %4u overruns\n",
+		       i, asSet[i].usPeriod, asSet[i].usWorkUs/1000.0, aulJobs[i], usMisses, usOverruns);
+	}
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+	WorkCalibrate();
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+}
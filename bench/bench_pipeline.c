@@ -0,0 +1,140 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_pipeline.c
+
+Sensor pipeline benchmark (POSIX port), built with BENCH_POLLING 0 and 1.
+A sample produced every 5 ms goes through two processing stages before 
+reaching the consumer. Stages are signalled by semaphores or, as before
+semaphores existed, they poll a flag with BRTOS_Sleep(1). The latency from
+production to consumption is reported.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_TIME_MS      3000
+#define BENCH_NUM_SAMPLES  1000
+#define BENCH_STAGES       3
+
+#ifndef BENCH_POLLING
+#define BENCH_POLLING      0
+#endif
+
+static unsigned long long aullLatency[BENCH_NUM_SAMPLES];
+static BENCH_SAMPLES sLatency = BENCH_SAMPLES_INIT("pipeline latency", aullLatency);
+
+static BRTOS_SEM             asStage[BENCH_STAGES];
+static volatile int          aiReady[BENCH_STAGES];
+static volatile unsigned long long ullProduced;
+
+unsigned short usStack[5][32];
+
+static void StageWait(int iStage)
+{
+#if BENCH_POLLING
+	while(!aiReady[iStage])
+		BRTOS_Sleep(1);
+	aiReady[iStage] = 0;
+#else
+	BRTOS_SemTake(&asStage[iStage], BRTOS_WAIT_FOREVER);
+#endif
+}
+
+static void StageSignal(int iStage)
+{
+#if BENCH_POLLING
+	aiReady[iStage] = 1;
+#else
+	BRTOS_SemGive(&asStage[iStage]);
+#endif
+}
+
+static void task_sensor(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_Sleep(5);
+		ullProduced = BRTOS_PortCycles();
+		StageSignal(0);
+	}
+}
+
+static void task_filter(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		StageWait(0);
+		StageSignal(1);
+	}
+}
+
+static void task_estimator(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		StageWait(1);
+		StageSignal(2);
+	}
+}
+
+static void task_consumer(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		StageWait(2);
+		BENCH_Add(&sLatency, BRTOS_PortCycles() - ullProduced);
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	BRTOS_Sleep(BENCH_TIME_MS);
+	DisableInterrupts();
+
+	printf("pipeline with %s:\n", BENCH_POLLING ? "sleep polling (1 ms)" : "semaphores");
+	BENCH_Report(&sLatency, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+
+	for(i = 0 ; i < BENCH_STAGES ; i++)
+		BRTOS_SemCreate(&asStage[i], 0, 1);
+
+	BRTOS_CreateTask(task_control,   usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_consumer,  usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_estimator, usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_3);
+	BRTOS_CreateTask(task_filter,    usStack[3], sizeof(usStack[3]), 10, BRTOS_TASK_PRIORITY_4);
+	BRTOS_CreateTask(task_sensor,    usStack[4], sizeof(usStack[4]), 10, BRTOS_TASK_PRIORITY_5);
+}
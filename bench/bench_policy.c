@@ -0,0 +1,160 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_policy.c
+
+Scheduling policy benchmark (POSIX port), built once for each policy 
+(bench_policy_N with BRTOS_SCHED_POLICY=N) with the same workload: eight 
+periodic tasks with rate monotonic priorities, using about half of the CPU,
+and two busy background tasks at the lowest priority with 2 ms time slices.
+
+Kernel cycles of each tick (time processing and task selection) and of the
+other scheduler calls (tasks blocking at the end of their jobs) are reported
+with the deadline misses and the CPU given to each background task, as one 
+row of the policy matrix.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_RUN_MS       2000
+#define BENCH_NUM_SAMPLES  200000
+#define BENCH_SET_SIZE     8
+
+static const char *apcPolicy[] = { "time slice", "priority", "round robin", "EDF" };
+
+static unsigned long long aullTick[BENCH_NUM_SAMPLES];
+static unsigned long long aullBlock[BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES sTick  = BENCH_SAMPLES_INIT("tick", aullTick);
+static BENCH_SAMPLES sBlock = BENCH_SAMPLES_INIT("block", aullBlock);
+
+static double dLoopsPerUs;
+static volatile unsigned long aulBusy[2];
+
+unsigned short usStack[1 + BENCH_SET_SIZE + 2][32];
+
+static void Work(unsigned long ulUs)
+{
+	unsigned long i, n = (unsigned long)(ulUs*dLoopsPerUs);
+
+	for(i = 0 ; i < n ; i++)
+		__asm__ volatile("");
+}
+
+static void WorkCalibrate(void)
+{
+	unsigned long long ullBeg = BRTOS_PortCycles();
+	unsigned long i;
+
+	for(i = 0 ; i < 10000000 ; i++)
+		__asm__ volatile("");
+
+	dLoopsPerUs = 10000000.0*dBenchCyclesPerUs/(BRTOS_PortCycles() - ullBeg);
+}
+
+static void ScheduleHook(int iTick, unsigned long long ullCycles)
+{
+	BENCH_Add(iTick ? &sTick : &sBlock, ullCycles);
+}
+
+/* periods from 2 to 9 ms, 6% of the CPU each */
+static unsigned short PeriodOf(int iSet)
+{
+	return 2 + iSet;
+}
+
+static void task_periodic(unsigned long ulArg)
+{
+	/* task indexes follow the creation order, after the control task */
+	int iSet = BRTOS_GetCurrentTask() - 1;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		Work(PeriodOf(iSet)*60);
+		BRTOS_TaskWaitPeriod();
+	}
+}
+
+static void task_busy(unsigned long ulArg)
+{
+	int iBusy = BRTOS_GetCurrentTask() - 1 - BENCH_SET_SIZE;
+
+	(void) ulArg;
+
+	for(;;)
+		aulBusy[iBusy]++;
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned short usMisses, usOverruns;
+	unsigned long ulMisses = 0;
+	double dBusy;
+	int i;
+
+	(void) ulArg;
+
+	BRTOS_Sleep(BENCH_RUN_MS);
+	DisableInterrupts();
+	pfPortScheduleHook = 0;
+
+	for(i = 0 ; i < BENCH_SET_SIZE ; i++)
+	{
+		BRTOS_TaskPeriodStats(1 + i, &usMisses, &usOverruns);
+		ulMisses += usMisses;
+	}
+	dBusy = (double) aulBusy[0] + aulBusy[1];
+
+	BENCH_Sort(&sTick);
+	BENCH_Sort(&sBlock);
+	printf("policy %-11s: tick p50 %5llu p99 %6llu, block p50 %5llu p99 %6llu cycles, "
+	       "%4lu deadline misses, background CPU %2.0f%%/%2.0f%%\n",
+	       apcPolicy[BRTOS_SCHED_POLICY],
+	       BENCH_Percentile(&sTick, 50), BENCH_Percentile(&sTick, 99),
+	       BENCH_Percentile(&sBlock, 50), BENCH_Percentile(&sBlock, 99),
+	       ulMisses, dBusy ? 100*aulBusy[0]/dBusy : 0, dBusy ? 100*aulBusy[1]/dBusy : 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+	WorkCalibrate();
+	pfPortScheduleHook = ScheduleHook;
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+
+	/* rate monotonic: shorter periods in higher levels */
+	for(i = 0 ; i < BENCH_SET_SIZE ; i++)
+	{
+		BRTOS_CreatePeriodicTask(task_periodic, usStack[1 + i], sizeof(usStack[0]), 10,
+		                         PeriodOf(i), 0, BRTOS_TASK_PRIORITY_2 << (i*6/BENCH_SET_SIZE));
+	}
+
+	for(i = 0 ; i < 2 ; i++)
+	{
+		BRTOS_CreateTask(task_busy, usStack[1 + BENCH_SET_SIZE + i], sizeof(usStack[0]), 2,
+		                 BRTOS_TASK_PRIORITY_8);
+	}
+}
@@ -0,0 +1,279 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_pool.c
+
+Memory pool benchmark (POSIX port):
+
+- allocation and release of random sizes from a set of pools (32, 128 and 
+  512 bytes blocks) compared against malloc()/free(), interrupts disabled
+- packets passed between tasks by pointer (pool blocks sent through a ring 
+  buffer of pointers) compared against packets copied through a ring buffer.
+  Producers and consumers share a priority level, so they run in batches
+  limited by the free blocks and ring sizes
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define BENCH_TIME_MS      2000
+#define BENCH_NUM_SAMPLES  200000
+#define BENCH_NUM_OPS      100000
+#define BENCH_LIVE         64
+#define BENCH_PACKET       128
+#define BENCH_PACKETS      16
+
+static unsigned long long aullAlloc[BENCH_NUM_SAMPLES];
+static unsigned long long aullFree[BENCH_NUM_SAMPLES];
+static unsigned long long aullMalloc[BENCH_NUM_SAMPLES];
+static unsigned long long aullLibFree[BENCH_NUM_SAMPLES];
+static unsigned long long aullPtrTx[BENCH_NUM_SAMPLES];
+static unsigned long long aullPtrRx[BENCH_NUM_SAMPLES];
+static unsigned long long aullCopyTx[BENCH_NUM_SAMPLES];
+static unsigned long long aullCopyRx[BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES sAlloc    = BENCH_SAMPLES_INIT("BRTOS_PoolSetAlloc", aullAlloc);
+static BENCH_SAMPLES sFree     = BENCH_SAMPLES_INIT("BRTOS_PoolSetFree", aullFree);
+static BENCH_SAMPLES sMalloc   = BENCH_SAMPLES_INIT("malloc", aullMalloc);
+static BENCH_SAMPLES sLibFree  = BENCH_SAMPLES_INIT("free", aullLibFree);
+static BENCH_SAMPLES sPtrTx    = BENCH_SAMPLES_INIT("by pointer: alloc+send", aullPtrTx);
+static BENCH_SAMPLES sPtrRx    = BENCH_SAMPLES_INIT("by pointer: receive+free", aullPtrRx);
+static BENCH_SAMPLES sCopyTx   = BENCH_SAMPLES_INIT("by copy: send", aullCopyTx);
+static BENCH_SAMPLES sCopyRx   = BENCH_SAMPLES_INIT("by copy: receive", aullCopyRx);
+
+/* pools for the allocation test */
+static unsigned long aulSmall[BRTOS_POOL_BUFFER_SIZE(32, BENCH_LIVE)/sizeof(unsigned long)];
+static unsigned long aulMedium[BRTOS_POOL_BUFFER_SIZE(128, BENCH_LIVE)/sizeof(unsigned long)];
+static unsigned long aulLarge[BRTOS_POOL_BUFFER_SIZE(512, BENCH_LIVE)/sizeof(unsigned long)];
+static BRTOS_POOL    asPools[3];
+
+/* packets passed by pointer */
+static unsigned long aulPackets[BRTOS_POOL_BUFFER_SIZE(BENCH_PACKET, BENCH_PACKETS)/sizeof(unsigned long)];
+static BRTOS_POOL    sPackets;
+static unsigned char *apucPtrRing[BENCH_PACKETS];
+static BRTOS_RING    sPtrRing;
+
+/* packets copied */
+static unsigned char aucCopyRing[BENCH_PACKETS][BENCH_PACKET];
+static BRTOS_RING    sCopyRing;
+
+static unsigned long ulPtrPackets, ulCopyPackets, ulErrors;
+
+unsigned short usStack[5][32];
+
+static void Fill(unsigned char *pucPacket, unsigned long ulSeq)
+{
+	int i;
+
+	for(i = 0 ; i < BENCH_PACKET ; i++)
+		pucPacket[i] = (unsigned char)(ulSeq + i);
+}
+
+static void Check(unsigned char *pucPacket, unsigned long ulSeq)
+{
+	if(pucPacket[0] != (unsigned char) ulSeq || pucPacket[BENCH_PACKET-1] != (unsigned char)(ulSeq + BENCH_PACKET - 1))
+		ulErrors++;
+}
+
+static void task_ptr_tx(unsigned long ulArg)
+{
+	unsigned long long ullBeg, ullCycles;
+	unsigned char     *pucPacket;
+	unsigned long      ulSeq = 0;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		ullBeg    = BRTOS_PortCycles();
+		pucPacket = BRTOS_PoolAlloc(&sPackets, BRTOS_WAIT_FOREVER);
+		ullCycles = BRTOS_PortCycles() - ullBeg;
+
+		Fill(pucPacket, ulSeq++);
+
+		ullBeg = BRTOS_PortCycles();
+		BRTOS_RingWrite(&sPtrRing, &pucPacket, 1);
+		BENCH_Add(&sPtrTx, ullCycles + BRTOS_PortCycles() - ullBeg);
+	}
+}
+
+static void task_ptr_rx(unsigned long ulArg)
+{
+	unsigned long long ullBeg, ullCycles;
+	unsigned char     *pucPacket;
+	unsigned long      ulSeq = 0;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_RingWait(&sPtrRing, BRTOS_WAIT_FOREVER);
+
+		ullBeg    = BRTOS_PortCycles();
+		BRTOS_RingRead(&sPtrRing, &pucPacket, 1);
+		ullCycles = BRTOS_PortCycles() - ullBeg;
+
+		Check(pucPacket, ulSeq++);
+
+		ullBeg = BRTOS_PortCycles();
+		BRTOS_PoolFree(&sPackets, pucPacket);
+		BENCH_Add(&sPtrRx, ullCycles + BRTOS_PortCycles() - ullBeg);
+		ulPtrPackets++;
+	}
+}
+
+static void task_copy_tx(unsigned long ulArg)
+{
+	unsigned long long ullBeg, ullCycles;
+	unsigned char      aucPacket[BENCH_PACKET];
+	unsigned long      ulSeq = 0;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		Fill(aucPacket, ulSeq);
+
+		ullBeg    = BRTOS_PortCycles();
+		ullCycles = BRTOS_RingWrite(&sCopyRing, aucPacket, 1);
+		if(ullCycles == 0)
+		{
+			/* ring full */
+			BRTOS_Yield();
+			continue;
+		}
+		BENCH_Add(&sCopyTx, BRTOS_PortCycles() - ullBeg);
+		ulSeq++;
+	}
+}
+
+static void task_copy_rx(unsigned long ulArg)
+{
+	unsigned long long ullBeg;
+	unsigned char      aucPacket[BENCH_PACKET];
+	unsigned long      ulSeq = 0;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_RingWait(&sCopyRing, BRTOS_WAIT_FOREVER);
+
+		ullBeg = BRTOS_PortCycles();
+		BRTOS_RingRead(&sCopyRing, aucPacket, 1);
+		BENCH_Add(&sCopyRx, BRTOS_PortCycles() - ullBeg);
+
+		Check(aucPacket, ulSeq++);
+		ulCopyPackets++;
+	}
+}
+
+static void AllocTest(void)
+{
+	static void       *apvPool[BENCH_LIVE];
+	static void       *apvLib[BENCH_LIVE];
+	unsigned long long ullBeg;
+	unsigned short     usSize;
+	int                i, j;
+
+	srand(1);
+
+	/* no ticks: worst cases come from the allocators */
+	DisableInterrupts();
+
+	for(i = 0 ; i < BENCH_NUM_OPS ; i++)
+	{
+		j      = rand() % BENCH_LIVE;
+		usSize = 1 + rand() % 512;
+
+		ullBeg = BRTOS_PortCycles();
+		if(apvPool[j])
+		{
+			BRTOS_PoolSetFree(asPools, 3, apvPool[j]);
+			apvPool[j] = 0;
+			BENCH_Add(&sFree, BRTOS_PortCycles() - ullBeg);
+		}
+		else
+		{
+			apvPool[j] = BRTOS_PoolSetAlloc(asPools, 3, usSize, BRTOS_NO_WAIT);
+			BENCH_Add(&sAlloc, BRTOS_PortCycles() - ullBeg);
+		}
+
+		ullBeg = BRTOS_PortCycles();
+		if(apvLib[j])
+		{
+			free(apvLib[j]);
+			apvLib[j] = 0;
+			BENCH_Add(&sLibFree, BRTOS_PortCycles() - ullBeg);
+		}
+		else
+		{
+			apvLib[j] = malloc(usSize);
+			BENCH_Add(&sMalloc, BRTOS_PortCycles() - ullBeg);
+		}
+	}
+
+	EnableInterrupts();
+
+	printf("pools: %u/%u/%u blocks used at most (32/128/512 bytes)\n", 
+	       asPools[0].usMaxUsed, asPools[1].usMaxUsed, asPools[2].usMaxUsed);
+}
+
+static void task_control(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	AllocTest();
+
+	BRTOS_Sleep(BENCH_TIME_MS);
+	DisableInterrupts();
+
+	BENCH_Report(&sAlloc, 0);
+	BENCH_Report(&sMalloc, 0);
+	BENCH_Report(&sFree, 0);
+	BENCH_Report(&sLibFree, 0);
+
+	printf("\n%d bytes packets: %lu by pointer, %lu by copy, %lu errors, %u of %u packet blocks used at most\n",
+	       BENCH_PACKET, ulPtrPackets, ulCopyPackets, ulErrors, sPackets.usMaxUsed, sPackets.usNumBlocks);
+	BENCH_Report(&sPtrTx, 0);
+	BENCH_Report(&sPtrRx, 0);
+	BENCH_Report(&sCopyTx, 0);
+	BENCH_Report(&sCopyRx, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+
+	BRTOS_PoolCreate(&asPools[0], aulSmall, 32, BENCH_LIVE);
+	BRTOS_PoolCreate(&asPools[1], aulMedium, 128, BENCH_LIVE);
+	BRTOS_PoolCreate(&asPools[2], aulLarge, 512, BENCH_LIVE);
+
+	BRTOS_PoolCreate(&sPackets, aulPackets, BENCH_PACKET, BENCH_PACKETS);
+	BRTOS_RingCreate(&sPtrRing, apucPtrRing, sizeof(apucPtrRing[0]), BENCH_PACKETS, 1);
+	BRTOS_RingCreate(&sCopyRing, aucCopyRing, BENCH_PACKET, BENCH_PACKETS, 1);
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_ptr_tx,  usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_ptr_rx,  usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_copy_tx, usStack[3], sizeof(usStack[3]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_copy_rx, usStack[4], sizeof(usStack[4]), 10, BRTOS_TASK_PRIORITY_2);
+}
@@ -0,0 +1,192 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_ring.c
+
+ISR to task streaming benchmark (POSIX port). A UART receive interrupt is
+simulated in the system tick, delivering a burst of bytes each tick to two
+consumers running side by side:
+
+- legacy: bytes appended to a global buffer, the consumer polls every 
+  millisecond and copies them with interrupts disabled
+- ring: \ref BRTOS_RingWriteFromISR(), the consumer waits for the high water
+  mark and uses the bytes in place, without disabling interrupts
+
+Both streams carry a byte sequence checked by the consumers. Dropped bytes,
+sequence errors, cycles spent in the interrupt and cycles with interrupts
+disabled by the consumers are reported.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_TIME_MS      3000
+#define BENCH_NUM_SAMPLES  20000
+#define BENCH_BURST        48      /* bytes per tick: 96 kB/s, about 1 Mbaud */
+#define BENCH_BUF_SIZE     256
+#define BENCH_HIGH_WATER   128
+
+static unsigned long long aullIsrLegacy[BENCH_NUM_SAMPLES];
+static unsigned long long aullIsrRing[BENCH_NUM_SAMPLES];
+static unsigned long long aullMasked[BENCH_NUM_SAMPLES];
+static BENCH_SAMPLES sIsrLegacy = BENCH_SAMPLES_INIT("legacy ISR (burst)", aullIsrLegacy);
+static BENCH_SAMPLES sIsrRing   = BENCH_SAMPLES_INIT("ring ISR (burst)", aullIsrRing);
+static BENCH_SAMPLES sMasked    = BENCH_SAMPLES_INIT("legacy consumer dint()", aullMasked);
+
+/* legacy: global buffer protected by disabling interrupts */
+static unsigned char           aucLegacy[BENCH_BUF_SIZE];
+static volatile unsigned short usLegacyCount;
+static unsigned long           ulLegacyDropped;
+
+/* ring buffer */
+static unsigned char aucRing[BENCH_BUF_SIZE];
+static BRTOS_RING    sRing;
+
+static unsigned char  ucSeqTx, ucSeqLegacy, ucSeqRing;
+static unsigned long  ulRxLegacy, ulRxRing, ulErrLegacy, ulErrRing, ulWakes;
+static volatile int   iRun = 1;
+
+unsigned short usStack[3][32];
+
+/* simulated UART receive interrupt (interrupts disabled) */
+static void UartInterrupt(void)
+{
+	unsigned char      aucRx[BENCH_BURST];
+	unsigned long long ullBeg;
+	int                i;
+
+	for(i = 0 ; i < BENCH_BURST ; i++)
+		aucRx[i] = ucSeqTx++;
+
+	ullBeg = BRTOS_PortCycles();
+	for(i = 0 ; i < BENCH_BURST ; i++)
+	{
+		if(usLegacyCount < BENCH_BUF_SIZE)
+			aucLegacy[usLegacyCount++] = aucRx[i];
+		else
+			ulLegacyDropped++;
+	}
+	BENCH_Add(&sIsrLegacy, BRTOS_PortCycles() - ullBeg);
+
+	ullBeg = BRTOS_PortCycles();
+	BRTOS_RingWriteFromISR(&sRing, aucRx, BENCH_BURST);
+	BENCH_Add(&sIsrRing, BRTOS_PortCycles() - ullBeg);
+}
+
+/* one burst per tick interrupt, including the ones taken in idle */
+static void ScheduleHook(int iTick, unsigned long long ullCycles)
+{
+	static unsigned long ulSeen;
+
+	(void) iTick;
+	(void) ullCycles;
+
+	for( ; ulSeen != ulPortInterrupts ; ulSeen++)
+		if(iRun)
+			UartInterrupt();
+}
+
+static void task_legacy(unsigned long ulArg)
+{
+	unsigned char      aucLocal[BENCH_BUF_SIZE];
+	unsigned long long ullBeg;
+	unsigned short     usCount, i;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_Sleep(1);
+
+		DisableInterrupts();
+		ullBeg  = BRTOS_PortCycles();
+		usCount = usLegacyCount;
+		for(i = 0 ; i < usCount ; i++)
+			aucLocal[i] = aucLegacy[i];
+		usLegacyCount = 0;
+		BENCH_Add(&sMasked, BRTOS_PortCycles() - ullBeg);
+		EnableInterrupts();
+
+		for(i = 0 ; i < usCount ; i++)
+			if(aucLocal[i] != ucSeqLegacy++)
+			{
+				ulErrLegacy++;
+				ucSeqLegacy = aucLocal[i] + 1;
+			}
+		ulRxLegacy += usCount;
+	}
+}
+
+static void task_ring(unsigned long ulArg)
+{
+	unsigned char *pucSpan;
+	unsigned short usSpan, i;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		if(BRTOS_RingWait(&sRing, 5) == BRTOS_SUCCESS)
+			ulWakes++;
+
+		/* zero copy: bytes are checked in place */
+		while((usSpan = BRTOS_RingReadSpan(&sRing, (void **) &pucSpan)) > 0)
+		{
+			for(i = 0 ; i < usSpan ; i++)
+				if(pucSpan[i] != ucSeqRing++)
+				{
+					ulErrRing++;
+					ucSeqRing = pucSpan[i] + 1;
+				}
+			BRTOS_RingReadRelease(&sRing, usSpan);
+			ulRxRing += usSpan;
+		}
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	BRTOS_Sleep(BENCH_TIME_MS);
+	iRun = 0;
+	BRTOS_Sleep(20);
+	DisableInterrupts();
+
+	printf("ISR to task streaming, %d bytes per tick, %d bytes buffers:\n", BENCH_BURST, BENCH_BUF_SIZE);
+	printf("legacy: %lu bytes received, %lu dropped, %lu sequence errors\n", ulRxLegacy, ulLegacyDropped, ulErrLegacy);
+	printf("ring  : %lu bytes received, %u dropped, %lu sequence errors, %lu high water wake ups\n", 
+	       ulRxRing, sRing.usDropped, ulErrRing, ulWakes);
+	BENCH_Report(&sIsrLegacy, 0);
+	BENCH_Report(&sIsrRing, 0);
+	BENCH_Report(&sMasked, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+
+	BRTOS_RingCreate(&sRing, aucRing, 1, BENCH_BUF_SIZE, BENCH_HIGH_WATER);
+	pfPortScheduleHook = ScheduleHook;
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_ring,    usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_legacy,  usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_2);
+}
@@ -0,0 +1,257 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_sched.c
+
+Scheduler scalability benchmark (POSIX port), built for several 
+BRTOS_MAX_TASKS values. All tasks but two are periodic sleepers spread 
+over the priority levels, one task is always busy at the lowest priority.
+
+Kernel cycles per scheduler call (tick or sleep) are compared with a replica 
+of the original scheduler (linear scan of the TCB array for sleeping tasks
+and round robin), running the same workload over a private TCB array. The
+kernel sample is the whole scheduler call, so the replica also does the other
+work of each call, on its own data: tick count and timer wheel step, stack 
+check of the task switched out and kernel time update (timestamp read). 
+Both samples differ only in how sleeping tasks are processed and the next 
+task is selected.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_TIME_MS      2000
+#define BENCH_NUM_SAMPLES  200000
+
+static unsigned long long aullKernel[BENCH_NUM_SAMPLES];
+static unsigned long long aullLegacy[BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES sKernel = BENCH_SAMPLES_INIT("bitmap scheduler", aullKernel);
+static BENCH_SAMPLES sLegacy = BENCH_SAMPLES_INIT("legacy linear scan", aullLegacy);
+
+unsigned short usStack[BRTOS_MAX_TASKS][32];
+
+/* sleep time of each task (ms), 0 for busy tasks */
+static unsigned short ausPeriod[BRTOS_MAX_TASKS];
+static int            iNumTasks;
+static volatile int   iNextSleeper = 1;
+
+/* legacy scheduler replica */
+static BRTOS_TCB     asLegacyTasks[BRTOS_MAX_TASKS];
+static unsigned char ucLegacyCurrent;
+static unsigned short ausLegacyStack[BRTOS_MAX_TASKS][8];
+
+/* work of each kernel call besides sleeping tasks and selection (replica) */
+static BRTOS_TIMER   *apsLegacyWheel[BRTOS_TIMER_WHEEL_LEVELS][BRTOS_TIMER_WHEEL_SIZE];
+static unsigned short usLegacyTimerNext;
+static BRTOS_TICKS    ulLegacyTicks;
+static unsigned long  ulLegacyTimeNow;
+static unsigned long  ulLegacyTimeRaw;
+
+/**
+Tick count and timer wheel step (no timers: cascade check and slot check, as
+the kernel does with an empty wheel).
+*/
+static void LegacyTimers(void)
+{
+	int iLevel;
+
+	ulLegacyTicks++;
+	for(iLevel = 1 ; iLevel < BRTOS_TIMER_WHEEL_LEVELS ; iLevel++)
+	{
+		if(usLegacyTimerNext & ((1U << (BRTOS_TIMER_WHEEL_BITS*iLevel)) - 1))
+			break;
+		apsLegacyWheel[iLevel][(usLegacyTimerNext >> (BRTOS_TIMER_WHEEL_BITS*iLevel)) & (BRTOS_TIMER_WHEEL_SIZE - 1)] = 0;
+	}
+	if(apsLegacyWheel[0][usLegacyTimerNext & (BRTOS_TIMER_WHEEL_SIZE - 1)])
+		printf("legacy replica: unexpected timer\n");
+	usLegacyTimerNext++;
+}
+
+/**
+Stack check of the task switched out and kernel time update, as the kernel
+does before selecting a task.
+*/
+static void LegacySwitchOut(void)
+{
+	unsigned long ulRaw;
+
+	if(ucLegacyCurrent < iNumTasks &&
+	   (asLegacyTasks[ucLegacyCurrent].pusStackPtr <= asLegacyTasks[ucLegacyCurrent].pusStackBeg ||
+	    *asLegacyTasks[ucLegacyCurrent].pusStackBeg != BRTOS_STACK_PATTERN))
+		printf("legacy replica: stack check failed\n");
+
+	ulRaw = BRTOS_PortTimestamp();
+	ulLegacyTimeNow += (ulRaw - ulLegacyTimeRaw) & BRTOS_PORT_TIMESTAMP_MASK;
+	ulLegacyTimeRaw  = ulRaw;
+}
+
+static void LegacySleepTasks(void)
+{
+	int i;
+
+	for(i = 0; i < iNumTasks; i++)
+	{
+		if(asLegacyTasks[i].ucTaskState == BRTOS_TASK_STATE_SLEEPING)
+		{
+			asLegacyTasks[i].ulSleepTicks--;
+			if(asLegacyTasks[i].ulSleepTicks == 0)
+				asLegacyTasks[i].ucTaskState = BRTOS_TASK_STATE_READY;
+		}
+	}
+}
+
+static int LegacyRoundRobin(void)
+{
+	int i, j;
+	int task = BRTOS_NO_TASK_TO_RUN;
+
+	for(i = ucLegacyCurrent, j = 0 ; j < iNumTasks; j++, i++)
+	{
+		if(i >= iNumTasks) 
+			i = 0;
+
+		if(asLegacyTasks[i].ucTaskState == BRTOS_TASK_STATE_RUNNING)
+		{
+			asLegacyTasks[i].usTicks++;
+			if(asLegacyTasks[i].usTicks < asLegacyTasks[i].usTimeSlice)
+			{
+				task = i;
+				break;
+			}
+			else 
+			{
+				asLegacyTasks[i].ucTaskState = BRTOS_TASK_STATE_READY;
+				continue;
+			}
+		}
+		if(asLegacyTasks[i].ucTaskState == BRTOS_TASK_STATE_READY)
+		{
+			asLegacyTasks[i].usTicks = 0;
+			asLegacyTasks[i].ucTaskState = BRTOS_TASK_STATE_RUNNING;
+			task = i;
+			break;
+		}
+	}
+
+	return task;
+}
+
+static void LegacySchedule(void)
+{
+	unsigned long long ullStart = BRTOS_PortCycles();
+
+	LegacyTimers();
+	LegacySleepTasks();
+	LegacySwitchOut();
+	ucLegacyCurrent = LegacyRoundRobin();
+
+	BENCH_Add(&sLegacy, BRTOS_PortCycles() - ullStart);
+}
+
+/**
+Same workload on the legacy scheduler, one scheduler call for each kernel
+call (so both run with the same cache state): sleepers go back to sleep 
+as soon as they run, entering the scheduler again (as _Sleep() did).
+*/
+static void LegacyStep(void)
+{
+	if(ucLegacyCurrent < iNumTasks && ausPeriod[ucLegacyCurrent])
+	{
+		asLegacyTasks[ucLegacyCurrent].ucTaskState  = BRTOS_TASK_STATE_SLEEPING;
+		asLegacyTasks[ucLegacyCurrent].ulSleepTicks = (BRTOS_PORT_TICKS_PER_SECOND*ausPeriod[ucLegacyCurrent])/1000;
+	}
+
+	LegacySchedule();
+}
+
+static void ScheduleHook(int iTick, unsigned long long ullCycles)
+{
+	(void) iTick;
+	BENCH_Add(&sKernel, ullCycles);
+	LegacyStep();
+}
+
+static void task_sleeper(unsigned long ulArg)
+{
+	unsigned short usPeriod;
+
+	(void) ulArg;
+
+	DisableInterrupts();
+	usPeriod = ausPeriod[iNextSleeper++];
+	EnableInterrupts();
+
+	for(;;)
+		BRTOS_Sleep(usPeriod);
+}
+
+static void task_busy(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+		;
+}
+
+static void task_control(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	BRTOS_Sleep(BENCH_TIME_MS);
+	DisableInterrupts();
+	pfPortScheduleHook = 0;
+
+	printf("scheduler, %d tasks (%d sleepers, 1 busy):\n", iNumTasks, iNumTasks - 2);
+	BENCH_Report(&sKernel, 0);
+	BENCH_Report(&sLegacy, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+	pfPortScheduleHook = ScheduleHook;
+
+	/* controller */
+	ausPeriod[0] = BENCH_TIME_MS;
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+
+	/* sleepers from 1 to 10 ms, spread over levels 1 to 7 */
+	for(i = 1 ; i < BRTOS_MAX_TASKS - 1 ; i++)
+	{
+		ausPeriod[i] = 1 + (i*3) % 10;
+		BRTOS_CreateTask(task_sleeper, usStack[i], sizeof(usStack[i]), 10, 1 << (i % 7));
+	}
+
+	BRTOS_CreateTask(task_busy, usStack[i], sizeof(usStack[i]), 10, BRTOS_TASK_PRIORITY_8);
+	iNumTasks = i + 1;
+
+	for(i = 0 ; i < iNumTasks ; i++)
+	{
+		asLegacyTasks[i].ucTaskState = BRTOS_TASK_STATE_READY;
+		asLegacyTasks[i].usTimeSlice = (BRTOS_PORT_TICKS_PER_SECOND*10)/1000;
+		asLegacyTasks[i].pusStackBeg = ausLegacyStack[i];
+		asLegacyTasks[i].pusStackPtr = &ausLegacyStack[i][4];
+		ausLegacyStack[i][0]         = BRTOS_STACK_PATTERN;
+	}
+	ucLegacyCurrent = BRTOS_NO_TASK_TO_RUN;
+}
@@ -0,0 +1,225 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_sim.c
+
+Soak test in virtual time (POSIX port with BRTOS_PORT_SIM and tickless idle):
+a week of device time, starting one hour before the kernel tick wraps around,
+with:
+
+- a periodic task (BRTOS_SleepUntil(), 1 s) that must wake up exactly at its
+  release ticks, at the virtual time of these ticks
+- a periodic software timer (10 s) whose callbacks are counted
+- a device interrupt (1 s on average, random intervals) giving a semaphore
+  to a task
+- worker tasks sleeping, waiting for notifications, locking a mutex and 
+  simulating CPU work, with random times
+
+The run is deterministic: the events of all tasks are hashed, the same seed
+(BRTOS_SIM_SEED environment variable) gives the same hash, so a failing run
+can be replayed and a regression bisected by comparing hashes. It fails 
+(exit status 1) if a check fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+
+#define BENCH_SIM_DAYS     7
+#define BENCH_WORKERS      8
+#define BENCH_FIRST_WORKER 3
+#define BENCH_NSEC_PER_TICK (1000000000UL/BRTOS_PORT_TICKS_PER_SECOND)
+
+static unsigned long long ullHash = 1469598103934665603ULL;
+static unsigned long ulPeriodicWakes;
+static unsigned long ulPeriodicErrors;
+static unsigned long ulTimerCalls;
+static unsigned long ulDeviceRuns;
+static unsigned long ulWorkerRuns;
+static BRTOS_SEM   sDeviceSem;
+static BRTOS_MUTEX sShared;
+static BRTOS_TIMER sTimer;
+
+unsigned short usStack[BENCH_FIRST_WORKER + BENCH_WORKERS][32];
+
+static void Hash(unsigned long ulValue)
+{
+	int i;
+
+	for(i = 0 ; i < 4 ; i++)
+	{
+		ullHash ^= (ulValue >> (8*i)) & 0xFF;
+		ullHash *= 1099511628211ULL;
+	}
+}
+
+static void Event(unsigned long ulArg)
+{
+	Hash(BRTOS_GetCurrentTask());
+	Hash(BRTOS_GetTicks());
+	Hash(ulArg);
+}
+
+static void DeviceIsr(void)
+{
+	BRTOS_ISR_Enter();
+	BRTOS_SemGiveFromISR(&sDeviceSem);
+	BRTOS_ISR_Exit();
+}
+
+static void TimerCallback(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	ulTimerCalls++;
+}
+
+static void task_periodic(unsigned long ulArg)
+{
+	BRTOS_TICKS   ulLastWake = BRTOS_GetTicks();
+	unsigned long ulStamp    = BRTOS_GetTimestamp();
+	BRTOS_TICKS   ulStart    = ulLastWake;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_SleepUntil(&ulLastWake, 1000);
+		ulPeriodicWakes++;
+
+		/* exact wake up tick, at the virtual time of that tick */
+		if(BRTOS_GetTicks() != ulLastWake || 
+		   BRTOS_GetTimestamp() - ulStamp != (ulLastWake - ulStart)*BENCH_NSEC_PER_TICK)
+			ulPeriodicErrors++;
+
+		BRTOS_PortSimRun(100);
+	}
+}
+
+static void task_device(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_SemTake(&sDeviceSem, BRTOS_WAIT_FOREVER);
+		ulDeviceRuns++;
+		Event(0);
+		BRTOS_PortSimRun(50);
+	}
+}
+
+static void task_worker(unsigned long ulArg)
+{
+	unsigned long ulRandom;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		ulRandom = BRTOS_PortSimRandom();
+
+		if(ulRandom & 1)
+			BRTOS_Sleep(1 + (ulRandom >> 1) % 20000);
+		else
+			BRTOS_TaskNotifyWait(0xFFFF, 0, 1 + (ulRandom >> 1) % 30000);
+
+		ulWorkerRuns++;
+		Event(ulRandom);
+		BRTOS_PortSimRun(BRTOS_PortSimRandom() % 3000);
+
+		BRTOS_MutexLock(&sShared, BRTOS_WAIT_FOREVER);
+		BRTOS_PortSimRun(BRTOS_PortSimRandom() % 500);
+		BRTOS_MutexUnlock(&sShared);
+
+		BRTOS_TaskNotify(BENCH_FIRST_WORKER + BRTOS_PortSimRandom() % BENCH_WORKERS, 1, BRTOS_NOTIFY_INCREMENT);
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	struct timespec sBeg, sEnd;
+	BRTOS_TICKS     ulStart = BRTOS_GetTicks();
+	unsigned long   ulExpected;
+	double          dReal;
+	int             iMinutes, iFail = 0;
+
+	(void) ulArg;
+
+	clock_gettime(CLOCK_MONOTONIC, &sBeg);
+
+	for(iMinutes = 0 ; iMinutes < BENCH_SIM_DAYS*24*60 ; iMinutes++)
+		BRTOS_Sleep(60000);
+
+	clock_gettime(CLOCK_MONOTONIC, &sEnd);
+	dReal = (sEnd.tv_sec - sBeg.tv_sec) + (sEnd.tv_nsec - sBeg.tv_nsec)/1e9;
+
+	DisableInterrupts();
+
+	ulExpected = BENCH_SIM_DAYS*24*3600UL/10;
+
+	printf("%d days of virtual time (%lu ticks, from %lu) in %.2f s: %.0f times faster than the device\n",
+	       BENCH_SIM_DAYS, (unsigned long)(BRTOS_GetTicks() - ulStart), (unsigned long) ulStart, 
+	       dReal, BENCH_SIM_DAYS*24*3600.0/dReal);
+	printf("periodic task: %lu wake ups, %lu not on time\n", ulPeriodicWakes, ulPeriodicErrors);
+	printf("timer: %lu callbacks (%lu expected)\n", ulTimerCalls, ulExpected);
+	printf("device: %lu interrupts, %lu task runs; workers: %lu runs\n", ulPortDeviceInterrupts, ulDeviceRuns, ulWorkerRuns);
+	printf("run hash %016llx (same seed, same hash)\n", ullHash);
+
+	if(BRTOS_TICKS_REACHED(ulStart, BRTOS_GetTicks()))
+	{
+		printf("FAIL: the tick did not advance\n");
+		iFail = 1;
+	}
+	/* the last release is at the end of the run, with this task */
+	if(ulPeriodicErrors || ulPeriodicWakes + 1 < BENCH_SIM_DAYS*24*3600UL)
+	{
+		printf("FAIL: periodic task\n");
+		iFail = 1;
+	}
+	if(ulTimerCalls + 1 < ulExpected || ulTimerCalls > ulExpected)
+	{
+		printf("FAIL: timer\n");
+		iFail = 1;
+	}
+
+	if(iFail)
+	{
+		fflush(stdout);
+		exit(1);
+	}
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BRTOS_SemCreate(&sDeviceSem, 0, 0xFFFF);
+	BRTOS_MutexCreate(&sShared);
+	BRTOS_TimerCreate(&sTimer, TimerCallback, 0, BRTOS_TASK_PRIORITY_1);
+	BRTOS_TimerStart(&sTimer, 10000, 10000);
+	BRTOS_PortDeviceStart(DeviceIsr, 1000000);
+
+	BRTOS_CreateTask(task_control,  usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_periodic, usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_device,   usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_3);
+	for(i = 0 ; i < BENCH_WORKERS ; i++)
+		BRTOS_CreateTask(task_worker, usStack[BENCH_FIRST_WORKER + i], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_4 << (i % 3));
+}
@@ -0,0 +1,166 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_stack.c
+
+Stack usage benchmark (POSIX port). Worker tasks use a known amount of
+stack and their high water marks are read with BRTOS_TaskStackHighWater().
+It reports:
+
+- the high water mark of each task and the margin left in its stack
+- the cost of the high water scan, which depends on the free stack
+- the cost of a yield switch pair, to compare builds with and without
+  the overflow check at each switch (bench_stack_1 and bench_stack_0)
+
+Host stacks are BRTOS_PORT_STACK_SIZE bytes given by the port, so the
+measured usage includes the switch frames and the signal frames of
+host interrupts (about 3 Kbytes), taken on the task stack.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_WORKERS      3
+#define BENCH_SCANS        1000
+#define BENCH_ROUNDS       100000
+
+static unsigned long long aaullScan[BENCH_WORKERS][BENCH_SCANS];
+static unsigned long long aullYield[BENCH_ROUNDS];
+
+static BENCH_SAMPLES asScan[BENCH_WORKERS] = {
+	BENCH_SAMPLES_INIT("high water scan (512 bytes)", aaullScan[0]),
+	BENCH_SAMPLES_INIT("high water scan (2048 bytes)", aaullScan[1]),
+	BENCH_SAMPLES_INIT("high water scan (8192 bytes)", aaullScan[2]),
+};
+static BENCH_SAMPLES sYield = BENCH_SAMPLES_INIT("yield switch pair", aullYield);
+
+static const unsigned short ausUse[BENCH_WORKERS] = { 512, 2048, 8192 };
+static unsigned char aucWorker[BENCH_WORKERS];
+static int iNextWorker;
+static unsigned char ucYield;
+static volatile int iYieldDone;
+
+unsigned short usStack[BENCH_WORKERS + 3][32];
+
+/* touch usBytes of stack, as a task with deep calls would do */
+static __attribute__((noinline)) unsigned char Use(unsigned short usBytes)
+{
+	volatile unsigned char aucBuf[8192];
+	unsigned short i;
+
+	for(i = 0 ; i < usBytes ; i++)
+		aucBuf[8192 - 1 - i] = (unsigned char) i;
+
+	return aucBuf[8192 - usBytes];
+}
+
+static void task_worker(unsigned long ulArg)
+{
+	int iWorker = iNextWorker++;
+
+	(void) ulArg;
+
+	aucWorker[iWorker] = BRTOS_GetCurrentTask();
+	Use(ausUse[iWorker]);
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+static void task_yield_a(unsigned long ulArg)
+{
+	unsigned long long ullBeg;
+	int i;
+
+	(void) ulArg;
+
+	ucYield = BRTOS_GetCurrentTask();
+
+	for(i = 0 ; i < BENCH_ROUNDS ; i++)
+	{
+		ullBeg = BRTOS_PortCycles();
+		BRTOS_Yield();
+		BENCH_Add(&sYield, BRTOS_PortCycles() - ullBeg);
+	}
+	iYieldDone = 1;
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+static void task_yield_b(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	while(!iYieldDone)
+		BRTOS_Yield();
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned long long ullBeg;
+	unsigned short usUsed;
+	int iWorker, i;
+
+	(void) ulArg;
+
+	while(!iYieldDone)
+		BRTOS_Sleep(10);
+
+	for(iWorker = 0 ; iWorker < BENCH_WORKERS ; iWorker++)
+		for(i = 0 ; i < BENCH_SCANS ; i++)
+		{
+			ullBeg = BRTOS_PortCycles();
+			BRTOS_TaskStackHighWater(aucWorker[iWorker]);
+			BENCH_Add(&asScan[iWorker], BRTOS_PortCycles() - ullBeg);
+		}
+
+	DisableInterrupts();
+
+	printf("stack usage (stack %u bytes, overflow check %s)\n", 
+	       (unsigned) BRTOS_PORT_STACK_SIZE, BRTOS_STACK_CHECK ? "on" : "off");
+	for(iWorker = 0 ; iWorker < BENCH_WORKERS ; iWorker++)
+	{
+		usUsed = BRTOS_TaskStackHighWater(aucWorker[iWorker]);
+		printf("worker using %5u bytes: high water %5u bytes, margin %5u bytes\n", 
+		       ausUse[iWorker], usUsed, (unsigned)(BRTOS_PORT_STACK_SIZE - usUsed));
+	}
+	printf("yield task: high water %u bytes\n", BRTOS_TaskStackHighWater(ucYield));
+	printf("control task: high water %u bytes\n", BRTOS_TaskStackHighWater(BRTOS_GetCurrentTask()));
+
+	for(iWorker = 0 ; iWorker < BENCH_WORKERS ; iWorker++)
+		BENCH_Report(&asScan[iWorker], 0);
+	BENCH_Report(&sYield, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	for(i = 0 ; i < BENCH_WORKERS ; i++)
+		BRTOS_CreateTask(task_worker, usStack[i + 1], sizeof(usStack[i + 1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_yield_a, usStack[i + 1], sizeof(usStack[i + 1]), 10, BRTOS_TASK_PRIORITY_3);
+	BRTOS_CreateTask(task_yield_b, usStack[i + 2], sizeof(usStack[i + 2]), 10, BRTOS_TASK_PRIORITY_3);
+}
@@ -0,0 +1,170 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_switch.c
+
+Context switch benchmark (POSIX port):
+
+- tick preemption: two busy tasks sharing a priority level, measured from the
+  last instruction of the preempted task to the first one of the next task
+  (full context path)
+- tick to resume: from the tick interrupt to the first instruction of the next task
+- yield switch: the same busy tasks calling BRTOS_Yield() in the second half
+  of the test (cooperative path)
+- sleep switch: from BRTOS_Sleep() to the first instruction of the next task
+- kernel schedule: cycles spent in BRTOS_Schedule() (tick: time processing and
+  task selection) and BRTOS_ScheduleYield() (cooperative: task selection)
+- sleep jitter: error of BRTOS_Sleep(5) wake up time
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_TIME_MS  3000
+#define BENCH_NUM_SAMPLES  200000
+
+static unsigned long long aullPreempt[BENCH_NUM_SAMPLES];
+static unsigned long long aullResume[BENCH_NUM_SAMPLES];
+static unsigned long long aullSleepSwitch[BENCH_NUM_SAMPLES];
+static unsigned long long aullYield[BENCH_NUM_SAMPLES];
+static unsigned long long aullSchedule[BENCH_NUM_SAMPLES];
+static unsigned long long aullScheduleYield[BENCH_NUM_SAMPLES];
+static unsigned long long aullJitter[BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES sPreempt     = BENCH_SAMPLES_INIT("tick preemption switch", aullPreempt);
+static BENCH_SAMPLES sResume      = BENCH_SAMPLES_INIT("tick to resume", aullResume);
+static BENCH_SAMPLES sSleepSwitch = BENCH_SAMPLES_INIT("sleep switch", aullSleepSwitch);
+static BENCH_SAMPLES sYield       = BENCH_SAMPLES_INIT("yield switch", aullYield);
+static BENCH_SAMPLES sSchedule    = BENCH_SAMPLES_INIT("kernel schedule (tick)", aullSchedule);
+static BENCH_SAMPLES sScheduleYld = BENCH_SAMPLES_INIT("kernel schedule (yield)", aullScheduleYield);
+static BENCH_SAMPLES sJitter      = BENCH_SAMPLES_INIT("sleep(5) wake error", aullJitter);
+
+static volatile unsigned long long ullLastSeen;
+static volatile unsigned long long ullSleepStart;
+static volatile unsigned long      ulSleeps;
+static volatile unsigned long      ulSeenSleeps;
+static volatile int                iLastBusy = -1;
+static volatile int                iYieldPhase;
+
+unsigned short usStack[4][32];
+
+static void ScheduleHook(int iTick, unsigned long long ullCycles)
+{
+	BENCH_Add(iTick ? &sSchedule : &sScheduleYld, ullCycles);
+}
+
+static void task_busy(unsigned long ulId)
+{
+	unsigned long long ullNow;
+
+	for(;;)
+	{
+		/* sample with interrupts disabled: a pending tick preempts the task
+		   only when they are enabled again, after updating ullLastSeen */
+		DisableInterrupts();
+		ullNow = BRTOS_PortCycles();
+
+		if(ulSeenSleeps != ulSleeps)
+		{
+			/* the sleeper was in between */
+			BENCH_Add(&sSleepSwitch, ullNow - ullSleepStart);
+			ulSeenSleeps = ulSleeps;
+		}
+		else if(iLastBusy != (int) ulId && iLastBusy >= 0)
+		{
+			if(iYieldPhase)
+				BENCH_Add(&sYield, ullNow - ullLastSeen);
+			else
+			{
+				BENCH_Add(&sPreempt, ullNow - ullLastSeen);
+				BENCH_Add(&sResume, ullNow - ullPortTickCycles);
+			}
+		}
+
+		iLastBusy   = ulId;
+		ullLastSeen = BRTOS_PortCycles();
+		EnableInterrupts();
+
+		if(iYieldPhase)
+			BRTOS_Yield();
+	}
+}
+
+static void task_busy_a(unsigned long ulArg)
+{
+	(void) ulArg;
+	task_busy(0);
+}
+
+static void task_busy_b(unsigned long ulArg)
+{
+	(void) ulArg;
+	task_busy(1);
+}
+
+static void task_sleeper(unsigned long ulArg)
+{
+	unsigned long long ullBeg, ullEnd, ullExpected;
+
+	(void) ulArg;
+	ullExpected = (unsigned long long)(5000*dBenchCyclesPerUs);
+
+	for(;;)
+	{
+		ullBeg = BRTOS_PortCycles();
+		DisableInterrupts();
+		ulSleeps++;
+		ullSleepStart = BRTOS_PortCycles();
+		EnableInterrupts();
+		BRTOS_Sleep(5);
+		ullEnd = BRTOS_PortCycles();
+		BENCH_Add(&sJitter, ullEnd - ullBeg > ullExpected ? ullEnd - ullBeg - ullExpected : ullExpected - (ullEnd - ullBeg));
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	BRTOS_Sleep(BENCH_TIME_MS/2);
+	iYieldPhase = 1;
+	BRTOS_Sleep(BENCH_TIME_MS/2);
+	DisableInterrupts();
+
+	printf("context switch (%.0f cycles/us, tick %d Hz, %d ms)\n", dBenchCyclesPerUs, BRTOS_PORT_TICKS_PER_SECOND, BENCH_TIME_MS);
+	BENCH_Report(&sPreempt, 1);
+	BENCH_Report(&sResume, 1);
+	BENCH_Report(&sYield, 1);
+	BENCH_Report(&sSleepSwitch, 1);
+	BENCH_Report(&sSchedule, 1);
+	BENCH_Report(&sScheduleYld, 1);
+	BENCH_Report(&sJitter, 1);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+	pfPortScheduleHook = ScheduleHook;
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_sleeper, usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_busy_a,  usStack[2], sizeof(usStack[2]),  1, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_busy_b,  usStack[3], sizeof(usStack[3]),  1, BRTOS_TASK_PRIORITY_2);
+}
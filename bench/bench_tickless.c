@@ -0,0 +1,104 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_tickless.c
+
+Tickless idle benchmark (POSIX port), built with BRTOS_TICKLESS_IDLE 0 and 1.
+A few tasks sleep for long periods and do almost nothing: the amount of
+CPU wake ups (tick interrupts) per second and the wake up error are reported.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "bench.h"
+
+#define BENCH_TIME_MS      3000
+#define BENCH_NUM_SAMPLES  1000
+
+static unsigned long long aullError[BENCH_NUM_SAMPLES];
+static BENCH_SAMPLES sError = BENCH_SAMPLES_INIT("sleep(100) wake error", aullError);
+
+unsigned short usStack[4][32];
+
+static unsigned long long BENCH_Ns(void)
+{
+	struct timespec sNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &sNow);
+	return sNow.tv_sec*1000000000ULL + sNow.tv_nsec;
+}
+
+static void task_sensor(unsigned long ulArg)
+{
+	unsigned long long ullBeg, ullElapsed;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		ullBeg = BRTOS_PortCycles();
+		BRTOS_Sleep(100);
+		ullElapsed = BRTOS_PortCycles() - ullBeg;
+		BENCH_Add(&sError, ullElapsed > 100000*dBenchCyclesPerUs ? 
+		          ullElapsed - (unsigned long long)(100000*dBenchCyclesPerUs) :
+		          (unsigned long long)(100000*dBenchCyclesPerUs) - ullElapsed);
+	}
+}
+
+static void task_link(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+		BRTOS_Sleep(250);
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned long      ulIrqs;
+	unsigned long long ullNs, ullCycles;
+
+	(void) ulArg;
+
+	ulIrqs    = ulPortInterrupts;
+	ullNs     = BENCH_Ns();
+	ullCycles = ullPortIdleCycles;
+
+	BRTOS_Sleep(BENCH_TIME_MS);
+	DisableInterrupts();
+
+	ullNs     = BENCH_Ns() - ullNs;
+	ulIrqs    = ulPortInterrupts - ulIrqs;
+	ullCycles = ullPortIdleCycles - ullCycles;
+
+	printf("tickless idle %s: %lu wake ups in %.0f ms (%.1f/s), idle %.1f%%\n",
+	       BRTOS_TICKLESS_IDLE ? "on " : "off", ulIrqs, ullNs/1e6, ulIrqs/(ullNs/1e9),
+	       100.0*ullCycles/(ullNs*dBenchCyclesPerUs/1000.0));
+	BENCH_Report(&sError, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_sensor,  usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_link,    usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_3);
+}
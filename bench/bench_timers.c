@@ -0,0 +1,138 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_timers.c
+
+Software timers benchmark (POSIX port): thousands of timers are started,
+stopped and rescheduled at random by a task while the timer wheel is
+processed by the kernel. Cycles of each timer operation and of the
+scheduler calls (including the timer wheel processing) are reported.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define BENCH_TIME_MS      3000
+#define BENCH_NUM_TIMERS   4000
+#define BENCH_NUM_SAMPLES  400000
+
+static BRTOS_TIMER asTimers[BENCH_NUM_TIMERS];
+
+static unsigned long long aullStart[BENCH_NUM_SAMPLES];
+static unsigned long long aullStop[BENCH_NUM_SAMPLES];
+static unsigned long long aullResched[BENCH_NUM_SAMPLES];
+static unsigned long long aullSchedule[BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES sStart   = BENCH_SAMPLES_INIT("BRTOS_TimerStart", aullStart);
+static BENCH_SAMPLES sStop    = BENCH_SAMPLES_INIT("BRTOS_TimerStop", aullStop);
+static BENCH_SAMPLES sResched = BENCH_SAMPLES_INIT("BRTOS_TimerReschedule", aullResched);
+static BENCH_SAMPLES sSchedule= BENCH_SAMPLES_INIT("kernel schedule (timers)", aullSchedule);
+
+static volatile unsigned long ulFired;
+
+unsigned short usStack[3][32];
+
+static void ScheduleHook(int iTick, unsigned long long ullCycles)
+{
+	/* the churn task sleeps often: ticks are also processed by cooperative calls, while idle */
+	(void) iTick;
+	BENCH_Add(&sSchedule, ullCycles);
+}
+
+static void TimerCallback(unsigned long ulArg)
+{
+	(void) ulArg;
+	ulFired++;
+}
+
+static void task_churn(unsigned long ulArg)
+{
+	unsigned long      ulOps = 0;
+	unsigned long long ullBeg, ullEnd;
+	BRTOS_TIMER       *psTimer;
+	BENCH_SAMPLES     *psSamples;
+	int                iOp;
+
+	(void) ulArg;
+	srand(1);
+
+	for(;;)
+	{
+		psTimer = &asTimers[rand() % BENCH_NUM_TIMERS];
+		iOp     = rand() % 4;
+
+		ullBeg = BRTOS_PortCycles();
+		if(iOp == 0)
+		{
+			BRTOS_TimerStop(psTimer);
+			psSamples = &sStop;
+		}
+		else if(iOp == 1 && psTimer->ucStatus == BRTOS_TIMER_ACTIVE)
+		{
+			BRTOS_TimerReschedule(psTimer, 1 + rand() % 10000);
+			psSamples = &sResched;
+		}
+		else
+		{
+			BRTOS_TimerStart(psTimer, 1 + rand() % 10000, (rand() & 1) ? 1 + rand() % 2000 : 0);
+			psSamples = &sStart;
+		}
+		ullEnd = BRTOS_PortCycles();
+		BENCH_Add(psSamples, ullEnd - ullBeg);
+
+		if((++ulOps % 64) == 0)
+			BRTOS_Sleep(1);
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned long ulActive = 0;
+	int           i;
+
+	(void) ulArg;
+
+	BRTOS_Sleep(BENCH_TIME_MS);
+	DisableInterrupts();
+
+	for(i = 0 ; i < BENCH_NUM_TIMERS ; i++)
+		ulActive += asTimers[i].ucStatus == BRTOS_TIMER_ACTIVE;
+
+	printf("timers: %d timers, %lu active at end, %lu expirations\n", BENCH_NUM_TIMERS, ulActive, ulFired);
+	BENCH_Report(&sStart, 0);
+	BENCH_Report(&sStop, 0);
+	BENCH_Report(&sResched, 0);
+	BENCH_Report(&sSchedule, 1);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+	pfPortScheduleHook = ScheduleHook;
+
+	for(i = 0 ; i < BENCH_NUM_TIMERS ; i++)
+		BRTOS_TimerCreate(&asTimers[i], TimerCallback, i, 1 << (i % 8));
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_churn,   usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+}
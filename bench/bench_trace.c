@@ -0,0 +1,222 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_trace.c
+
+CPU accounting and trace benchmark (POSIX port). Two periodic load tasks 
+run for one second and the CPU usage given by BRTOS_TaskStats() is 
+compared with the work each task measured by itself (cycles counted while
+spinning, without the gaps where it was preempted). The trace of that
+second is written to bench/trace.bin, for tools/tracedecode.
+
+The cost of the instrumentation is measured as a yield switch pair, to
+compare builds with statistics and trace (bench_trace_1) and without them
+(bench_trace_0).
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_ROUNDS       100000
+#define BENCH_LOADS        2
+#define BENCH_TIME_MS      1000
+/* gaps longer than this (us) while spinning are preemptions */
+#define BENCH_GAP_US       2
+
+static unsigned long long aullYield[BENCH_ROUNDS];
+static BENCH_SAMPLES sYield = BENCH_SAMPLES_INIT("yield switch pair", aullYield);
+
+static const unsigned short ausBusy[BENCH_LOADS]  = { 2, 3 };
+static const unsigned short ausSleep[BENCH_LOADS] = { 8, 5 };
+static volatile unsigned long long aullWork[BENCH_LOADS];
+static unsigned char aucLoad[BENCH_LOADS];
+static int iNextLoad;
+static volatile int iLoadDone;
+static volatile int iYieldDone;
+
+#if BRTOS_TRACE
+static unsigned char aucDump[BRTOS_TRACE_HEADER_SIZE + BRTOS_TRACE_SIZE*BRTOS_TRACE_RECORD_SIZE];
+#endif
+
+unsigned short usStack[5][32];
+
+/* spin for ullCycles of work, counting only the time this task ran */
+static void Spin(unsigned long long ullCycles, volatile unsigned long long *pullWork)
+{
+	unsigned long long ullGap = (unsigned long long)(BENCH_GAP_US*dBenchCyclesPerUs);
+	unsigned long long ullDone = 0;
+	unsigned long long ullLast = BRTOS_PortCycles();
+	unsigned long long ullNow;
+
+	while(ullDone < ullCycles)
+	{
+		ullNow = BRTOS_PortCycles();
+		if(ullNow - ullLast < ullGap)
+			ullDone += ullNow - ullLast;
+		ullLast = ullNow;
+	}
+
+	*pullWork += ullDone;
+}
+
+static void task_load(unsigned long ulArg)
+{
+	int iLoad = iNextLoad++;
+
+	(void) ulArg;
+
+	aucLoad[iLoad] = BRTOS_GetCurrentTask();
+
+	while(!iLoadDone)
+	{
+		Spin((unsigned long long)(ausBusy[iLoad]*1000*dBenchCyclesPerUs), &aullWork[iLoad]);
+		BRTOS_Sleep(ausSleep[iLoad]);
+	}
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+static void task_yield_a(unsigned long ulArg)
+{
+	unsigned long long ullBeg;
+	int i;
+
+	(void) ulArg;
+
+	while(!iLoadDone)
+		BRTOS_Sleep(10);
+
+	for(i = 0 ; i < BENCH_ROUNDS ; i++)
+	{
+		ullBeg = BRTOS_PortCycles();
+		BRTOS_Yield();
+		BENCH_Add(&sYield, BRTOS_PortCycles() - ullBeg);
+	}
+	iYieldDone = 1;
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+static void task_yield_b(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	while(!iLoadDone)
+		BRTOS_Sleep(10);
+
+	while(!iYieldDone)
+		BRTOS_Yield();
+
+	for(;;)
+		BRTOS_Sleep(1000);
+}
+
+static void task_control(unsigned long ulArg)
+{
+#if BRTOS_CPU_STATS
+	unsigned long aulBeg[BENCH_LOADS + 1], aulEnd[BENCH_LOADS + 1];
+	unsigned long long aullWorkBeg[BENCH_LOADS];
+	unsigned long ulSwitches;
+	unsigned long long ullWall;
+	double dTotal = 0;
+	int i;
+#endif
+#if BRTOS_TRACE
+	unsigned short usBytes;
+	FILE *psFile;
+#endif
+	unsigned long long ullBeg;
+
+	(void) ulArg;
+
+	/* let the loads start */
+	BRTOS_Sleep(20);
+
+#if BRTOS_CPU_STATS
+	for(i = 0 ; i < BENCH_LOADS ; i++)
+	{
+		BRTOS_TaskStats(aucLoad[i], &aulBeg[i], &ulSwitches);
+		aullWorkBeg[i] = aullWork[i];
+	}
+	BRTOS_TaskStats(BRTOS_TASK_IDLE, &aulBeg[i], &ulSwitches);
+#endif
+#if BRTOS_TRACE
+	BRTOS_TraceDump(aucDump, 0);
+#endif
+	ullBeg = BRTOS_PortCycles();
+
+	BRTOS_Sleep(BENCH_TIME_MS);
+
+#if BRTOS_TRACE
+	usBytes = BRTOS_TraceDump(aucDump, sizeof(aucDump));
+#endif
+#if BRTOS_CPU_STATS
+	ullWall = BRTOS_PortCycles() - ullBeg;
+	for(i = 0 ; i < BENCH_LOADS ; i++)
+		BRTOS_TaskStats(aucLoad[i], &aulEnd[i], &ulSwitches);
+	BRTOS_TaskStats(BRTOS_TASK_IDLE, &aulEnd[i], &ulSwitches);
+#endif
+
+	iLoadDone = 1;
+	while(!iYieldDone)
+		BRTOS_Sleep(10);
+
+	DisableInterrupts();
+
+#if BRTOS_CPU_STATS
+	printf("CPU usage over %u ms (statistics against the work measured by each task)\n", BENCH_TIME_MS);
+	for(i = 0 ; i < BENCH_LOADS ; i++)
+	{
+		printf("load %u ms every %u ms: %6.2f %% (task measured %6.2f %%)\n", ausBusy[i], ausBusy[i] + ausSleep[i],
+		       100.0*(aulEnd[i] - aulBeg[i])/ullWall, 100.0*(aullWork[i] - aullWorkBeg[i])/ullWall);
+		dTotal += 100.0*(aulEnd[i] - aulBeg[i])/ullWall;
+	}
+	printf("idle: %6.2f %%, control and kernel: %6.2f %%\n", 100.0*(aulEnd[i] - aulBeg[i])/ullWall,
+	       100.0 - dTotal - 100.0*(aulEnd[i] - aulBeg[i])/ullWall);
+#else
+	(void) ullBeg;
+	printf("CPU statistics and trace disabled\n");
+#endif
+#if BRTOS_TRACE
+	psFile = fopen("bench/trace.bin", "wb");
+	if(psFile)
+	{
+		fwrite(aucDump, 1, usBytes, psFile);
+		fclose(psFile);
+	}
+	printf("trace: %u records in bench/trace.bin, decode with tools/tracedecode -hz %.0f bench/trace.bin\n",
+	       (usBytes - BRTOS_TRACE_HEADER_SIZE)/BRTOS_TRACE_RECORD_SIZE, dBenchCyclesPerUs*1e6);
+#endif
+	BENCH_Report(&sYield, 0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	int i;
+
+	BENCH_Calibrate();
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	for(i = 0 ; i < BENCH_LOADS ; i++)
+		BRTOS_CreateTask(task_load, usStack[i + 1], sizeof(usStack[i + 1]), 10, 1 << (i + 1));
+	BRTOS_CreateTask(task_yield_a, usStack[3], sizeof(usStack[3]), 10, BRTOS_TASK_PRIORITY_4);
+	BRTOS_CreateTask(task_yield_b, usStack[4], sizeof(usStack[4]), 10, BRTOS_TASK_PRIORITY_4);
+}
@@ -0,0 +1,216 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   bench_waitany.c
+
+Multi object wait benchmark (POSIX port, kernel built with BRTOS_WAIT_ANY).
+A gateway task reacts to three sources fed by a device interrupt every 
+BENCH_DEVICE_US (each interrupt feeds one of them, or none, in turn): a ring
+buffer (radio packets), a semaphore (UART frames) and event flags 
+(configuration). The gateway is written in two ways:
+
+- polling: it checks each source without waiting and sleeps 1 ms when 
+  none is ready (BRTOS_Sleep() loop)
+- BRTOS_WaitAny(): it blocks once on the three sources, with a timeout
+
+The device is quiet during the last BENCH_QUIET_MS of each phase. For each 
+gateway, the latency from the interrupt feeding a source to the gateway 
+taking it, the gateway wake ups and timeouts and the CPU time used per event
+(all tasks and interrupts, idle excluded) are reported.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_PHASE_MS     1000
+#define BENCH_QUIET_MS     200
+#define BENCH_DEVICE_US    700
+#define BENCH_NUM_SAMPLES  4096
+#define BENCH_PHASES       2
+#define BENCH_SOURCES      3
+#define BENCH_CONFIG_FLAG  0x0001
+
+static unsigned long long aaullLatency[BENCH_PHASES][BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES asLatency[BENCH_PHASES] = {
+	BENCH_SAMPLES_INIT("polling (1 ms sleep)", aaullLatency[0]),
+	BENCH_SAMPLES_INIT("BRTOS_WaitAny()", aaullLatency[1]),
+};
+
+static BRTOS_RING  sRadio;
+static BRTOS_SEM   sUart;
+static BRTOS_EVENT sConfig;
+static unsigned char aucRadio[16];
+
+static BRTOS_WAIT_NODE asWait[BENCH_SOURCES] = {
+	BRTOS_WAIT_RING(&sRadio), 
+	BRTOS_WAIT_SEM(&sUart), 
+	BRTOS_WAIT_EVENT(&sConfig, BENCH_CONFIG_FLAG)
+};
+
+/* interrupt time of the oldest event not taken of each source */
+static unsigned long long aullStamp[BENCH_SOURCES];
+static unsigned long      aulEvents[BENCH_PHASES];
+static unsigned long      aulWakes[BENCH_PHASES];
+static unsigned long      aulTimeouts[BENCH_PHASES];
+static unsigned long long aullIdle[BENCH_PHASES];
+static unsigned long long aullTotal[BENCH_PHASES];
+static unsigned short     usSeq;
+static volatile int       iPhase = -1;
+
+unsigned short usStack[2][32];
+
+static void DeviceIsr(void)
+{
+	unsigned char ucByte = (unsigned char) usSeq;
+	int iSource = usSeq++ % (BENCH_SOURCES + 1);
+
+	if(iSource == BENCH_SOURCES)
+		return;
+
+	if(aullStamp[iSource] == 0)
+		aullStamp[iSource] = BRTOS_PortCycles();
+
+	BRTOS_ISR_Enter();
+	if(iSource == 0)
+		BRTOS_RingWriteFromISR(&sRadio, &ucByte, 1);
+	else if(iSource == 1)
+		BRTOS_SemGiveFromISR(&sUart);
+	else
+		BRTOS_EventSetFromISR(&sConfig, BENCH_CONFIG_FLAG);
+	BRTOS_ISR_Exit();
+}
+
+/*
+Take an event of a source without waiting.
+
+@return 1 if the source had an event
+*/
+static int Take(int iSource)
+{
+	unsigned char      aucData[sizeof(aucRadio)];
+	unsigned long long ullStamp;
+	int                iTaken;
+	int                iNow = iPhase;
+
+	if(iSource == 0)
+		iTaken = BRTOS_RingRead(&sRadio, aucData, sizeof(aucData)) > 0;
+	else if(iSource == 1)
+		iTaken = BRTOS_SemTake(&sUart, BRTOS_NO_WAIT) == BRTOS_SUCCESS;
+	else
+		iTaken = BRTOS_EventWait(&sConfig, BENCH_CONFIG_FLAG, BRTOS_EVENT_WAIT_ANY | BRTOS_EVENT_CLEAR, 0, BRTOS_NO_WAIT) == BRTOS_SUCCESS;
+
+	if(!iTaken)
+		return 0;
+
+	DisableInterrupts();
+	ullStamp = aullStamp[iSource];
+	aullStamp[iSource] = 0;
+	EnableInterrupts();
+
+	if(iNow >= 0 && iNow < BENCH_PHASES && ullStamp)
+	{
+		BENCH_Add(&asLatency[iNow], BRTOS_PortCycles() - ullStamp);
+		aulEvents[iNow]++;
+	}
+
+	return 1;
+}
+
+static void task_gateway(unsigned long ulArg)
+{
+	unsigned char ucReady;
+	int           i, iNow, iTaken;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		iNow = iPhase;
+
+		if(iNow == 0)
+		{
+			for(iTaken = 0, i = 0 ; i < BENCH_SOURCES ; i++)
+				iTaken |= Take(i);
+			if(!iTaken)
+				BRTOS_Sleep(1);
+		}
+		else if(iNow == 1)
+		{
+			if(BRTOS_WaitAny(asWait, BENCH_SOURCES, &ucReady, 50) == BRTOS_SUCCESS)
+				Take(ucReady);
+			else
+				aulTimeouts[iNow]++;
+		}
+		else
+		{
+			BRTOS_Sleep(1);
+			continue;
+		}
+
+		aulWakes[iNow]++;
+	}
+}
+
+static void task_control(unsigned long ulArg)
+{
+	unsigned long long ullStart, ullIdle;
+	int i;
+
+	(void) ulArg;
+
+	BRTOS_Sleep(10);
+
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+	{
+		ullIdle  = ullPortIdleCycles;
+		ullStart = BRTOS_PortCycles();
+		iPhase = i;
+		BRTOS_PortDeviceStart(DeviceIsr, BENCH_DEVICE_US);
+		BRTOS_Sleep(BENCH_PHASE_MS - BENCH_QUIET_MS);
+		BRTOS_PortDeviceStop();
+		BRTOS_Sleep(BENCH_QUIET_MS);
+		aullIdle[i]  = ullPortIdleCycles - ullIdle;
+		aullTotal[i] = BRTOS_PortCycles() - ullStart;
+	}
+
+	iPhase = BENCH_PHASES;
+	DisableInterrupts();
+
+	printf("device interrupt every %d us feeding a ring, a semaphore or event flags in turn\n", BENCH_DEVICE_US);
+	printf("event to gateway latency:\n");
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+		BENCH_Report(&asLatency[i], 0);
+	for(i = 0 ; i < BENCH_PHASES ; i++)
+		printf("%-22s: %lu events, %lu gateway wake ups (%lu timeouts), CPU %.2f us per event\n",
+		       asLatency[i].pcName, aulEvents[i], aulWakes[i], aulTimeouts[i],
+		       aulEvents[i] ? (aullTotal[i] - aullIdle[i])/dBenchCyclesPerUs/aulEvents[i] : 0.0);
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+
+	BRTOS_RingCreate(&sRadio, aucRadio, 1, sizeof(aucRadio), 1);
+	BRTOS_SemCreate(&sUart, 0, 0xFFFF);
+	BRTOS_EventCreate(&sConfig, 0);
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_gateway, usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+}
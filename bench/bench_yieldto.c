@@ -0,0 +1,169 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   bench_yieldto.c
+
+Direct handoff benchmark (POSIX port): ping pong between two pipeline stages
+of the same priority, sharing their level with a busy housekeeping task. The
+producer does 50 us of work, wakes up the consumer with a semaphore and goes
+on with 300 us of post processing before waiting for the answer. The consumer
+does 50 us of work, answers and waits for the next buffer. After each wake up,
+the stage does nothing special, calls BRTOS_Yield() or hands the CPU to the
+other stage with BRTOS_YieldTo() (one phase each).
+
+Without a handoff, the consumer waits for the end of the post processing and,
+behind the housekeeping task in the round robin, for a whole time slice.
+BRTOS_Yield() still lets the housekeeping task run first, BRTOS_YieldTo() 
+switches to the consumer at once (and back to the producer after the answer).
+The latency from the wake up to the consumer running and the rounds done in
+each phase are reported.
+*/
+
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_PHASE_MS     1000
+#define BENCH_NUM_SAMPLES  100000
+#define BENCH_WORK_US      50
+#define BENCH_POST_US      300
+
+static const char *apcMode[] = { "no handoff", "BRTOS_Yield()", "BRTOS_YieldTo()" };
+
+static unsigned long long aullLatency[3][BENCH_NUM_SAMPLES];
+
+static BENCH_SAMPLES asLatency[3] = {
+	BENCH_SAMPLES_INIT("wake up to consumer, no handoff", aullLatency[0]),
+	BENCH_SAMPLES_INIT("wake up to consumer, BRTOS_Yield()", aullLatency[1]),
+	BENCH_SAMPLES_INIT("wake up to consumer, BRTOS_YieldTo()", aullLatency[2]),
+};
+
+static BRTOS_SEM sBuffer;
+static BRTOS_SEM sAnswer;
+static volatile int iMode;
+static unsigned long long ullWake;
+static int iWakeMode;
+static unsigned long aulRounds[3];
+static double dLoopsPerUs;
+
+unsigned short usStack[4][32];
+
+static void Work(unsigned long ulUs)
+{
+	unsigned long i, n = (unsigned long)(ulUs*dLoopsPerUs);
+
+	for(i = 0 ; i < n ; i++)
+		__asm__ volatile("");
+}
+
+static void WorkCalibrate(void)
+{
+	unsigned long long ullBeg = BRTOS_PortCycles();
+	unsigned long i;
+
+	for(i = 0 ; i < 10000000 ; i++)
+		__asm__ volatile("");
+
+	dLoopsPerUs = 10000000.0*dBenchCyclesPerUs/(BRTOS_PortCycles() - ullBeg);
+}
+
+static void task_producer(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		Work(BENCH_WORK_US);
+
+		iWakeMode = iMode;
+		ullWake   = BRTOS_PortCycles();
+		BRTOS_SemGive(&sBuffer);
+		if(iWakeMode == 1)
+			BRTOS_Yield();
+		else if(iWakeMode == 2)
+			BRTOS_YieldTo(2);
+
+		Work(BENCH_POST_US);
+		BRTOS_SemTake(&sAnswer, BRTOS_WAIT_FOREVER);
+	}
+}
+
+static void task_consumer(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_SemTake(&sBuffer, BRTOS_WAIT_FOREVER);
+		BENCH_Add(&asLatency[iWakeMode], BRTOS_PortCycles() - ullWake);
+		aulRounds[iWakeMode]++;
+
+		Work(BENCH_WORK_US);
+		BRTOS_SemGive(&sAnswer);
+		if(iMode == 1)
+			BRTOS_Yield();
+		else if(iMode == 2)
+			BRTOS_YieldTo(1);
+	}
+}
+
+static void task_housekeeping(unsigned long ulArg)
+{
+	(void) ulArg;
+
+	for(;;)
+		;
+}
+
+static void task_control(unsigned long ulArg)
+{
+	int i;
+
+	(void) ulArg;
+
+	for(i = 0 ; i < 3 ; i++)
+	{
+		iMode = i;
+		BRTOS_Sleep(BENCH_PHASE_MS);
+	}
+
+	DisableInterrupts();
+
+	printf("pipeline ping pong, %d us of work per stage and %d us of post processing in the producer, "
+	       "one housekeeping task in the same level\n", BENCH_WORK_US, BENCH_POST_US);
+	for(i = 0 ; i < 3 ; i++)
+	{
+		printf("%-16s: %5lu rounds in %d ms\n", apcMode[i], aulRounds[i], BENCH_PHASE_MS);
+		BENCH_Report(&asLatency[i], 0);
+	}
+
+	BENCH_Exit();
+}
+
+void BRTOS_Application_Initialize(void)
+{
+	BENCH_Calibrate();
+	WorkCalibrate();
+
+	BRTOS_SemCreate(&sBuffer, 0, 1);
+	BRTOS_SemCreate(&sAnswer, 0, 1);
+
+	BRTOS_CreateTask(task_control, usStack[0], sizeof(usStack[0]), 10, BRTOS_TASK_PRIORITY_1);
+	BRTOS_CreateTask(task_producer, usStack[1], sizeof(usStack[1]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_consumer, usStack[2], sizeof(usStack[2]), 10, BRTOS_TASK_PRIORITY_2);
+	BRTOS_CreateTask(task_housekeeping, usStack[3], sizeof(usStack[3]), 10, BRTOS_TASK_PRIORITY_2);
+}
@@ -19,130 +19,472 @@ The views and conclusions contained in the software and documentation are those
 @author Marcelo Barros
 @date   20050416
 
-Initial stack organization for tasks:
+CPU dependent code (context switch, system tick and low power modes) is
+kept in ports, see \ref brtos_port.h.
 
-<pre>
-stack_addr 0xABCD      +------------------- +
-                       | BRTOS_TaskEnd addr | -> avoid problems with tasks that return
-           0xABCD - 2  +--------------------+
-                       |  Status Register   | -> points to stack_addr
-           0xABCD - 4  +--------------------+
-                       |  Program Counter   | -> points to entry_point
-           0xABCD - 6  +--------------------+
-                       |                    |
-                       |  Initial Context   | -> dummy values for work registers
-                       |                    |
-           0xABCD - 32 +--------------------+
-</pre>
-
-Register usage description:
-
-- R0: PC
-- R1: Stack Pointer
-- R2: Status/CG1
-- R3: CG2
-- R4-R15: Working registers
+Scheduling is done by priority levels. Each level has its own ready list
+and a bit in \ref ucNotEmptyLevel, so finding the next task is a lowest bit
+search plus a list head, independent of the number of tasks. Tasks in the 
+same level share the CPU in round robin, using their time slices.
 
-If you are using msp-gcc, it is possible to optimize 
-the context saving since R12, R13, R14, R15 are cloberred registers
-that only need to be saved in interrupt service routines.
-
-@todo Improvements in scheduler by adding priority capabilities
+Other policies are selected at compile time (\ref BRTOS_SCHED_POLICY): no time
+slices (first come first served inside each level), or a single level where
+priorities are ignored (plain round robin, or EDF for periodic tasks). Only
+the code of the selected policy is built.
 
 */
 
-#include <signal.h>
-#include <io.h>
+#include <string.h>
 #include "brtos.h"
 
-#define SaveContext() __asm__ __volatile__ ("push R3\n"  \
-                                            "push R4\n"  \
-                                            "push R5\n"  \
-                                            "push R6\n"  \
-                                            "push R7\n"  \
-                                            "push R8\n"  \
-                                            "push R9\n"  \
-                                            "push R10\n" \
-                                            "push R11\n" \
-                                            "push R12\n" \
-                                            "push R13\n" \
-                                            "push R14\n" \
-                                            "push R15" )
-
-#define RestoreContext() __asm__ __volatile__ (	"pop R15\n" \
-                                                "pop R14\n" \
-                                                "pop R13\n" \
-                                                "pop R12\n" \
-                                                "pop R11\n" \
-                                                "pop R10\n" \
-                                                "pop R9\n"  \
-                                                "pop R8\n"  \
-                                                "pop R7\n"  \
-                                                "pop R6\n"  \
-                                                "pop R5\n"  \
-                                                "pop R4\n"  \
-                                                "pop R3" )
-
-#define NUM_REGS_IN_CONTEXT   13
-#define SaveStackPointer()    asm("mov.w R1,%0"  : "=m" (asBrtosTasks[ucCurrentTask].pusStackPtr))
-#define RestoreStackPointer() asm("mov.w %0,R1" :: "m" (asBrtosTasks[ucCurrentTask].pusStackPtr))
-
-#define SaveSchedStackPointer()    asm("mov.w R1,%0"  : "=m" (usSchStackPtr))
-#define RestoreSchedStackPointer() asm("mov.w %0,R1" :: "m" (usSchStackPtr))
-
-/* changing a calling function stack into a interrupt stack */
-#define AdjustInterruptStack() __asm__ __volatile__ ( "decd R1\n"           \
-                                                      "mov.w 2(R1),0(R1)\n" \
-                                                      "mov.w R2,2(R1)")
-
-#define ReturnFromInterrupt()  asm("reti")
-#define GoToScheduler()        asm("br #BRTOS_Scheduler")
-
-/* RTOS scheduler function is allocated at watchdog interrupt */
-static interrupt (WDT_VECTOR)  BRTOS_Scheduler(void);
-
-/** array of TCBs used to control the tasks */
+/** Kernel state (see BRTOS_KERNEL): a static context, or the instance run by
+    the calling thread with BRTOS_INSTANCES. Its members are used through the
+    names below, like plain variables (ports use them too) */
+#if BRTOS_INSTANCES
+__thread BRTOS_KERNEL *psBrtosKernel;
+#define BRTOS_STATE            (*psBrtosKernel)
+#else
+static BRTOS_KERNEL sBrtosKernel;
+#define BRTOS_STATE            sBrtosKernel
+#endif
+
+/** array of TCBs used to control the tasks (with a static task table, it is
+    initialized at compile time after the port, see \ref asBrtosTaskConst) */
+#ifdef BRTOS_STATIC_TASKS
 static BRTOS_TCB      asBrtosTasks[BRTOS_MAX_TASKS];
+#else
+#define asBrtosTasks           (BRTOS_STATE.asBrtosTasks)
+#endif
 /** Number of tasks */
-static unsigned short usNumTasks;
+#ifdef BRTOS_STATIC_TASKS
+static const unsigned short usNumTasks = BRTOS_MAX_TASKS;
+#else
+#define usNumTasks             (BRTOS_STATE.usNumTasks)
+#endif
 /** Current priority level in execution */
-static unsigned char  ucCurrentPriLevel;
+#define ucCurrentPriLevel      (BRTOS_STATE.ucCurrentPriLevel)
 /** Current task under execution */
-static unsigned char  ucCurrentTask;
-/** Controls if there are tasks in a specific priority level 
-static unsigned char  ucNotEmptyLevel;*/
-/** Scheduler stack pointer */
-static unsigned short usSchStackPtr;
-/** Ticks per second for RTOS. Depends on clock source and 
-    interval timer configuration */
-unsigned short usTicksPerSecond;
+#define ucCurrentTask          (BRTOS_STATE.ucCurrentTask)
+/** Controls if there are tasks in a specific priority level (one bit per level) */
+#define ucNotEmptyLevel        (BRTOS_STATE.ucNotEmptyLevel)
+/** First task of the ready list of each priority level */
+#define aucReadyHead           (BRTOS_STATE.aucReadyHead)
+/** Last task of the ready list of each priority level */
+#define aucReadyTail           (BRTOS_STATE.aucReadyTail)
+/** First task of the sleep list, ordered by wake up time */
+#define ucSleepHead            (BRTOS_STATE.ucSleepHead)
+/** Timing wheel: a list of timers for each slot of each level */
+#define apsTimerWheel          (BRTOS_STATE.apsTimerWheel)
+/** Expired timers waiting for their callbacks, ordered by priority */
+#define psTimerPending         (BRTOS_STATE.psTimerPending)
+/** Next tick to be processed by the timing wheel */
+#define usTimerNext            (BRTOS_STATE.usTimerNext)
+/** Kernel time: ticks processed since the start (usTimerNext extended to 32 bits) */
+#define ulTicks                (BRTOS_STATE.ulTicks)
+/** Number of active timers */
+#define usActiveTimers         (BRTOS_STATE.usActiveTimers)
+/** Critical section nesting level */
+#define ucCriticalNesting      (BRTOS_STATE.ucCriticalNesting)
+/** Interrupt service routines nesting level (see \ref BRTOS_ISR_Enter()) */
+#define ucIsrNesting           (BRTOS_STATE.ucIsrNesting)
+/** Deferred work queue, see \ref BRTOS_Defer() */
+#define asDeferQueue           (BRTOS_STATE.asDeferQueue)
+/** Next deferred work to write and to run */
+#define ucDeferHead            (BRTOS_STATE.ucDeferHead)
+#define ucDeferTail            (BRTOS_STATE.ucDeferTail)
+/** Task running the deferred work */
+#define ucDeferTask            (BRTOS_STATE.ucDeferTask)
+/** Jobs with posted events, run by the deferred work task (see \ref BRTOS_JobPost()) */
+#define psJobHead              (BRTOS_STATE.psJobHead)
+#define psJobTail              (BRTOS_STATE.psJobTail)
+#ifndef BRTOS_STATIC_TASKS
+/** First free TCB (tasks that ended), linked through ucNext */
+#define ucFreeTask             (BRTOS_STATE.ucFreeTask)
+#endif
+/** Tasks waiting for the end of other tasks (see \ref BRTOS_TaskJoin()) */
+#define sJoinQueue             (BRTOS_STATE.sJoinQueue)
+/** Kernel time (port timestamp extended to unsigned long) and the port
+    timestamp when it was updated */
+#define ulTimeNow              (BRTOS_STATE.ulTimeNow)
+#define ulTimeRaw              (BRTOS_STATE.ulTimeRaw)
+#if BRTOS_CPU_STATS
+/** Time already charged to a task or to idle */
+#define ulStatsTime            (BRTOS_STATE.ulStatsTime)
+/** Time and times in idle */
+#define ulIdleTime             (BRTOS_STATE.ulIdleTime)
+#define ulIdleSwitches         (BRTOS_STATE.ulIdleSwitches)
+#endif
+#if BRTOS_TRACE
+/** Trace ring, next record to write and records in the ring */
+#define asTrace                (BRTOS_STATE.asTrace)
+#define usTraceNext            (BRTOS_STATE.usTraceNext)
+#define usTraceCount           (BRTOS_STATE.usTraceCount)
+/** Time of the last record */
+#define ulTraceTime            (BRTOS_STATE.ulTraceTime)
+#endif
+#if BRTOS_LATENCY_STATS
+/** Latency statistics (BRTOS_LATENCY_CRITICAL and BRTOS_LATENCY_WAKE) */
+#define asLatency              (BRTOS_STATE.asLatency)
+/** Start of the current critical section and its line (0: not measured) */
+#define ulCriticalStart        (BRTOS_STATE.ulCriticalStart)
+#define usCriticalLine         (BRTOS_STATE.usCriticalLine)
+/** Timestamp of the current tick processing (never 0) */
+#define ulTickTime             (BRTOS_STATE.ulTickTime)
+#endif
+#if BRTOS_IDLE_GOVERNOR
+/** Drivers needing each low power mode as the deepest one (BRTOS_IdleConstrain()) */
+#define aucIdleConstraints     (BRTOS_STATE.aucIdleConstraints)
+/** Sleeps and time (port timestamp units) in each low power mode */
+#define aulIdleEntries         (BRTOS_STATE.aulIdleEntries)
+#define aulIdleTime            (BRTOS_STATE.aulIdleTime)
+#endif
+/** Index of the lowest bit set for each nibble value */
+static const unsigned char aucLowestBit[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+
+/* task index of a created task that has not ended */
+#define TaskValid(ucTask) ((ucTask) < usNumTasks && asBrtosTasks[ucTask].ucTaskState != BRTOS_TASK_STATE_INVALID)
+
+#if BRTOS_LATENCY_STATS
+#define EnterCriticalSection() do { DisableInterrupts(); if(ucCriticalNesting++ == 0) BRTOS_CriticalBegin(__LINE__); } while(0)
+#define LeaveCriticalSection() do { if(--ucCriticalNesting == 0) { BRTOS_CriticalEnd(); EnableInterrupts(); } } while(0)
+#define CriticalEnd()          BRTOS_CriticalEnd()
+#else
+#define EnterCriticalSection() do { DisableInterrupts(); ucCriticalNesting++; } while(0)
+#define LeaveCriticalSection() do { if(--ucCriticalNesting == 0) EnableInterrupts(); } while(0)
+#define CriticalEnd()          ((void) 0)
+#endif
+
+#if BRTOS_CPU_STATS
+#define StatsCharge(pulTime)       BRTOS_StatsCharge(pulTime)
+#define StatsCount(ulCounter)      ((ulCounter)++)
+#else
+/* the kernel time must be updated at each scheduler run */
+#define StatsCharge(pulTime)       ((void) BRTOS_TimeNow())
+#define StatsCount(ulCounter)      ((void) 0)
+#endif
+
+#if BRTOS_TRACE
+#define TraceEvent(ucEvent, ucArg) BRTOS_TraceAdd(ucEvent, ucArg)
+#else
+#define TraceEvent(ucEvent, ucArg) ((void) 0)
+#endif
+
+#if BRTOS_WAIT_ANY
+#define WaitAnyInit(psQueue)       ((psQueue)->psAnyHead = 0)
+#define WaitAnyArmed(psQueue)      ((psQueue)->psAnyHead != 0)
+#define WaitAnyWake(psQueue)       do { if((psQueue)->psAnyHead) BRTOS_WaitAnyWake(psQueue); } while(0)
+#else
+#define WaitAnyInit(psQueue)       ((void) 0)
+#define WaitAnyArmed(psQueue)      0
+#define WaitAnyWake(psQueue)       ((void) 0)
+#endif
+
+#define TIMER_WHEEL_MASK       (BRTOS_TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_SHIFT(lvl) (BRTOS_TIMER_WHEEL_BITS*(lvl))
+
+/* CPU dependent code: it uses the kernel state declared above */
+#include "brtos_port.h"
+
+/* milliseconds to ticks (BRTOS_TICKS), resolved at compile time: a multiply 
+   (a shift for 2000 ticks/s) when the tick rate is a multiple of 1 kHz and a 
+   divide by a constant when it divides 1 kHz */
+#if BRTOS_PORT_TICKS_PER_SECOND % 1000 == 0
+#define MSEC_TO_TICKS(x) ((BRTOS_TICKS)(x)*(BRTOS_PORT_TICKS_PER_SECOND/1000))
+#elif 1000 % BRTOS_PORT_TICKS_PER_SECOND == 0
+#define MSEC_TO_TICKS(x) ((BRTOS_TICKS)(x)/(1000/BRTOS_PORT_TICKS_PER_SECOND))
+#else
+#define MSEC_TO_TICKS(x) ((BRTOS_TICKS)(x)*BRTOS_PORT_TICKS_PER_SECOND/1000)
+#endif
+
+#if BRTOS_IDLE_GOVERNOR
+#if BRTOS_PORT_IDLE_MODES > BRTOS_IDLE_MODES
+#error "the port has more low power modes than BRTOS_IDLE_MODES"
+#endif
+/** Low power modes of the port, lightest first */
+static const BRTOS_IDLE_MODE asIdleModes[BRTOS_PORT_IDLE_MODES] = BRTOS_PORT_IDLE_MODE_TABLE;
+#endif
+
+#ifdef BRTOS_STATIC_TASKS
+/* stack of each task, with its initial context already in place when the
+   port can generate it (BRTOS_PORT_STACK_INIT) */
+#define BRTOS_TASK_STACK(entry, stack, slice, pri) \
+	static unsigned short ausStack_##entry[BRTOS_PORT_STACK_WORDS(stack)] BRTOS_PORT_STACK_ATTR = \
+		BRTOS_PORT_STACK_INIT(entry, stack);
+#define BRTOS_TASK_CONST_INIT(entry, stack, slice, pri) \
+	{ entry, ausStack_##entry, BRTOS_PORT_STACK_WORDS(stack)*sizeof(unsigned short), \
+	  (unsigned short) MSEC_TO_TICKS(slice), pri },
+/* BRTOS_NO_TASK_TO_RUN counts the tasks with BRTOS_TASKS, which cannot be 
+   expanded again inside BRTOS_TASKS: the task indexes enum gives it */
+#define BRTOS_TASK_TCB_INIT(entry, stack, slice, pri) \
+	{ .ucLevel = BRTOS_PRIORITY_LEVEL(pri), .ucNext = BRTOS_ID_COUNT + 1,   \
+	  .ucTaskState = BRTOS_TASK_STATE_READY, .ucWaitNext = BRTOS_ID_COUNT + 1, \
+	  .pusStackPtr = &ausStack_##entry[BRTOS_PORT_STACK_WORDS(stack) - BRTOS_PORT_STACK_FRAME/sizeof(unsigned short)], \
+	  .ucWaitResult = BRTOS_SUCCESS, .ucNotifyState = BRTOS_NOTIFY_NONE },
+
+BRTOS_TASKS(BRTOS_TASK_STACK)
+
+/** Constant part of the tasks (entry point, priority, time slice and stack),
+    in flash. Tasks are ready to run at reset */
+static const BRTOS_TASK_CONST asBrtosTaskConst[BRTOS_MAX_TASKS] = { BRTOS_TASKS(BRTOS_TASK_CONST_INIT) };
+static BRTOS_TCB asBrtosTasks[BRTOS_MAX_TASKS] = { BRTOS_TASKS(BRTOS_TASK_TCB_INIT) };
+
+#define TaskConst(ucTask) (&asBrtosTaskConst[ucTask])
+#else
+#define TaskConst(ucTask) (&asBrtosTasks[ucTask])
+#endif
+
+/**
+Read the port timestamp and extend it to unsigned long. It must be called
+at least once per timestamp period: it is done at each scheduler run (every
+tick, or every wake up with tickless idle), with interrupts disabled.
+
+@return kernel time in port timestamp units
+*/
+static unsigned long BRTOS_TimeNow(void)
+{
+	unsigned long ulRaw = BRTOS_PortTimestamp();
+
+	ulTimeNow += (ulRaw - ulTimeRaw) & BRTOS_PORT_TIMESTAMP_MASK;
+	ulTimeRaw  = ulRaw;
+
+	return ulTimeNow;
+}
+
+#if BRTOS_CPU_STATS
+/**
+Charge the time elapsed since the last charge to a task or to idle.
+*/
+static void BRTOS_StatsCharge(unsigned long *pulTime)
+{
+	*pulTime   += BRTOS_TimeNow() - ulStatsTime;
+	ulStatsTime = ulTimeNow;
+}
+#endif
+
+#if BRTOS_LATENCY_STATS
+/**
+Add a sample to latency statistics: worst case and log2 histogram.
+*/
+static void BRTOS_LatencyAdd(BRTOS_LATENCY *psStats, unsigned long ulTime, unsigned short usWhere)
+{
+	unsigned char ucBucket = 0;
+
+	if(ulTime > psStats->ulMax)
+	{
+		psStats->ulMax   = ulTime;
+		psStats->usWhere = usWhere;
+	}
+
+	while((ulTime >>= 1) != 0 && ucBucket < BRTOS_LATENCY_BUCKETS - 1)
+		ucBucket++;
+
+	psStats->aulHistogram[ucBucket]++;
+}
+
+/**
+A critical section starts (interrupts just disabled, outermost level).
+*/
+static void BRTOS_CriticalBegin(unsigned short usLine)
+{
+	usCriticalLine  = usLine;
+	ulCriticalStart = BRTOS_PortTimestamp();
+}
+
+/**
+The outermost critical section ends: interrupts are enabled right after, or
+by the task resumed by a switch. Sections entered without 
+EnterCriticalSection() (initialization, interrupts) are not measured.
+*/
+static void BRTOS_CriticalEnd(void)
+{
+	if(usCriticalLine == 0)
+		return;
+
+	BRTOS_LatencyAdd(&asLatency[BRTOS_LATENCY_CRITICAL], 
+	                 (BRTOS_PortTimestamp() - ulCriticalStart) & BRTOS_PORT_TIMESTAMP_MASK, usCriticalLine);
+	usCriticalLine = 0;
+}
+#endif
+
+#if BRTOS_TRACE
+/**
+Write a record in the trace ring, overwriting the oldest one when full.
+*/
+static void BRTOS_TracePut(unsigned short usTime, unsigned char ucEvent, unsigned char ucArg)
+{
+	asTrace[usTraceNext].usTime  = usTime;
+	asTrace[usTraceNext].ucEvent = ucEvent;
+	asTrace[usTraceNext].ucArg   = ucArg;
+
+	usTraceNext = (usTraceNext + 1) & (BRTOS_TRACE_SIZE - 1);
+	if(usTraceCount < BRTOS_TRACE_SIZE)
+		usTraceCount++;
+}
+
+/**
+Trace an event (interrupts disabled). Records keep 16 bits of the time since 
+the previous one, longer intervals need an extra BRTOS_TRACE_ELAPSED record.
+*/
+static void BRTOS_TraceAdd(unsigned char ucEvent, unsigned char ucArg)
+{
+	unsigned long ulDelta = BRTOS_TimeNow() - ulTraceTime;
+
+	ulTraceTime = ulTimeNow;
+	if(ulDelta > 0xFFFF)
+	{
+		BRTOS_TracePut((unsigned short)(ulDelta >> 16), BRTOS_TRACE_ELAPSED, 
+		               (unsigned char)((ulDelta >> 16) >> 16));
+		ulDelta &= 0xFFFF;
+	}
+
+	BRTOS_TracePut((unsigned short) ulDelta, ucEvent, ucArg);
+}
+#endif
+
+/**
+Return the index of the lowest bit set in ucBits (ucBits can not be zero).
+Lower indexes mean higher priorities, so this is the highest priority level 
+in a levels bitmap.
+*/
+static unsigned char BRTOS_LowestBit(unsigned char ucBits)
+{
+	if(ucBits & 0x0F)
+		return aucLowestBit[ucBits & 0x0F];
+	else
+		return aucLowestBit[ucBits >> 4] + 4;
+}
+
+/* level of a priority and highest ready level (constant with a single level) */
+#if BRTOS_MAX_PRIORITY_LEVELS == 1
+#define PriorityLevel(pri)  0
+#define HighestLevel()      0
+#else
+#define PriorityLevel(pri)  BRTOS_LowestBit(pri)
+#define HighestLevel()      BRTOS_LowestBit(ucNotEmptyLevel)
+#endif
+
+#if BRTOS_EDF
+/**
+Check if a periodic task has to run before another task of the same level:
+the other task is not periodic or its absolute deadline is later.
+*/
+static int BRTOS_DeadlineBefore(unsigned char ucTask, unsigned char ucOther)
+{
+	BRTOS_TCB *psTask  = &asBrtosTasks[ucTask];
+	BRTOS_TCB *psOther = &asBrtosTasks[ucOther];
+
+	if(psOther->usPeriod == 0)
+		return 1;
+
+	return BRTOS_TICKS_BEFORE(psTask->ulRelease + psTask->usDeadline, 
+	                          psOther->ulRelease + psOther->usDeadline);
+}
+#endif
 
-static DisableInterrupts(void)
+/**
+Insert a task at the end of the ready list of its priority level. With EDF,
+periodic tasks are inserted before the first task with a later deadline, 
+tasks with the same deadline are kept in arrival order.
+*/
+static void BRTOS_ReadyInsert(unsigned char ucTask)
 {
-	dint();
+	unsigned char ucLevel = asBrtosTasks[ucTask].ucLevel;
+#if BRTOS_EDF
+	unsigned char ucPrev;
+	unsigned char ucNext;
+#endif
+
+	asBrtosTasks[ucTask].ucNext = BRTOS_NO_TASK_TO_RUN;
+
+#if BRTOS_EDF
+	if(asBrtosTasks[ucTask].usPeriod && (ucNotEmptyLevel & (1 << ucLevel)))
+	{
+		ucPrev = BRTOS_NO_TASK_TO_RUN;
+		for(ucNext = aucReadyHead[ucLevel] ; ucNext != BRTOS_NO_TASK_TO_RUN ; ucNext = asBrtosTasks[ucNext].ucNext)
+		{
+			if(BRTOS_DeadlineBefore(ucTask, ucNext))
+			{
+				asBrtosTasks[ucTask].ucNext = ucNext;
+				if(ucPrev == BRTOS_NO_TASK_TO_RUN)
+					aucReadyHead[ucLevel] = ucTask;
+				else
+					asBrtosTasks[ucPrev].ucNext = ucTask;
+				return;
+			}
+			ucPrev = ucNext;
+		}
+	}
+#endif
+
+	if(ucNotEmptyLevel & (1 << ucLevel))
+		asBrtosTasks[aucReadyTail[ucLevel]].ucNext = ucTask;
+	else
+	{
+		aucReadyHead[ucLevel] = ucTask;
+		ucNotEmptyLevel |= (1 << ucLevel);
+	}
+
+	aucReadyTail[ucLevel] = ucTask;
 }
 
-static EnableInterrupts(void)
+/**
+Insert a task at the beginning of the ready list of its priority level
+(running task changing its level or target of \ref BRTOS_YieldTo()).
+*/
+static void BRTOS_ReadyInsertHead(unsigned char ucTask)
 {
-	eint();
+	unsigned char ucLevel = asBrtosTasks[ucTask].ucLevel;
+
+	if(ucNotEmptyLevel & (1 << ucLevel))
+		asBrtosTasks[ucTask].ucNext = aucReadyHead[ucLevel];
+	else
+	{
+		asBrtosTasks[ucTask].ucNext = BRTOS_NO_TASK_TO_RUN;
+		aucReadyTail[ucLevel] = ucTask;
+		ucNotEmptyLevel |= (1 << ucLevel);
+	}
+
+	aucReadyHead[ucLevel] = ucTask;
 }
 
-#define MSEC_TO_TICKS(x) ((usTicksPerSecond*(x))/1000)
-#define TICKS_TO_MSEC(x) ((1000*(x))/usTicksPerSecond)
+/**
+Remove a task from the ready list of its priority level.
+The running task is the head of its list (unless an earlier deadline 
+arrived with EDF), so the common case (task going to sleep) does not 
+need any search.
+*/
+static void BRTOS_ReadyRemove(unsigned char ucTask)
+{
+	unsigned char ucLevel = asBrtosTasks[ucTask].ucLevel;
+	unsigned char ucPrev;
+
+	if(aucReadyHead[ucLevel] == ucTask)
+	{
+		aucReadyHead[ucLevel] = asBrtosTasks[ucTask].ucNext;
+		if(aucReadyHead[ucLevel] == BRTOS_NO_TASK_TO_RUN)
+			ucNotEmptyLevel &= ~(1 << ucLevel);
+		return;
+	}
 
-#define EnterCriticalSection() DisableInterrupts()
-#define LeaveCriticalSection() EnableInterrupts()
+	for(ucPrev = aucReadyHead[ucLevel] ; ucPrev != BRTOS_NO_TASK_TO_RUN ; ucPrev = asBrtosTasks[ucPrev].ucNext)
+	{
+		if(asBrtosTasks[ucPrev].ucNext == ucTask)
+		{
+			asBrtosTasks[ucPrev].ucNext = asBrtosTasks[ucTask].ucNext;
+			if(aucReadyTail[ucLevel] == ucTask)
+				aucReadyTail[ucLevel] = ucPrev;
+			break;
+		}
+	}
+}
 
 /**
-Generic function used to avoid a stack overflow when 
-a task returns.
+Called when a task returns from its entry point: the task ends
+(see \ref BRTOS_TaskExit()).
 */
 static void BRTOS_TaskEnd(void)
 {
-	EnterCriticalSection();
-	asBrtosTasks[ucCurrentTask].ucTaskState = BRTOS_TASK_STATE_TERMINATED;
-	LeaveCriticalSection();
-	while(1);
+	BRTOS_TaskExit();
 }
 
 /**
@@ -152,9 +494,7 @@ executed at each tick.
 */
 static void BRTOS_ConfigureClock(void)
 {
-	/* configuring interval timer */
-	WDTCTL = WDT_MDLY_0_5;
-	usTicksPerSecond = 1000/0.5; /* 2k ticks per second */	
+	BRTOS_PortConfigureTick();
 }
 
 /**
@@ -167,315 +507,3718 @@ static void BRTOS_Initialize(void)
 	/* initialize control variables */
 	ucCurrentPriLevel  = 0;
 	ucCurrentTask      = 0;
-	/*ucNotEmptyLevel    = 0;*/
+	ucNotEmptyLevel    = 0;
+	ucSleepHead        = BRTOS_NO_TASK_TO_RUN;
+#ifndef BRTOS_STATIC_TASKS
 	usNumTasks         = 0;
+#endif
+	psTimerPending     = 0;
+	usTimerNext        = (unsigned short) BRTOS_TICKS_START;
+	ulTicks            = BRTOS_TICKS_START;
+	usActiveTimers     = 0;
+	ucIsrNesting       = 0;
+	ucDeferHead        = 0;
+	ucDeferTail        = 0;
+	ucDeferTask        = BRTOS_NO_TASK_TO_RUN;
+	psJobHead          = 0;
+	psJobTail          = 0;
+#ifndef BRTOS_STATIC_TASKS
+	ucFreeTask         = BRTOS_NO_TASK_TO_RUN;
+#endif
+	sJoinQueue.ucHead  = BRTOS_NO_TASK_TO_RUN;
+	sJoinQueue.ucType  = BRTOS_WAITQ_JOIN;
+#if BRTOS_CPU_STATS
+	ulIdleTime         = 0;
+	ulIdleSwitches     = 0;
+#endif
+#if BRTOS_TRACE
+	usTraceNext        = 0;
+	usTraceCount       = 0;
+#endif
+
+	for(i = 0 ; i < BRTOS_TIMER_WHEEL_LEVELS*BRTOS_TIMER_WHEEL_SIZE; i++)
+		apsTimerWheel[i / BRTOS_TIMER_WHEEL_SIZE][i % BRTOS_TIMER_WHEEL_SIZE] = 0;
 
+	for(i = 0 ; i < BRTOS_MAX_PRIORITY_LEVELS; i++)
+	{
+		aucReadyHead[i] = BRTOS_NO_TASK_TO_RUN;
+		aucReadyTail[i] = BRTOS_NO_TASK_TO_RUN;
+	}
+
+#ifdef BRTOS_STATIC_TASKS
+	/* TCBs and stacks were initialized at compile time: tasks are only put
+	   in their ready lists (and given their stacks, on ports that cannot
+	   generate them) */
+	for(i = 0 ; i < BRTOS_MAX_TASKS; i++)
+	{
+		BRTOS_PortStaticStack(&asBrtosTasks[i], &asBrtosTaskConst[i]);
+		if(asBrtosTaskConst[i].pfEntryPoint == BRTOS_DeferTask)
+			ucDeferTask = i;
+		BRTOS_ReadyInsert(i);
+	}
+#else
 	/* initialize TCBs */
 	for(i = 0 ; i < BRTOS_MAX_TASKS; i++)
 	{
         asBrtosTasks[i].pfEntryPoint = 0;
         asBrtosTasks[i].pusStackBeg  = 0;
         asBrtosTasks[i].pusStackPtr  = 0;
+        asBrtosTasks[i].usStackSize  = 0;
         asBrtosTasks[i].usTimeSlice  = 0;
         asBrtosTasks[i].ucPriority   = 0;
+        asBrtosTasks[i].ucLevel      = 0;
+        asBrtosTasks[i].ucNext       = BRTOS_NO_TASK_TO_RUN;
         asBrtosTasks[i].ucTaskState  = BRTOS_TASK_STATE_INVALID;
-        asBrtosTasks[i].usSleepTicks = 0;
+        asBrtosTasks[i].ulSleepTicks = 0;
         asBrtosTasks[i].usTicks      = 0;		
+        asBrtosTasks[i].ucWaitNext   = BRTOS_NO_TASK_TO_RUN;
+        asBrtosTasks[i].ucWaitResult = BRTOS_SUCCESS;
+        asBrtosTasks[i].psWaitQueue  = 0;
+        asBrtosTasks[i].psMutexHeld  = 0;
+        asBrtosTasks[i].pvWaitData   = 0;
+        asBrtosTasks[i].usNotifyValue = 0;
+        asBrtosTasks[i].ucNotifyState = BRTOS_NOTIFY_NONE;
+#if BRTOS_LATENCY_STATS
+        asBrtosTasks[i].ulWakeTime   = 0;
+#endif
+#if BRTOS_CPU_STATS
+        asBrtosTasks[i].ulRunTime    = 0;
+        asBrtosTasks[i].ulSwitches   = 0;
+#endif
 	}
+#endif
 	
     /* Configure clock: depends on external clock and clock source 
      We are assuming a 1MHz clock and the source clock as MCLK */
     BRTOS_ConfigureClock();
-  
-    /* Do not waste time with priorities without associated tasks 
-    for(i = 0 ; i < usNumTasks ; i++)
-        ucNotEmptyLevel |= asBrtosTasks[i].ucPriority;
-    */
+
+    /* time starts now (the port timestamp runs after the clock configuration) */
+    ulTimeNow = 0;
+    ulTimeRaw = BRTOS_PortTimestamp();
+#if BRTOS_CPU_STATS
+    ulStatsTime = 0;
+#endif
+#if BRTOS_TRACE
+    ulTraceTime = 0;
+#endif
 }
 
 /**
-This scheduler users a round robin schema to 
-select tasks. If the time slice of current task is active, 
-return the current task. Otherwise, find the next ready task
-and return it. Priorities are not implemented, just the time slice feature.
+Priority scheduler. The running task has its tick counted and, if its 
+time slice is over, it goes to the end of the ready list of its level
+(round robin inside each level, no time slices with BRTOS_SCHED_PRIORITY). 
+After that, the head of the highest priority non empty level is selected. 
+A running task is preempted when a task with higher priority becomes ready,
+keeping its place (and its remaining time slice) at the head of its own level.
+
+The cost does not depend on the number of tasks: one bitmap search and
+a list head (only the list head with a single level).
 
-@param pri seach for task in this priority level (not used yet)
-@return next task to run
-@todo This function could be more efficient if implemented 
-      using pointers/lists instead array. Code first, optimize after.
-       
+@return next task to run or BRTOS_NO_TASK_TO_RUN
 */
-static int BRTOS_RoundRobin(int pri)
+static int BRTOS_RoundRobin(void)
 {
-	int i, j;
-	int task = BRTOS_NO_TASK_TO_RUN;
+#if BRTOS_SCHED_POLICY != BRTOS_SCHED_PRIORITY
+	BRTOS_TCB *psTask;
+#endif
+	unsigned char ucLevel;
+	unsigned char ucTask;
 
-	/* starting from last task since it is the preferred task */
-	/* last task must be the only task in running state ! */
-	for(i = ucCurrentTask, j = 0 ; j < usNumTasks; j++, i++)
+#if BRTOS_SCHED_POLICY != BRTOS_SCHED_PRIORITY
+	if(ucCurrentTask < usNumTasks)
 	{
-		if(i >= usNumTasks) 
-		  i = 0;
-
+		psTask = &asBrtosTasks[ucCurrentTask];
 		/* if running, increase tick and test time slice */
-		if(asBrtosTasks[i].ucTaskState == BRTOS_TASK_STATE_RUNNING)
+		if(psTask->ucTaskState == BRTOS_TASK_STATE_RUNNING)
 		{
-			asBrtosTasks[i].usTicks++;
-			if(asBrtosTasks[i].usTicks < asBrtosTasks[i].usTimeSlice)
-			{
-				/* time slice not reached yet: go on */
-				task = i;
-				break;
-			}
-			else 
+			psTask->usTicks++;
+			if(psTask->usTicks >= TaskConst(ucCurrentTask)->usTimeSlice)
 			{
-				/* time slice reached: allow other tasks to run */
-				asBrtosTasks[i].ucTaskState = BRTOS_TASK_STATE_READY;
-				continue;
+				/* time slice reached: allow other tasks of the same level to run */
+				psTask->usTicks = 0;
+				psTask->ucTaskState = BRTOS_TASK_STATE_READY;
+				if(aucReadyTail[psTask->ucLevel] != ucCurrentTask)
+				{
+					BRTOS_ReadyRemove(ucCurrentTask);
+					BRTOS_ReadyInsert(ucCurrentTask);
+				}
 			}
 		}
-		/* task in ready state ? */
-		if(asBrtosTasks[i].ucTaskState == BRTOS_TASK_STATE_READY)
-		{
-			asBrtosTasks[i].usTicks = 0;
-			asBrtosTasks[i].ucTaskState = BRTOS_TASK_STATE_RUNNING;
-			task = i;
-			break;
-		}
 	}
+#endif
+
+	if(ucNotEmptyLevel == 0)
+		return BRTOS_NO_TASK_TO_RUN;
 
-	return task;
+	ucLevel = HighestLevel();
+	ucTask  = aucReadyHead[ucLevel];
+
+	/* preempted by a task with higher priority */
+	if(ucTask != ucCurrentTask && ucCurrentTask < usNumTasks && 
+	   asBrtosTasks[ucCurrentTask].ucTaskState == BRTOS_TASK_STATE_RUNNING)
+		asBrtosTasks[ucCurrentTask].ucTaskState = BRTOS_TASK_STATE_READY;
+
+	asBrtosTasks[ucTask].ucTaskState = BRTOS_TASK_STATE_RUNNING;
+	ucCurrentPriLevel = ucLevel;
+
+	return ucTask;
 }
 
 /**
-Check timers and verify if is time to run
-the task scheduler. 
+Link a timer at the beginning of a list.
+*/
+static void BRTOS_TimerLink(BRTOS_TIMER **ppsList, BRTOS_TIMER *psTimer)
+{
+	psTimer->psNext = *ppsList;
+	if(*ppsList)
+		(*ppsList)->ppsPrev = &psTimer->psNext;
+	*ppsList = psTimer;
+	psTimer->ppsPrev = ppsList;
+}
 
-The system tick should be as small and possible, to provide
-a good timer resolution. Tasks, by their turn, use a bigger
-periodic timer, in general a multiple of system tick.
+/**
+Unlink a timer from its list (wheel slot or pending list).
+*/
+static void BRTOS_TimerUnlink(BRTOS_TIMER *psTimer)
+{
+	*psTimer->ppsPrev = psTimer->psNext;
+	if(psTimer->psNext)
+		psTimer->psNext->ppsPrev = psTimer->ppsPrev;
+	psTimer->psNext  = 0;
+	psTimer->ppsPrev = 0;
+}
+
+/**
+Put a timer in the timing wheel, according to its expiration tick.
 
-@retval 0 timers processed, do not run the task scheduler
-@retval 1 timers processed, run the task scheduler
+Timers expiring in less than BRTOS_TIMER_WHEEL_SIZE ticks go to the first
+level, one slot per tick. Others go to the upper levels, where each slot 
+covers BRTOS_TIMER_WHEEL_SIZE slots of the level below. When the level below
+completes a turn, the timers of the next upper slot are moved down (cascade).
 */
-static int BRTOS_ProcessTimers(void)
+static void BRTOS_TimerInsert(BRTOS_TIMER *psTimer)
 {
-    return 1;
+	unsigned short usDelta = psTimer->usExpire - usTimerNext;
+	unsigned char  ucLevel = 0;
+
+	while(ucLevel < BRTOS_TIMER_WHEEL_LEVELS - 1 && (usDelta >> TIMER_WHEEL_SHIFT(ucLevel+1)) != 0)
+		ucLevel++;
+
+	BRTOS_TimerLink(&apsTimerWheel[ucLevel][(psTimer->usExpire >> TIMER_WHEEL_SHIFT(ucLevel)) & TIMER_WHEEL_MASK], psTimer);
 }
+
 /**
-Check sleeping tasks and update their status.
-@todo may be optimized using a list of tasks in sleep state
+Process one tick of the timing wheel: cascade upper levels if the first 
+level completed a turn, expire the timers of the current slot and run 
+their callbacks, higher priorities first.
+
+Callbacks run in timer context (scheduler stack, interrupts disabled).
+They can use the timer API but must not sleep.
 */
-static int BRTOS_SleepTasks(void)
+static void BRTOS_TimerStep(void)
 {
-	int i;
+	BRTOS_TIMER   *psTimer;
+	BRTOS_TIMER   *psList;
+	BRTOS_TIMER  **ppsPos;
+	unsigned char  ucLevel;
+	unsigned short usSlot;
 
-	for(i = 0; i < usNumTasks; i++)
+	/* cascade: move timers from upper levels to the levels below */
+	for(ucLevel = 1 ; ucLevel < BRTOS_TIMER_WHEEL_LEVELS ; ucLevel++)
 	{
-		if(asBrtosTasks[i].ucTaskState == BRTOS_TASK_STATE_SLEEPING)
+		if(usTimerNext & ((1U << TIMER_WHEEL_SHIFT(ucLevel)) - 1))
+			break;
+
+		usSlot = (usTimerNext >> TIMER_WHEEL_SHIFT(ucLevel)) & TIMER_WHEEL_MASK;
+		psList = apsTimerWheel[ucLevel][usSlot];
+		apsTimerWheel[ucLevel][usSlot] = 0;
+
+		while(psList)
 		{
-            asBrtosTasks[i].usSleepTicks--;
-            if(asBrtosTasks[i].usSleepTicks == 0)
-                asBrtosTasks[i].ucTaskState = BRTOS_TASK_STATE_READY;
-        }
-    }
-}
+			psTimer = psList;
+			psList  = psList->psNext;
+			BRTOS_TimerInsert(psTimer);
+		}
+	}
 
-/**
-The scheduler function.
+	/* expired timers go to pending list, sorted by priority */
+	usSlot = usTimerNext & TIMER_WHEEL_MASK;
+	while((psTimer = apsTimerWheel[0][usSlot]) != 0)
+	{
+		BRTOS_TimerUnlink(psTimer);
 
-@todo there is a problem when this function is called by
-_Sleep(). We are assuming that this function is called 
-only by the system tick, that it is not true in this case.
-It seems that we really need a scheduler function in assembly,
-with at least three different entry points:
-- normal system tick processing, via interval timer
-- callings coming from kernel space (no context saving)
-- callings coming from user space (context saving)
+		for(ppsPos = &psTimerPending ; *ppsPos ; ppsPos = &(*ppsPos)->psNext)
+		{
+			if(BRTOS_LowestBit((*ppsPos)->ucPriority) > BRTOS_LowestBit(psTimer->ucPriority))
+				break;
+		}
+		BRTOS_TimerLink(ppsPos, psTimer);
+	}
 
-\dot
-digraph task_states {
-node [shape=circle];
-RDY -> RUN [label="next running period"]; 
-RUN -> RDY [label="time slice executed"]; 
+	usTimerNext++;
+
+	/* callbacks can start or stop timers, including pending ones */
+	ucCriticalNesting++;
+	while((psTimer = psTimerPending) != 0)
+	{
+		BRTOS_TimerUnlink(psTimer);
+
+		if(psTimer->usPeriod)
+		{
+			/* periodic timers do not drift: next expiration from the last one */
+			psTimer->usExpire += psTimer->usPeriod;
+			BRTOS_TimerInsert(psTimer);
+		}
+		else
+		{
+			psTimer->ucStatus = BRTOS_TIMER_STOPPED;
+			usActiveTimers--;
+		}
+
+		psTimer->pfEntryPoint(psTimer->ulArg);
+	}
+	ucCriticalNesting--;
 }
-\enddot
 
+/**
+Amount of next ticks that do not have any work for the timing wheel
+(no timers to expire or to cascade). Used to skip ticks after a 
+tickless sleep and to know how long it is possible to sleep.
+The cost depends on the wheel size, not on the number of timers.
+
+@return amount of ticks without timer processing
 */
-NAKED( BRTOS_Scheduler )
+static unsigned short BRTOS_TimerIdleTicks(void)
 {
-save_context_entry:
+	unsigned short usIdle = 0xFFFF;
+	unsigned short usSpan;
+	unsigned short usStart;
+	unsigned short usTicks;
+	unsigned char  ucLevel;
+	unsigned char  i;
 
-    SaveContext();
-    SaveStackPointer();
-    RestoreSchedStackPointer();
-  	
-dont_save_context_entry:
+	if(usActiveTimers == 0)
+		return usIdle;
 
-    /* Update timers */
-    BRTOS_ProcessTimers();
-    /* check sleeping tasks */
-    BRTOS_SleepTasks();
-    /* Get the next task to run */
-    ucCurrentTask = BRTOS_RoundRobin(ucCurrentPriLevel);
+	for(ucLevel = 0 ; ucLevel < BRTOS_TIMER_WHEEL_LEVELS ; ucLevel++)
+	{
+		/* first tick that processes (level 0) or cascades (upper levels) a slot in this level */
+		usSpan  = 1U << TIMER_WHEEL_SHIFT(ucLevel);
+		usStart = (usTimerNext + usSpan - 1) & ~(usSpan - 1);
 
-    if(ucCurrentTask == BRTOS_NO_TASK_TO_RUN)
-    {
-        /* nothing to do: sleep */
-        GoToLowPowerMode3();
-        goto dont_save_context_entry;
-    }
+		for(i = 0 ; i < BRTOS_TIMER_WHEEL_SIZE ; i++)
+		{
+			if(apsTimerWheel[ucLevel][((usStart >> TIMER_WHEEL_SHIFT(ucLevel)) + i) & TIMER_WHEEL_MASK])
+			{
+				usTicks = (unsigned short)(usStart + i*usSpan - usTimerNext);
+				if(usTicks < usIdle)
+					usIdle = usTicks;
+				break;
+			}
+		}
+	}
 
-    /* save scheduler context */
-    SaveSchedStackPointer();
-    /* restore stack pointer */
-    RestoreStackPointer();
-    /* restore other registers */
-    RestoreContext();	
-    /* reti will pop PC and Status from stack (naked function) */
-    EnableInterrupts();
-    ReturnFromInterrupt();
+	return usIdle;
 }
 
 /**
+Check timers, running callbacks of expired ones.
 
-Initialize RTOS and user application.
+The system tick should be as small and possible, to provide
+a good timer resolution. Tasks, by their turn, use a bigger
+periodic timer, in general a multiple of system tick.
+
+Start, stop and expiration are O(1). Ticks without timer work 
+are skipped at once when more than one tick elapsed (tickless idle).
 
+@param usElapsed amount of ticks elapsed since last call
 */
-int main(void)
+static void BRTOS_ProcessTimers(unsigned short usElapsed)
 {
-	/* Saving the current stack pointer. It will be used by the scheduler. */
-	SaveSchedStackPointer();
-  
-	EnterCriticalSection();
-	
-	/* initialize control structures and create all user tasks */
-	BRTOS_Initialize();
+	unsigned short usIdle;
 
-	/* call user initialization: you must create at least one thread */
-	BRTOS_Application_Initialize();
-	
-    /* the stack pointer should point to the first available task stack,
-     and the context should be subtracted. This way, the calling of
-     GoToScheduler will not fail
-    */
-    asBrtosTasks[ucCurrentTask].pusStackPtr += NUM_REGS_IN_CONTEXT;
-    RestoreStackPointer();
+	while(usElapsed > 1)
+	{
+		usIdle = BRTOS_TimerIdleTicks();
+		if(usIdle >= usElapsed)
+		{
+			usTimerNext += usElapsed;
+			return;
+		}
+		usTimerNext += usIdle;
+		usElapsed   -= usIdle + 1;
+		BRTOS_TimerStep();
+	}
 
-    LeaveCriticalSection();
-    /* go to to scheduler routine*/
-    GoToScheduler();
+	if(usElapsed)
+		BRTOS_TimerStep();
 }
 
 /**
-Create a new task.
-
-@param entry_point Task entry point. It should be a function that follows \ref pfTaskEntry.
-@param stack_addr  Start address for task stack. Remember: MSP stacks go downword and it points
-                   to a valid position. 
-@param time_slice Task time slice, specified in ms.
-@param pri        Task priority.
+Put a task in the sleep list. The list is ordered by wake up time and each
+task keeps in ulSleepTicks only the difference to the previous task in the
+list (delta list), so the tick processing only needs to check the first 
+task. Tasks with the same wake up time are kept in arrival order.
 
-@retval BRTOS_NO_ROOM_IN_TCB_ARRAY The task could not be created (no room in TCB array)
-@retval BRTOS_SUCCESS The task was created sucessfully.
+@param ucTask  task to put to sleep
+@param ulDelay amount of ticks to sleep
 */
-int BRTOS_CreateTask(pfTaskEntry entry_point, unsigned short stack_addr, int time_slice, int pri)
+static void BRTOS_SleepInsert(unsigned char ucTask, BRTOS_TICKS ulDelay)
 {
-    int i;
-	EnterCriticalSection();
-	
-	if(usNumTasks >= BRTOS_MAX_TASKS)
-		return BRTOS_NO_ROOM_IN_TCB_ARRAY;
+	unsigned char ucPrev = BRTOS_NO_TASK_TO_RUN;
+	unsigned char ucNext = ucSleepHead;
 
-	asBrtosTasks[usNumTasks].pfEntryPoint     = entry_point;
-	asBrtosTasks[usNumTasks].pusStackBeg      = (unsigned short *) stack_addr;
-	asBrtosTasks[usNumTasks].pusStackPtr      = (unsigned short *) stack_addr;
-	asBrtosTasks[usNumTasks].usTimeSlice      = MSEC_TO_TICKS(time_slice);
-	asBrtosTasks[usNumTasks].ucPriority       = pri;
-	asBrtosTasks[usNumTasks].ucTaskState      = BRTOS_TASK_STATE_READY;
-	asBrtosTasks[usNumTasks].usSleepTicks     = 0;
-	asBrtosTasks[usNumTasks].usTicks          = 0;
-
-	/* if task returns some day, prepare stack */
-	*(asBrtosTasks[usNumTasks].pusStackPtr) = (unsigned short) BRTOS_TaskEnd;
-	asBrtosTasks[usNumTasks].pusStackPtr -=1;
-	
-	/* status register and program counter */
-	*(asBrtosTasks[usNumTasks].pusStackPtr) = (unsigned short) 0;
-	asBrtosTasks[usNumTasks].pusStackPtr -=1;
-	*(asBrtosTasks[usNumTasks].pusStackPtr) = (unsigned short) entry_point;
-	asBrtosTasks[usNumTasks].pusStackPtr -=1;
-	
-    /* prepare for first RestoreContext(): dummy NUM_REGS_IN_CONTEXT regs */
-    for(i = 0 ; i < NUM_REGS_IN_CONTEXT ; i++)
-    {
-        *(asBrtosTasks[usNumTasks].pusStackPtr) = (unsigned short) 0;
-        asBrtosTasks[usNumTasks].pusStackPtr -= 1;
-    }
+	while(ucNext != BRTOS_NO_TASK_TO_RUN && asBrtosTasks[ucNext].ulSleepTicks <= ulDelay)
+	{
+		ulDelay -= asBrtosTasks[ucNext].ulSleepTicks;
+		ucPrev   = ucNext;
+		ucNext   = asBrtosTasks[ucNext].ucNext;
+	}
 
-	usNumTasks++;
-	
-	LeaveCriticalSection();
-	
-	return BRTOS_SUCCESS;
+	asBrtosTasks[ucTask].ulSleepTicks = ulDelay;
+	asBrtosTasks[ucTask].ucNext       = ucNext;
+
+	if(ucNext != BRTOS_NO_TASK_TO_RUN)
+		asBrtosTasks[ucNext].ulSleepTicks -= ulDelay;
+
+	if(ucPrev == BRTOS_NO_TASK_TO_RUN)
+		ucSleepHead = ucTask;
+	else
+		asBrtosTasks[ucPrev].ucNext = ucTask;
 }
 
 /**
-Put the calling task to sleep (kernel level).
+Remove a task from the sleep list (woken up before its timeout). 
+Its remaining ticks are given to the next task in the list.
+*/
+static void BRTOS_SleepRemove(unsigned char ucTask)
+{
+	unsigned char ucPrev = BRTOS_NO_TASK_TO_RUN;
+	unsigned char ucNext = ucSleepHead;
 
-It is necessary to prepare the return stack and call the scheduler again.
-This function cannot be called from a non task routine, otherwise it will
-put the current task in execution to sleep.
+	while(ucNext != ucTask)
+	{
+		ucPrev = ucNext;
+		ucNext = asBrtosTasks[ucNext].ucNext;
+	}
 
-Stack structure after calling:
-<pre>
-                    +------------------- +
-                    |        ...         | -> other values in task stack
-                    +--------------------+
-                    |  Program Counter   | -> return address, (just after RTOS_Sleep)
-  stack_pointer ->  +--------------------+
-</pre>
-Stack before calling scheduler should be similar to the
-schedule prepared for a reti instruction:
-<pre>
-                    +------------------- +
-                    |        ...         | -> other values in task stack
-                    +--------------------+
-                    |  Status Register   | -> Satus register must be saved 
-                    +--------------------+
-                    |  Program Counter   | -> return address (just after RTOS_Sleep)
-  stack_pointer ->  +--------------------+
-</pre>
+	ucNext = asBrtosTasks[ucTask].ucNext;
+	if(ucNext != BRTOS_NO_TASK_TO_RUN)
+		asBrtosTasks[ucNext].ulSleepTicks += asBrtosTasks[ucTask].ulSleepTicks;
+
+	if(ucPrev == BRTOS_NO_TASK_TO_RUN)
+		ucSleepHead = ucNext;
+	else
+		asBrtosTasks[ucPrev].ucNext = ucNext;
+
+	asBrtosTasks[ucTask].ulSleepTicks = 0;
+}
+
+#if BRTOS_CPU_BUDGETS
+/**
+Give the whole budget back if its period ended and return the ticks left in 
+the current period. When a whole period passed unused, the new period starts
+now (no 32 bits division in the tick interrupt, nothing was owed anyway).
 */
-NAKED( _Sleep )
+static unsigned short BRTOS_BudgetLeft(BRTOS_BUDGET *psBudget)
 {
-    /* reorganizing stack: PC@SP -> SR@(SP+2),PC@SP and saving context */
-    AdjustInterruptStack();
-    //SaveContext(); /* next operation will change the registers, so its 
-    //                necessary to save them */
-    /* setting task state */
-    GoToScheduler();
+	if(BRTOS_TICKS_REACHED(ulTicks, psBudget->ulStart + psBudget->usPeriod))
+	{
+		psBudget->ulStart += psBudget->usPeriod;
+		if(BRTOS_TICKS_REACHED(ulTicks, psBudget->ulStart + psBudget->usPeriod))
+			psBudget->ulStart = ulTicks;
+		psBudget->usLeft = psBudget->usBudget;
+	}
+
+	return psBudget->usLeft;
 }
 
 /**
-Put the calling task to sleep (user level).
-
-@param usTime Amount of time to sleep in milliseconds
+Throttle a ready or running task whose budget is used up: it sleeps until the 
+next period of its budget, so the tick processing makes it ready again.
 */
-void BRTOS_Sleep(unsigned short usTime)
+static void BRTOS_BudgetThrottle(unsigned char ucTask)
 {
+	BRTOS_BUDGET *psBudget = asBrtosTasks[ucTask].psBudget;
 
-    unsigned short t = MSEC_TO_TICKS(usTime);
-    if(t == 0)
-        return;
-        
-    DisableInterrupts();
+	asBrtosTasks[ucTask].ucTaskState = BRTOS_TASK_STATE_SLEEPING;
+	asBrtosTasks[ucTask].usTicks     = 0;
+	BRTOS_ReadyRemove(ucTask);
+	BRTOS_SleepInsert(ucTask, psBudget->ulStart + psBudget->usPeriod - ulTicks);
+	TraceEvent(BRTOS_TRACE_SLEEP, ucTask);
+}
 
-    /* put the task to sleep */
-    asBrtosTasks[ucCurrentTask].usSleepTicks = t;
-    asBrtosTasks[ucCurrentTask].ucTaskState  = BRTOS_TASK_STATE_SLEEPING;
+/**
+Charge the tick to the budget of the running task (tick interrupt). The task
+is throttled when the last tick of the budget is used.
+*/
+static void BRTOS_BudgetCharge(unsigned char ucTask)
+{
+	BRTOS_BUDGET *psBudget = asBrtosTasks[ucTask].psBudget;
+
+	if(psBudget == 0 || BRTOS_BudgetLeft(psBudget) == 0)
+		return;
+
+	psBudget->ulUsed++;
+	if(--psBudget->usLeft == 0)
+	{
+		psBudget->usThrottles++;
+		BRTOS_BudgetThrottle(ucTask);
+	}
+}
+
+/**
+Select the next task, throttling the ones whose budget was used up by other 
+tasks of their group.
+
+@return next task to run or BRTOS_NO_TASK_TO_RUN
+*/
+static int BRTOS_BudgetSelect(void)
+{
+	int iTask;
+
+	while((iTask = BRTOS_RoundRobin()) != BRTOS_NO_TASK_TO_RUN &&
+	      asBrtosTasks[iTask].psBudget && BRTOS_BudgetLeft(asBrtosTasks[iTask].psBudget) == 0)
+		BRTOS_BudgetThrottle(iTask);
+
+	return iTask;
+}
+#define BRTOS_NextTask()  BRTOS_BudgetSelect()
+#else
+#define BRTOS_NextTask()  BRTOS_RoundRobin()
+#endif
+
+/**
+Insert a task in a wait queue, after the tasks with the same or higher 
+priority (FIFO inside each priority level).
+*/
+static void BRTOS_WaitInsert(BRTOS_WAITQ *psQueue, unsigned char ucTask)
+{
+	unsigned char *pucLink = &psQueue->ucHead;
+
+	while(*pucLink != BRTOS_NO_TASK_TO_RUN && asBrtosTasks[*pucLink].ucLevel <= asBrtosTasks[ucTask].ucLevel)
+		pucLink = &asBrtosTasks[*pucLink].ucWaitNext;
+
+	asBrtosTasks[ucTask].ucWaitNext = *pucLink;
+	*pucLink = ucTask;
+}
+
+/**
+Remove a task from a wait queue.
+*/
+static void BRTOS_WaitUnlink(BRTOS_WAITQ *psQueue, unsigned char ucTask)
+{
+	unsigned char *pucLink = &psQueue->ucHead;
+
+	while(*pucLink != ucTask)
+		pucLink = &asBrtosTasks[*pucLink].ucWaitNext;
+
+	*pucLink = asBrtosTasks[ucTask].ucWaitNext;
+	asBrtosTasks[ucTask].ucWaitNext = BRTOS_NO_TASK_TO_RUN;
+}
+
+/**
+Priority inheritance: a task runs at its own priority or at the priority of
+the highest priority task waiting for a mutex it holds. The effective level 
+of ucTask is computed again and, when it changes, the task is moved in its 
+ready list or wait queue. If it is waiting for a mutex, the owner of this
+mutex is updated too (chain of blocked owners).
+*/
+static void BRTOS_UpdateLevel(unsigned char ucTask)
+{
+	BRTOS_TCB    *psTask;
+	BRTOS_MUTEX  *psMutex;
+	BRTOS_WAITQ  *psQueue;
+	unsigned char ucLevel;
+
+	while(ucTask != BRTOS_NO_TASK_TO_RUN)
+	{
+		psTask  = &asBrtosTasks[ucTask];
+		ucLevel = PriorityLevel(TaskConst(ucTask)->ucPriority);
+
+		for(psMutex = psTask->psMutexHeld ; psMutex ; psMutex = psMutex->psNextHeld)
+		{
+			if(psMutex->sQueue.ucHead != BRTOS_NO_TASK_TO_RUN && 
+			   asBrtosTasks[psMutex->sQueue.ucHead].ucLevel < ucLevel)
+				ucLevel = asBrtosTasks[psMutex->sQueue.ucHead].ucLevel;
+		}
+
+		if(ucLevel == psTask->ucLevel)
+			return;
+
+		ucTask = BRTOS_NO_TASK_TO_RUN;
+
+		if(psTask->ucTaskState & (BRTOS_TASK_STATE_READY | BRTOS_TASK_STATE_RUNNING))
+		{
+			BRTOS_ReadyRemove(psTask - asBrtosTasks);
+			psTask->ucLevel = ucLevel;
+			/* the running task is kept at the head of its list */
+			if(psTask->ucTaskState == BRTOS_TASK_STATE_RUNNING)
+				BRTOS_ReadyInsertHead(psTask - asBrtosTasks);
+			else
+				BRTOS_ReadyInsert(psTask - asBrtosTasks);
+		}
+		else if((psTask->ucTaskState & BRTOS_TASK_STATE_WAITING) && psTask->psWaitQueue)
+		{
+			psQueue = psTask->psWaitQueue;
+			BRTOS_WaitUnlink(psQueue, psTask - asBrtosTasks);
+			psTask->ucLevel = ucLevel;
+			BRTOS_WaitInsert(psQueue, psTask - asBrtosTasks);
+
+			if(psQueue->ucType == BRTOS_WAITQ_MUTEX)
+				ucTask = ((BRTOS_MUTEX *) psQueue)->ucOwner;
+		}
+		else
+			psTask->ucLevel = ucLevel;
+	}
+}
+
+#if BRTOS_WAIT_ANY
+/* wait of a task in BRTOS_WaitAny(), kept in its stack. The task waits alone 
+   in sQueue, so timeouts, deletion and priority changes work as for objects */
+typedef struct {
+	BRTOS_WAITQ      sQueue;          /* first: the nodes point to it     */
+	BRTOS_WAIT_NODE *asNodes;         /* objects waited for               */
+	unsigned char    ucNumNodes;
+	BRTOS_WAIT_NODE *psReady;         /* node of the object that woke up the task */
+} BRTOS_ANY_WAITER;
+
+/**
+Remove the wait nodes of a task from their objects (interrupts disabled). 
+Nodes already removed are skipped.
+*/
+static void BRTOS_WaitAnyDisarm(BRTOS_ANY_WAITER *psWait)
+{
+	BRTOS_WAIT_NODE *psNode;
+
+	for(psNode = psWait->asNodes ; psNode < psWait->asNodes + psWait->ucNumNodes ; psNode++)
+	{
+		if(psNode->ppsPrev == 0)
+			continue;
+
+		*psNode->ppsPrev = psNode->psNext;
+		if(psNode->psNext)
+			psNode->psNext->ppsPrev = psNode->ppsPrev;
+		psNode->ppsPrev = 0;
+	}
+}
+#endif
+
+/**
+Remove a waiting task from its wait queue (timeout). If the queue belongs to
+a mutex, the priority of the owner may be lower now.
+*/
+static void BRTOS_WaitRemove(unsigned char ucTask)
+{
+	BRTOS_WAITQ *psQueue = asBrtosTasks[ucTask].psWaitQueue;
+
+	/* waiting for a notification, not in a queue */
+	if(psQueue == 0)
+	{
+		asBrtosTasks[ucTask].ucNotifyState = BRTOS_NOTIFY_NONE;
+		return;
+	}
+
+	BRTOS_WaitUnlink(psQueue, ucTask);
+	asBrtosTasks[ucTask].psWaitQueue = 0;
+
+	if(psQueue->ucType == BRTOS_WAITQ_MUTEX)
+		BRTOS_UpdateLevel(((BRTOS_MUTEX *) psQueue)->ucOwner);
+#if BRTOS_WAIT_ANY
+	else if(psQueue->ucType == BRTOS_WAITQ_ANY)
+		BRTOS_WaitAnyDisarm((BRTOS_ANY_WAITER *) psQueue);
+#endif
+}
+
+/**
+End the wait of a task already removed from its wait queue: it 
+leaves the sleep list (timeout) and becomes ready.
+*/
+static void BRTOS_WaitEnd(unsigned char ucTask)
+{
+	BRTOS_TCB *psTask = &asBrtosTasks[ucTask];
+
+	psTask->ucWaitNext  = BRTOS_NO_TASK_TO_RUN;
+	psTask->psWaitQueue = 0;
+
+	if(psTask->ucTaskState & BRTOS_TASK_STATE_SLEEPING)
+		BRTOS_SleepRemove(ucTask);
+
+	psTask->ucWaitResult = BRTOS_SUCCESS;
+	psTask->ucTaskState  = BRTOS_TASK_STATE_READY;
+	psTask->usTicks      = 0;
+	BRTOS_ReadyInsert(ucTask);
+	TraceEvent(BRTOS_TRACE_WAKE, ucTask);
+}
+
+/**
+Wake up the first task of a wait queue (it must not be empty).
+
+@return woken task
+*/
+static unsigned char BRTOS_WaitWake(BRTOS_WAITQ *psQueue)
+{
+	unsigned char ucTask = psQueue->ucHead;
+
+	psQueue->ucHead = asBrtosTasks[ucTask].ucWaitNext;
+	BRTOS_WaitEnd(ucTask);
+
+	return ucTask;
+}
+
+#if BRTOS_WAIT_ANY
+/**
+Check if the object of a wait node is ready: what the task waits for can be
+taken without waiting.
+*/
+static int BRTOS_WaitAnyReady(BRTOS_WAIT_NODE *psNode)
+{
+	BRTOS_WAITQ *psObject = psNode->psObject;
+
+	switch(psObject->ucType)
+	{
+	case BRTOS_WAITQ_SEM:
+		return ((BRTOS_SEM *) psObject)->usCount > 0;
+	case BRTOS_WAITQ_RING:
+		return (unsigned short)(((BRTOS_RING *) psObject)->usHead - ((BRTOS_RING *) psObject)->usTail) >= 
+		       ((BRTOS_RING *) psObject)->usHighWater;
+	case BRTOS_WAITQ_EVENT:
+		return (((BRTOS_EVENT *) psObject)->usFlags & psNode->usFlags) != 0;
+	case BRTOS_WAITQ_POOL:
+		return ((BRTOS_POOL *) psObject)->pvFree != 0;
+	}
+
+	return 0;
+}
+
+/**
+Wake up the task of a wait node, telling it which object is ready. All its
+nodes are disarmed now, so no object refers to its stack once it is ready 
+(it may be deleted before it runs).
+*/
+static void BRTOS_WaitAnyEnd(BRTOS_WAIT_NODE *psNode)
+{
+	((BRTOS_ANY_WAITER *) psNode->psWait)->psReady = psNode;
+	BRTOS_WaitAnyDisarm((BRTOS_ANY_WAITER *) psNode->psWait);
+	BRTOS_WaitWake(psNode->psWait);
+}
+
+/**
+An object became ready (interrupts disabled): wake up the tasks waiting for 
+it in \ref BRTOS_WaitAny(). Event flags wake up all of them, like the tasks
+waiting in \ref BRTOS_EventWait(); the other objects wake up the task with 
+the highest priority, the one that would take them.
+*/
+static void BRTOS_WaitAnyWake(BRTOS_WAITQ *psObject)
+{
+	BRTOS_WAIT_NODE *psNode;
+	BRTOS_WAIT_NODE *psFirst = 0;
+
+	/* disarmed nodes keep their next link, so the walk goes on after a wake 
+	   up, which disarms the other nodes of the task (maybe on this object) */
+	for(psNode = psObject->psAnyHead ; psNode ; psNode = psNode->psNext)
+	{
+		if(psNode->ppsPrev == 0 || !BRTOS_WaitAnyReady(psNode))
+			continue;
+
+		if(psObject->ucType == BRTOS_WAITQ_EVENT)
+			BRTOS_WaitAnyEnd(psNode);
+		else if(psFirst == 0 || 
+		        asBrtosTasks[psNode->psWait->ucHead].ucLevel < asBrtosTasks[psFirst->psWait->ucHead].ucLevel)
+			psFirst = psNode;
+	}
+
+	if(psFirst)
+		BRTOS_WaitAnyEnd(psFirst);
+}
+#endif
+
+/**
+Block the running task in a wait queue, with a timeout (milliseconds) or 
+forever (BRTOS_WAIT_FOREVER). The task is switched out by \ref BRTOS_WaitSwitch().
+A task waiting with timeout is also in the sleep list (SLEEPING and WAITING states).
+Without a queue (psQueue is 0), the task is woken up directly (notifications).
+*/
+static void BRTOS_WaitBlock(BRTOS_WAITQ *psQueue, unsigned short usTimeout)
+{
+	BRTOS_TCB *psTask = &asBrtosTasks[ucCurrentTask];
+	BRTOS_TICKS ulTimeout;
+
+	BRTOS_ReadyRemove(ucCurrentTask);
+	psTask->ucTaskState  = BRTOS_TASK_STATE_WAITING;
+	psTask->ucWaitResult = BRTOS_TIMEOUT;
+	psTask->psWaitQueue  = psQueue;
+	if(psQueue)
+		BRTOS_WaitInsert(psQueue, ucCurrentTask);
+	TraceEvent(BRTOS_TRACE_WAIT, ucCurrentTask);
+
+	if(usTimeout != BRTOS_WAIT_FOREVER)
+	{
+		ulTimeout = MSEC_TO_TICKS(usTimeout);
+		psTask->ucTaskState |= BRTOS_TASK_STATE_SLEEPING;
+		BRTOS_SleepInsert(ucCurrentTask, ulTimeout ? ulTimeout : 1);
+	}
+}
+
+/**
+Switch to another task from a (not nested) critical section. The critical
+section is left, interrupts are enabled again when the task is resumed.
+
+@return wait result of the task
+*/
+static int BRTOS_WaitSwitch(void)
+{
+	ucCriticalNesting--;
+	CriticalEnd();
+	BRTOS_PortYield();
+
+	return asBrtosTasks[ucCurrentTask].ucWaitResult;
+}
+
+/**
+Check if the running task must be preempted by a ready one: a task in a higher
+priority level or, with EDF, a task with an earlier deadline in its level
+(inserted before it in the ready list).
+*/
+static int BRTOS_MustPreempt(void)
+{
+	unsigned char ucLevel = asBrtosTasks[ucCurrentTask].ucLevel;
+
+	if(HighestLevel() < ucLevel)
+		return 1;
+
+#if BRTOS_EDF
+	if(aucReadyHead[ucLevel] != ucCurrentTask)
+		return 1;
+#endif
+
+	return 0;
+}
+
+/**
+Leave a critical section after waking up tasks or changing priorities: if there
+is a ready task with higher priority than the running one, switch to it now. 
+This is not done in nested critical sections (timer callbacks, initialization),
+the new task will be selected by the scheduler.
+*/
+static void BRTOS_LeaveAndPreempt(void)
+{
+	if(ucCriticalNesting == 1 && BRTOS_MustPreempt())
+	{
+		/* preempted: the task keeps its place in the ready list */
+		asBrtosTasks[ucCurrentTask].ucTaskState = BRTOS_TASK_STATE_READY;
+		BRTOS_WaitSwitch();
+	}
+	else
+		LeaveCriticalSection();
+}
+
+/**
+Check sleeping tasks and update their status.
+Only the head of the sleep list is updated, all tasks whose 
+wake up time was reached are moved to the ready lists.
+
+@param usElapsed amount of ticks elapsed since last call
+*/
+static void BRTOS_SleepTasks(unsigned short usElapsed)
+{
+	unsigned char ucTask;
+
+	while(ucSleepHead != BRTOS_NO_TASK_TO_RUN)
+	{
+		ucTask = ucSleepHead;
+
+		if(asBrtosTasks[ucTask].ulSleepTicks > usElapsed)
+		{
+			asBrtosTasks[ucTask].ulSleepTicks -= usElapsed;
+			break;
+		}
+
+		usElapsed  -= asBrtosTasks[ucTask].ulSleepTicks;
+		ucSleepHead = asBrtosTasks[ucTask].ucNext;
+
+		/* timeout while waiting: ucWaitResult is already BRTOS_TIMEOUT */
+		if(asBrtosTasks[ucTask].ucTaskState & BRTOS_TASK_STATE_WAITING)
+			BRTOS_WaitRemove(ucTask);
+
+		asBrtosTasks[ucTask].ulSleepTicks = 0;
+		asBrtosTasks[ucTask].ucTaskState  = BRTOS_TASK_STATE_READY;
+		asBrtosTasks[ucTask].usTicks      = 0;
+#if BRTOS_LATENCY_STATS
+		asBrtosTasks[ucTask].ulWakeTime   = ulTickTime;
+#endif
+		BRTOS_ReadyInsert(ucTask);
+		TraceEvent(BRTOS_TRACE_WAKE, ucTask);
+	}
+}
+
+/**
+Time processing: update timers and check sleeping tasks.
+
+@param usElapsed amount of ticks elapsed since last call
+*/
+static void BRTOS_ProcessTicks(unsigned short usElapsed)
+{
+#if BRTOS_LATENCY_STATS
+	ulTickTime = BRTOS_PortTimestamp();
+	if(ulTickTime == 0)
+		ulTickTime = 1;
+#endif
+
+	ulTicks += usElapsed;
+	BRTOS_ProcessTimers(usElapsed);
+	BRTOS_SleepTasks(usElapsed);
+}
+
+/**
+Amount of ticks the CPU can sleep when there is nothing to run: up to
+the wake up time of the first sleeping task or the next timer processing.
+*/
+static unsigned short BRTOS_IdleTicks(void)
+{
+	unsigned short usTicks = BRTOS_TICKLESS_MAX_TICKS;
+	unsigned short usTimer;
+
+	if(ucSleepHead != BRTOS_NO_TASK_TO_RUN && asBrtosTasks[ucSleepHead].ulSleepTicks < usTicks)
+		usTicks = asBrtosTasks[ucSleepHead].ulSleepTicks;
+
+	usTimer = BRTOS_TimerIdleTicks();
+	if(usTimer < usTicks)
+		usTicks = usTimer + 1;
+
+	return usTicks;
+}
+
+#if BRTOS_IDLE_GOVERNOR
+/**
+Idle governor: sleep in the deepest low power mode allowed by the drivers
+(\ref BRTOS_IdleConstrain()) that pays off before the next wake up, that is,
+the sleep covers the exit latency of the mode and its shortest useful time.
+Modes stopping the wake up timer are taken only when nothing timed is pending
+(tickless idle, no sleeping task and no active timer): the CPU waits for an
+interrupt there and the kernel time does not advance. The wake up is programmed
+earlier by the exit latency (whole ticks), so tasks run on time.
+
+@return amount of ticks elapsed while sleeping
+*/
+static unsigned short BRTOS_IdleGovernor(void)
+{
+	unsigned char  ucMode = 0;
+	unsigned short usTicks = BRTOS_TICKLESS_IDLE ? BRTOS_IdleTicks() : 1;
+	unsigned short usElapsed;
+	unsigned long  ulStart;
+	int            iTimed = !BRTOS_TICKLESS_IDLE || ucSleepHead != BRTOS_NO_TASK_TO_RUN || usActiveTimers;
+
+	/* deepest mode allowed by the constraints */
+	while(ucMode < BRTOS_PORT_IDLE_MODES - 1 && aucIdleConstraints[ucMode] == 0)
+		ucMode++;
+
+	/* lighter modes until one is worth the time to the wake up */
+	while(iTimed && ucMode > 0 && (!asIdleModes[ucMode].ucTimed || usTicks < asIdleModes[ucMode].usWorthTicks))
+		ucMode--;
+
+	/* wake up early by the exit latency */
+	if(iTimed && usTicks > asIdleModes[ucMode].usExitTicks)
+		usTicks -= asIdleModes[ucMode].usExitTicks;
+
+	ulStart   = BRTOS_TimeNow();
+	usElapsed = BRTOS_PortIdle(usTicks, ucMode);
+	aulIdleEntries[ucMode]++;
+	aulIdleTime[ucMode] += BRTOS_TimeNow() - ulStart;
+
+	return usElapsed;
+}
+
+#define BRTOS_Idle()  BRTOS_IdleGovernor()
+#else
+#define BRTOS_Idle()  BRTOS_PortIdle(BRTOS_TICKLESS_IDLE ? BRTOS_IdleTicks() : 1, BRTOS_PORT_IDLE_DEFAULT)
+#endif
+
+#if BRTOS_STACK_CHECK
+/**
+Check the stack of the task switched out: its saved stack pointer must be 
+above the lowest stack word (canary), which must still hold the pattern
+written at task creation.
+*/
+static void BRTOS_StackCheck(unsigned char ucTask)
+{
+    unsigned short *pusStackBeg = TaskConst(ucTask)->pusStackBeg;
+
+    if(asBrtosTasks[ucTask].pusStackPtr <= pusStackBeg || *pusStackBeg != BRTOS_STACK_PATTERN)
+        BRTOS_STACK_OVERFLOW(ucTask);
+}
+#endif
+
+/**
+Select the next task to run. While there is nothing to run the CPU stays 
+in low power mode (the whole sleep time, with tickless idle).
+
+\dot
+digraph task_states {
+node [shape=circle];
+RDY -> RUN [label="highest ready priority"]; 
+RUN -> RDY [label="time slice executed, preempted or yield"]; 
+}
+\enddot
+
+@return task to run
+*/
+static BRTOS_TCB *BRTOS_SelectTask(void)
+{
+    unsigned char  ucPrevious = ucCurrentTask;
+    unsigned short usElapsed;
+
+#if BRTOS_STACK_CHECK
+    /* the stack of a task that just ended may be in use by others */
+    if(TaskValid(ucCurrentTask))
+        BRTOS_StackCheck(ucCurrentTask);
+#endif
+
+    /* time used by the task switched out (or by idle) */
+    StatsCharge(ucCurrentTask < usNumTasks ? &asBrtosTasks[ucCurrentTask].ulRunTime : &ulIdleTime);
+
+    while((ucCurrentTask = BRTOS_NextTask()) == BRTOS_NO_TASK_TO_RUN)
+    {
+        if(ucPrevious != BRTOS_NO_TASK_TO_RUN)
+        {
+            ucPrevious = BRTOS_NO_TASK_TO_RUN;
+            StatsCount(ulIdleSwitches);
+            TraceEvent(BRTOS_TRACE_SWITCH, BRTOS_TASK_IDLE);
+        }
+
+        /* nothing to do: sleep */
+        usElapsed = BRTOS_Idle();
+        StatsCharge(&ulIdleTime);
+        BRTOS_ProcessTicks(usElapsed);
+    }
+
+#if BRTOS_LATENCY_STATS
+    /* woken up by the tick: its context is restored right after */
+    if(asBrtosTasks[ucCurrentTask].ulWakeTime)
+    {
+        BRTOS_LatencyAdd(&asLatency[BRTOS_LATENCY_WAKE], 
+                         (BRTOS_PortTimestamp() - asBrtosTasks[ucCurrentTask].ulWakeTime) & BRTOS_PORT_TIMESTAMP_MASK,
+                         ucCurrentTask);
+        asBrtosTasks[ucCurrentTask].ulWakeTime = 0;
+    }
+#endif
+
+    if(ucCurrentTask != ucPrevious)
+    {
+        StatsCount(asBrtosTasks[ucCurrentTask].ulSwitches);
+        TraceEvent(BRTOS_TRACE_SWITCH, ucCurrentTask);
+    }
+
+    return &asBrtosTasks[ucCurrentTask];
+}
+
+/**
+The scheduler function for the system tick. It is called by the port tick
+interrupt with interrupts disabled, in the scheduler stack, after saving
+the full context of the current task. Time is processed (timers, sleeping
+tasks and time slice) and the next task is selected.
+
+@return task to run
+*/
+BRTOS_TCB *BRTOS_Schedule(void)
+{
+    /* Update timers and sleeping tasks */
+    BRTOS_ProcessTicks(1);
+
+    /* tick inside an interrupt service routine (interrupts enabled by it): 
+       the interrupted task is resumed, the switch is done by BRTOS_ISR_Exit() */
+    if(ucIsrNesting)
+        return &asBrtosTasks[ucCurrentTask];
+
+#if BRTOS_CPU_BUDGETS
+    /* the interrupted task used this tick */
+    if(ucCurrentTask < usNumTasks && asBrtosTasks[ucCurrentTask].ucTaskState == BRTOS_TASK_STATE_RUNNING)
+        BRTOS_BudgetCharge(ucCurrentTask);
+#endif
+
+    /* Get the next task to run */
+    return BRTOS_SelectTask();
+}
+
+/**
+The scheduler function for cooperative switches (\ref BRTOS_Sleep(), \ref BRTOS_Yield()).
+It is called by the port with interrupts disabled, in the scheduler stack,
+after saving only the registers preserved across function calls. No time
+has elapsed: timers and sleeping tasks are not processed and the current
+task was already removed from running state by the caller. It is also 
+called by the switch requested by \ref BRTOS_ISR_Exit() (full context), 
+where the current task is just preempted.
+
+@return task to run
+*/
+BRTOS_TCB *BRTOS_ScheduleYield(void)
+{
+    /* preempted after an interrupt: it keeps its place and its time slice */
+    if(ucCurrentTask < usNumTasks && asBrtosTasks[ucCurrentTask].ucTaskState == BRTOS_TASK_STATE_RUNNING)
+        asBrtosTasks[ucCurrentTask].ucTaskState = BRTOS_TASK_STATE_READY;
+
+    return BRTOS_SelectTask();
+}
+
+#if BRTOS_INSTANCES
+/**
+Start a kernel instance (BRTOS_INSTANCES), in place of main(). It is called
+by the port in the scheduler stack of the instance, with psBrtosKernel 
+pointing to its zeroed state, and never returns.
+
+@param pvData application data of the instance (see \ref BRTOS_InstanceData())
+*/
+void BRTOS_InstanceMain(void *pvData)
+{
+	BRTOS_STATE.pvInstanceData = pvData;
+
+	EnterCriticalSection();
+	BRTOS_Initialize();
+	BRTOS_Application_Initialize();
+	BRTOS_PortStart();
+}
+
+/**
+Application data of the running kernel instance, so the same application
+code can run in many instances.
+
+@return data given to \ref BRTOS_InstanceMain()
+*/
+void *BRTOS_InstanceData(void)
+{
+	return BRTOS_STATE.pvInstanceData;
+}
+#else
+/**
+
+Initialize RTOS and user application.
+
+*/
+int main(void)
+{
+	EnterCriticalSection();
+	
+	/* initialize control structures and create all user tasks */
+	BRTOS_Initialize();
+
+	/* call user initialization: you must create at least one thread */
+	BRTOS_Application_Initialize();
+	
+	/* start the scheduler, it never returns */
+	BRTOS_PortStart();
+
+	return 0;
+}
+#endif
+
+#ifndef BRTOS_STATIC_TASKS
+/**
+Set up a new task in a free TCB (interrupts disabled). TCBs of tasks that
+ended are used first. See \ref BRTOS_CreateTask().
+
+@param pucTask Index of the new task.
+*/
+static int BRTOS_TaskNew(pfTaskEntry entry_point, unsigned short *stack_addr, unsigned short stack_size, int time_slice, int pri, unsigned char *pucTask)
+{
+	BRTOS_TCB *psTask;
+	unsigned short *pusWord;
+	unsigned char ucTask;
+
+	if(ucFreeTask == BRTOS_NO_TASK_TO_RUN && usNumTasks >= BRTOS_MAX_TASKS)
+		return BRTOS_NO_ROOM_IN_TCB_ARRAY;
+
+	if((pri & 0xFF) == 0 || stack_size < BRTOS_PORT_STACK_FRAME + sizeof(unsigned short))
+		return BRTOS_FAILURE;
+
+	if(ucFreeTask != BRTOS_NO_TASK_TO_RUN)
+	{
+		ucTask     = ucFreeTask;
+		ucFreeTask = asBrtosTasks[ucTask].ucNext;
+	}
+	else
+		ucTask = usNumTasks++;
+
+	psTask = &asBrtosTasks[ucTask];
+	psTask->pfEntryPoint  = entry_point;
+	psTask->pusStackBeg   = stack_addr;
+	psTask->pusStackPtr   = stack_addr;
+	psTask->usStackSize   = stack_size & ~1;
+	psTask->usTimeSlice   = (unsigned short) MSEC_TO_TICKS(time_slice);
+	psTask->ucPriority    = pri;
+	psTask->ucLevel       = PriorityLevel(pri);
+	psTask->ucTaskState   = BRTOS_TASK_STATE_READY;
+	psTask->ulSleepTicks  = 0;
+	psTask->usTicks       = 0;
+	psTask->ucWaitNext    = BRTOS_NO_TASK_TO_RUN;
+	psTask->ucWaitResult  = BRTOS_SUCCESS;
+	psTask->psWaitQueue   = 0;
+	psTask->psMutexHeld   = 0;
+	psTask->pvWaitData    = 0;
+	psTask->usNotifyValue = 0;
+	psTask->ucNotifyState = BRTOS_NOTIFY_NONE;
+	psTask->psStackPool   = 0;
+	psTask->pvStackBlock  = 0;
+#if BRTOS_PERIODIC_TASKS
+	psTask->usPeriod      = 0;
+	psTask->usDeadline    = 0;
+	psTask->ulRelease     = 0;
+	psTask->usDeadlineMisses = 0;
+	psTask->usOverruns    = 0;
+#endif
+#if BRTOS_CPU_BUDGETS
+	psTask->psBudget      = 0;
+#endif
+#if BRTOS_LATENCY_STATS
+	psTask->ulWakeTime    = 0;
+#endif
+#if BRTOS_CPU_STATS
+	psTask->ulRunTime     = 0;
+	psTask->ulSwitches    = 0;
+#endif
+
+	BRTOS_PortInitStack(psTask, stack_addr + stack_size/2 - 1);
+
+	/* paint the stack below the initial context (the port may have moved it) */
+	for(pusWord = psTask->pusStackBeg ; pusWord < psTask->pusStackPtr ; pusWord++)
+		*pusWord = BRTOS_STACK_PATTERN;
+
+	BRTOS_ReadyInsert(ucTask);
+	*pucTask = ucTask;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Create a new task. Tasks are identified by their index, starting at 0 
+(see \ref BRTOS_GetCurrentTask()): the creation order, while no task 
+has ended, since TCBs of ended tasks are used again. The free part of the
+stack is painted with BRTOS_STACK_PATTERN, so its real usage can be 
+checked with \ref BRTOS_TaskStackHighWater().
+
+@param entry_point Task entry point. It should be a function that follows \ref pfTaskEntry.
+@param stack_addr  Stack lowest address (usually an unsigned short array). MSP stacks go
+                   downward, starting at the last word. Not used by ports that allocate
+                   their own stacks (host).
+@param stack_size Stack size in bytes. It must hold the initial context of the task 
+                  (BRTOS_PORT_STACK_FRAME) plus the canary word.
+@param time_slice Task time slice, specified in ms.
+@param pri        Task priority, one of BRTOS_TASK_PRIORITY_1 (highest) to BRTOS_TASK_PRIORITY_8 (lowest).
+
+@retval BRTOS_FAILURE Invalid priority or stack too small.
+@retval BRTOS_NO_ROOM_IN_TCB_ARRAY The task could not be created (no room in TCB array)
+@retval BRTOS_SUCCESS The task was created sucessfully.
+*/
+int BRTOS_CreateTask(pfTaskEntry entry_point, unsigned short *stack_addr, unsigned short stack_size, int time_slice, int pri)
+{
+	unsigned char ucTask;
+	int iRet;
+
+	EnterCriticalSection();
+	iRet = BRTOS_TaskNew(entry_point, stack_addr, stack_size, time_slice, pri, &ucTask);
+	LeaveCriticalSection();
+
+	return iRet;
+}
+
+#if BRTOS_PERIODIC_TASKS
+/**
+Create a periodic task (see \ref BRTOS_CreateTask()). Its first job is released
+now, the next ones every usPeriod ms: the task calls \ref BRTOS_TaskWaitPeriod()
+when each job is done. A job finished after its release plus usDeadline is a
+deadline miss, a job still running at the next release is an overrun
+(\ref BRTOS_TaskPeriodStats()). With BRTOS_EDF, periodic tasks of the same 
+priority level run in deadline order.
+
+@param usPeriod   Release period in ms (up to 65535 ticks).
+@param usDeadline Relative deadline in ms, up to the period (0: the period).
+
+@retval BRTOS_FAILURE Invalid period, deadline, priority or stack too small.
+@retval BRTOS_NO_ROOM_IN_TCB_ARRAY The task could not be created (no room in TCB array)
+@retval BRTOS_SUCCESS The task was created sucessfully.
+*/
+int BRTOS_CreatePeriodicTask(pfTaskEntry entry_point, unsigned short *stack_addr, unsigned short stack_size, int time_slice, 
+                             unsigned short usPeriod, unsigned short usDeadline, int pri)
+{
+	BRTOS_TCB *psTask;
+	BRTOS_TICKS ulPeriodTicks   = MSEC_TO_TICKS(usPeriod);
+	BRTOS_TICKS ulDeadlineTicks = usDeadline ? MSEC_TO_TICKS(usDeadline) : ulPeriodTicks;
+	unsigned char ucTask;
+	int iRet;
+
+	if(ulPeriodTicks == 0 || ulPeriodTicks > 0xFFFF || ulDeadlineTicks == 0 || ulDeadlineTicks > ulPeriodTicks)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+	iRet = BRTOS_TaskNew(entry_point, stack_addr, stack_size, time_slice, pri, &ucTask);
+	if(iRet == BRTOS_SUCCESS)
+	{
+		psTask = &asBrtosTasks[ucTask];
+		psTask->usPeriod   = (unsigned short) ulPeriodTicks;
+		psTask->usDeadline = (unsigned short) ulDeadlineTicks;
+		psTask->ulRelease  = ulTicks;
+		/* take its place by deadline */
+		BRTOS_ReadyRemove(ucTask);
+		BRTOS_ReadyInsert(ucTask);
+	}
+	BRTOS_LeaveAndPreempt();
+
+	return iRet;
+}
+#endif
+#endif
+
+/**
+Stack high water mark of a task: the most stack it has used since it was
+created, including its initial context. The painted words are scanned from
+the stack bottom up to the first overwritten one, with interrupts enabled.
+The stack size minus this value is the margin left for the task.
+
+@param ucTask Task index (see \ref BRTOS_GetCurrentTask()).
+
+@return used stack in bytes (0 for an invalid task)
+*/
+unsigned short BRTOS_TaskStackHighWater(unsigned char ucTask)
+{
+	unsigned short *pusWord;
+	unsigned short *pusEnd;
+
+	if(!TaskValid(ucTask))
+		return 0;
+
+	pusWord = TaskConst(ucTask)->pusStackBeg;
+	pusEnd  = pusWord + TaskConst(ucTask)->usStackSize/2;
+	while(pusWord < pusEnd && *pusWord == BRTOS_STACK_PATTERN)
+		pusWord++;
+
+	return (pusEnd - pusWord)*sizeof(unsigned short);
+}
+
+#if BRTOS_CPU_STATS
+/**
+CPU usage of a task or of idle (BRTOS_CPU_STATS). Times are in port
+timestamp units (BRTOS_PORT_TIMESTAMP_HZ) and include the interrupts taken 
+while the task was running. Counters wrap around, so usage is usually taken
+as the difference between two calls.
+
+@param ucTask      Task index (see \ref BRTOS_GetCurrentTask()) or BRTOS_TASK_IDLE.
+@param pulRunTime  Time running (or sleeping, for idle).
+@param pulSwitches Times switched in (or idle periods).
+
+@retval BRTOS_FAILURE Invalid task.
+@retval BRTOS_SUCCESS Statistics returned.
+*/
+int BRTOS_TaskStats(unsigned char ucTask, unsigned long *pulRunTime, unsigned long *pulSwitches)
+{
+	EnterCriticalSection();
+
+	if(ucTask == BRTOS_TASK_IDLE)
+	{
+		*pulRunTime  = ulIdleTime;
+		*pulSwitches = ulIdleSwitches;
+	}
+	else if(TaskValid(ucTask))
+	{
+		/* the caller is running: charge its current run */
+		if(ucTask == ucCurrentTask)
+			BRTOS_StatsCharge(&asBrtosTasks[ucTask].ulRunTime);
+
+		*pulRunTime  = asBrtosTasks[ucTask].ulRunTime;
+		*pulSwitches = asBrtosTasks[ucTask].ulSwitches;
+	}
+	else
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+#endif
+
+#if BRTOS_LATENCY_STATS
+/**
+Latency statistics (BRTOS_LATENCY_STATS), in port timestamp units 
+(BRTOS_PORT_TIMESTAMP_HZ):
+
+- BRTOS_LATENCY_CRITICAL: time with interrupts disabled by each kernel critical 
+  section, up to its end or to the switch it requested. The worst case keeps 
+  the brtos.c line where the section started. Interrupts and the scheduler
+  (tick processing) are not included: they are part of the wake up latency.
+- BRTOS_LATENCY_WAKE: time from the tick processing (the tick interrupt or the
+  wake up from low power mode) to the dispatch of each task it woke up (sleep
+  or wait timeout), including the time spent running tasks with higher 
+  priority. The worst case keeps the task index.
+
+@param ucKind   BRTOS_LATENCY_CRITICAL or BRTOS_LATENCY_WAKE.
+@param psStats  Statistics.
+@param iReset   Clear the statistics after reading them.
+
+@retval BRTOS_FAILURE Invalid kind.
+@retval BRTOS_SUCCESS Statistics returned.
+*/
+int BRTOS_LatencyStats(unsigned char ucKind, BRTOS_LATENCY *psStats, int iReset)
+{
+	if(ucKind > BRTOS_LATENCY_WAKE)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+
+	*psStats = asLatency[ucKind];
+	if(iReset)
+		memset(&asLatency[ucKind], 0, sizeof(BRTOS_LATENCY));
+
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+#endif
+
+#if BRTOS_TRACE
+/**
+Copy the trace ring to a buffer, oldest record first, and empty it (BRTOS_TRACE).
+The buffer starts with a header of BRTOS_TRACE_HEADER_SIZE bytes (magic, 
+record count and BRTOS_PORT_TIMESTAMP_HZ, 0 if known only at run time), 
+followed by records of BRTOS_TRACE_RECORD_SIZE bytes, all little endian. 
+It can be sent to a host as it is and decoded with tools/tracedecode. When
+the buffer is too small, the newest records are kept.
+
+@param pvBuf  Buffer.
+@param usSize Buffer size in bytes.
+
+@return bytes written (0 if the buffer can not hold the header)
+*/
+unsigned short BRTOS_TraceDump(void *pvBuf, unsigned short usSize)
+{
+	unsigned char *pucBuf = (unsigned char *) pvBuf;
+	unsigned long  ulHz   = BRTOS_PORT_TIMESTAMP_HZ;
+	unsigned short usCount;
+	unsigned short usRecord;
+	unsigned short i;
+
+	if(usSize < BRTOS_TRACE_HEADER_SIZE)
+		return 0;
+
+	EnterCriticalSection();
+
+	usCount = usTraceCount;
+	if(usCount > (usSize - BRTOS_TRACE_HEADER_SIZE)/BRTOS_TRACE_RECORD_SIZE)
+		usCount = (usSize - BRTOS_TRACE_HEADER_SIZE)/BRTOS_TRACE_RECORD_SIZE;
+	usRecord = (usTraceNext - usCount) & (BRTOS_TRACE_SIZE - 1);
+
+	pucBuf[0] = BRTOS_TRACE_MAGIC & 0xFF;
+	pucBuf[1] = BRTOS_TRACE_MAGIC >> 8;
+	pucBuf[2] = usCount & 0xFF;
+	pucBuf[3] = usCount >> 8;
+	for(i = 0 ; i < 4 ; i++)
+		pucBuf[4 + i] = (ulHz >> (8*i)) & 0xFF;
+	pucBuf += BRTOS_TRACE_HEADER_SIZE;
+
+	for(i = 0 ; i < usCount ; i++)
+	{
+		pucBuf[0] = asTrace[usRecord].usTime & 0xFF;
+		pucBuf[1] = asTrace[usRecord].usTime >> 8;
+		pucBuf[2] = asTrace[usRecord].ucEvent;
+		pucBuf[3] = asTrace[usRecord].ucArg;
+		pucBuf   += BRTOS_TRACE_RECORD_SIZE;
+		usRecord  = (usRecord + 1) & (BRTOS_TRACE_SIZE - 1);
+	}
+
+	usTraceCount = 0;
+
+	LeaveCriticalSection();
+
+	return BRTOS_TRACE_HEADER_SIZE + usCount*BRTOS_TRACE_RECORD_SIZE;
+}
+#endif
+
+/**
+Put the calling task to sleep (user level).
+
+@param usTime Amount of time to sleep in milliseconds
+*/
+void BRTOS_Sleep(unsigned short usTime)
+{
+
+    BRTOS_TICKS t = MSEC_TO_TICKS(usTime);
+    if(t == 0)
+        return;
+        
+    EnterCriticalSection();
+
+    /* put the task to sleep */
+    asBrtosTasks[ucCurrentTask].ucTaskState  = BRTOS_TASK_STATE_SLEEPING;
+    BRTOS_ReadyRemove(ucCurrentTask);
+    BRTOS_SleepInsert(ucCurrentTask, t);
+    TraceEvent(BRTOS_TRACE_SLEEP, ucCurrentTask);
+
+    BRTOS_WaitSwitch();
+}
+
+/**
+Put the running task to sleep until an absolute tick (interrupts disabled, 
+from a not nested critical section). The wake up tick must be in the future.
+*/
+static void BRTOS_SleepTo(BRTOS_TICKS ulWake)
+{
+	asBrtosTasks[ucCurrentTask].ucTaskState = BRTOS_TASK_STATE_SLEEPING;
+	BRTOS_ReadyRemove(ucCurrentTask);
+	BRTOS_SleepInsert(ucCurrentTask, ulWake - ulTicks);
+	TraceEvent(BRTOS_TRACE_SLEEP, ucCurrentTask);
+
+	BRTOS_WaitSwitch();
+}
+
+/**
+Current kernel tick: ticks processed since the system started, counted from
+BRTOS_TICKS_START (32 bits, see BRTOS_TICKS). Intervals are unsigned differences, times are compared with
+BRTOS_TICKS_BEFORE() and BRTOS_TICKS_REACHED().
+
+@return current tick
+*/
+BRTOS_TICKS BRTOS_GetTicks(void)
+{
+	BRTOS_TICKS ulNow;
+
+	/* not atomic on 16 bits CPUs */
+	EnterCriticalSection();
+	ulNow = ulTicks;
+	LeaveCriticalSection();
+
+	return ulNow;
+}
+
+/**
+High resolution time: the port timestamp (Timer_A at ACLK rate on MSP430, 
+the cycle counter on the host) extended to 32 bits. Its rate is the port 
+BRTOS_PORT_TIMESTAMP_HZ.
+
+@return time in port timestamp units
+*/
+unsigned long BRTOS_GetTimestamp(void)
+{
+	unsigned long ulNow;
+
+	EnterCriticalSection();
+	ulNow = BRTOS_TimeNow();
+	LeaveCriticalSection();
+
+	return ulNow;
+}
+
+/**
+Put the calling task to sleep until a fixed period after its last wake up.
+Wake up times are absolute, so a periodic loop does not drift with its 
+execution time and the jitter does not add up:
+
+    ulLastWake = BRTOS_GetTicks();
+    for(;;) { work(); BRTOS_SleepUntil(&ulLastWake, 10); }
+
+@param pulLastWake Tick of the last wake up, updated to the next one.
+@param usPeriod    Period in milliseconds.
+
+@retval BRTOS_SUCCESS The task slept until the next wake up time.
+@retval BRTOS_TIMEOUT The next wake up time had already passed, the task did not sleep.
+*/
+int BRTOS_SleepUntil(BRTOS_TICKS *pulLastWake, unsigned short usPeriod)
+{
+	BRTOS_TICKS ulWake;
+
+	EnterCriticalSection();
+
+	ulWake = *pulLastWake + MSEC_TO_TICKS(usPeriod);
+	*pulLastWake = ulWake;
+
+	/* late: the work took longer than the period */
+	if(BRTOS_TICKS_REACHED(ulTicks, ulWake))
+	{
+		LeaveCriticalSection();
+		return BRTOS_TIMEOUT;
+	}
+
+	BRTOS_SleepTo(ulWake);
+
+	return BRTOS_SUCCESS;
+}
+
+#if BRTOS_PERIODIC_TASKS
+/**
+End the current job of a periodic task and sleep until the next release
+(see \ref BRTOS_CreatePeriodicTask()). A job ending after its deadline counts
+as a deadline miss. If the next release already passed, it counts as an
+overrun: releases missed meanwhile are skipped and the new job starts at 
+once, at the last release time of the period grid.
+
+@retval BRTOS_SUCCESS The task slept until its next release.
+@retval BRTOS_TIMEOUT Overrun, the new job started without sleeping.
+@retval BRTOS_FAILURE The calling task is not periodic.
+*/
+int BRTOS_TaskWaitPeriod(void)
+{
+	BRTOS_TCB *psTask = &asBrtosTasks[ucCurrentTask];
+
+	EnterCriticalSection();
+
+	if(psTask->usPeriod == 0)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	/* the deadline tick was processed while the job was running */
+	if(BRTOS_TICKS_REACHED(ulTicks, psTask->ulRelease + psTask->usDeadline))
+		psTask->usDeadlineMisses++;
+
+	psTask->ulRelease += psTask->usPeriod;
+	if(BRTOS_TICKS_REACHED(ulTicks, psTask->ulRelease))
+	{
+		psTask->usOverruns++;
+		/* skip the missed releases (no 32 bits division, usually none or one) */
+		while(BRTOS_TICKS_REACHED(ulTicks, psTask->ulRelease + psTask->usPeriod))
+			psTask->ulRelease += psTask->usPeriod;
+		/* the new deadline may be later than other ready jobs */
+		BRTOS_ReadyRemove(ucCurrentTask);
+		BRTOS_ReadyInsert(ucCurrentTask);
+		BRTOS_LeaveAndPreempt();
+		return BRTOS_TIMEOUT;
+	}
+
+	BRTOS_SleepTo(psTask->ulRelease);
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Deadline statistics of a periodic task.
+
+@param ucTask      Task index (see \ref BRTOS_GetCurrentTask()).
+@param pusMisses   Jobs finished after their deadline (can be null).
+@param pusOverruns Jobs still running at their next release (can be null).
+
+@retval BRTOS_FAILURE Invalid or not periodic task.
+@retval BRTOS_SUCCESS Statistics returned.
+*/
+int BRTOS_TaskPeriodStats(unsigned char ucTask, unsigned short *pusMisses, unsigned short *pusOverruns)
+{
+	EnterCriticalSection();
+
+	if(!TaskValid(ucTask) || asBrtosTasks[ucTask].usPeriod == 0)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	if(pusMisses)
+		*pusMisses = asBrtosTasks[ucTask].usDeadlineMisses;
+	if(pusOverruns)
+		*pusOverruns = asBrtosTasks[ucTask].usOverruns;
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+#endif
+
+#if BRTOS_CPU_BUDGETS
+/**
+Initialize a CPU budget: usBudget ms of CPU every usPeriod ms, for one task or
+shared by a group of tasks (\ref BRTOS_TaskSetBudget()). The time used by a task
+is counted in ticks: each tick is charged to the task it interrupts. When the
+budget is used up, the tasks of the group are throttled (they sleep) until the
+next period, which gives the whole budget back. Unused budget is not kept for
+later periods. Throttled tasks keep the mutexes they hold: tasks with a budget
+should not hold mutexes for long.
+
+Best effort work (logging, compression) can then run at a high priority, for
+low latency, without taking more than its share of the CPU from control loops.
+
+@param psBudget Budget, allocated by the user.
+@param usBudget CPU time for each period, in ms (at least one tick).
+@param usPeriod Replenishment period, in ms (up to 65535 ticks).
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The budget was created sucessfully.
+*/
+int BRTOS_BudgetCreate(BRTOS_BUDGET *psBudget, unsigned short usBudget, unsigned short usPeriod)
+{
+	BRTOS_TICKS ulBudget = MSEC_TO_TICKS(usBudget);
+	BRTOS_TICKS ulPeriod = MSEC_TO_TICKS(usPeriod);
+
+	if(psBudget == 0 || ulBudget == 0 || ulBudget > ulPeriod || ulPeriod > 0xFFFF)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+	psBudget->ulStart     = ulTicks;
+	psBudget->ulUsed      = 0;
+	psBudget->usBudget    = (unsigned short) ulBudget;
+	psBudget->usPeriod    = (unsigned short) ulPeriod;
+	psBudget->usLeft      = (unsigned short) ulBudget;
+	psBudget->usThrottles = 0;
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Give a CPU budget to a task, or take it away. A task throttled when its budget
+is taken away wakes up at the end of the budget period.
+
+@param ucTask   Task index (see \ref BRTOS_GetCurrentTask()).
+@param psBudget Budget created by \ref BRTOS_BudgetCreate(), 0 for none.
+
+@retval BRTOS_FAILURE Invalid task.
+@retval BRTOS_SUCCESS The budget was set.
+*/
+int BRTOS_TaskSetBudget(unsigned char ucTask, BRTOS_BUDGET *psBudget)
+{
+	EnterCriticalSection();
+
+	if(!TaskValid(ucTask))
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	asBrtosTasks[ucTask].psBudget = psBudget;
+
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Usage statistics of a CPU budget.
+
+@param psBudget     Budget created by \ref BRTOS_BudgetCreate().
+@param pusThrottles Periods in which the budget was used up (can be null).
+@param pulUsed      Ticks charged to the budget since it was created (can be null).
+
+@retval BRTOS_FAILURE Invalid budget.
+@retval BRTOS_SUCCESS Statistics returned.
+*/
+int BRTOS_BudgetStats(BRTOS_BUDGET *psBudget, unsigned short *pusThrottles, unsigned long *pulUsed)
+{
+	if(psBudget == 0)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+	if(pusThrottles)
+		*pusThrottles = psBudget->usThrottles;
+	if(pulUsed)
+		*pulUsed = psBudget->ulUsed;
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+#endif
+
+#if BRTOS_IDLE_GOVERNOR
+/**
+Limit the low power mode of idle (BRTOS_IDLE_GOVERNOR): while a driver needs
+a clock or a wake up latency that deeper modes do not give (a transfer on a
+peripheral clocked by SMCLK, for instance), the CPU sleeps at most in ucMode.
+Constraints are counted per mode, each one is removed by \ref BRTOS_IdleRelease()
+with the same mode. It can be called from interrupt routines.
+
+@param ucMode Deepest low power mode allowed (BRTOS_PORT_IDLE_xxx of the port).
+
+@retval BRTOS_FAILURE Invalid mode or too many constraints on it.
+@retval BRTOS_SUCCESS Constraint added.
+*/
+int BRTOS_IdleConstrain(unsigned char ucMode)
+{
+	int iRet = BRTOS_FAILURE;
+
+	if(ucMode >= BRTOS_PORT_IDLE_MODES)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+	if(aucIdleConstraints[ucMode] < 0xFF)
+	{
+		aucIdleConstraints[ucMode]++;
+		iRet = BRTOS_SUCCESS;
+	}
+	LeaveCriticalSection();
+
+	return iRet;
+}
+
+/**
+Remove a constraint added by \ref BRTOS_IdleConstrain(). It can be called
+from interrupt routines.
+
+@param ucMode Mode given to \ref BRTOS_IdleConstrain().
+
+@retval BRTOS_FAILURE Invalid mode or no constraint on it.
+@retval BRTOS_SUCCESS Constraint removed.
+*/
+int BRTOS_IdleRelease(unsigned char ucMode)
+{
+	int iRet = BRTOS_FAILURE;
+
+	if(ucMode >= BRTOS_PORT_IDLE_MODES)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+	if(aucIdleConstraints[ucMode] > 0)
+	{
+		aucIdleConstraints[ucMode]--;
+		iRet = BRTOS_SUCCESS;
+	}
+	LeaveCriticalSection();
+
+	return iRet;
+}
+
+/**
+Residency of a low power mode (BRTOS_IDLE_GOVERNOR). The time is in port
+timestamp units (BRTOS_PORT_TIMESTAMP_HZ), wake up included: a timestamp
+stopped in a mode (MSP430 LPM4) does not count it. Counters wrap around.
+
+@param ucMode     Low power mode (BRTOS_PORT_IDLE_xxx of the port).
+@param pulEntries Times the CPU slept in the mode (can be null).
+@param pulTime    Time slept in the mode (can be null).
+
+@retval BRTOS_FAILURE Invalid mode.
+@retval BRTOS_SUCCESS Statistics returned.
+*/
+int BRTOS_IdleStats(unsigned char ucMode, unsigned long *pulEntries, unsigned long *pulTime)
+{
+	if(ucMode >= BRTOS_PORT_IDLE_MODES)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+	if(pulEntries)
+		*pulEntries = aulIdleEntries[ucMode];
+	if(pulTime)
+		*pulTime = aulIdleTime[ucMode];
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+#endif
+
+/**
+Give up the CPU to the next ready task with the same priority. The calling
+task goes to the end of its ready list, with a new time slice. If it is the
+only ready task of the highest ready level, it keeps running.
+*/
+void BRTOS_Yield(void)
+{
+    EnterCriticalSection();
+
+    asBrtosTasks[ucCurrentTask].ucTaskState = BRTOS_TASK_STATE_READY;
+    asBrtosTasks[ucCurrentTask].usTicks     = 0;
+    if(aucReadyTail[asBrtosTasks[ucCurrentTask].ucLevel] != ucCurrentTask)
+    {
+        BRTOS_ReadyRemove(ucCurrentTask);
+        BRTOS_ReadyInsert(ucCurrentTask);
+    }
+
+    BRTOS_WaitSwitch();
+}
+
+/**
+Give up the CPU to a given ready task (direct handoff), for instance the next
+stage of a pipeline, right after waking it up. The calling task goes to the
+end of its ready list and the target goes to the head of its own list, with
+what is left of the caller's time slice (donated, up to its own time slice). 
+The switch is a cooperative one: no time processing and no list search.
+
+The target runs at once if it has the highest ready priority (usually the 
+same priority as the caller), otherwise the priority order is kept and it 
+runs first in its level.
+
+    BRTOS_RingWriteCommit(&sSamples, usCount);
+    BRTOS_YieldTo(ucFilterTask);
+
+@param ucTask Task to run (see \ref BRTOS_GetCurrentTask()).
+
+@retval BRTOS_FAILURE Invalid task, the caller itself or a task not ready to run.
+@retval BRTOS_SUCCESS The CPU was given to the task (the caller runs again).
+*/
+int BRTOS_YieldTo(unsigned char ucTask)
+{
+	BRTOS_TCB *psCaller;
+	BRTOS_TCB *psTask;
+	unsigned short usLeft;
+
+	EnterCriticalSection();
+
+	if(!TaskValid(ucTask) || ucTask == ucCurrentTask || 
+	   asBrtosTasks[ucTask].ucTaskState != BRTOS_TASK_STATE_READY)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	psCaller = &asBrtosTasks[ucCurrentTask];
+	psTask   = &asBrtosTasks[ucTask];
+
+	/* rest of the caller's time slice, given to the target */
+	usLeft = TaskConst(ucCurrentTask)->usTimeSlice > psCaller->usTicks ?
+	         TaskConst(ucCurrentTask)->usTimeSlice - psCaller->usTicks : 1;
+	if(usLeft > TaskConst(ucTask)->usTimeSlice)
+		usLeft = TaskConst(ucTask)->usTimeSlice;
+	psTask->usTicks = TaskConst(ucTask)->usTimeSlice - usLeft;
+
+	psCaller->ucTaskState = BRTOS_TASK_STATE_READY;
+	psCaller->usTicks     = 0;
+	if(aucReadyTail[psCaller->ucLevel] != ucCurrentTask)
+	{
+		BRTOS_ReadyRemove(ucCurrentTask);
+		BRTOS_ReadyInsert(ucCurrentTask);
+	}
+
+	if(aucReadyHead[psTask->ucLevel] != ucTask)
+	{
+		BRTOS_ReadyRemove(ucTask);
+		BRTOS_ReadyInsertHead(ucTask);
+	}
+
+	BRTOS_WaitSwitch();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Initialize a software timer. The timer is created stopped.
+
+@param psTimer  Timer control block, allocated by the user.
+@param callback Function called when the timer expires. It runs in timer context
+                (see \ref BRTOS_TimerStep()) and receives arg.
+@param arg      Callback argument.
+@param pri      Callback priority (BRTOS_TASK_PRIORITY_1 to BRTOS_TASK_PRIORITY_8). When several
+                timers expire at the same tick, higher priorities are called first.
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The timer was created sucessfully.
+*/
+int BRTOS_TimerCreate(BRTOS_TIMER *psTimer, pfTaskEntry callback, unsigned long arg, int pri)
+{
+	if(psTimer == 0 || callback == 0 || (pri & 0xFF) == 0)
+		return BRTOS_FAILURE;
+
+	psTimer->psNext       = 0;
+	psTimer->ppsPrev      = 0;
+	psTimer->pfEntryPoint = callback;
+	psTimer->ulArg        = arg;
+	psTimer->usExpire     = 0;
+	psTimer->usPeriod     = 0;
+	psTimer->ucPriority   = pri;
+	psTimer->ucStatus     = BRTOS_TIMER_STOPPED;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Start (or restart) a timer. The timing wheel covers 16 bits of ticks, so 
+times and periods can not be longer than 65535 ticks (32 s at 2000 ticks/s).
+
+@param psTimer  Timer created by \ref BRTOS_TimerCreate().
+@param usTime   Time to first expiration, in milliseconds.
+@param usPeriod Period for next expirations, in milliseconds (0 for one shot timers).
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The timer was started sucessfully.
+*/
+int BRTOS_TimerStart(BRTOS_TIMER *psTimer, unsigned short usTime, unsigned short usPeriod)
+{
+	BRTOS_TICKS t = MSEC_TO_TICKS(usTime);
+
+	if(psTimer == 0 || psTimer->pfEntryPoint == 0 || t > 0xFFFF || MSEC_TO_TICKS(usPeriod) > 0xFFFF)
+		return BRTOS_FAILURE;
+
+	if(t == 0)
+		t = 1;
+
+	EnterCriticalSection();
+
+	if(psTimer->ucStatus == BRTOS_TIMER_ACTIVE)
+		BRTOS_TimerUnlink(psTimer);
+	else
+		usActiveTimers++;
+
+	/* usTimerNext - 1 is the current tick */
+	psTimer->usExpire = usTimerNext - 1 + (unsigned short) t;
+	psTimer->usPeriod = (unsigned short) MSEC_TO_TICKS(usPeriod);
+	psTimer->ucStatus = BRTOS_TIMER_ACTIVE;
+	BRTOS_TimerInsert(psTimer);
+
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Change the next expiration of a timer, keeping its period. 
+A stopped timer is started.
+
+@param psTimer Timer created by \ref BRTOS_TimerCreate().
+@param usTime  New time to expiration, in milliseconds (up to 65535 ticks).
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The timer was rescheduled sucessfully.
+*/
+int BRTOS_TimerReschedule(BRTOS_TIMER *psTimer, unsigned short usTime)
+{
+	BRTOS_TICKS t = MSEC_TO_TICKS(usTime);
+
+	if(psTimer == 0 || psTimer->pfEntryPoint == 0 || t > 0xFFFF)
+		return BRTOS_FAILURE;
+
+	if(t == 0)
+		t = 1;
+
+	EnterCriticalSection();
+
+	if(psTimer->ucStatus == BRTOS_TIMER_ACTIVE)
+		BRTOS_TimerUnlink(psTimer);
+	else
+		usActiveTimers++;
+
+	psTimer->usExpire = usTimerNext - 1 + (unsigned short) t;
+	psTimer->ucStatus = BRTOS_TIMER_ACTIVE;
+	BRTOS_TimerInsert(psTimer);
+
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Stop a timer. Its callback will not be called, even if it has
+already expired at the current tick.
+
+@param psTimer Timer created by \ref BRTOS_TimerCreate().
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The timer was stopped sucessfully.
+*/
+int BRTOS_TimerStop(BRTOS_TIMER *psTimer)
+{
+	if(psTimer == 0)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+
+	if(psTimer->ucStatus == BRTOS_TIMER_ACTIVE)
+	{
+		BRTOS_TimerUnlink(psTimer);
+		psTimer->ucStatus = BRTOS_TIMER_STOPPED;
+		usActiveTimers--;
+	}
+
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Initialize a counting semaphore.
+
+@param psSem     Semaphore control block, allocated by the user.
+@param usInitial Initial count.
+@param usMax     Maximum count (1 for binary semaphores).
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The semaphore was created sucessfully.
+*/
+int BRTOS_SemCreate(BRTOS_SEM *psSem, unsigned short usInitial, unsigned short usMax)
+{
+	if(psSem == 0 || usMax == 0 || usInitial > usMax)
+		return BRTOS_FAILURE;
+
+	psSem->sQueue.ucHead = BRTOS_NO_TASK_TO_RUN;
+	psSem->sQueue.ucType = BRTOS_WAITQ_SEM;
+	WaitAnyInit(&psSem->sQueue);
+	psSem->usCount       = usInitial;
+	psSem->usMax         = usMax;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Take a semaphore (decrement its count), waiting while the count is zero.
+Waiting tasks are woken up by priority order (FIFO for the same priority).
+
+@param psSem     Semaphore created by \ref BRTOS_SemCreate().
+@param usTimeout Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+                 Inside timer callbacks only BRTOS_NO_WAIT is possible.
+
+@retval BRTOS_TIMEOUT The count was zero during the timeout.
+@retval BRTOS_SUCCESS The semaphore was taken.
+*/
+int BRTOS_SemTake(BRTOS_SEM *psSem, unsigned short usTimeout)
+{
+	EnterCriticalSection();
+
+	if(psSem->usCount > 0)
+	{
+		psSem->usCount--;
+		LeaveCriticalSection();
+		return BRTOS_SUCCESS;
+	}
+
+	if(usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+	{
+		LeaveCriticalSection();
+		return BRTOS_TIMEOUT;
+	}
+
+	BRTOS_WaitBlock(&psSem->sQueue, usTimeout);
+
+	return BRTOS_WaitSwitch();
+}
+
+/**
+Give a semaphore: the first waiting task is woken up or the count is incremented.
+
+@retval BRTOS_FAILURE Count already at its maximum.
+@retval BRTOS_SUCCESS The semaphore was given.
+*/
+static int BRTOS_SemSignal(BRTOS_SEM *psSem)
+{
+	if(psSem->sQueue.ucHead != BRTOS_NO_TASK_TO_RUN)
+		BRTOS_WaitWake(&psSem->sQueue);
+	else if(psSem->usCount < psSem->usMax)
+	{
+		psSem->usCount++;
+		WaitAnyWake(&psSem->sQueue);
+	}
+	else
+		return BRTOS_FAILURE;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Give a semaphore. The first waiting task (highest priority) becomes ready 
+and preempts the caller if it has a higher priority.
+
+@param psSem Semaphore created by \ref BRTOS_SemCreate().
+
+@retval BRTOS_FAILURE Count already at its maximum.
+@retval BRTOS_SUCCESS The semaphore was given.
+*/
+int BRTOS_SemGive(BRTOS_SEM *psSem)
+{
+	int iRet;
+
+	EnterCriticalSection();
+	iRet = BRTOS_SemSignal(psSem);
+	BRTOS_LeaveAndPreempt();
+
+	return iRet;
+}
+
+/**
+Give a semaphore from an interrupt service routine (interrupts disabled).
+The woken task is selected at the next system tick or, if the routine uses 
+\ref BRTOS_ISR_Enter(), when it calls \ref BRTOS_ISR_Exit().
+
+@param psSem Semaphore created by \ref BRTOS_SemCreate().
+
+@retval BRTOS_FAILURE Count already at its maximum.
+@retval BRTOS_SUCCESS The semaphore was given.
+*/
+int BRTOS_SemGiveFromISR(BRTOS_SEM *psSem)
+{
+	return BRTOS_SemSignal(psSem);
+}
+
+/**
+Initialize a mutex. Mutexes can be locked recursively by their owner and 
+use priority inheritance: the owner runs with the priority of the highest
+priority task waiting for it.
+
+@param psMutex Mutex control block, allocated by the user.
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The mutex was created sucessfully.
+*/
+int BRTOS_MutexCreate(BRTOS_MUTEX *psMutex)
+{
+	if(psMutex == 0)
+		return BRTOS_FAILURE;
+
+	psMutex->sQueue.ucHead = BRTOS_NO_TASK_TO_RUN;
+	psMutex->sQueue.ucType = BRTOS_WAITQ_MUTEX;
+	psMutex->ucOwner       = BRTOS_NO_TASK_TO_RUN;
+	psMutex->ucNesting     = 0;
+	psMutex->psNextHeld    = 0;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Lock a mutex, waiting while it is owned by another task. The owner
+inherits the priority of the caller, if it is higher.
+
+@param psMutex   Mutex created by \ref BRTOS_MutexCreate().
+@param usTimeout Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@retval BRTOS_FAILURE Too many recursive locks.
+@retval BRTOS_TIMEOUT The mutex was owned by other task during the timeout.
+@retval BRTOS_SUCCESS The mutex was locked.
+*/
+int BRTOS_MutexLock(BRTOS_MUTEX *psMutex, unsigned short usTimeout)
+{
+	BRTOS_TCB *psTask;
+
+	EnterCriticalSection();
+
+	psTask = &asBrtosTasks[ucCurrentTask];
+
+	if(psMutex->ucOwner == BRTOS_NO_TASK_TO_RUN)
+	{
+		psMutex->ucOwner    = ucCurrentTask;
+		psMutex->ucNesting  = 1;
+		psMutex->psNextHeld = psTask->psMutexHeld;
+		psTask->psMutexHeld = psMutex;
+		LeaveCriticalSection();
+		return BRTOS_SUCCESS;
+	}
+
+	if(psMutex->ucOwner == ucCurrentTask)
+	{
+		if(psMutex->ucNesting == 0xFF)
+		{
+			LeaveCriticalSection();
+			return BRTOS_FAILURE;
+		}
+		psMutex->ucNesting++;
+		LeaveCriticalSection();
+		return BRTOS_SUCCESS;
+	}
+
+	if(usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+	{
+		LeaveCriticalSection();
+		return BRTOS_TIMEOUT;
+	}
+
+	BRTOS_WaitBlock(&psMutex->sQueue, usTimeout);
+	BRTOS_UpdateLevel(psMutex->ucOwner);
+
+	/* on success, the ownership was given by BRTOS_MutexUnlock() */
+	return BRTOS_WaitSwitch();
+}
+
+/**
+Give a mutex released by its owner, already removed from the owner list of
+held mutexes, to the first waiting task (highest priority). Without waiting
+tasks, the mutex is free (interrupts disabled).
+*/
+static void BRTOS_MutexGive(BRTOS_MUTEX *psMutex)
+{
+	unsigned char ucTask;
+
+	if(psMutex->sQueue.ucHead != BRTOS_NO_TASK_TO_RUN)
+	{
+		ucTask = BRTOS_WaitWake(&psMutex->sQueue);
+		psMutex->ucOwner    = ucTask;
+		psMutex->ucNesting  = 1;
+		psMutex->psNextHeld = asBrtosTasks[ucTask].psMutexHeld;
+		asBrtosTasks[ucTask].psMutexHeld = psMutex;
+		BRTOS_UpdateLevel(ucTask);
+	}
+	else
+	{
+		psMutex->ucOwner    = BRTOS_NO_TASK_TO_RUN;
+		psMutex->psNextHeld = 0;
+	}
+}
+
+/**
+Unlock a mutex. When the last recursive lock is released, the mutex is given 
+to the first waiting task (highest priority) and the caller goes back to its
+own priority (or the one inherited from other mutexes it holds).
+
+@param psMutex Mutex locked by the caller.
+
+@retval BRTOS_FAILURE The caller is not the owner.
+@retval BRTOS_SUCCESS The mutex was unlocked.
+*/
+int BRTOS_MutexUnlock(BRTOS_MUTEX *psMutex)
+{
+	BRTOS_MUTEX **ppsLink;
+
+	EnterCriticalSection();
+
+	if(psMutex->ucOwner != ucCurrentTask)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	if(--psMutex->ucNesting > 0)
+	{
+		LeaveCriticalSection();
+		return BRTOS_SUCCESS;
+	}
+
+	/* remove from the list of held mutexes */
+	for(ppsLink = &asBrtosTasks[ucCurrentTask].psMutexHeld ; *ppsLink != psMutex ; ppsLink = &(*ppsLink)->psNextHeld)
+		;
+	*ppsLink = psMutex->psNextHeld;
+
+	BRTOS_MutexGive(psMutex);
+	BRTOS_UpdateLevel(ucCurrentTask);
+	BRTOS_LeaveAndPreempt();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Initialize a single producer, single consumer ring buffer. The producer is 
+usually an interrupt service routine and the consumer a task. Data is moved
+without masking interrupts: the producer only changes the write index and
+the consumer only the read index. Interrupts are disabled only to wake up
+the consumer, waiting in \ref BRTOS_RingWait().
+
+@param psRing      Ring buffer control block, allocated by the user.
+@param pvBuffer    Storage for usNumElems elements.
+@param usElemSize  Element size in bytes (1 for byte streams).
+@param usNumElems  Number of elements, a power of two up to 32768.
+@param usHighWater Elements needed to wake up the consumer (0 or 1: any data).
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The ring buffer was created sucessfully.
+*/
+int BRTOS_RingCreate(BRTOS_RING *psRing, void *pvBuffer, unsigned short usElemSize, unsigned short usNumElems, unsigned short usHighWater)
+{
+	if(psRing == 0 || pvBuffer == 0 || usElemSize == 0 || 
+	   usNumElems == 0 || usNumElems > 0x8000 || (usNumElems & (usNumElems - 1)) ||
+	   usHighWater > usNumElems)
+		return BRTOS_FAILURE;
+
+	psRing->sQueue.ucHead = BRTOS_NO_TASK_TO_RUN;
+	psRing->sQueue.ucType = BRTOS_WAITQ_RING;
+	WaitAnyInit(&psRing->sQueue);
+	psRing->pucBuffer     = (unsigned char *) pvBuffer;
+	psRing->usElemSize    = usElemSize;
+	psRing->usMask        = usNumElems - 1;
+	psRing->usHighWater   = usHighWater ? usHighWater : 1;
+	psRing->usDropped     = 0;
+	psRing->usHead        = 0;
+	psRing->usTail        = 0;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Amount of elements in the ring buffer.
+
+@param psRing Ring buffer created by \ref BRTOS_RingCreate().
+@return elements available for reading
+*/
+unsigned short BRTOS_RingCount(BRTOS_RING *psRing)
+{
+	return (unsigned short)(psRing->usHead - psRing->usTail);
+}
+
+/**
+Get the contiguous free space at the write position (producer only), 
+so elements can be written in place. They become visible to the consumer
+after \ref BRTOS_RingWriteCommit() or \ref BRTOS_RingWriteCommitFromISR().
+When the free space wraps around the end of the buffer, a second call 
+after the commit returns the remaining part.
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param ppvSpan Returns the address of the first free element.
+@return amount of contiguous free elements (0: ring full)
+*/
+unsigned short BRTOS_RingWriteSpan(BRTOS_RING *psRing, void **ppvSpan)
+{
+	unsigned short usHead = psRing->usHead;
+	unsigned short usFree = psRing->usMask + 1 - (unsigned short)(usHead - psRing->usTail);
+	unsigned short usEnd  = psRing->usMask + 1 - (usHead & psRing->usMask);
+
+	*ppvSpan = psRing->pucBuffer + (usHead & psRing->usMask)*psRing->usElemSize;
+
+	return usFree < usEnd ? usFree : usEnd;
+}
+
+/**
+Make written elements visible to the consumer. 
+*/
+static void BRTOS_RingPublish(BRTOS_RING *psRing, unsigned short usCount)
+{
+	/* elements must be in memory before the index moves */
+	BRTOS_PortMemoryBarrier();
+	psRing->usHead += usCount;
+	BRTOS_PortMemoryBarrier();
+}
+
+/**
+Wake up the consumer (or a \ref BRTOS_WaitAny() waiter) if the high water mark
+was reached (interrupts disabled).
+*/
+static void BRTOS_RingNotify(BRTOS_RING *psRing)
+{
+	if(psRing->sQueue.ucHead != BRTOS_NO_TASK_TO_RUN &&
+	   (unsigned short)(psRing->usHead - psRing->usTail) >= psRing->usHighWater)
+		BRTOS_WaitWake(&psRing->sQueue);
+#if BRTOS_WAIT_ANY
+	else if(psRing->sQueue.psAnyHead &&
+	        (unsigned short)(psRing->usHead - psRing->usTail) >= psRing->usHighWater)
+		BRTOS_WaitAnyWake(&psRing->sQueue);
+#endif
+}
+
+/**
+Wake up the consumer from a task producer, switching to it when it has a 
+higher priority. Interrupts are disabled only when the consumer is waiting.
+*/
+static void BRTOS_RingWakeConsumer(BRTOS_RING *psRing)
+{
+	if(psRing->sQueue.ucHead == BRTOS_NO_TASK_TO_RUN && !WaitAnyArmed(&psRing->sQueue))
+		return;
+
+	EnterCriticalSection();
+	BRTOS_RingNotify(psRing);
+	BRTOS_LeaveAndPreempt();
+}
+
+/**
+Copy elements into the ring buffer, using up to two spans.
+
+@return amount of elements written
+*/
+static unsigned short BRTOS_RingCopyIn(BRTOS_RING *psRing, const void *pvData, unsigned short usCount)
+{
+	const unsigned char *pucData = (const unsigned char *) pvData;
+	unsigned short usDone = 0;
+	unsigned short usSpan;
+	void *pvSpan;
+
+	while(usDone < usCount && (usSpan = BRTOS_RingWriteSpan(psRing, &pvSpan)) > 0)
+	{
+		if(usSpan > usCount - usDone)
+			usSpan = usCount - usDone;
+
+		memcpy(pvSpan, pucData + usDone*psRing->usElemSize, usSpan*psRing->usElemSize);
+		BRTOS_RingPublish(psRing, usSpan);
+		usDone += usSpan;
+	}
+
+	psRing->usDropped += usCount - usDone;
+
+	return usDone;
+}
+
+/**
+Commit elements written in the span given by \ref BRTOS_RingWriteSpan() (task producer).
+A waiting consumer is woken up when the high water mark is reached and 
+preempts the caller if it has a higher priority.
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param usCount Amount of elements written, up to the span size.
+*/
+void BRTOS_RingWriteCommit(BRTOS_RING *psRing, unsigned short usCount)
+{
+	BRTOS_RingPublish(psRing, usCount);
+	BRTOS_RingWakeConsumer(psRing);
+}
+
+/**
+Commit elements written in the span given by \ref BRTOS_RingWriteSpan(), from
+an interrupt service routine (interrupts disabled). A consumer woken up by
+the high water mark runs after \ref BRTOS_ISR_Exit() or at the next system tick.
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param usCount Amount of elements written, up to the span size.
+*/
+void BRTOS_RingWriteCommitFromISR(BRTOS_RING *psRing, unsigned short usCount)
+{
+	BRTOS_RingPublish(psRing, usCount);
+	BRTOS_RingNotify(psRing);
+}
+
+/**
+Copy elements into the ring buffer (task producer). Elements that do not fit
+are dropped and counted in usDropped.
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param pvData  Elements to write.
+@param usCount Amount of elements.
+@return amount of elements written
+*/
+unsigned short BRTOS_RingWrite(BRTOS_RING *psRing, const void *pvData, unsigned short usCount)
+{
+	unsigned short usDone = BRTOS_RingCopyIn(psRing, pvData, usCount);
+
+	BRTOS_RingWakeConsumer(psRing);
+
+	return usDone;
+}
+
+/**
+Copy elements into the ring buffer from an interrupt service routine 
+(interrupts disabled). Elements that do not fit are dropped and counted in usDropped.
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param pvData  Elements to write.
+@param usCount Amount of elements.
+@return amount of elements written
+*/
+unsigned short BRTOS_RingWriteFromISR(BRTOS_RING *psRing, const void *pvData, unsigned short usCount)
+{
+	unsigned short usDone = BRTOS_RingCopyIn(psRing, pvData, usCount);
+
+	BRTOS_RingNotify(psRing);
+
+	return usDone;
+}
+
+/**
+Get the contiguous elements at the read position (consumer only), so they
+can be used in place. They are released with \ref BRTOS_RingReadRelease().
+When the data wraps around the end of the buffer, a second call after the
+release returns the remaining part.
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param ppvSpan Returns the address of the first element.
+@return amount of contiguous elements (0: ring empty)
+*/
+unsigned short BRTOS_RingReadSpan(BRTOS_RING *psRing, void **ppvSpan)
+{
+	unsigned short usTail  = psRing->usTail;
+	unsigned short usCount = (unsigned short)(psRing->usHead - usTail);
+	unsigned short usEnd   = psRing->usMask + 1 - (usTail & psRing->usMask);
+
+	/* elements are read only after the index */
+	BRTOS_PortMemoryBarrier();
+	*ppvSpan = psRing->pucBuffer + (usTail & psRing->usMask)*psRing->usElemSize;
+
+	return usCount < usEnd ? usCount : usEnd;
+}
+
+/**
+Release elements read from the span given by \ref BRTOS_RingReadSpan().
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param usCount Amount of elements consumed, up to the span size.
+*/
+void BRTOS_RingReadRelease(BRTOS_RING *psRing, unsigned short usCount)
+{
+	/* elements must be read before the producer can reuse them */
+	BRTOS_PortMemoryBarrier();
+	psRing->usTail += usCount;
+}
+
+/**
+Copy elements from the ring buffer (consumer only).
+
+@param psRing  Ring buffer created by \ref BRTOS_RingCreate().
+@param pvData  Destination.
+@param usCount Maximum amount of elements.
+@return amount of elements read
+*/
+unsigned short BRTOS_RingRead(BRTOS_RING *psRing, void *pvData, unsigned short usCount)
+{
+	unsigned char *pucData = (unsigned char *) pvData;
+	unsigned short usDone = 0;
+	unsigned short usSpan;
+	void *pvSpan;
+
+	while(usDone < usCount && (usSpan = BRTOS_RingReadSpan(psRing, &pvSpan)) > 0)
+	{
+		if(usSpan > usCount - usDone)
+			usSpan = usCount - usDone;
+
+		memcpy(pucData + usDone*psRing->usElemSize, pvSpan, usSpan*psRing->usElemSize);
+		BRTOS_RingReadRelease(psRing, usSpan);
+		usDone += usSpan;
+	}
+
+	return usDone;
+}
+
+/**
+Wait until the ring buffer has at least the high water mark of elements
+(consumer only). Use a timeout to get the remaining data when the producer 
+stops below the mark (idle line).
+
+@param psRing    Ring buffer created by \ref BRTOS_RingCreate().
+@param usTimeout Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@retval BRTOS_TIMEOUT The high water mark was not reached during the timeout.
+@retval BRTOS_SUCCESS The high water mark was reached.
+*/
+int BRTOS_RingWait(BRTOS_RING *psRing, unsigned short usTimeout)
+{
+	EnterCriticalSection();
+
+	if((unsigned short)(psRing->usHead - psRing->usTail) >= psRing->usHighWater)
+	{
+		LeaveCriticalSection();
+		return BRTOS_SUCCESS;
+	}
+
+	if(usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+	{
+		LeaveCriticalSection();
+		return BRTOS_TIMEOUT;
+	}
+
+	BRTOS_WaitBlock(&psRing->sQueue, usTimeout);
+
+	return BRTOS_WaitSwitch();
+}
+
+/**
+Initialize a pool of fixed size blocks. Blocks are allocated and freed in
+constant time, from tasks or interrupts, without fragmentation. 
+Use several pools for different block sizes (see \ref BRTOS_PoolSetAlloc()).
+
+@param psPool      Pool control block, allocated by the user.
+@param pvBuffer    Storage for the blocks, BRTOS_POOL_BUFFER_SIZE(usBlockSize, usNumBlocks) 
+                   bytes aligned for pointers.
+@param usBlockSize Block size in bytes, rounded up by BRTOS_POOL_BLOCK_SIZE().
+@param usNumBlocks Number of blocks.
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The pool was created sucessfully.
+*/
+int BRTOS_PoolCreate(BRTOS_POOL *psPool, void *pvBuffer, unsigned short usBlockSize, unsigned short usNumBlocks)
+{
+	unsigned char *pucBlock;
+	unsigned short i;
+
+	if(psPool == 0 || pvBuffer == 0 || usBlockSize == 0 || usNumBlocks == 0)
+		return BRTOS_FAILURE;
+
+	usBlockSize = BRTOS_POOL_BLOCK_SIZE(usBlockSize);
+
+	psPool->sQueue.ucHead = BRTOS_NO_TASK_TO_RUN;
+	psPool->sQueue.ucType = BRTOS_WAITQ_POOL;
+	WaitAnyInit(&psPool->sQueue);
+	psPool->pucBuffer     = (unsigned char *) pvBuffer;
+	psPool->pucEnd        = psPool->pucBuffer + (unsigned long) usBlockSize*usNumBlocks;
+	psPool->usBlockSize   = usBlockSize;
+	psPool->usNumBlocks   = usNumBlocks;
+	psPool->usUsed        = 0;
+	psPool->usMaxUsed     = 0;
+
+	/* free list in address order */
+	pucBlock = psPool->pucBuffer;
+	for(i = 0 ; i < usNumBlocks - 1 ; i++, pucBlock += usBlockSize)
+		*(void **) pucBlock = pucBlock + usBlockSize;
+	*(void **) pucBlock = 0;
+	psPool->pvFree = pvBuffer;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Take the first free block (interrupts disabled).
+
+@return block or 0 when the pool is empty
+*/
+static void *BRTOS_PoolTake(BRTOS_POOL *psPool)
+{
+	void *pvBlock = psPool->pvFree;
+
+	if(pvBlock)
+	{
+		psPool->pvFree = *(void **) pvBlock;
+		if(++psPool->usUsed > psPool->usMaxUsed)
+			psPool->usMaxUsed = psPool->usUsed;
+	}
+
+	return pvBlock;
+}
+
+/**
+Return a block to the pool (interrupts disabled). When tasks are waiting, 
+the block is given to the first one and stays in use.
+
+@retval BRTOS_FAILURE The block does not belong to the pool.
+@retval BRTOS_SUCCESS The block was freed.
+*/
+static int BRTOS_PoolPut(BRTOS_POOL *psPool, void *pvBlock)
+{
+	unsigned char ucTask;
+
+	if((unsigned char *) pvBlock < psPool->pucBuffer || (unsigned char *) pvBlock >= psPool->pucEnd)
+		return BRTOS_FAILURE;
+
+	if(psPool->sQueue.ucHead != BRTOS_NO_TASK_TO_RUN)
+	{
+		ucTask = BRTOS_WaitWake(&psPool->sQueue);
+		asBrtosTasks[ucTask].pvWaitData = pvBlock;
+	}
+	else
+	{
+		*(void **) pvBlock = psPool->pvFree;
+		psPool->pvFree = pvBlock;
+		psPool->usUsed--;
+		WaitAnyWake(&psPool->sQueue);
+	}
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Allocate a block, waiting while the pool is empty.
+
+@param psPool    Pool created by \ref BRTOS_PoolCreate().
+@param usTimeout Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@return block or 0 when the pool was empty during the timeout
+*/
+void *BRTOS_PoolAlloc(BRTOS_POOL *psPool, unsigned short usTimeout)
+{
+	void *pvBlock;
+
+	EnterCriticalSection();
+
+	pvBlock = BRTOS_PoolTake(psPool);
+	if(pvBlock || usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+	{
+		LeaveCriticalSection();
+		return pvBlock;
+	}
+
+	BRTOS_WaitBlock(&psPool->sQueue, usTimeout);
+
+	/* on success, the block was given by BRTOS_PoolFree() */
+	if(BRTOS_WaitSwitch() != BRTOS_SUCCESS)
+		return 0;
+
+	return asBrtosTasks[ucCurrentTask].pvWaitData;
+}
+
+/**
+Allocate a block from an interrupt service routine (interrupts disabled).
+
+@param psPool Pool created by \ref BRTOS_PoolCreate().
+
+@return block or 0 when the pool is empty
+*/
+void *BRTOS_PoolAllocFromISR(BRTOS_POOL *psPool)
+{
+	return BRTOS_PoolTake(psPool);
+}
+
+/**
+Free a block. If tasks are waiting for the pool, the block is given to
+the first one (highest priority), which preempts the caller if it has a 
+higher priority.
+
+@param psPool  Pool of the block.
+@param pvBlock Block allocated from psPool.
+
+@retval BRTOS_FAILURE The block does not belong to the pool.
+@retval BRTOS_SUCCESS The block was freed.
+*/
+int BRTOS_PoolFree(BRTOS_POOL *psPool, void *pvBlock)
+{
+	int iRet;
+
+	EnterCriticalSection();
+	iRet = BRTOS_PoolPut(psPool, pvBlock);
+	BRTOS_LeaveAndPreempt();
+
+	return iRet;
+}
+
+/**
+Free a block from an interrupt service routine (interrupts disabled).
+A task waiting for the block runs after \ref BRTOS_ISR_Exit() or at the next system tick.
+
+@param psPool  Pool of the block.
+@param pvBlock Block allocated from psPool.
+
+@retval BRTOS_FAILURE The block does not belong to the pool.
+@retval BRTOS_SUCCESS The block was freed.
+*/
+int BRTOS_PoolFreeFromISR(BRTOS_POOL *psPool, void *pvBlock)
+{
+	return BRTOS_PoolPut(psPool, pvBlock);
+}
+
+/**
+Allocate a block of at least usSize bytes from a set of pools, sorted by
+increasing block size. The smallest block available is taken; when all 
+pools big enough are empty, the caller waits for the smallest one.
+
+@param asPools    Pools created by \ref BRTOS_PoolCreate(), sorted by block size.
+@param ucNumPools Number of pools.
+@param usSize     Size needed, in bytes.
+@param usTimeout  Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@return block or 0 (no pool big enough or timeout)
+*/
+void *BRTOS_PoolSetAlloc(BRTOS_POOL *asPools, unsigned char ucNumPools, unsigned short usSize, unsigned short usTimeout)
+{
+	unsigned char ucFirst;
+	unsigned char i;
+	void *pvBlock;
+
+	for(ucFirst = 0 ; ucFirst < ucNumPools && asPools[ucFirst].usBlockSize < usSize ; ucFirst++)
+		;
+
+	if(ucFirst == ucNumPools)
+		return 0;
+
+	for(i = ucFirst ; i < ucNumPools ; i++)
+	{
+		pvBlock = BRTOS_PoolAlloc(&asPools[i], BRTOS_NO_WAIT);
+		if(pvBlock)
+			return pvBlock;
+	}
+
+	return BRTOS_PoolAlloc(&asPools[ucFirst], usTimeout);
+}
+
+/**
+Free a block allocated by \ref BRTOS_PoolSetAlloc(). The pool is found by the block address.
+
+@param asPools    Pools used to allocate the block.
+@param ucNumPools Number of pools.
+@param pvBlock    Block to free.
+
+@retval BRTOS_FAILURE The block does not belong to any pool.
+@retval BRTOS_SUCCESS The block was freed.
+*/
+int BRTOS_PoolSetFree(BRTOS_POOL *asPools, unsigned char ucNumPools, void *pvBlock)
+{
+	unsigned char i;
+
+	for(i = 0 ; i < ucNumPools ; i++)
+		if((unsigned char *) pvBlock >= asPools[i].pucBuffer && (unsigned char *) pvBlock < asPools[i].pucEnd)
+			return BRTOS_PoolFree(&asPools[i], pvBlock);
+
+	return BRTOS_FAILURE;
+}
+
+/**
+Identifier of the running task (its index, see \ref BRTOS_CreateTask()).
+
+@return current task
+*/
+unsigned char BRTOS_GetCurrentTask(void)
+{
+	return ucCurrentTask;
+}
+
+#ifndef BRTOS_STATIC_TASKS
+/**
+Create a task with a stack taken from a pool of stacks (blocks of the stack
+size, see \ref BRTOS_PoolCreate()). The stack goes back to the pool when the
+task ends, so short lived tasks can be created again and again, reusing 
+TCBs and stacks. The new task preempts the caller if it has a higher priority.
+
+@param entry_point Task entry point. It should be a function that follows \ref pfTaskEntry.
+@param psStacks    Pool of stacks.
+@param time_slice  Task time slice, specified in ms.
+@param pri         Task priority, one of BRTOS_TASK_PRIORITY_1 (highest) to BRTOS_TASK_PRIORITY_8 (lowest).
+@param pucTask     Index of the new task, for \ref BRTOS_TaskJoin() (it may be 0).
+
+@retval BRTOS_FAILURE Invalid priority, stack too small or no free stack.
+@retval BRTOS_NO_ROOM_IN_TCB_ARRAY No free TCB.
+@retval BRTOS_SUCCESS The task was created sucessfully.
+*/
+int BRTOS_TaskSpawn(pfTaskEntry entry_point, BRTOS_POOL *psStacks, int time_slice, int pri, unsigned char *pucTask)
+{
+	unsigned short *pusStack;
+	unsigned char ucTask;
+	int iRet;
+
+	EnterCriticalSection();
+
+	pusStack = BRTOS_PoolTake(psStacks);
+	if(pusStack == 0)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	iRet = BRTOS_TaskNew(entry_point, pusStack, psStacks->usBlockSize, time_slice, pri, &ucTask);
+	if(iRet != BRTOS_SUCCESS)
+	{
+		BRTOS_PoolPut(psStacks, pusStack);
+		LeaveCriticalSection();
+		return iRet;
+	}
+
+	asBrtosTasks[ucTask].psStackPool  = psStacks;
+	asBrtosTasks[ucTask].pvStackBlock = pusStack;
+	if(pucTask)
+		*pucTask = ucTask;
+
+	BRTOS_LeaveAndPreempt();
+
+	return BRTOS_SUCCESS;
+}
+#endif
+
+/**
+Release the TCB of a task that ended, already removed from the ready, sleep
+and wait lists (interrupts disabled). Tasks joining it are woken up, its 
+stack goes back to its pool (\ref BRTOS_TaskSpawn()) and the TCB is free
+for a new task.
+*/
+static void BRTOS_TaskFree(unsigned char ucTask)
+{
+	BRTOS_TCB *psTask = &asBrtosTasks[ucTask];
+	unsigned char *pucLink = &sJoinQueue.ucHead;
+	unsigned char ucJoiner;
+
+	while(*pucLink != BRTOS_NO_TASK_TO_RUN)
+	{
+		ucJoiner = *pucLink;
+		if(asBrtosTasks[ucJoiner].pvWaitData == psTask)
+		{
+			*pucLink = asBrtosTasks[ucJoiner].ucWaitNext;
+			BRTOS_WaitEnd(ucJoiner);
+		}
+		else
+			pucLink = &asBrtosTasks[ucJoiner].ucWaitNext;
+	}
+
+	if(ucTask == ucDeferTask)
+		ucDeferTask = BRTOS_NO_TASK_TO_RUN;
+
+	psTask->ucTaskState = BRTOS_TASK_STATE_INVALID;
+#ifndef BRTOS_STATIC_TASKS
+	if(psTask->psStackPool)
+		BRTOS_PoolPut(psTask->psStackPool, psTask->pvStackBlock);
+
+	psTask->ucNext = ucFreeTask;
+	ucFreeTask     = ucTask;
+#endif
+}
+
+/**
+End the calling task, which is switched out right away. Mutexes it holds
+are given to their waiting tasks, tasks joining it are woken up and its TCB
+and stack are free for new tasks. It is called when a task returns from its
+entry point. It never returns.
+*/
+void BRTOS_TaskExit(void)
+{
+	BRTOS_TCB   *psTask;
+	BRTOS_MUTEX *psMutex;
+
+	EnterCriticalSection();
+
+	psTask = &asBrtosTasks[ucCurrentTask];
+	while((psMutex = psTask->psMutexHeld) != 0)
+	{
+		psTask->psMutexHeld = psMutex->psNextHeld;
+		BRTOS_MutexGive(psMutex);
+	}
+
+	BRTOS_ReadyRemove(ucCurrentTask);
+	BRTOS_TaskFree(ucCurrentTask);
+
+	/* the TCB and the stack are not given to other tasks before the switch,
+	   done with interrupts disabled. Critical sections of the task end here */
+	ucCriticalNesting = 0;
+	BRTOS_PortYield();
+}
+
+/**
+Delete a task: it leaves its ready, sleep or wait list and ends, as if it
+had called \ref BRTOS_TaskExit(). Tasks holding mutexes cannot be deleted,
+since they may be in the middle of an update protected by the mutex.
+
+@param ucTask Task to delete (the caller itself never returns).
+
+@retval BRTOS_FAILURE Invalid task or task holding mutexes.
+@retval BRTOS_SUCCESS The task was deleted.
+*/
+int BRTOS_TaskDelete(unsigned char ucTask)
+{
+	BRTOS_TCB *psTask;
+
+	if(ucTask == ucCurrentTask)
+		BRTOS_TaskExit();
+
+	EnterCriticalSection();
+
+	if(!TaskValid(ucTask) || asBrtosTasks[ucTask].psMutexHeld)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	psTask = &asBrtosTasks[ucTask];
+	if(psTask->ucTaskState & BRTOS_TASK_STATE_WAITING)
+		BRTOS_WaitRemove(ucTask);
+	if(psTask->ucTaskState & BRTOS_TASK_STATE_SLEEPING)
+		BRTOS_SleepRemove(ucTask);
+	if(psTask->ucTaskState & BRTOS_TASK_STATE_READY)
+		BRTOS_ReadyRemove(ucTask);
+
+	BRTOS_TaskFree(ucTask);
+	BRTOS_LeaveAndPreempt();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Wait for the end of a task (\ref BRTOS_TaskExit(), return from its entry 
+point or \ref BRTOS_TaskDelete()). The index of a task that ended is given 
+to the next task created: the join must be done while the task exists or 
+before other tasks are created, usually by the task that created it.
+
+@param ucTask    Task to wait for.
+@param usTimeout Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@retval BRTOS_FAILURE The caller itself.
+@retval BRTOS_TIMEOUT The task did not end during the timeout.
+@retval BRTOS_SUCCESS The task ended (or there is no such task).
+*/
+int BRTOS_TaskJoin(unsigned char ucTask, unsigned short usTimeout)
+{
+	EnterCriticalSection();
+
+	if(ucTask == ucCurrentTask)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	if(!TaskValid(ucTask))
+	{
+		LeaveCriticalSection();
+		return BRTOS_SUCCESS;
+	}
+
+	if(usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+	{
+		LeaveCriticalSection();
+		return BRTOS_TIMEOUT;
+	}
+
+	asBrtosTasks[ucCurrentTask].pvWaitData = &asBrtosTasks[ucTask];
+	BRTOS_WaitBlock(&sJoinQueue, usTimeout);
+
+	return BRTOS_WaitSwitch();
+}
+
+/**
+Update the notification word of a task and wake it up if it is waiting
+for a notification (interrupts disabled).
+
+@retval BRTOS_FAILURE Invalid task or action.
+@retval BRTOS_SUCCESS The task was notified.
+*/
+static int BRTOS_NotifySignal(unsigned char ucTask, unsigned short usValue, unsigned char ucAction)
+{
+	BRTOS_TCB *psTask;
+
+	if(!TaskValid(ucTask))
+		return BRTOS_FAILURE;
+
+	psTask = &asBrtosTasks[ucTask];
+
+	switch(ucAction)
+	{
+		case BRTOS_NOTIFY_SET_BITS:
+			psTask->usNotifyValue |= usValue;
+			break;
+		case BRTOS_NOTIFY_OVERWRITE:
+			psTask->usNotifyValue = usValue;
+			break;
+		case BRTOS_NOTIFY_INCREMENT:
+			psTask->usNotifyValue++;
+			break;
+		default:
+			return BRTOS_FAILURE;
+	}
+
+	if(psTask->ucNotifyState == BRTOS_NOTIFY_WAITING)
+		BRTOS_WaitEnd(ucTask);
+
+	psTask->ucNotifyState = BRTOS_NOTIFY_PENDING;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Notify a task: its notification word is updated and the task is woken up
+if it is waiting in \ref BRTOS_TaskNotifyWait(), preempting the caller if
+it has a higher priority. Notifications need no object and no wait queue,
+each task has its own notification word.
+
+@param ucTask   Task to notify (see \ref BRTOS_GetCurrentTask()).
+@param usValue  Value used by the action.
+@param ucAction BRTOS_NOTIFY_SET_BITS (or usValue into the word), BRTOS_NOTIFY_OVERWRITE
+                (write usValue) or BRTOS_NOTIFY_INCREMENT (increment the word, usValue ignored).
+
+@retval BRTOS_FAILURE Invalid task or action.
+@retval BRTOS_SUCCESS The task was notified.
+*/
+int BRTOS_TaskNotify(unsigned char ucTask, unsigned short usValue, unsigned char ucAction)
+{
+	int iRet;
+
+	EnterCriticalSection();
+	iRet = BRTOS_NotifySignal(ucTask, usValue, ucAction);
+	BRTOS_LeaveAndPreempt();
+
+	return iRet;
+}
+
+/**
+Notify a task from an interrupt service routine (interrupts disabled).
+The woken task is selected at the next system tick or, if the routine uses 
+\ref BRTOS_ISR_Enter(), when it calls \ref BRTOS_ISR_Exit().
+
+@param ucTask   Task to notify (see \ref BRTOS_GetCurrentTask()).
+@param usValue  Value used by the action.
+@param ucAction BRTOS_NOTIFY_SET_BITS, BRTOS_NOTIFY_OVERWRITE or BRTOS_NOTIFY_INCREMENT.
+
+@retval BRTOS_FAILURE Invalid task or action.
+@retval BRTOS_SUCCESS The task was notified.
+*/
+int BRTOS_TaskNotifyFromISR(unsigned char ucTask, unsigned short usValue, unsigned char ucAction)
+{
+	return BRTOS_NotifySignal(ucTask, usValue, ucAction);
+}
+
+/**
+Wait for a notification to the running task. Notifications received before
+the call are not lost: the call returns at once.
+
+@param usClearOnExit Bits cleared in the notification word after reading it 
+                     (0xFFFF clears the whole word, e.g. after increments).
+@param pusValue      Returns the notification word before clearing (may be 0).
+@param usTimeout     Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@retval BRTOS_TIMEOUT No notification during the timeout.
+@retval BRTOS_SUCCESS A notification was received.
+*/
+int BRTOS_TaskNotifyWait(unsigned short usClearOnExit, unsigned short *pusValue, unsigned short usTimeout)
+{
+	BRTOS_TCB *psTask;
+	int iRet = BRTOS_SUCCESS;
+
+	EnterCriticalSection();
+
+	psTask = &asBrtosTasks[ucCurrentTask];
 
-    _Sleep();
-   
+	if(psTask->ucNotifyState != BRTOS_NOTIFY_PENDING)
+	{
+		if(usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+		{
+			LeaveCriticalSection();
+			return BRTOS_TIMEOUT;
+		}
+
+		psTask->ucNotifyState = BRTOS_NOTIFY_WAITING;
+		BRTOS_WaitBlock(0, usTimeout);
+		iRet = BRTOS_WaitSwitch();
+		EnterCriticalSection();
+	}
+
+	if(iRet == BRTOS_SUCCESS)
+	{
+		if(pusValue)
+			*pusValue = psTask->usNotifyValue;
+		psTask->usNotifyValue &= ~usClearOnExit;
+		psTask->ucNotifyState  = BRTOS_NOTIFY_NONE;
+	}
+
+	LeaveCriticalSection();
+
+	return iRet;
+}
+
+/* wait condition of a task waiting for event flags, kept in its stack */
+typedef struct {
+	unsigned short usFlags;           /* wanted flags, flags seen when woken up */
+	unsigned char  ucOptions;         /* BRTOS_EVENT_xxx */
+} BRTOS_EVENT_WAITER;
+
+/**
+Check the wait condition of event flags.
+*/
+static int BRTOS_EventMatch(unsigned short usFlags, unsigned short usWanted, unsigned char ucOptions)
+{
+	if(ucOptions & BRTOS_EVENT_WAIT_ALL)
+		return (usFlags & usWanted) == usWanted;
+
+	return (usFlags & usWanted) != 0;
+}
+
+/**
+Initialize a group of event flags.
+
+@param psEvent Event flags, allocated by the user.
+@param usFlags Initial flags.
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The event flags were created sucessfully.
+*/
+int BRTOS_EventCreate(BRTOS_EVENT *psEvent, unsigned short usFlags)
+{
+	if(psEvent == 0)
+		return BRTOS_FAILURE;
+
+	psEvent->sQueue.ucHead = BRTOS_NO_TASK_TO_RUN;
+	psEvent->sQueue.ucType = BRTOS_WAITQ_EVENT;
+	WaitAnyInit(&psEvent->sQueue);
+	psEvent->usFlags       = usFlags;
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Set event flags and wake up all tasks whose condition is now true. Flags
+waited with BRTOS_EVENT_CLEAR are cleared after all waiting tasks were
+checked, so all of them see the same flags (interrupts disabled).
+*/
+static void BRTOS_EventSignal(BRTOS_EVENT *psEvent, unsigned short usFlags)
+{
+	unsigned char     *pucLink = &psEvent->sQueue.ucHead;
+	unsigned short     usClear = 0;
+	unsigned char      ucTask;
+	BRTOS_EVENT_WAITER *psWaiter;
+
+	psEvent->usFlags |= usFlags;
+
+	while(*pucLink != BRTOS_NO_TASK_TO_RUN)
+	{
+		ucTask   = *pucLink;
+		psWaiter = (BRTOS_EVENT_WAITER *) asBrtosTasks[ucTask].pvWaitData;
+
+		if(BRTOS_EventMatch(psEvent->usFlags, psWaiter->usFlags, psWaiter->ucOptions))
+		{
+			if(psWaiter->ucOptions & BRTOS_EVENT_CLEAR)
+				usClear |= psWaiter->usFlags;
+
+			psWaiter->usFlags = psEvent->usFlags;
+			*pucLink = asBrtosTasks[ucTask].ucWaitNext;
+			BRTOS_WaitEnd(ucTask);
+		}
+		else
+			pucLink = &asBrtosTasks[ucTask].ucWaitNext;
+	}
+
+	psEvent->usFlags &= ~usClear;
+	WaitAnyWake(&psEvent->sQueue);
+}
+
+/**
+Set event flags. Waiting tasks whose condition becomes true are woken up
+and preempt the caller if they have a higher priority.
+
+@param psEvent Event flags created by \ref BRTOS_EventCreate().
+@param usFlags Flags to set.
+
+@retval BRTOS_SUCCESS The flags were set.
+*/
+int BRTOS_EventSet(BRTOS_EVENT *psEvent, unsigned short usFlags)
+{
+	EnterCriticalSection();
+	BRTOS_EventSignal(psEvent, usFlags);
+	BRTOS_LeaveAndPreempt();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Set event flags from an interrupt service routine (interrupts disabled).
+Woken tasks run after \ref BRTOS_ISR_Exit() or at the next system tick.
+
+@param psEvent Event flags created by \ref BRTOS_EventCreate().
+@param usFlags Flags to set.
+
+@retval BRTOS_SUCCESS The flags were set.
+*/
+int BRTOS_EventSetFromISR(BRTOS_EVENT *psEvent, unsigned short usFlags)
+{
+	BRTOS_EventSignal(psEvent, usFlags);
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Clear event flags.
+
+@param psEvent Event flags created by \ref BRTOS_EventCreate().
+@param usFlags Flags to clear.
+
+@return flags before clearing
+*/
+unsigned short BRTOS_EventClear(BRTOS_EVENT *psEvent, unsigned short usFlags)
+{
+	unsigned short usOld;
+
+	EnterCriticalSection();
+	usOld = psEvent->usFlags;
+	psEvent->usFlags &= ~usFlags;
+	LeaveCriticalSection();
+
+	return usOld;
+}
+
+/**
+Wait for event flags: any of them (BRTOS_EVENT_WAIT_ANY) or all of them
+(BRTOS_EVENT_WAIT_ALL). With BRTOS_EVENT_CLEAR, the waited flags are
+cleared when the condition is met.
+
+@param psEvent   Event flags created by \ref BRTOS_EventCreate().
+@param usFlags   Flags to wait for (not 0).
+@param ucOptions BRTOS_EVENT_WAIT_ANY or BRTOS_EVENT_WAIT_ALL, or'ed with BRTOS_EVENT_CLEAR.
+@param pusFlags  Returns the flags that met the condition, before clearing (may be 0).
+@param usTimeout Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@retval BRTOS_FAILURE No flags to wait for.
+@retval BRTOS_TIMEOUT The condition was not met during the timeout.
+@retval BRTOS_SUCCESS The condition was met.
+*/
+int BRTOS_EventWait(BRTOS_EVENT *psEvent, unsigned short usFlags, unsigned char ucOptions, unsigned short *pusFlags, unsigned short usTimeout)
+{
+	BRTOS_EVENT_WAITER sWaiter;
+	int iRet;
+
+	if(usFlags == 0)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+
+	if(BRTOS_EventMatch(psEvent->usFlags, usFlags, ucOptions))
+	{
+		if(pusFlags)
+			*pusFlags = psEvent->usFlags;
+		if(ucOptions & BRTOS_EVENT_CLEAR)
+			psEvent->usFlags &= ~usFlags;
+		LeaveCriticalSection();
+		return BRTOS_SUCCESS;
+	}
+
+	if(usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+	{
+		LeaveCriticalSection();
+		return BRTOS_TIMEOUT;
+	}
+
+	sWaiter.usFlags   = usFlags;
+	sWaiter.ucOptions = ucOptions;
+	asBrtosTasks[ucCurrentTask].pvWaitData = &sWaiter;
+	BRTOS_WaitBlock(&psEvent->sQueue, usTimeout);
+
+	iRet = BRTOS_WaitSwitch();
+	if(iRet == BRTOS_SUCCESS && pusFlags)
+		*pusFlags = sWaiter.usFlags;
+
+	return iRet;
+}
+
+#if BRTOS_WAIT_ANY
+/**
+Wait for the first of several objects to become ready: semaphores with count,
+ring buffers at their high water mark, event flags (any of the flags of the 
+node) or pools with free blocks. The task blocks once, on all of them, and
+is woken up by the first one, or by the timeout:
+
+<pre>
+static BRTOS_WAIT_NODE asWait[] = { BRTOS_WAIT_RING(&sRadio), BRTOS_WAIT_SEM(&sUartFrame),
+                                    BRTOS_WAIT_EVENT(&sConfig, CONFIG_CHANGED) };
+
+if(BRTOS_WaitAny(asWait, 3, &ucReady, 1000) == BRTOS_SUCCESS && ucReady == 1)
+	BRTOS_SemTake(&sUartFrame, BRTOS_NO_WAIT);
+</pre>
+
+The ready object is not taken: the task takes it with a call that does not
+wait, which fails only if another task took it first. Nodes are armed on their
+objects while the task waits, so arming and disarming cost O(number of nodes).
+Each node belongs to one waiting task at a time.
+
+@param asNodes    Objects to wait for, set with the BRTOS_WAIT_xxx initializers.
+@param ucNumNodes Amount of objects.
+@param pucReady   Returns the index of the ready object (may be 0).
+@param usTimeout  Time to wait, in milliseconds, BRTOS_NO_WAIT or BRTOS_WAIT_FOREVER.
+
+@retval BRTOS_FAILURE No objects or an object that cannot be waited for (mutex).
+@retval BRTOS_TIMEOUT No object became ready during the timeout.
+@retval BRTOS_SUCCESS An object is ready.
+*/
+int BRTOS_WaitAny(BRTOS_WAIT_NODE *asNodes, unsigned char ucNumNodes, unsigned char *pucReady, unsigned short usTimeout)
+{
+	BRTOS_ANY_WAITER sWait;
+	BRTOS_WAIT_NODE *psNode;
+	BRTOS_WAITQ     *psObject;
+	int              iRet;
+
+	if(asNodes == 0 || ucNumNodes == 0)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+
+	for(psNode = asNodes ; psNode < asNodes + ucNumNodes ; psNode++)
+	{
+		if(psNode->psObject == 0 || psNode->psObject->ucType == BRTOS_WAITQ_MUTEX || 
+		   psNode->psObject->ucType >= BRTOS_WAITQ_JOIN)
+		{
+			LeaveCriticalSection();
+			return BRTOS_FAILURE;
+		}
+
+		if(BRTOS_WaitAnyReady(psNode))
+		{
+			LeaveCriticalSection();
+			if(pucReady)
+				*pucReady = (unsigned char)(psNode - asNodes);
+			return BRTOS_SUCCESS;
+		}
+	}
+
+	if(usTimeout == BRTOS_NO_WAIT || ucCriticalNesting > 1)
+	{
+		LeaveCriticalSection();
+		return BRTOS_TIMEOUT;
+	}
+
+	sWait.sQueue.ucHead    = BRTOS_NO_TASK_TO_RUN;
+	sWait.sQueue.ucType    = BRTOS_WAITQ_ANY;
+	sWait.sQueue.psAnyHead = 0;
+	sWait.asNodes          = asNodes;
+	sWait.ucNumNodes       = ucNumNodes;
+	sWait.psReady          = 0;
+
+	for(psNode = asNodes ; psNode < asNodes + ucNumNodes ; psNode++)
+	{
+		psObject        = psNode->psObject;
+		psNode->psWait  = &sWait.sQueue;
+		psNode->psNext  = psObject->psAnyHead;
+		psNode->ppsPrev = &psObject->psAnyHead;
+		if(psNode->psNext)
+			psNode->psNext->ppsPrev = &psNode->psNext;
+		psObject->psAnyHead = psNode;
+	}
+
+	/* the nodes are disarmed by the object that wakes up the task or by the 
+	   timeout */
+	BRTOS_WaitBlock(&sWait.sQueue, usTimeout);
+	iRet = BRTOS_WaitSwitch();
+
+	if(iRet == BRTOS_SUCCESS && pucReady)
+		*pucReady = (unsigned char)(sWait.psReady - asNodes);
+
+	return iRet;
+}
+#endif
+
+/**
+Enter an interrupt service routine that calls the kernel. It must be the
+first call of the routine, with interrupts disabled (as they are when an
+interrupt is taken), paired with \ref BRTOS_ISR_Exit() at its end:
+
+<pre>
+interrupt (ADC12_VECTOR) AdcIsr(void)
+{
+    BRTOS_ISR_Enter();
+    BRTOS_TaskNotify(ucAdcTask, ADC12MEM0, BRTOS_NOTIFY_OVERWRITE);
+    BRTOS_ISR_Exit();
+}
+</pre>
+
+Between both calls the whole kernel API can be used, except blocking 
+calls (they return BRTOS_TIMEOUT at once): it works as inside a critical
+section, so tasks woken up are not switched to before the outermost 
+routine ends. Routines may enable interrupts to allow nesting.
+*/
+void BRTOS_ISR_Enter(void)
+{
+	ucIsrNesting++;
+	ucCriticalNesting++;
+	TraceEvent(BRTOS_TRACE_ISR_ENTER, ucIsrNesting);
+}
+
+/**
+Leave an interrupt service routine started with \ref BRTOS_ISR_Enter(), with
+interrupts disabled. When the outermost routine ends and a task with higher
+priority than the interrupted one is ready, the port is asked to switch to 
+it just after the routine returns, instead of waiting for the next tick.
+*/
+void BRTOS_ISR_Exit(void)
+{
+	TraceEvent(BRTOS_TRACE_ISR_EXIT, ucIsrNesting);
+	ucCriticalNesting--;
+
+	if(--ucIsrNesting > 0 || ucNotEmptyLevel == 0)
+		return;
+
+	/* interrupted task or idle (no current task) */
+	if(ucCurrentTask >= usNumTasks || BRTOS_MustPreempt())
+		BRTOS_PortPendSwitch();
+}
+
+/**
+Deferred work task: runs the functions queued by \ref BRTOS_Defer(), in order,
+and then the jobs with posted events (\ref BRTOS_JobPost()), in the order they
+became ready. It is created by \ref BRTOS_DeferInit() or declared in the static
+task table. Its stack is shared by all jobs.
+*/
+void BRTOS_DeferTask(unsigned long ulArg)
+{
+	pfTaskEntry   pfWork;
+	unsigned long ulWorkArg;
+	BRTOS_JOB     *psJob;
+	unsigned short usEvents;
+
+	(void) ulArg;
+
+	for(;;)
+	{
+		BRTOS_TaskNotifyWait(0xFFFF, 0, BRTOS_WAIT_FOREVER);
+
+		while(ucDeferTail != ucDeferHead)
+		{
+			EnterCriticalSection();
+			pfWork    = asDeferQueue[ucDeferTail].pfWork;
+			ulWorkArg = asDeferQueue[ucDeferTail].ulArg;
+			ucDeferTail = (ucDeferTail + 1) & (BRTOS_DEFER_QUEUE_SIZE - 1);
+			LeaveCriticalSection();
+
+			pfWork(ulWorkArg);
+		}
+
+		for(;;)
+		{
+			EnterCriticalSection();
+			psJob = psJobHead;
+			if(psJob == 0)
+			{
+				LeaveCriticalSection();
+				break;
+			}
+			psJobHead = psJob->psNext;
+			usEvents  = psJob->usEvents;
+			psJob->usEvents = 0;
+			psJob->ucReady  = 0;
+			LeaveCriticalSection();
+
+			psJob->pfEntry(psJob, usEvents);
+		}
+	}
+}
+
+/**
+Create the deferred work task, which runs the work queued by \ref BRTOS_Defer().
+It must be called before the scheduler starts (\ref BRTOS_Application_Initialize()).
+
+@param pusStack    Stack of the task, as in \ref BRTOS_CreateTask().
+@param usStackSize Stack size in bytes.
+@param iTimeSlice  Task time slice, in ms, as in \ref BRTOS_CreateTask(). It 
+                   only matters when other tasks share its priority.
+@param iPri        Task priority, usually the highest one, so deferred work runs
+                   right after the interrupts that queued it.
+
+@retval BRTOS_FAILURE The task was already created, invalid priority or stack too small.
+@retval BRTOS_NO_ROOM_IN_TCB_ARRAY No room in TCB array for the task.
+@retval BRTOS_SUCCESS The task was created sucessfully.
+*/
+#ifndef BRTOS_STATIC_TASKS
+int BRTOS_DeferInit(unsigned short *pusStack, unsigned short usStackSize, int iTimeSlice, int iPri)
+{
+	unsigned char ucTask;
+	int iRet;
+
+	EnterCriticalSection();
+
+	if(ucDeferTask != BRTOS_NO_TASK_TO_RUN)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	iRet = BRTOS_TaskNew(BRTOS_DeferTask, pusStack, usStackSize, iTimeSlice, iPri, &ucTask);
+	if(iRet == BRTOS_SUCCESS)
+		ucDeferTask = ucTask;
+
+	LeaveCriticalSection();
+
+	return iRet;
+}
+#endif
+
+/**
+Queue work to be done at task level by the deferred work task (bottom half),
+so interrupt service routines stay short. It can be called from tasks or 
+from interrupt service routines between \ref BRTOS_ISR_Enter() and 
+\ref BRTOS_ISR_Exit(). Work runs in the order it was queued.
+
+@param pfWork Function to call.
+@param ulArg  Argument for pfWork.
+
+@retval BRTOS_FAILURE Queue full (BRTOS_DEFER_QUEUE_SIZE) or no deferred work task.
+@retval BRTOS_SUCCESS The work was queued.
+*/
+int BRTOS_Defer(pfTaskEntry pfWork, unsigned long ulArg)
+{
+	unsigned char ucNext;
+
+	EnterCriticalSection();
+
+	ucNext = (ucDeferHead + 1) & (BRTOS_DEFER_QUEUE_SIZE - 1);
+	if(ucNext == ucDeferTail || ucDeferTask == BRTOS_NO_TASK_TO_RUN)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	asDeferQueue[ucDeferHead].pfWork = pfWork;
+	asDeferQueue[ucDeferHead].ulArg  = ulArg;
+	ucDeferHead = ucNext;
+
+	BRTOS_NotifySignal(ucDeferTask, 0, BRTOS_NOTIFY_INCREMENT);
+	BRTOS_LeaveAndPreempt();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Job timer callback (timer context): post the timer event.
+*/
+static void BRTOS_JobTimer(unsigned long ulArg)
+{
+	BRTOS_JobPost((BRTOS_JOB *) ulArg, BRTOS_JOB_EVENT_TIMER);
+}
+
+/**
+Initialize a job: a run to completion function called by the deferred work
+task (\ref BRTOS_DeferInit()) each time events are posted to it. Jobs share 
+the stack of that task, so each one costs only its control block, and they 
+do not preempt each other. Jobs that wait for events or time between steps
+can be written as protothreads (BRTOS_PT_BEGIN()).
+
+@param psJob   Job control block, allocated by the user.
+@param pfEntry Job function. It receives the job and the events posted since
+               its last run (cleared before the call).
+@param ulArg   User argument (psJob->ulArg).
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The job was initialized sucessfully.
+*/
+int BRTOS_JobCreate(BRTOS_JOB *psJob, pfJobEntry pfEntry, unsigned long ulArg)
+{
+	if(psJob == 0 || pfEntry == 0)
+		return BRTOS_FAILURE;
+
+	psJob->psNext   = 0;
+	psJob->pfEntry  = pfEntry;
+	psJob->ulArg    = ulArg;
+	psJob->usEvents = 0;
+	psJob->usLc     = 0;
+	psJob->ucReady  = 0;
+
+	return BRTOS_TimerCreate(&psJob->sTimer, BRTOS_JobTimer, (unsigned long) psJob, BRTOS_TASK_PRIORITY_8);
+}
+
+/**
+Post events to a job, which becomes ready to run if it was not. Events posted
+before the job runs are merged. It can be called from tasks, timer callbacks
+and interrupt service routines (between \ref BRTOS_ISR_Enter() and 
+\ref BRTOS_ISR_Exit()).
+
+@param psJob    Job initialized by \ref BRTOS_JobCreate().
+@param usEvents Events to post (BRTOS_JOB_EVENT_TIMER is used by the job timer).
+
+@retval BRTOS_FAILURE Invalid job or no deferred work task.
+@retval BRTOS_SUCCESS The events were posted.
+*/
+int BRTOS_JobPost(BRTOS_JOB *psJob, unsigned short usEvents)
+{
+	if(psJob == 0 || psJob->pfEntry == 0)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+
+	if(ucDeferTask == BRTOS_NO_TASK_TO_RUN)
+	{
+		LeaveCriticalSection();
+		return BRTOS_FAILURE;
+	}
+
+	psJob->usEvents |= usEvents;
+	if(!psJob->ucReady)
+	{
+		psJob->ucReady = 1;
+		psJob->psNext  = 0;
+
+		/* the deferred work task empties the list before waiting again */
+		if(psJobHead)
+			psJobTail->psNext = psJob;
+		else
+		{
+			psJobHead = psJob;
+			BRTOS_NotifySignal(ucDeferTask, 0, BRTOS_NOTIFY_INCREMENT);
+		}
+		psJobTail = psJob;
+	}
+
+	BRTOS_LeaveAndPreempt();
+
+	return BRTOS_SUCCESS;
+}
+
+/**
+Start the timer of a job: BRTOS_JOB_EVENT_TIMER is posted after usTime ms
+and then every usPeriod ms (see \ref BRTOS_TimerStart()).
+
+@param psJob    Job initialized by \ref BRTOS_JobCreate().
+@param usTime   Time to the first event, in milliseconds.
+@param usPeriod Period of the next events, in milliseconds (0: one event).
+
+@retval BRTOS_FAILURE Invalid parameters.
+@retval BRTOS_SUCCESS The timer was started.
+*/
+int BRTOS_JobPostIn(BRTOS_JOB *psJob, unsigned short usTime, unsigned short usPeriod)
+{
+	if(psJob == 0)
+		return BRTOS_FAILURE;
+
+	return BRTOS_TimerStart(&psJob->sTimer, usTime, usPeriod);
 }
 
+/**
+Stop a job: its timer is stopped, pending events are dropped and a 
+protothread starts again from its beginning when the job is posted again.
+
+@param psJob Job initialized by \ref BRTOS_JobCreate().
+
+@retval BRTOS_FAILURE Invalid job.
+@retval BRTOS_SUCCESS The job was stopped.
+*/
+int BRTOS_JobStop(BRTOS_JOB *psJob)
+{
+	BRTOS_JOB *psPrev = 0;
+	BRTOS_JOB *psPos;
+
+	if(psJob == 0 || psJob->pfEntry == 0)
+		return BRTOS_FAILURE;
+
+	EnterCriticalSection();
+
+	BRTOS_TimerStop(&psJob->sTimer);
+
+	if(psJob->ucReady)
+	{
+		for(psPos = psJobHead ; psPos != psJob ; psPos = psPos->psNext)
+			psPrev = psPos;
+
+		if(psPrev)
+			psPrev->psNext = psJob->psNext;
+		else
+			psJobHead = psJob->psNext;
+		if(psJobTail == psJob)
+			psJobTail = psPrev;
+		psJob->ucReady = 0;
+	}
+	psJob->usEvents = 0;
+	psJob->usLc     = 0;
+
+	LeaveCriticalSection();
+
+	return BRTOS_SUCCESS;
+}
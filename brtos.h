@@ -24,12 +24,193 @@ The views and conclusions contained in the software and documentation are those
 #ifndef __BRTOS_H__
 #define __BRTOS_H__
 
+/* scheduling policy, chosen at compile time (only its code is built):
+   BRTOS_SCHED_TIME_SLICE   priority levels, round robin with time slices inside
+                            each level (default)
+   BRTOS_SCHED_PRIORITY     priority levels, first come first served inside each
+                            level: a task runs until it blocks, yields or is preempted
+   BRTOS_SCHED_ROUND_ROBIN  one level: priorities are ignored, tasks share the CPU
+                            by time slices
+   BRTOS_SCHED_EDF          one level: ready periodic tasks by absolute deadline, the
+                            other tasks after them in round robin (BRTOS_EDF) */
+#define BRTOS_SCHED_TIME_SLICE     0
+#define BRTOS_SCHED_PRIORITY       1
+#define BRTOS_SCHED_ROUND_ROBIN    2
+#define BRTOS_SCHED_EDF            3
 
+#ifndef BRTOS_SCHED_POLICY
+#define BRTOS_SCHED_POLICY         BRTOS_SCHED_TIME_SLICE
+#endif
+
+#if BRTOS_SCHED_POLICY == BRTOS_SCHED_ROUND_ROBIN || BRTOS_SCHED_POLICY == BRTOS_SCHED_EDF
+#define BRTOS_MAX_PRIORITY_LEVELS  1
+#else
 #define BRTOS_MAX_PRIORITY_LEVELS  8
+#endif
+
+/* static task table: BRTOS_STATIC_TASKS names a header declaring all tasks
+   (for instance -DBRTOS_STATIC_TASKS='"app_tasks.h"'), which defines 
+   BRTOS_TASKS(TASK) as a list of TASK(entry, stack bytes, time slice ms, priority).
+   Constant task data goes to flash, TCBs and initial stacks are initialized
+   at compile time and the TCB array has exactly one entry per task. 
+   BRTOS_CreateTask() is not available and tasks are identified by 
+   BRTOS_ID_<entry> */
+#ifdef BRTOS_STATIC_TASKS
+#include BRTOS_STATIC_TASKS
+#ifdef BRTOS_MAX_TASKS
+#error "BRTOS_MAX_TASKS is given by the static task table (BRTOS_STATIC_TASKS)"
+#endif
+#define BRTOS_TASK_COUNT(entry, stack, slice, pri) + 1
+#define BRTOS_MAX_TASKS            (0 BRTOS_TASKS(BRTOS_TASK_COUNT))
+#endif
+#ifndef BRTOS_MAX_TASKS
 #define BRTOS_MAX_TASKS            5
+#endif
 #define BRTOS_NO_TASK_TO_RUN      (BRTOS_MAX_TASKS+1)
 
-/* eight priority levels */
+/* tickless idle: the system tick is stopped while all tasks are sleeping */
+#ifndef BRTOS_TICKLESS_IDLE
+#define BRTOS_TICKLESS_IDLE        0
+#endif
+/* longest tickless sleep, it must fit in Timer_A 16 bits at ACLK rate */
+#define BRTOS_TICKLESS_MAX_TICKS   3000
+/* kernel tick at start (BRTOS_GetTicks()): a value close to the wrap around,
+   like (~0UL - 7200000UL), lets tests cross it after a short time */
+#ifndef BRTOS_TICKS_START
+#define BRTOS_TICKS_START          0
+#endif
+/* ACLK frequency (watch crystal) */
+#define BRTOS_ACLK_HZ              32768UL
+
+/* software timers: hierarchical timing wheel with BRTOS_TIMER_WHEEL_LEVELS
+   levels of 2^BRTOS_TIMER_WHEEL_BITS slots, covering the 16 bits tick range */
+#define BRTOS_TIMER_WHEEL_BITS     4
+#define BRTOS_TIMER_WHEEL_LEVELS   4
+#define BRTOS_TIMER_WHEEL_SIZE     (1 << BRTOS_TIMER_WHEEL_BITS)
+
+/* stack painting: free stack words are filled with this pattern when a task
+   is created, so its high water mark can be found (BRTOS_TaskStackHighWater()) */
+#define BRTOS_STACK_PATTERN        0xA5A5
+
+/* stack overflow check at each context switch: the saved stack pointer and
+   the lowest stack word (canary) of the task switched out are checked and 
+   BRTOS_STACK_OVERFLOW(task) is called if the stack overflowed. The default
+   action stops the system with interrupts disabled */
+#ifndef BRTOS_STACK_CHECK
+#define BRTOS_STACK_CHECK          1
+#endif
+#ifndef BRTOS_STACK_OVERFLOW
+#define BRTOS_STACK_OVERFLOW(ucTask) while(1)
+#endif
+
+/* CPU usage accounting: run time of each task and idle time, measured with
+   the port timestamp at each switch (see BRTOS_TaskStats()) */
+#ifndef BRTOS_CPU_STATS
+#define BRTOS_CPU_STATS            0
+#endif
+
+/* kernel trace: events recorded in a ring of BRTOS_TRACE_SIZE records (power
+   of two), overwriting the oldest ones (see BRTOS_TraceDump()) */
+#ifndef BRTOS_TRACE
+#define BRTOS_TRACE                0
+#endif
+#ifndef BRTOS_TRACE_SIZE
+#define BRTOS_TRACE_SIZE           64
+#endif
+
+#if (BRTOS_TRACE_SIZE & (BRTOS_TRACE_SIZE - 1)) || BRTOS_TRACE_SIZE > 16384
+#error "BRTOS_TRACE_SIZE must be a power of two up to 16384"
+#endif
+
+/* latency statistics: longest spans with interrupts disabled by kernel critical
+   sections and latency from the tick processing to the dispatch of the tasks it
+   woke up, as worst cases and log2 histograms in port timestamp units (see
+   BRTOS_LatencyStats()) */
+#ifndef BRTOS_LATENCY_STATS
+#define BRTOS_LATENCY_STATS        0
+#endif
+#define BRTOS_LATENCY_BUCKETS      16
+
+/* kernel instances: the kernel state is a BRTOS_KERNEL context reached through
+   the thread local pointer psBrtosKernel, so many kernels can run in one process
+   (fleet simulation on a host, the port must support it). Without it, the
+   context is a single static variable accessed directly, as plain variables */
+#ifndef BRTOS_INSTANCES
+#define BRTOS_INSTANCES            0
+#endif
+
+#if BRTOS_INSTANCES && defined(BRTOS_STATIC_TASKS)
+#error "BRTOS_INSTANCES needs tasks created at run time (no BRTOS_STATIC_TASKS)"
+#endif
+
+/* deferred work queue size (power of two, see BRTOS_Defer()) */
+#ifndef BRTOS_DEFER_QUEUE_SIZE
+#define BRTOS_DEFER_QUEUE_SIZE     8
+#endif
+
+#if (BRTOS_DEFER_QUEUE_SIZE & (BRTOS_DEFER_QUEUE_SIZE - 1)) || BRTOS_DEFER_QUEUE_SIZE > 128
+#error "BRTOS_DEFER_QUEUE_SIZE must be a power of two up to 128"
+#endif
+
+/* periodic tasks: release period and relative deadline, with deadline misses
+   and overruns counted per task (see BRTOS_CreatePeriodicTask()) */
+#ifndef BRTOS_PERIODIC_TASKS
+#define BRTOS_PERIODIC_TASKS       (BRTOS_SCHED_POLICY == BRTOS_SCHED_EDF)
+#endif
+
+/* earliest deadline first: inside each priority level, ready periodic tasks
+   are ordered by absolute deadline, ahead of the other tasks of the level */
+#ifndef BRTOS_EDF
+#define BRTOS_EDF                  (BRTOS_SCHED_POLICY == BRTOS_SCHED_EDF)
+#endif
+
+#if BRTOS_SCHED_POLICY == BRTOS_SCHED_EDF && !BRTOS_EDF
+#error "BRTOS_SCHED_EDF needs BRTOS_EDF"
+#endif
+
+#if BRTOS_SCHED_POLICY < BRTOS_SCHED_TIME_SLICE || BRTOS_SCHED_POLICY > BRTOS_SCHED_EDF
+#error "unknown BRTOS_SCHED_POLICY"
+#endif
+
+#if BRTOS_EDF && !BRTOS_PERIODIC_TASKS
+#error "BRTOS_EDF needs BRTOS_PERIODIC_TASKS"
+#endif
+
+/* multi object wait: a task blocks once on several semaphores, ring buffers,
+   event flags and pools and a timeout (see BRTOS_WaitAny()). Objects keep a
+   list of the wait nodes armed on them (a pointer more in each object) */
+#ifndef BRTOS_WAIT_ANY
+#define BRTOS_WAIT_ANY             0
+#endif
+
+/* CPU budgets: tasks or groups of tasks get an amount of CPU time replenished
+   every period. A task whose budget is used up is throttled until the next
+   period (see BRTOS_BudgetCreate()) */
+#ifndef BRTOS_CPU_BUDGETS
+#define BRTOS_CPU_BUDGETS          0
+#endif
+
+/* idle governor: with nothing to run, the CPU sleeps in the deepest low power
+   mode of the port allowed by the drivers (see BRTOS_IdleConstrain()) and worth
+   its exit latency for the time to the next wake up, with entries and time
+   spent in each mode (see BRTOS_IdleStats()). Without it, idle always uses the
+   default mode of the port (BRTOS_PORT_IDLE_DEFAULT) */
+#ifndef BRTOS_IDLE_GOVERNOR
+#define BRTOS_IDLE_GOVERNOR        0
+#endif
+/* most low power modes a port can have (kernel state) */
+#define BRTOS_IDLE_MODES           4
+
+#if BRTOS_TIMER_WHEEL_BITS*BRTOS_TIMER_WHEEL_LEVELS != 16
+#error "timer wheel must cover 16 bits (BRTOS_TIMER_WHEEL_BITS*BRTOS_TIMER_WHEEL_LEVELS)"
+#endif
+
+#if BRTOS_NO_TASK_TO_RUN > 0xFF
+#error "BRTOS_MAX_TASKS is too big: task indexes are stored in unsigned char"
+#endif
+
+/* eight priorities (BRTOS_TASK_PRIORITY_1 is the highest), one level for each
+   one, or a single level for all of them (see BRTOS_SCHED_POLICY) */
 #define BRTOS_TASK_PRIORITY_1 0x01
 #define BRTOS_TASK_PRIORITY_2 0x02
 #define BRTOS_TASK_PRIORITY_3 0x04
@@ -39,6 +220,15 @@ The views and conclusions contained in the software and documentation are those
 #define BRTOS_TASK_PRIORITY_7 0x40
 #define BRTOS_TASK_PRIORITY_8 0x80
 
+/* priority level of a priority (lowest bit set), for constant expressions */
+#if BRTOS_MAX_PRIORITY_LEVELS == 1
+#define BRTOS_PRIORITY_LEVEL(pri) 0
+#else
+#define BRTOS_PRIORITY_LEVEL(pri) ((pri) & 0x01 ? 0 : (pri) & 0x02 ? 1 : (pri) & 0x04 ? 2 : \
+                                   (pri) & 0x08 ? 3 : (pri) & 0x10 ? 4 : (pri) & 0x20 ? 5 : \
+                                   (pri) & 0x40 ? 6 : 7)
+#endif
+
 /* task states */
 #define BRTOS_TASK_STATE_INVALID    0x00
 #define BRTOS_TASK_STATE_RUNNING    0x01
@@ -49,37 +239,482 @@ The views and conclusions contained in the software and documentation are those
 
 #define BRTOS_TASK_NULL              0x00
 
+/* task index of the idle time (statistics and trace) */
+#define BRTOS_TASK_IDLE             0xFF
+
+/* timer status */
+#define BRTOS_TIMER_STOPPED         0x00
+#define BRTOS_TIMER_ACTIVE          0x01
+
 /* return codes */
 #define BRTOS_SUCCESS              0x00
 #define BRTOS_FAILURE              0x01
 #define BRTOS_NO_ROOM_IN_TCB_ARRAY 0x02
+#define BRTOS_TIMEOUT              0x03
 
-/* go to saving energy mode 3 */
-#define GoToLowPowerMode3()  LPM3
+/* timeouts for blocking calls (other values are in milliseconds) */
+#define BRTOS_NO_WAIT              0x0000
+#define BRTOS_WAIT_FOREVER         0xFFFF
+
+/* kind of object of a wait queue */
+#define BRTOS_WAITQ_SEM            0x00
+#define BRTOS_WAITQ_MUTEX          0x01
+#define BRTOS_WAITQ_RING           0x02
+#define BRTOS_WAITQ_POOL           0x03
+#define BRTOS_WAITQ_EVENT          0x04
+#define BRTOS_WAITQ_JOIN           0x05
+#define BRTOS_WAITQ_ANY            0x06
+
+/* task notification actions */
+#define BRTOS_NOTIFY_SET_BITS      0x00
+#define BRTOS_NOTIFY_OVERWRITE     0x01
+#define BRTOS_NOTIFY_INCREMENT     0x02
+
+/* task notification state */
+#define BRTOS_NOTIFY_NONE          0x00
+#define BRTOS_NOTIFY_PENDING       0x01
+#define BRTOS_NOTIFY_WAITING       0x02
+
+/* event flags wait options */
+#define BRTOS_EVENT_WAIT_ANY       0x00
+#define BRTOS_EVENT_WAIT_ALL       0x01
+#define BRTOS_EVENT_CLEAR          0x02
+
+/* job event set by its timer (BRTOS_JobPostIn()), other bits are free */
+#define BRTOS_JOB_EVENT_TIMER      0x8000
+
+/* trace events, with their argument */
+#define BRTOS_TRACE_SWITCH         0x01 /* task switched in (BRTOS_TASK_IDLE: idle) */
+#define BRTOS_TRACE_WAKE           0x02 /* task ready after a wait or a sleep */
+#define BRTOS_TRACE_SLEEP          0x03 /* task sleeping (BRTOS_Sleep()) */
+#define BRTOS_TRACE_WAIT           0x04 /* task waiting for an object or a notification */
+#define BRTOS_TRACE_ISR_ENTER      0x05 /* interrupt nesting level */
+#define BRTOS_TRACE_ISR_EXIT       0x06 /* interrupt nesting level */
+#define BRTOS_TRACE_ELAPSED        0x07 /* bits 32-39 of the time to the next record,
+                                           bits 16-31 are in the record time */
+
+/* trace dump: magic ("BT"), record count and timestamp frequency (4 bytes),
+   followed by the records, all little endian */
+#define BRTOS_TRACE_MAGIC          0x5442
+#define BRTOS_TRACE_HEADER_SIZE    8
+#define BRTOS_TRACE_RECORD_SIZE    4
+
+/* memory pools: block size rounded up to hold the free list link (and keep
+   it aligned) and buffer size needed for a pool */
+#define BRTOS_POOL_BLOCK_SIZE(size)       (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define BRTOS_POOL_BUFFER_SIZE(size, num) (BRTOS_POOL_BLOCK_SIZE(size)*(num))
 
 typedef void (*pfTaskEntry)(unsigned long); /* task entry: void task(unsigned long) */
 
+/* kernel time in ticks (BRTOS_GetTicks()), 32 bits: it wraps after 24 days at 
+   2000 ticks/s. Times are compared through their difference, which is right
+   while they are less than 2^31 ticks apart */
+typedef unsigned long BRTOS_TICKS;
+
+#define BRTOS_TICKS_BEFORE(a, b)   ((long)((BRTOS_TICKS)(a) - (BRTOS_TICKS)(b)) < 0)
+#define BRTOS_TICKS_REACHED(now, t) ((long)((BRTOS_TICKS)(now) - (BRTOS_TICKS)(t)) >= 0)
+
+struct BRTOS_WAITQ_S;
+struct BRTOS_WAIT_NODE_S;
+struct BRTOS_MUTEX_S;
+struct BRTOS_POOL_S;
+struct BRTOS_BUDGET_S;
+
+#ifdef BRTOS_STATIC_TASKS
+/* constant part of the tasks declared in the static task table (flash) */
 typedef struct {
 	pfTaskEntry    pfEntryPoint;      /* task entry point    */
+	unsigned short *pusStackBeg;      /* stack lowest address */
+	unsigned short usStackSize;       /* stack size in bytes */
+	unsigned short usTimeSlice;       /* desired time slice  */
 	unsigned char  ucPriority;        /* task priority       */
+} BRTOS_TASK_CONST;
+
+/* task entry points and task indexes (BRTOS_ID_<entry>) */
+#define BRTOS_TASK_PROTO(entry, stack, slice, pri) void entry(unsigned long);
+#define BRTOS_TASK_ID(entry, stack, slice, pri)    BRTOS_ID_##entry,
+BRTOS_TASKS(BRTOS_TASK_PROTO)
+enum { BRTOS_TASKS(BRTOS_TASK_ID) BRTOS_ID_COUNT };
+#endif
+
+typedef struct {
+#ifndef BRTOS_STATIC_TASKS
+	pfTaskEntry    pfEntryPoint;      /* task entry point    */
+	unsigned char  ucPriority;        /* task priority       */
+#endif
+	unsigned char  ucLevel;           /* priority level (0 is the highest) */
+	unsigned char  ucNext;            /* next task in the same list */
 	unsigned char  ucTaskState;       /* current task state  */
+#ifndef BRTOS_STATIC_TASKS
 	unsigned short usTimeSlice;       /* desired time slice  */
-	unsigned short *pusStackBeg;      /* stack beginning     */
+	unsigned short *pusStackBeg;      /* stack lowest address */
+#endif
 	unsigned short *pusStackPtr;      /* stack pointer       */
-	unsigned short usSleepTicks;      /* count sleep ticks   */
+#ifndef BRTOS_STATIC_TASKS
+	unsigned short usStackSize;       /* stack size in bytes */
+	struct BRTOS_POOL_S *psStackPool; /* pool of the stack, freed when the task ends */
+	void           *pvStackBlock;     /* stack block taken from psStackPool */
+#endif
+	BRTOS_TICKS    ulSleepTicks;      /* sleep ticks after previous task in sleep list */
 	unsigned short usTicks;           /* count slice ticks   */
+	unsigned char  ucWaitNext;        /* next task in the same wait queue */
+	unsigned char  ucWaitResult;      /* result of last wait (BRTOS_SUCCESS or BRTOS_TIMEOUT) */
+	struct BRTOS_WAITQ_S *psWaitQueue;/* wait queue while waiting */
+	struct BRTOS_MUTEX_S *psMutexHeld;/* mutexes held by the task */
+	void           *pvWaitData;       /* data given to the task when its wait ends */
+	unsigned short usNotifyValue;     /* notification word   */
+	unsigned char  ucNotifyState;     /* notification state (BRTOS_NOTIFY_xxx) */
+#if BRTOS_PERIODIC_TASKS
+	unsigned short usPeriod;          /* release period in ticks (0: not periodic) */
+	unsigned short usDeadline;        /* relative deadline in ticks */
+	BRTOS_TICKS    ulRelease;         /* release tick of the current job */
+	unsigned short usDeadlineMisses;  /* jobs finished after their deadline */
+	unsigned short usOverruns;        /* jobs still running at their next release */
+#endif
+#if BRTOS_CPU_BUDGETS
+	struct BRTOS_BUDGET_S *psBudget;  /* CPU budget of the task (0: none) */
+#endif
+#if BRTOS_LATENCY_STATS
+	unsigned long  ulWakeTime;        /* timestamp of the tick that woke the task (0: none) */
+#endif
+#if BRTOS_CPU_STATS
+	unsigned long  ulRunTime;         /* time running (port timestamp units) */
+	unsigned long  ulSwitches;        /* times switched in */
+#endif
 } BRTOS_TCB;
 
+/* tasks waiting for an object, highest priority first. It is the first
+   member of all objects tasks can wait for */
+typedef struct BRTOS_WAITQ_S {
+	unsigned char  ucHead;            /* first waiting task               */
+	unsigned char  ucType;            /* kind of object (BRTOS_WAITQ_xxx) */
+#if BRTOS_WAIT_ANY
+	struct BRTOS_WAIT_NODE_S *psAnyHead; /* wait nodes armed on the object */
+#endif
+} BRTOS_WAITQ;
+
+/* one object of a multi object wait (BRTOS_WaitAny()), kept by the waiting 
+   task (usually a static or stack array). Only psObject and usFlags are set 
+   by the user, with the BRTOS_WAIT_xxx initializers */
+typedef struct BRTOS_WAIT_NODE_S {
+	BRTOS_WAITQ   *psObject;          /* object (its wait queue)          */
+	unsigned short usFlags;           /* event flags: any of them         */
+	struct BRTOS_WAIT_NODE_S  *psNext;   /* next node armed on the object */
+	struct BRTOS_WAIT_NODE_S **ppsPrev;  /* link pointing to this node (0: not armed) */
+	BRTOS_WAITQ   *psWait;            /* wait of the task                 */
+} BRTOS_WAIT_NODE;
+
+#define BRTOS_WAIT_SEM(psSem)             { &(psSem)->sQueue, 0, 0, 0, 0 }
+#define BRTOS_WAIT_RING(psRing)           { &(psRing)->sQueue, 0, 0, 0, 0 }
+#define BRTOS_WAIT_EVENT(psEvent, usFlags) { &(psEvent)->sQueue, (usFlags), 0, 0, 0 }
+#define BRTOS_WAIT_POOL(psPool)           { &(psPool)->sQueue, 0, 0, 0, 0 }
+
+typedef struct {
+	BRTOS_WAITQ    sQueue;            /* waiting tasks                    */
+	unsigned short usCount;           /* current count                    */
+	unsigned short usMax;             /* maximum count                    */
+} BRTOS_SEM;
+
+typedef struct BRTOS_MUTEX_S {
+	BRTOS_WAITQ    sQueue;            /* waiting tasks                    */
+	unsigned char  ucOwner;           /* owner task or BRTOS_NO_TASK_TO_RUN */
+	unsigned char  ucNesting;         /* recursive locks by the owner     */
+	struct BRTOS_MUTEX_S *psNextHeld; /* next mutex held by the owner     */
+} BRTOS_MUTEX;
+
+/* single producer, single consumer ring buffer. Indexes run freely and are 
+   masked on access: only the producer writes usHead and only the consumer
+   writes usTail, so no interrupt masking is needed to move data */
+typedef struct {
+	BRTOS_WAITQ    sQueue;            /* consumer waiting for data        */
+	unsigned char  *pucBuffer;        /* elements                         */
+	unsigned short usElemSize;        /* element size in bytes            */
+	unsigned short usMask;            /* number of elements - 1           */
+	unsigned short usHighWater;       /* elements needed to wake the consumer */
+	unsigned short usDropped;         /* elements not written (ring full) */
+	volatile unsigned short usHead;   /* next element to write (producer) */
+	volatile unsigned short usTail;   /* next element to read (consumer)  */
+} BRTOS_RING;
+
+/* event flags shared by tasks */
+typedef struct {
+	BRTOS_WAITQ    sQueue;            /* waiting tasks                    */
+	unsigned short usFlags;           /* current flags                    */
+} BRTOS_EVENT;
+
+/* trace record: an event and the time elapsed since the previous one */
 typedef struct {
-	pfTaskEntry    pfEntryPoint;
-	unsigned short usCounter;
-	unsigned char  ucPriority;
-	unsigned char  ucStatus;
+	unsigned short usTime;            /* port timestamp units since previous record */
+	unsigned char  ucEvent;           /* BRTOS_TRACE_xxx                  */
+	unsigned char  ucArg;             /* task or nesting level            */
+} BRTOS_TRACE_RECORD;
+
+/* latency statistics, see BRTOS_LatencyStats() */
+#define BRTOS_LATENCY_CRITICAL     0  /* interrupts disabled by a critical section */
+#define BRTOS_LATENCY_WAKE         1  /* tick processing to dispatch of a woken task */
+
+typedef struct {
+	unsigned long  ulMax;             /* worst case (port timestamp units) */
+	unsigned short usWhere;           /* worst case: brtos.c line of the critical section or task */
+	unsigned long  aulHistogram[BRTOS_LATENCY_BUCKETS]; /* bucket i: [2^i, 2^(i+1)) */
+} BRTOS_LATENCY;
+
+/* fixed size blocks. Free blocks are linked through their first word */
+typedef struct BRTOS_POOL_S {
+	BRTOS_WAITQ    sQueue;            /* tasks waiting for a block        */
+	void           *pvFree;           /* first free block                 */
+	unsigned char  *pucBuffer;        /* blocks                           */
+	unsigned char  *pucEnd;           /* end of blocks                    */
+	unsigned short usBlockSize;       /* block size in bytes              */
+	unsigned short usNumBlocks;       /* number of blocks                 */
+	unsigned short usUsed;            /* blocks in use                    */
+	unsigned short usMaxUsed;         /* usage high water mark            */
+} BRTOS_POOL;
+
+typedef struct BRTOS_TIMER_S {
+	struct BRTOS_TIMER_S  *psNext;    /* next timer in the same list      */
+	struct BRTOS_TIMER_S **ppsPrev;   /* link pointing to this timer      */
+	pfTaskEntry    pfEntryPoint;      /* callback                         */
+	unsigned long  ulArg;             /* callback argument                */
+	unsigned short usExpire;          /* expiration tick                  */
+	unsigned short usPeriod;          /* period in ticks (0: one shot)    */
+	unsigned char  ucPriority;        /* callback priority                */
+	unsigned char  ucStatus;          /* timer status                     */
 } BRTOS_TIMER;
 
+/* CPU budget of a task or group of tasks: usBudget ticks of CPU every usPeriod 
+   ticks, the whole budget given back at the start of each period (deferrable
+   server) */
+typedef struct BRTOS_BUDGET_S {
+	BRTOS_TICKS    ulStart;           /* start tick of the current period */
+	unsigned long  ulUsed;            /* ticks charged since creation     */
+	unsigned short usBudget;          /* ticks of CPU for each period     */
+	unsigned short usPeriod;          /* replenishment period in ticks    */
+	unsigned short usLeft;            /* ticks left in the current period */
+	unsigned short usThrottles;       /* periods with the budget used up  */
+} BRTOS_BUDGET;
+
+/* low power mode of a port, as the idle governor sees it (entries of
+   BRTOS_PORT_IDLE_MODE_TABLE, lightest mode first, set with 
+   BRTOS_IDLE_MODE_INIT()) */
+typedef struct {
+	unsigned short usExitUs;          /* exit latency: wake up to code running (us) */
+	unsigned short usMinUs;           /* shortest sleep saving energy, exit excluded (us) */
+	unsigned short usExitTicks;       /* exit latency in ticks, rounded down */
+	unsigned short usWorthTicks;      /* shortest sleep worth the mode, exit included (ticks) */
+	unsigned char  ucTimed;           /* the wake up timer runs (kernel time goes on) */
+} BRTOS_IDLE_MODE;
+
+/* low power mode initializer: exit latency (us), shortest useful sleep (us) 
+   and wake up timer running. Ticks are computed at compile time, so the 
+   governor compares ticks without dividing or multiplying */
+#define BRTOS_IDLE_MODE_INIT(usExit, usMin, ucTimed) \
+	{ (usExit), (usMin), \
+	  (unsigned short)(((unsigned long)(usExit)*BRTOS_PORT_TICKS_PER_SECOND)/1000000UL), \
+	  (unsigned short)((((unsigned long)(usExit) + (usMin))*BRTOS_PORT_TICKS_PER_SECOND + 999999UL)/1000000UL), \
+	  (ucTimed) }
+
+struct BRTOS_JOB_S;
+
+/* job entry: void job(BRTOS_JOB *psJob, unsigned short usEvents) */
+typedef void (*pfJobEntry)(struct BRTOS_JOB_S *, unsigned short);
+
+/* run to completion job: a function called by the deferred work task, on its 
+   stack, each time events are posted to it. Jobs need no stack or TCB of 
+   their own and switching between them is a function call */
+typedef struct BRTOS_JOB_S {
+	struct BRTOS_JOB_S *psNext;       /* next job in the ready list       */
+	pfJobEntry     pfEntry;           /* job function                     */
+	unsigned long  ulArg;             /* user argument                    */
+	BRTOS_TIMER    sTimer;            /* posts BRTOS_JOB_EVENT_TIMER      */
+	unsigned short usEvents;          /* events posted since the last run */
+	unsigned short usLc;              /* protothread continuation (line)  */
+	unsigned char  ucReady;           /* in the ready list                */
+} BRTOS_JOB;
+
+/* protothreads: jobs written as sequential code that waits, keeping their
+   position in usLc between runs (a switch on __LINE__, so locals are lost 
+   and there can be one wait per line). A job body is
+   BRTOS_PT_BEGIN(psJob); ... BRTOS_PT_END(psJob); */
+#define BRTOS_PT_BEGIN(psJob)     switch((psJob)->usLc) { case 0:
+#define BRTOS_PT_END(psJob)       } (psJob)->usLc = 0; return
+/* return until cond is true, checked at each run (at once the first time) */
+#define BRTOS_PT_WAIT_UNTIL(psJob, cond) \
+	do { (psJob)->usLc = __LINE__; case __LINE__: if(!(cond)) return; } while(0)
+/* return and wait for a later run where cond is true */
+#define BRTOS_PT_YIELD_UNTIL(psJob, cond) \
+	do { (psJob)->usLc = __LINE__; return; case __LINE__: if(!(cond)) return; } while(0)
+/* wait for some of the events in usMask (usEvents is the job argument) */
+#define BRTOS_PT_WAIT_EVENT(psJob, usEvents, usMask) \
+	BRTOS_PT_YIELD_UNTIL(psJob, (usEvents) & (usMask))
+/* sleep usTime ms */
+#define BRTOS_PT_SLEEP(psJob, usEvents, usTime) \
+	do { BRTOS_JobPostIn(psJob, usTime, 0); BRTOS_PT_WAIT_EVENT(psJob, usEvents, BRTOS_JOB_EVENT_TIMER); } while(0)
+
+/* kernel state (context of a kernel instance). Applications only allocate 
+   it (BRTOS_INSTANCES), its members are private to brtos.c */
+typedef struct {
+#ifndef BRTOS_STATIC_TASKS
+	BRTOS_TCB      asBrtosTasks[BRTOS_MAX_TASKS];   /* task control blocks */
+	unsigned short usNumTasks;                      /* TCBs in use or freed */
+#endif
+	unsigned char  ucCurrentPriLevel;
+	unsigned char  ucCurrentTask;
+	unsigned char  ucNotEmptyLevel;
+	unsigned char  aucReadyHead[BRTOS_MAX_PRIORITY_LEVELS];
+	unsigned char  aucReadyTail[BRTOS_MAX_PRIORITY_LEVELS];
+	unsigned char  ucSleepHead;
+	BRTOS_TIMER   *apsTimerWheel[BRTOS_TIMER_WHEEL_LEVELS][BRTOS_TIMER_WHEEL_SIZE];
+	BRTOS_TIMER   *psTimerPending;
+	unsigned short usTimerNext;
+	BRTOS_TICKS    ulTicks;
+	unsigned short usActiveTimers;
+	unsigned char  ucCriticalNesting;
+	unsigned char  ucIsrNesting;
+	struct {
+		pfTaskEntry   pfWork;
+		unsigned long ulArg;
+	} asDeferQueue[BRTOS_DEFER_QUEUE_SIZE];
+	unsigned char  ucDeferHead;
+	unsigned char  ucDeferTail;
+	unsigned char  ucDeferTask;
+	BRTOS_JOB     *psJobHead;
+	BRTOS_JOB     *psJobTail;
+#ifndef BRTOS_STATIC_TASKS
+	unsigned char  ucFreeTask;
+#endif
+	BRTOS_WAITQ    sJoinQueue;
+	unsigned long  ulTimeNow;
+	unsigned long  ulTimeRaw;
+#if BRTOS_CPU_STATS
+	unsigned long  ulStatsTime;
+	unsigned long  ulIdleTime;
+	unsigned long  ulIdleSwitches;
+#endif
+#if BRTOS_TRACE
+	BRTOS_TRACE_RECORD asTrace[BRTOS_TRACE_SIZE];
+	unsigned short usTraceNext;
+	unsigned short usTraceCount;
+	unsigned long  ulTraceTime;
+#endif
+#if BRTOS_LATENCY_STATS
+	BRTOS_LATENCY  asLatency[2];
+	unsigned long  ulCriticalStart;
+	unsigned short usCriticalLine;
+	unsigned long  ulTickTime;
+#endif
+#if BRTOS_IDLE_GOVERNOR
+	unsigned char  aucIdleConstraints[BRTOS_IDLE_MODES];
+	unsigned long  aulIdleEntries[BRTOS_IDLE_MODES];
+	unsigned long  aulIdleTime[BRTOS_IDLE_MODES];
+#endif
+#if BRTOS_INSTANCES
+	void          *pvInstanceData;                  /* application data of the instance */
+#endif
+} BRTOS_KERNEL;
+
+#if BRTOS_INSTANCES
+/** Kernel instance running in the calling thread */
+extern __thread BRTOS_KERNEL *psBrtosKernel;
+
+void BRTOS_InstanceMain(void *pvData);
+void *BRTOS_InstanceData(void);
+#endif
+
 /* prototypes */
-int BRTOS_CreateTask(pfTaskEntry entry_point, unsigned short stack_addr, int time_slice, int pri);
+#ifndef BRTOS_STATIC_TASKS
+int BRTOS_CreateTask(pfTaskEntry entry_point, unsigned short *stack_addr, unsigned short stack_size, int time_slice, int pri);
+int BRTOS_TaskSpawn(pfTaskEntry entry_point, BRTOS_POOL *psStacks, int time_slice, int pri, unsigned char *pucTask);
+#if BRTOS_PERIODIC_TASKS
+int BRTOS_CreatePeriodicTask(pfTaskEntry entry_point, unsigned short *stack_addr, unsigned short stack_size, int time_slice, 
+                             unsigned short usPeriod, unsigned short usDeadline, int pri);
+#endif
+#endif
+#if BRTOS_PERIODIC_TASKS
+int BRTOS_TaskWaitPeriod(void);
+int BRTOS_TaskPeriodStats(unsigned char ucTask, unsigned short *pusMisses, unsigned short *pusOverruns);
+#endif
+#if BRTOS_CPU_BUDGETS
+int BRTOS_BudgetCreate(BRTOS_BUDGET *psBudget, unsigned short usBudget, unsigned short usPeriod);
+int BRTOS_TaskSetBudget(unsigned char ucTask, BRTOS_BUDGET *psBudget);
+int BRTOS_BudgetStats(BRTOS_BUDGET *psBudget, unsigned short *pusThrottles, unsigned long *pulUsed);
+#endif
+void BRTOS_TaskExit(void);
+int BRTOS_TaskDelete(unsigned char ucTask);
+int BRTOS_TaskJoin(unsigned char ucTask, unsigned short usTimeout);
+unsigned short BRTOS_TaskStackHighWater(unsigned char ucTask);
 void BRTOS_Sleep(unsigned short usTime);
+int BRTOS_SleepUntil(BRTOS_TICKS *pulLastWake, unsigned short usPeriod);
+BRTOS_TICKS BRTOS_GetTicks(void);
+unsigned long BRTOS_GetTimestamp(void);
+void BRTOS_Yield(void);
+int BRTOS_YieldTo(unsigned char ucTask);
+int BRTOS_TimerCreate(BRTOS_TIMER *psTimer, pfTaskEntry callback, unsigned long arg, int pri);
+int BRTOS_TimerStart(BRTOS_TIMER *psTimer, unsigned short usTime, unsigned short usPeriod);
+int BRTOS_TimerReschedule(BRTOS_TIMER *psTimer, unsigned short usTime);
+int BRTOS_TimerStop(BRTOS_TIMER *psTimer);
+int BRTOS_SemCreate(BRTOS_SEM *psSem, unsigned short usInitial, unsigned short usMax);
+int BRTOS_SemTake(BRTOS_SEM *psSem, unsigned short usTimeout);
+int BRTOS_SemGive(BRTOS_SEM *psSem);
+int BRTOS_SemGiveFromISR(BRTOS_SEM *psSem);
+int BRTOS_MutexCreate(BRTOS_MUTEX *psMutex);
+int BRTOS_MutexLock(BRTOS_MUTEX *psMutex, unsigned short usTimeout);
+int BRTOS_MutexUnlock(BRTOS_MUTEX *psMutex);
+int BRTOS_RingCreate(BRTOS_RING *psRing, void *pvBuffer, unsigned short usElemSize, unsigned short usNumElems, unsigned short usHighWater);
+unsigned short BRTOS_RingCount(BRTOS_RING *psRing);
+unsigned short BRTOS_RingWriteSpan(BRTOS_RING *psRing, void **ppvSpan);
+void BRTOS_RingWriteCommit(BRTOS_RING *psRing, unsigned short usCount);
+void BRTOS_RingWriteCommitFromISR(BRTOS_RING *psRing, unsigned short usCount);
+unsigned short BRTOS_RingWrite(BRTOS_RING *psRing, const void *pvData, unsigned short usCount);
+unsigned short BRTOS_RingWriteFromISR(BRTOS_RING *psRing, const void *pvData, unsigned short usCount);
+unsigned short BRTOS_RingReadSpan(BRTOS_RING *psRing, void **ppvSpan);
+void BRTOS_RingReadRelease(BRTOS_RING *psRing, unsigned short usCount);
+unsigned short BRTOS_RingRead(BRTOS_RING *psRing, void *pvData, unsigned short usCount);
+int BRTOS_RingWait(BRTOS_RING *psRing, unsigned short usTimeout);
+int BRTOS_PoolCreate(BRTOS_POOL *psPool, void *pvBuffer, unsigned short usBlockSize, unsigned short usNumBlocks);
+void *BRTOS_PoolAlloc(BRTOS_POOL *psPool, unsigned short usTimeout);
+void *BRTOS_PoolAllocFromISR(BRTOS_POOL *psPool);
+int BRTOS_PoolFree(BRTOS_POOL *psPool, void *pvBlock);
+int BRTOS_PoolFreeFromISR(BRTOS_POOL *psPool, void *pvBlock);
+void *BRTOS_PoolSetAlloc(BRTOS_POOL *asPools, unsigned char ucNumPools, unsigned short usSize, unsigned short usTimeout);
+int BRTOS_PoolSetFree(BRTOS_POOL *asPools, unsigned char ucNumPools, void *pvBlock);
+unsigned char BRTOS_GetCurrentTask(void);
+int BRTOS_TaskNotify(unsigned char ucTask, unsigned short usValue, unsigned char ucAction);
+int BRTOS_TaskNotifyFromISR(unsigned char ucTask, unsigned short usValue, unsigned char ucAction);
+int BRTOS_TaskNotifyWait(unsigned short usClearOnExit, unsigned short *pusValue, unsigned short usTimeout);
+int BRTOS_EventCreate(BRTOS_EVENT *psEvent, unsigned short usFlags);
+int BRTOS_EventSet(BRTOS_EVENT *psEvent, unsigned short usFlags);
+int BRTOS_EventSetFromISR(BRTOS_EVENT *psEvent, unsigned short usFlags);
+unsigned short BRTOS_EventClear(BRTOS_EVENT *psEvent, unsigned short usFlags);
+int BRTOS_EventWait(BRTOS_EVENT *psEvent, unsigned short usFlags, unsigned char ucOptions, unsigned short *pusFlags, unsigned short usTimeout);
+#if BRTOS_WAIT_ANY
+int BRTOS_WaitAny(BRTOS_WAIT_NODE *asNodes, unsigned char ucNumNodes, unsigned char *pucReady, unsigned short usTimeout);
+#endif
+void BRTOS_ISR_Enter(void);
+void BRTOS_ISR_Exit(void);
+#ifndef BRTOS_STATIC_TASKS
+int BRTOS_DeferInit(unsigned short *pusStack, unsigned short usStackSize, int iTimeSlice, int iPri);
+#endif
+void BRTOS_DeferTask(unsigned long ulArg);
+int BRTOS_Defer(pfTaskEntry pfWork, unsigned long ulArg);
+int BRTOS_JobCreate(BRTOS_JOB *psJob, pfJobEntry pfEntry, unsigned long ulArg);
+int BRTOS_JobPost(BRTOS_JOB *psJob, unsigned short usEvents);
+int BRTOS_JobPostIn(BRTOS_JOB *psJob, unsigned short usTime, unsigned short usPeriod);
+int BRTOS_JobStop(BRTOS_JOB *psJob);
+#if BRTOS_CPU_STATS
+int BRTOS_TaskStats(unsigned char ucTask, unsigned long *pulRunTime, unsigned long *pulSwitches);
+#endif
+#if BRTOS_LATENCY_STATS
+int BRTOS_LatencyStats(unsigned char ucKind, BRTOS_LATENCY *psStats, int iReset);
+#endif
+#if BRTOS_TRACE
+unsigned short BRTOS_TraceDump(void *pvBuf, unsigned short usSize);
+#endif
+#if BRTOS_IDLE_GOVERNOR
+int BRTOS_IdleConstrain(unsigned char ucMode);
+int BRTOS_IdleRelease(unsigned char ucMode);
+int BRTOS_IdleStats(unsigned char ucMode, unsigned long *pulEntries, unsigned long *pulTime);
+#endif
 extern void BRTOS_Application_Initialize(void);
 
 #endif /* __BRTOS_H__ */
@@ -0,0 +1,89 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   brtos_port.h
+
+Port layer. Everything that depends on the CPU or on the host system
+is provided by a port, selected at compile time:
+
+- port_msp430.h: MSP430 with mspgcc (default)
+- port_posix.h:  Linux host (x86-64), define BRTOS_PORT_POSIX
+
+This file is included only by brtos.c, after the kernel declarations,
+since ports are allowed to access the kernel state (current task and
+its TCB). A port must provide:
+
+- DisableInterrupts() / EnableInterrupts()
+- BRTOS_PortMemoryBarrier(): orders memory accesses between tasks and interrupts
+  (lock free ring buffers). A compiler barrier is enough on single core CPUs
+- BRTOS_PortConfigureTick(): configure the system tick, at BRTOS_PORT_TICKS_PER_SECOND
+  (a constant: time conversions are resolved at compile time)
+- BRTOS_PortInitStack(psTask, pusStack): prepare the initial context of a task,
+  so it starts at psTask->pfEntryPoint and calls BRTOS_TaskEnd() when it returns.
+  pusStack is the last word of the stack. Ports that allocate their own stacks
+  update psTask->pusStackBeg and psTask->usStackSize, so the kernel paints and
+  checks the stack really used
+- BRTOS_PORT_STACK_FRAME: size in bytes of the initial context (minimum stack)
+- static task table (BRTOS_STATIC_TASKS): BRTOS_PORT_STACK_WORDS(bytes), the 
+  stack array size, BRTOS_PORT_STACK_ATTR, its attributes, and 
+  BRTOS_PORT_STACK_INIT(entry, bytes), its initializer: the painted stack with 
+  the initial context on top, when the port can build it at compile time. 
+  Otherwise BRTOS_PortStaticStack(psTask, psConst) builds it at initialization
+- BRTOS_PortTimestamp(): free running counter for BRTOS_GetTimestamp(), CPU statistics and trace, read
+  with interrupts disabled. BRTOS_PORT_TIMESTAMP_MASK gives its width (the kernel
+  extends it, reading it at each scheduler run) and BRTOS_PORT_TIMESTAMP_HZ its
+  rate (0 if known only at run time)
+- BRTOS_PortIdle(usTicks, ucMode): sleep in low power mode ucMode while there is
+  nothing to run, returning the amount of elapsed ticks (usTicks is the longest
+  possible sleep, for tickless idle)
+- low power modes, lightest first: BRTOS_PORT_IDLE_MODES, their number,
+  BRTOS_PORT_IDLE_DEFAULT, the mode used without the idle governor, and
+  BRTOS_PORT_IDLE_MODE_TABLE, the BRTOS_IDLE_MODE_INIT() of each one
+  (exit latency, shortest useful sleep and wake up timer running). Mode 0 must
+  keep the wake up timer running
+- BRTOS_PortYield(): cooperative switch, called with interrupts disabled. Only
+  the registers preserved across function calls need to be saved, since it is 
+  a function call for the task. It calls BRTOS_ScheduleYield() in the scheduler
+  stack and enables interrupts again when the task is resumed
+- BRTOS_PortPendSwitch(): called by \ref BRTOS_ISR_Exit() when the outermost
+  interrupt routine woke up a task with higher priority. The port saves the
+  full context and calls BRTOS_ScheduleYield() right after the routine returns. 
+  While idle, it makes BRTOS_PortIdle() return (0 ticks may have elapsed)
+- BRTOS_PortStart(): start the scheduler (never returns)
+- the system tick interrupt, which saves the full context of the current task and calls
+  BRTOS_Schedule() in the scheduler stack, restoring the context of the returned task
+
+A task switched out by one path may be resumed by the other one, so the
+port must know how the context of each task was saved.
+
+*/
+#ifndef __BRTOS_PORT_H__
+#define __BRTOS_PORT_H__
+
+/* kernel functions used by ports */
+BRTOS_TCB *BRTOS_Schedule(void);
+BRTOS_TCB *BRTOS_ScheduleYield(void);
+static void BRTOS_TaskEnd(void);
+
+#if defined(BRTOS_PORT_POSIX)
+#include "port_posix.h"
+#else
+#include "port_msp430.h"
+#endif
+
+#endif /* __BRTOS_PORT_H__ */
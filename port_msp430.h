@@ -0,0 +1,472 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   port_msp430.h
+@author Marcelo Barros
+@date   20050416
+
+MSP430 port (mspgcc). Included only by brtos.c, see \ref brtos_port.h.
+
+Initial stack organization for tasks (an interrupt frame, as if the
+task had been interrupted just before its entry point):
+
+<pre>
+stack_addr 0xABCD      +--------------------+
+                       | BRTOS_TaskEnd addr | -> avoid problems with tasks that return
+           0xABCD - 2  +--------------------+
+                       |  Program Counter   | -> points to entry_point
+           0xABCD - 4  +--------------------+
+                       |  Status Register   | -> GIE set
+           0xABCD - 6  +--------------------+
+                       |                    |
+                       |  Initial Context   | -> dummy values for R4-R15
+                       |                    |
+           0xABCD - 28 +--------------------+
+</pre>
+
+Register usage description:
+
+- R0: PC
+- R1: Stack Pointer
+- R2: Status/CG1
+- R3: CG2
+- R4-R15: Working registers
+
+There are two ways of entering the scheduler:
+
+- system tick (BRTOS_Scheduler()): the task may be interrupted anywhere, so
+  R4-R15 are saved over the interrupt frame (full context)
+- cooperative (BRTOS_PortYield()): the task calls the kernel, and mspgcc 
+  considers R12-R15 as clobbered by function calls, so only R4-R11 are saved
+  over an interrupt frame built from the return address (cooperative context)
+
+Both frames end with a reti, so a task can be switched out by one path and 
+resumed by the other: the kind of frame of each task is kept in \ref aucPortFrame.
+R3 (constant generator) is never saved.
+
+A switch requested by \ref BRTOS_ISR_Exit() uses a third entry, like the
+system tick but without time processing: Timer_A CCR1 interrupt flag is set
+by software, so BRTOS_PortSwitchIsr() runs as soon as the outermost interrupt
+returns. Timer_A CCR1 and its vector (TIMERA1_VECTOR) are reserved for the port.
+
+Idle runs in the scheduler stack, in LPM3 with tickless idle, LPM0 otherwise
+(or the mode chosen by the idle governor) with interrupts enabled. The tick and switch interrupts only wake up
+the CPU there (\ref ucPortIdle), the scheduler loop goes on when BRTOS_PortIdle()
+returns.
+
+Cycles spent saving and restoring registers (MSP430 CPU, push 3 and pop 2 cycles):
+
+- full context: 12 push + 12 pop = 60 cycles
+- cooperative context: push SR, set GIE, 8 push + 8 pop = 47 cycles, instead of
+  the 11 cycles to adjust the stack plus 13 push + 13 pop = 76 cycles before
+
+*/
+#ifndef __PORT_MSP430_H__
+#define __PORT_MSP430_H__
+
+#include <signal.h>
+#include <io.h>
+
+/* a device runs one kernel (scheduler stack and timer state are file scope) */
+#if BRTOS_INSTANCES
+#error "BRTOS_INSTANCES is not supported by the MSP430 port"
+#endif
+
+#define SaveContext() __asm__ __volatile__ ("push R4\n"  \
+                                            "push R5\n"  \
+                                            "push R6\n"  \
+                                            "push R7\n"  \
+                                            "push R8\n"  \
+                                            "push R9\n"  \
+                                            "push R10\n" \
+                                            "push R11\n" \
+                                            "push R12\n" \
+                                            "push R13\n" \
+                                            "push R14\n" \
+                                            "push R15" )
+
+#define RestoreContext() __asm__ __volatile__ ( "pop R15\n" \
+                                                "pop R14\n" \
+                                                "pop R13\n" \
+                                                "pop R12\n" \
+                                                "pop R11\n" \
+                                                "pop R10\n" \
+                                                "pop R9\n"  \
+                                                "pop R8\n"  \
+                                                "pop R7\n"  \
+                                                "pop R6\n"  \
+                                                "pop R5\n"  \
+                                                "pop R4" )
+
+/* registers preserved across function calls (cooperative context) */
+#define SaveCalleeSaved() __asm__ __volatile__ ("push R4\n"  \
+                                                "push R5\n"  \
+                                                "push R6\n"  \
+                                                "push R7\n"  \
+                                                "push R8\n"  \
+                                                "push R9\n"  \
+                                                "push R10\n" \
+                                                "push R11" )
+
+#define RestoreCalleeSaved() __asm__ __volatile__ ( "pop R11\n" \
+                                                    "pop R10\n" \
+                                                    "pop R9\n"  \
+                                                    "pop R8\n"  \
+                                                    "pop R7\n"  \
+                                                    "pop R6\n"  \
+                                                    "pop R5\n"  \
+                                                    "pop R4" )
+
+#define NUM_REGS_IN_CONTEXT   12
+#define SaveStackPointer()    asm("mov.w R1,%0"  : "=m" (asBrtosTasks[ucCurrentTask].pusStackPtr))
+#define RestoreStackPointer() asm("mov.w %0,R1" :: "m" (asBrtosTasks[ucCurrentTask].pusStackPtr))
+
+#define SaveSchedStackPointer()    asm("mov.w R1,%0"  : "=m" (usSchStackPtr))
+#define RestoreSchedStackPointer() asm("mov.w %0,R1" :: "m" (usSchStackPtr))
+
+/* changing a calling function stack into a interrupt stack: SR is pushed over
+   the return address, with GIE set since reti restores it (interrupts are
+   disabled when calling the scheduler) */
+#define AdjustInterruptStack() __asm__ __volatile__ ( "push R2\n"          \
+                                                      "bis #8, 0(R1)" ) /* GIE */
+
+#define ReturnFromInterrupt()  asm("reti")
+#define GoToScheduler()        asm("br #BRTOS_Scheduler")
+
+#define DisableInterrupts()    dint()
+#define EnableInterrupts()     eint()
+
+/* single core: interrupts see memory in program order, only the compiler must not reorder */
+#define BRTOS_PortMemoryBarrier() __asm__ __volatile__ ("" ::: "memory")
+
+/* go to a saving energy mode (SR bits), with interrupts enabled to wake up */
+#define GoToLowPowerMode(usBits) _BIS_SR((usBits) | GIE)
+
+/* clear low power bits of SR saved under the full context (12 registers), 
+   so the CPU stays awake after reti */
+#define LeaveLowPowerMode()    __asm__ __volatile__ ("bic #0xF0, 24(R1)")
+
+/* request the switch interrupt (see BRTOS_PortSwitchIsr()) */
+#define BRTOS_PortPendSwitch() (TACCTL1 = CCIE | CCIFG)
+
+/* low power modes for idle (BRTOS_PortIdle()), lightest first. LPM0 keeps
+   SMCLK (watchdog tick and peripherals), LPM3 keeps only ACLK (Timer_A wake up
+   of tickless idle, so the watchdog tick does not run there) and LPM4 stops all
+   clocks: only an external interrupt wakes up the CPU and the watch crystal has
+   to start again. The DCO starts in 6 us when leaving LPM3 or LPM4. Without 
+   tickless idle, only LPM0 keeps the tick running: it is the default mode */
+#define BRTOS_PORT_IDLE_LPM0       0
+#define BRTOS_PORT_IDLE_LPM3       1
+#define BRTOS_PORT_IDLE_LPM4       2
+#define BRTOS_PORT_IDLE_MODES      3
+#ifndef BRTOS_PORT_IDLE_DEFAULT
+#define BRTOS_PORT_IDLE_DEFAULT    (BRTOS_TICKLESS_IDLE ? BRTOS_PORT_IDLE_LPM3 : BRTOS_PORT_IDLE_LPM0)
+#endif
+/* exit latency (us), shortest useful sleep (us), wake up timer running */
+#define BRTOS_PORT_IDLE_MODE_TABLE { BRTOS_IDLE_MODE_INIT(0, 0, 1), \
+                                     BRTOS_IDLE_MODE_INIT(6, 50, BRTOS_TICKLESS_IDLE), \
+                                     BRTOS_IDLE_MODE_INIT(6, 0, 0) }
+
+/* system tick rate: watchdog interval timer, 0.5 ms at 1 MHz */
+#define BRTOS_PORT_TICKS_PER_SECOND 2000
+
+/* ACLK counts (tickless idle wake up timer) to ticks and vice versa, with
+   constant multipliers and divisors */
+#define ACLK_TO_TICKS(x) ((unsigned short)(((unsigned long)(x)*BRTOS_PORT_TICKS_PER_SECOND)/BRTOS_ACLK_HZ))
+#define TICKS_TO_ACLK(x) ((unsigned short)(((unsigned long)(x)*BRTOS_ACLK_HZ+BRTOS_PORT_TICKS_PER_SECOND-1)/BRTOS_PORT_TICKS_PER_SECOND))
+
+/* RTOS scheduler function is allocated at watchdog interrupt */
+static interrupt (WDT_VECTOR)  BRTOS_Scheduler(void);
+/* switch requested by BRTOS_ISR_Exit(), software Timer_A CCR1 interrupt */
+static interrupt (TIMERA1_VECTOR) BRTOS_PortSwitchIsr(void);
+
+/** SR bits of each low power mode (BRTOS_PORT_IDLE_xxx) */
+static const unsigned short ausPortIdleBits[BRTOS_PORT_IDLE_MODES] = { LPM0_bits, LPM3_bits, LPM4_bits };
+
+/** CPU sleeping in BRTOS_PortIdle() (scheduler stack) */
+static volatile unsigned char ucPortIdle;
+/** Ticks taken while idle, without tickless idle */
+static volatile unsigned char ucPortIdleTicks;
+
+/** Scheduler stack pointer */
+static unsigned short usSchStackPtr;
+
+/* kind of context saved in the stack of each task */
+#define PORT_FRAME_FULL        0
+#define PORT_FRAME_COOPERATIVE 1
+
+/** Kind of context saved for each task (PORT_FRAME_FULL or PORT_FRAME_COOPERATIVE) */
+static unsigned char aucPortFrame[BRTOS_MAX_TASKS];
+
+/* 
+  Restore the context of the current task, as it was saved, and return to it.
+  Scratch registers used by the test are restored or not used by the task.
+*/
+#define ResumeTask()                                                 \
+    do {                                                             \
+        RestoreStackPointer();                                       \
+        if(aucPortFrame[ucCurrentTask] == PORT_FRAME_COOPERATIVE)    \
+        {                                                            \
+            RestoreCalleeSaved();                                    \
+            ReturnFromInterrupt();                                   \
+        }                                                            \
+        RestoreContext();                                            \
+        ReturnFromInterrupt();                                       \
+    } while(0)
+
+void BRTOS_PortYield(void);
+
+/**
+Configure the system tick: watchdog as interval timer.
+We are assuming a 1MHz clock and the source clock as MCLK.
+*/
+static void BRTOS_PortConfigureTick(void)
+{
+	/* configuring interval timer */
+	WDTCTL = WDT_MDLY_0_5;
+	/* Timer_A free running from ACLK: timestamp and tickless idle wake up source */
+	TACTL = TASSEL_1 | MC_2 | TACLR;
+}
+
+/* timestamp (BRTOS_GetTimestamp(), statistics and trace): Timer_A counter (ACLK), 16 bits */
+#define BRTOS_PortTimestamp()      ((unsigned long) TAR)
+#define BRTOS_PORT_TIMESTAMP_MASK  0xFFFFUL
+#define BRTOS_PORT_TIMESTAMP_HZ    BRTOS_ACLK_HZ
+
+/* initial context: BRTOS_TaskEnd() return address, PC, SR and registers */
+#define BRTOS_PORT_STACK_FRAME ((NUM_REGS_IN_CONTEXT + 3)*sizeof(unsigned short))
+
+/* static task table: painted stack with the same initial context built by 
+   BRTOS_PortInitStack(), so tasks start with a full frame (aucPortFrame is 0).
+   The pattern range is empty, and the build fails, if the stack cannot hold 
+   the initial context plus the canary word */
+#define BRTOS_PORT_STACK_WORDS(bytes) ((bytes)/sizeof(unsigned short))
+#define BRTOS_PORT_STACK_ATTR
+#define BRTOS_PORT_STACK_INIT(entry, bytes) \
+    { [0 ... BRTOS_PORT_STACK_WORDS(bytes) - BRTOS_PORT_STACK_FRAME/sizeof(unsigned short) - 1] = BRTOS_STACK_PATTERN, \
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, GIE, (unsigned short) entry, (unsigned short) BRTOS_TaskEnd }
+#define BRTOS_PortStaticStack(psTask, psConst) ((void) 0)
+
+#ifndef BRTOS_STATIC_TASKS
+/**
+Prepare the initial stack of a task, as if it had been interrupted
+just before its entry point (see stack organization above).
+*/
+static void BRTOS_PortInitStack(BRTOS_TCB *psTask, unsigned short *pusStack)
+{
+	int i;
+
+	psTask->pusStackPtr = pusStack;
+
+	/* if task returns some day, prepare stack */
+	*(psTask->pusStackPtr) = (unsigned short) BRTOS_TaskEnd;
+	/* interrupt frame: SR on top of PC */
+	*(--psTask->pusStackPtr) = (unsigned short) psTask->pfEntryPoint;
+	*(--psTask->pusStackPtr) = (unsigned short) GIE;
+
+	/* prepare for first RestoreContext(): dummy NUM_REGS_IN_CONTEXT regs */
+	for(i = 0 ; i < NUM_REGS_IN_CONTEXT ; i++)
+		*(--psTask->pusStackPtr) = (unsigned short) 0;
+
+	aucPortFrame[psTask - asBrtosTasks] = PORT_FRAME_FULL;
+}
+#endif
+
+#if BRTOS_TICKLESS_IDLE
+/**
+Wake up interrupt for tickless idle. It just leaves the low power mode when returning.
+*/
+interrupt (TIMERA0_VECTOR) wakeup BRTOS_TicklessWakeup(void)
+{
+	TACCTL0 &= ~CCIE;
+}
+#endif
+
+/**
+Idle: nothing to run, the CPU sleeps in low power mode ucMode (without the
+idle governor, LPM3 with tickless idle and LPM0 otherwise).
+
+Without tickless idle the CPU just waits for the next tick.
+
+With tickless idle the system tick is stopped and the CPU sleeps
+for usTicks, instead of waking up at every tick. Timer_A (ACLK) is used
+as wake up source since it keeps running in LPM3 and its counter can be read,
+so the elapsed time is corrected when another interrupt wakes up the CPU earlier.
+In LPM4 ACLK stops too: no time elapses for the kernel.
+
+@param usTicks amount of ticks to sleep (tickless idle)
+@param ucMode  low power mode (BRTOS_PORT_IDLE_xxx)
+@return amount of ticks elapsed while sleeping
+*/
+static unsigned short BRTOS_PortIdle(unsigned short usTicks, unsigned char ucMode)
+{
+#if BRTOS_TICKLESS_IDLE
+	unsigned short usStart;
+	unsigned short usCounts;
+
+	/* stop the system tick and discard any pending tick */
+	WDTCTL = WDTPW | WDTHOLD;
+	IFG1 &= ~WDTIFG;
+
+	/* program the wake up time */
+	usStart = TAR;
+	TACCR0  = usStart + TICKS_TO_ACLK(usTicks);
+	TACCTL0 = CCIE;
+
+	/* sleep until BRTOS_TicklessWakeup() or a switch request (BRTOS_ISR_Exit()) */
+	ucPortIdle = 1;
+	GoToLowPowerMode(ausPortIdleBits[ucMode]);
+	DisableInterrupts();
+	ucPortIdle = 0;
+
+	TACCTL0  = 0;
+	usCounts = TAR - usStart;
+
+	/* restart the system tick */
+	WDTCTL = WDT_MDLY_0_5;
+
+	return ACLK_TO_TICKS(usCounts);
+#else
+	unsigned short usElapsed;
+
+	(void) usTicks;
+
+	/* woken up by the tick or by a switch request (BRTOS_ISR_Exit()) */
+	ucPortIdle = 1;
+	GoToLowPowerMode(ausPortIdleBits[ucMode]);
+	DisableInterrupts();
+	ucPortIdle = 0;
+
+	usElapsed = ucPortIdleTicks;
+	ucPortIdleTicks = 0;
+
+	return usElapsed;
+#endif
+}
+
+/**
+The scheduler interrupt (system tick). The full context of the running
+task is saved in its stack, the scheduler runs in its own stack
+and the context of the selected task is restored.
+*/
+NAKED( BRTOS_Scheduler )
+{
+    SaveContext();
+
+    /* tick while idle, in the scheduler stack: just wake up */
+    if(ucPortIdle)
+    {
+        ucPortIdleTicks++;
+        LeaveLowPowerMode();
+        RestoreContext();
+        ReturnFromInterrupt();
+    }
+
+    SaveStackPointer();
+    aucPortFrame[ucCurrentTask] = PORT_FRAME_FULL;
+    RestoreSchedStackPointer();
+
+    /* Update time and get the next task to run */
+    BRTOS_Schedule();
+
+    /* save scheduler context */
+    SaveSchedStackPointer();
+    /* restore stack pointer, registers and return (reti will pop SR and PC) */
+    ResumeTask();
+}
+
+/**
+Switch requested by \ref BRTOS_ISR_Exit(): a task with higher priority 
+was woken up by an interrupt. It works like the system tick, saving the 
+full context, but no time has elapsed. While idle it just wakes up the CPU.
+*/
+NAKED( BRTOS_PortSwitchIsr )
+{
+    SaveContext();
+    TACCTL1 = 0;
+
+    if(ucPortIdle)
+    {
+        LeaveLowPowerMode();
+        RestoreContext();
+        ReturnFromInterrupt();
+    }
+
+    SaveStackPointer();
+    aucPortFrame[ucCurrentTask] = PORT_FRAME_FULL;
+    RestoreSchedStackPointer();
+
+    /* get the next task to run */
+    BRTOS_ScheduleYield();
+
+    SaveSchedStackPointer();
+    ResumeTask();
+}
+
+/**
+Cooperative entry of the scheduler, called by the kernel (\ref BRTOS_Sleep(), 
+\ref BRTOS_Yield()) with interrupts disabled.
+
+The return address is turned into an interrupt frame and only the 
+registers preserved across function calls are saved:
+<pre>
+                    +--------------------+
+                    |        ...         | -> other values in task stack
+                    +--------------------+
+                    |  Program Counter   | -> return address (pushed by call)
+                    +--------------------+
+                    |  Status Register   | -> GIE set, for reti
+                    +--------------------+
+                    |      R4-R11        | -> cooperative context
+  stack_pointer ->  +--------------------+
+</pre>
+No time has elapsed, so the scheduler does not process timers and sleeping tasks.
+*/
+NAKED( BRTOS_PortYield )
+{
+    AdjustInterruptStack();
+    SaveCalleeSaved();
+    SaveStackPointer();
+    aucPortFrame[ucCurrentTask] = PORT_FRAME_COOPERATIVE;
+    RestoreSchedStackPointer();
+
+    /* get the next task to run */
+    BRTOS_ScheduleYield();
+
+    SaveSchedStackPointer();
+    ResumeTask();
+}
+
+/**
+Start the first task. The current stack becomes the scheduler stack and
+the stack pointer is moved to the first task stack, without its context,
+so the scheduler can be entered as if this task had been interrupted.
+*/
+#define BRTOS_PortStart()                                         \
+    do {                                                          \
+        /* Saving the current stack pointer. It will be used by the scheduler. */ \
+        SaveSchedStackPointer();                                  \
+        asBrtosTasks[ucCurrentTask].pusStackPtr += NUM_REGS_IN_CONTEXT; \
+        RestoreStackPointer();                                    \
+        /* interrupts are enabled by reti, when the task starts */ \
+        ucCriticalNesting--;                                      \
+        /* go to to scheduler routine*/                           \
+        GoToScheduler();                                          \
+    } while(0)
+
+#endif /* __PORT_MSP430_H__ */
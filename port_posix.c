@@ -0,0 +1,885 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   port_posix.c
+
+POSIX host port (Linux, x86-64), see \ref port_posix.h.
+
+Initial stack organization for tasks (the same frame saved by 
+BRTOS_PortSwitch(), returning to BRTOS_PortTaskEntry):
+
+<pre>
+top of stack           +--------------------+
+                       |         0          | -> keeps the ABI stack alignment
+                       +--------------------+
+                       | BRTOS_PortTaskEntry| -> return address of BRTOS_PortSwitch()
+                       +--------------------+
+                       |  rbp, rbx          | -> dummy values
+                       +--------------------+
+                       |  r12               | -> task entry point
+                       +--------------------+
+                       |  r13               | -> BRTOS_TaskEnd
+                       +--------------------+
+                       |  r14, r15          | -> dummy values
+  stack pointer ->     +--------------------+
+</pre>
+*/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "brtos.h"
+#include "port_posix.h"
+
+#if !defined(__x86_64__)
+#error "POSIX port supports only x86-64 hosts"
+#endif
+
+#define PORT_NSEC_PER_TICK (1000000000L/BRTOS_PORT_TICKS_PER_SECOND)
+
+void (*pfPortScheduleHook)(int iTick, unsigned long long ullCycles);
+
+#if !BRTOS_INSTANCES
+BRTOS_PORT_STATE sBrtosPort = { .iIrqDisabled = 1
+#if BRTOS_PORT_SIM
+                              , .ullSimDevice = ~0ULL, .ullSimState = 1
+#endif
+                              };
+#ifndef BRTOS_STATIC_TASKS
+/** Task stacks (static task tables have their own stacks) */
+static unsigned char aucPortStacks[BRTOS_MAX_TASKS][BRTOS_PORT_STACK_SIZE] __attribute__((aligned(16)));
+#define PORT_STACK(ucTask)     aucPortStacks[ucTask]
+#endif
+#else
+/** Instance in execution, the first task stack is the scheduler one */
+#define PORT_INSTANCE          ((BRTOS_INSTANCE *) psBrtosKernel)
+#define PORT_STACK(ucTask)     PORT_INSTANCE->aucStacks[(ucTask) + 1]
+#endif
+
+/** Scheduler stack pointer */
+#define pusPortSchedSP         (BRTOS_PORT_STATE_PTR->pusSchedSP)
+/** Task in execution (0 while in scheduler) */
+#define psPortCurrent          (BRTOS_PORT_STATE_PTR->psCurrent)
+/** Virtual interrupt flag: not zero when interrupts are disabled */
+#define iPortIrqDisabled       (BRTOS_PORT_STATE_PTR->iIrqDisabled)
+/** A tick arrived while interrupts were disabled */
+#define iPortIrqPending        (BRTOS_PORT_STATE_PTR->iIrqPending)
+/** The current task was switched out by the tick (not by BRTOS_PortYield()) */
+#define iPortTick              (BRTOS_PORT_STATE_PTR->iTick)
+/** Simulated device interrupt routine (BRTOS_PortDeviceStart()) */
+#define pfPortDeviceIsr        (BRTOS_PORT_STATE_PTR->pfDeviceIsr)
+#if !BRTOS_PORT_SIM
+/** Device interrupt timer */
+static timer_t sPortDeviceTimer;
+#endif
+/** A device interrupt arrived while interrupts were disabled */
+#define iPortDevicePending     (BRTOS_PORT_STATE_PTR->iDevicePending)
+/** Waiting for interrupts in BRTOS_PortIdle() */
+#define iPortIdle              (BRTOS_PORT_STATE_PTR->iIdle)
+#if BRTOS_PORT_SIM
+/** Virtual time of the next tick and of the next device interrupt (~0: none) */
+#define ullPortSimTick         (BRTOS_PORT_STATE_PTR->ullSimTick)
+#define ullPortSimDevice       (BRTOS_PORT_STATE_PTR->ullSimDevice)
+/** Mean interval between device interrupts (ns) */
+#define ullPortSimPeriod       (BRTOS_PORT_STATE_PTR->ullSimPeriod)
+/** Random generator state (xorshift64*, never zero) */
+#define ullPortSimState        (BRTOS_PORT_STATE_PTR->ullSimState)
+/** Low power modes (exit latency and wake up timer) */
+static const BRTOS_IDLE_MODE asPortIdleModes[BRTOS_PORT_IDLE_MODES] = BRTOS_PORT_IDLE_MODE_TABLE;
+/** Energy model (nW): MSP430F149 at 3 V and 1 MHz, running and in each low power mode */
+#define PORT_ACTIVE_POWER      1260000
+static const unsigned long aulPortIdlePower[BRTOS_PORT_IDLE_MODES] = { 150000, 6000, 300 };
+#endif
+#if BRTOS_INSTANCES
+/** Stack pointers of the suspended instance and of the thread stepping it */
+#define pusPortResumeSP        (BRTOS_PORT_STATE_PTR->pusResumeSP)
+#define pusPortWorkerSP        (BRTOS_PORT_STATE_PTR->pusWorkerSP)
+/** Virtual time where the current step ends */
+#define ullPortStepEnd         (BRTOS_PORT_STATE_PTR->ullStepEnd)
+#endif
+
+/*
+Context switch: save callee saved registers and the stack pointer of 
+the current context, load the new stack pointer and restore its registers.
+Other registers are saved by the C calling convention (voluntary switches)
+or by the signal frame (tick interrupt).
+*/
+__asm__(
+    ".text\n"
+    ".globl  BRTOS_PortSwitch\n"
+    ".hidden BRTOS_PortSwitch\n"
+    ".type   BRTOS_PortSwitch, @function\n"
+    "BRTOS_PortSwitch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq  %rsp, (%rdi)\n"
+    "    movq  %rsi, %rsp\n"
+    "    popq  %r15\n"
+    "    popq  %r14\n"
+    "    popq  %r13\n"
+    "    popq  %r12\n"
+    "    popq  %rbx\n"
+    "    popq  %rbp\n"
+    "    ret\n"
+    ".size   BRTOS_PortSwitch, .-BRTOS_PortSwitch\n"
+    "\n"
+    ".globl  BRTOS_PortTaskEntry\n"
+    ".hidden BRTOS_PortTaskEntry\n"
+    ".type   BRTOS_PortTaskEntry, @function\n"
+    "BRTOS_PortTaskEntry:\n"
+    "    movq  %r12, %rdi\n"
+    "    movq  %r13, %rsi\n"
+    "    andq  $-16, %rsp\n"
+    "    call  BRTOS_PortTaskStart\n"
+    "    ud2\n"
+    ".size   BRTOS_PortTaskEntry, .-BRTOS_PortTaskEntry\n"
+);
+
+void BRTOS_PortTaskEntry(void);
+
+/**
+First function executed by a task: interrupts are enabled (the
+task was started by the scheduler) and the entry point is called.
+*/
+__attribute__((used)) static void BRTOS_PortTaskStart(pfTaskEntry pfEntry, void (*pfExit)(void))
+{
+	BRTOS_PortEnableInterrupts();
+	pfEntry(0);
+	pfExit();
+}
+
+/**
+Build the initial frame of a task (see stack organization above).
+
+@param pvTop   stack end (16 bytes aligned)
+@param pfEntry task entry point
+@param pfExit  called if the task returns
+
+@return initial stack pointer
+*/
+static unsigned short *BRTOS_PortFrame(void *pvTop, pfTaskEntry pfEntry, void (*pfExit)(void))
+{
+	unsigned long *pulSP = (unsigned long *) pvTop;
+
+	*--pulSP = 0;
+	*--pulSP = (unsigned long) BRTOS_PortTaskEntry;
+	*--pulSP = 0;                        /* rbp */
+	*--pulSP = 0;                        /* rbx */
+	*--pulSP = (unsigned long) pfEntry;  /* r12 */
+	*--pulSP = (unsigned long) pfExit;   /* r13 */
+	*--pulSP = 0;                        /* r14 */
+	*--pulSP = 0;                        /* r15 */
+
+	return (unsigned short *) pulSP;
+}
+
+#ifndef BRTOS_STATIC_TASKS
+/**
+Prepare the stack of a new task. The stack given to BRTOS_CreateTask() 
+is replaced by a port stack.
+
+@param psTask task, with its entry point
+@param ucTask task index, selects the stack
+@param pfExit called if the task returns
+*/
+void BRTOS_PortNewStack(BRTOS_TCB *psTask, unsigned char ucTask, void (*pfExit)(void))
+{
+	psTask->pusStackBeg = (unsigned short *) PORT_STACK(ucTask);
+	psTask->usStackSize = BRTOS_PORT_STACK_SIZE;
+	psTask->pusStackPtr = BRTOS_PortFrame(PORT_STACK(ucTask) + BRTOS_PORT_STACK_SIZE, 
+	                                      psTask->pfEntryPoint, pfExit);
+}
+#else
+/**
+Prepare the stack of a task of the static task table: the initial frame
+cannot be generated at compile time (64 bits addresses in a relocatable
+program), so it is built and the stack painted at initialization.
+
+@param psTask  task
+@param psConst constant part of the task
+@param pfExit  called if the task returns
+*/
+void BRTOS_PortStaticFrame(BRTOS_TCB *psTask, const BRTOS_TASK_CONST *psConst, void (*pfExit)(void))
+{
+	unsigned short *pusWord;
+
+	psTask->pusStackPtr = BRTOS_PortFrame(psConst->pusStackBeg + psConst->usStackSize/sizeof(unsigned short),
+	                                      psConst->pfEntryPoint, pfExit);
+
+	for(pusWord = psConst->pusStackBeg ; pusWord < psTask->pusStackPtr ; pusWord++)
+		*pusWord = BRTOS_STACK_PATTERN;
+}
+#endif
+
+/**
+Tick taken from task level: the task is switched out as if interrupted.
+*/
+static void BRTOS_PortTick(void)
+{
+	iPortTick = 1;
+	BRTOS_PortSwitch(&psPortCurrent->pusStackPtr, pusPortSchedSP);
+}
+
+/**
+Device interrupt, with interrupts disabled. If the routine requested a switch
+(BRTOS_ISR_Exit()), the task is switched out as if interrupted, but the 
+scheduler does not process time. While idle, the request stays pending
+to wake up BRTOS_PortIdle().
+*/
+static void BRTOS_PortDevice(void)
+{
+	ulPortDeviceInterrupts++;
+	pfPortDeviceIsr();
+
+	if(iPortSwitchPending && psPortCurrent)
+	{
+		iPortSwitchPending = 0;
+		iPortTick = 0;
+		BRTOS_PortSwitch(&psPortCurrent->pusStackPtr, pusPortSchedSP);
+	}
+}
+
+/**
+Deliver interrupts that arrived while interrupts were disabled. 
+*/
+static void BRTOS_PortPendingIrq(void)
+{
+	while((iPortIrqPending || iPortDevicePending) && psPortCurrent)
+	{
+		/* the signal handlers may take them first */
+		if(__atomic_exchange_n(&iPortIrqDisabled, 1, __ATOMIC_SEQ_CST))
+			return;
+
+		if(iPortDevicePending)
+		{
+			iPortDevicePending = 0;
+			BRTOS_PortDevice();
+		}
+		else if(iPortIrqPending)
+		{
+			iPortIrqPending = 0;
+			BRTOS_PortTick();
+		}
+
+		iPortIrqDisabled = 0;
+	}
+}
+
+void BRTOS_PortDisableInterrupts(void)
+{
+	iPortIrqDisabled = 1;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void BRTOS_PortEnableInterrupts(void)
+{
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	iPortIrqDisabled = 0;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+	if(iPortIrqPending || iPortDevicePending)
+		BRTOS_PortPendingIrq();
+}
+
+/**
+System tick interrupt, from the SIGALRM handler or the virtual clock.
+*/
+static void BRTOS_PortTickIrq(void)
+{
+	ulPortInterrupts++;
+	ullPortTickCycles = BRTOS_PortCycles();
+
+	if(__atomic_exchange_n(&iPortIrqDisabled, 1, __ATOMIC_SEQ_CST) || psPortCurrent == 0)
+		iPortIrqPending = 1;
+	else
+	{
+		BRTOS_PortTick();
+		iPortIrqDisabled = 0;
+		BRTOS_PortPendingIrq();
+	}
+}
+
+/**
+Device interrupt, from the SIGRTMIN handler or the virtual clock. While idle,
+the routine runs at once, as an interrupt waking up the CPU from a low power mode.
+*/
+static void BRTOS_PortDeviceIrq(void)
+{
+	if(iPortIdle)
+	{
+		/* nested device interrupts are kept pending */
+		iPortIdle = 0;
+		BRTOS_PortDevice();
+		iPortIdle = 1;
+	}
+	else if(__atomic_exchange_n(&iPortIrqDisabled, 1, __ATOMIC_SEQ_CST) || psPortCurrent == 0)
+		iPortDevicePending = 1;
+	else
+	{
+		BRTOS_PortDevice();
+		iPortIrqDisabled = 0;
+		BRTOS_PortPendingIrq();
+	}
+}
+
+#if BRTOS_PORT_SIM
+/**
+Seed the random generator of the simulation (device interrupt intervals 
+and \ref BRTOS_PortSimRandom()). The BRTOS_SIM_SEED environment variable,
+if set, overrides it when the kernel starts (not for instances, seeded by
+\ref BRTOS_PortInstanceInit()).
+*/
+void BRTOS_PortSimSeed(unsigned long ulSeed)
+{
+	ullPortSimState = ulSeed*0x9E3779B97F4A7C15ULL + 1;
+	if(ullPortSimState == 0)
+		ullPortSimState = 1;
+}
+
+/**
+Random number from the generator of the simulation (32 bits), so 
+applications can vary their behaviour and still replay a run from its seed.
+*/
+unsigned long BRTOS_PortSimRandom(void)
+{
+	ullPortSimState ^= ullPortSimState >> 12;
+	ullPortSimState ^= ullPortSimState << 25;
+	ullPortSimState ^= ullPortSimState >> 27;
+
+	return (unsigned long)((ullPortSimState*0x2545F4914F6CDD1DULL) >> 32);
+}
+
+#if BRTOS_INSTANCES
+/**
+Suspend the instance in execution until its next step, going back to the 
+thread stepping it. The instance may be resumed by another thread: only the
+instance pointer (psBrtosKernel, set again by BRTOS_PortInstanceStep()) is 
+read from thread local storage.
+*/
+static void BRTOS_PortSuspend(void)
+{
+	BRTOS_PortSwitch(&pusPortResumeSP, pusPortWorkerSP);
+}
+
+#endif
+/**
+Virtual time of the device interrupt after the current one.
+*/
+static unsigned long long BRTOS_PortSimNextDevice(void)
+{
+	/* 64 bits random number: no visible bias for periods of seconds */
+	unsigned long long ullRandom = (unsigned long long) BRTOS_PortSimRandom() << 32;
+
+	ullRandom |= BRTOS_PortSimRandom();
+
+	return ullPortSimTime + ullPortSimPeriod/2 + 1 + ullRandom % ullPortSimPeriod;
+}
+
+/**
+Take the interrupts due at the current virtual time (task level). The task
+may be switched out, the events are checked again when it is resumed.
+*/
+static void BRTOS_PortSimEvents(void)
+{
+	if(ullPortSimDevice <= ullPortSimTime)
+	{
+		ullPortSimDevice = BRTOS_PortSimNextDevice();
+		BRTOS_PortDeviceIrq();
+	}
+
+	if(ullPortSimTick <= ullPortSimTime)
+	{
+		ullPortSimTick += PORT_NSEC_PER_TICK;
+		BRTOS_PortTickIrq();
+	}
+}
+
+/**
+Simulate ulUs microseconds of CPU work of the running task: the virtual time 
+advances and the interrupts arriving meanwhile are taken, so the task may be 
+preempted. Only the time the task runs is counted.
+
+@param ulUs work time in microseconds
+*/
+void BRTOS_PortSimRun(unsigned long ulUs)
+{
+	unsigned long long ullLeft = ulUs*1000ULL;
+	unsigned long long ullNext;
+
+	for(;;)
+	{
+		ullNext = ullPortSimTick < ullPortSimDevice ? ullPortSimTick : ullPortSimDevice;
+#if BRTOS_INSTANCES
+		/* the step ends before the next event: the work goes on in the next step */
+		if(ullNext > ullPortStepEnd)
+		{
+			if(ullPortStepEnd - ullPortSimTime >= ullLeft)
+				break;
+
+			ullLeft       -= ullPortStepEnd - ullPortSimTime;
+			ullPortSimTime = ullPortStepEnd;
+			BRTOS_PortSuspend();
+			continue;
+		}
+#endif
+		if(ullNext - ullPortSimTime > ullLeft)
+			break;
+
+		ullLeft       -= ullNext - ullPortSimTime;
+		ullPortSimTime = ullNext;
+		BRTOS_PortSimEvents();
+	}
+
+	ullPortSimTime += ullLeft;
+}
+
+/**
+Idle in virtual time: jump to the wake up tick (usTicks ticks from the last 
+one). Device interrupts before it are taken on the way and end the sleep if
+they request a switch. In a mode without wake up timer (LPM4, LPM3 without 
+tickless idle) only they end it and the ticks are lost (unless no device is
+running: nothing else could wake up the CPU, so the timer is kept).
+
+@param usTicks amount of ticks to sleep
+@param ucMode  low power mode
+@return amount of ticks elapsed
+*/
+static unsigned short BRTOS_PortSimIdle(unsigned short usTicks, unsigned char ucMode)
+{
+	unsigned long long ullStart = ullPortSimTime;
+	unsigned long long ullWake;
+	unsigned short     usElapsed = 0;
+
+	if(usTicks == 0)
+		usTicks = 1;
+	ullWake = ullPortSimTick + (usTicks - 1)*(unsigned long long) PORT_NSEC_PER_TICK;
+	if(!asPortIdleModes[ucMode].ucTimed && ullPortSimDevice != ~0ULL)
+		ullWake = ~0ULL;
+
+#if BRTOS_INSTANCES
+	/* nothing happens until the end of the step: the instance stops here */
+	while((ullWake < ullPortSimDevice ? ullWake : ullPortSimDevice) > ullPortStepEnd)
+	{
+		ullPortSimTime = ullPortStepEnd;
+		BRTOS_PortSuspend();
+	}
+#endif
+
+	while(ullPortSimDevice < ullWake && !iPortSwitchPending)
+	{
+		ullPortSimTime   = ullPortSimDevice;
+		ullPortSimDevice = BRTOS_PortSimNextDevice();
+		iPortIdle = 1;
+		BRTOS_PortDevice();
+		iPortIdle = 0;
+	}
+
+	if(iPortSwitchPending)
+		iPortSwitchPending = 0;
+	else if(ullWake != ~0ULL)
+		ullPortSimTime = ullWake;
+
+	if(ullPortSimTick <= ullPortSimTime && !asPortIdleModes[ucMode].ucTimed)
+		ullPortSimTick += ((ullPortSimTime - ullPortSimTick)/PORT_NSEC_PER_TICK + 1)*PORT_NSEC_PER_TICK;
+	while(ullPortSimTick <= ullPortSimTime)
+	{
+		ullPortSimTick += PORT_NSEC_PER_TICK;
+		usElapsed++;
+	}
+	ulPortInterrupts++;
+
+	aullPortSimIdle[ucMode] += ullPortSimTime - ullStart;
+	aulPortSimWakes[ucMode]++;
+
+	return usElapsed;
+}
+
+/**
+Energy spent since the start, in microjoules, from the model of the MSP430
+currents: the CPU running all the time it is not idle, the power of each low
+power mode while sleeping in it and its exit latency at running power.
+*/
+double BRTOS_PortSimEnergy(void)
+{
+	unsigned long long ullIdle = 0;
+	double             dEnergy = 0;
+	int                i;
+
+	for(i = 0 ; i < BRTOS_PORT_IDLE_MODES ; i++)
+	{
+		ullIdle += aullPortSimIdle[i];
+		dEnergy += (double) aullPortSimIdle[i]*aulPortIdlePower[i] + 
+		           (double) aulPortSimWakes[i]*asPortIdleModes[i].usExitUs*1000.0*PORT_ACTIVE_POWER;
+	}
+	dEnergy += (double)(ullPortSimTime - ullIdle)*PORT_ACTIVE_POWER;
+
+	/* nW x ns */
+	return dEnergy/1e12;
+}
+
+/**
+Start a simulated peripheral: pfIsr is called as an interrupt service routine
+at random intervals of ulPeriodUs microseconds on average, in virtual time 
+(see \ref port_posix.h). Like the tick, it is kept pending while interrupts are 
+disabled. The routine may wake up tasks using \ref BRTOS_ISR_Enter() and 
+\ref BRTOS_ISR_Exit().
+
+@param pfIsr      interrupt service routine
+@param ulPeriodUs mean interrupt period
+*/
+void BRTOS_PortDeviceStart(void (*pfIsr)(void), unsigned long ulPeriodUs)
+{
+	pfPortDeviceIsr  = pfIsr;
+	ullPortSimPeriod = ulPeriodUs*1000ULL;
+	ullPortSimDevice = BRTOS_PortSimNextDevice();
+}
+
+/**
+Stop the simulated peripheral started by \ref BRTOS_PortDeviceStart().
+*/
+void BRTOS_PortDeviceStop(void)
+{
+	ullPortSimDevice = ~0ULL;
+}
+#else
+/**
+System tick interrupt (SIGALRM handler).
+*/
+static void BRTOS_PortSignal(int iSig)
+{
+	int iErrno = errno;
+
+	(void) iSig;
+
+	BRTOS_PortTickIrq();
+
+	errno = iErrno;
+}
+
+/**
+Device interrupt (SIGRTMIN handler).
+*/
+static void BRTOS_PortDeviceSignal(int iSig)
+{
+	int iErrno = errno;
+
+	(void) iSig;
+
+	BRTOS_PortDeviceIrq();
+
+	errno = iErrno;
+}
+
+/**
+Start a simulated peripheral: pfIsr is called as an interrupt service routine
+every ulPeriodUs microseconds (SIGRTMIN from a POSIX timer). Like the tick, it
+is kept pending while interrupts are disabled. The routine may wake up tasks 
+using \ref BRTOS_ISR_Enter() and \ref BRTOS_ISR_Exit().
+
+@param pfIsr      interrupt service routine
+@param ulPeriodUs interrupt period
+*/
+void BRTOS_PortDeviceStart(void (*pfIsr)(void), unsigned long ulPeriodUs)
+{
+	struct sigaction  sAction;
+	struct sigevent   sEvent;
+	struct itimerspec sPeriod;
+
+	pfPortDeviceIsr = pfIsr;
+
+	memset(&sAction, 0, sizeof(sAction));
+	sAction.sa_handler = BRTOS_PortDeviceSignal;
+	sAction.sa_flags   = SA_RESTART | SA_NODEFER;
+	sigemptyset(&sAction.sa_mask);
+	sigaction(SIGRTMIN, &sAction, 0);
+
+	memset(&sEvent, 0, sizeof(sEvent));
+	sEvent.sigev_notify = SIGEV_SIGNAL;
+	sEvent.sigev_signo  = SIGRTMIN;
+	timer_create(CLOCK_MONOTONIC, &sEvent, &sPortDeviceTimer);
+
+	sPeriod.it_interval.tv_sec  = ulPeriodUs/1000000;
+	sPeriod.it_interval.tv_nsec = (ulPeriodUs%1000000)*1000;
+	sPeriod.it_value            = sPeriod.it_interval;
+	timer_settime(sPortDeviceTimer, 0, &sPeriod, 0);
+}
+
+/**
+Stop the simulated peripheral started by \ref BRTOS_PortDeviceStart().
+*/
+void BRTOS_PortDeviceStop(void)
+{
+	timer_delete(sPortDeviceTimer);
+}
+
+/**
+Start the periodic system tick.
+*/
+static void BRTOS_PortStartTick(void)
+{
+	struct itimerval sTimer;
+
+	sTimer.it_interval.tv_sec  = 0;
+	sTimer.it_interval.tv_usec = PORT_NSEC_PER_TICK/1000;
+	sTimer.it_value            = sTimer.it_interval;
+	setitimer(ITIMER_REAL, &sTimer, 0);
+}
+
+/**
+Wait for a tick interrupt or a switch request from a device interrupt, 
+in the scheduler. Device interrupts are served while waiting.
+
+@return 1 if a tick was taken
+*/
+static int BRTOS_PortWaitTick(void)
+{
+	sigset_t sTick;
+	sigset_t sOld;
+	int      iTick;
+
+	sigemptyset(&sTick);
+	sigaddset(&sTick, SIGALRM);
+	sigaddset(&sTick, SIGRTMIN);
+
+	sigprocmask(SIG_BLOCK, &sTick, &sOld);
+	iPortIdle = 1;
+	while(!iPortIrqPending && !iPortSwitchPending)
+	{
+		/* arrived while a device routine was running */
+		if(iPortDevicePending)
+		{
+			iPortDevicePending = 0;
+			BRTOS_PortDevice();
+			continue;
+		}
+		sigsuspend(&sOld);
+	}
+	iPortIdle = 0;
+	sigprocmask(SIG_SETMASK, &sOld, 0);
+
+	iTick = iPortIrqPending;
+	iPortIrqPending    = 0;
+	iPortSwitchPending = 0;
+
+	return iTick;
+}
+
+#endif
+
+/**
+Idle: nothing to run, wait for the next tick. With tickless idle,
+the periodic tick is replaced by a one shot timer of usTicks and 
+the elapsed time is measured when waking up. In virtual time, it jumps 
+to the wake up tick at once.
+
+@param usTicks amount of ticks to sleep (tickless idle)
+@param ucMode  low power mode (BRTOS_PORT_IDLE_xxx, only used in virtual time)
+@return amount of ticks elapsed while sleeping
+*/
+unsigned short BRTOS_PortIdle(unsigned short usTicks, unsigned char ucMode)
+{
+	unsigned long long ullStart = BRTOS_PortCycles();
+#if BRTOS_TICKLESS_IDLE && !BRTOS_PORT_SIM
+	struct itimerval sTimer;
+	struct timespec  sBeg;
+	struct timespec  sEnd;
+	long long        llElapsed;
+	static long long llRest;
+#endif
+
+	/* a device interrupt has arrived while in scheduler: it wakes up the CPU at once */
+	if(iPortDevicePending)
+	{
+		iPortDevicePending = 0;
+		BRTOS_PortDevice();
+	}
+
+	/* a tick or a switch request has arrived while in scheduler */
+	if(iPortIrqPending || iPortSwitchPending)
+	{
+		iPortSwitchPending = 0;
+		if(!iPortIrqPending)
+			return 0;
+		iPortIrqPending = 0;
+		return 1;
+	}
+
+#if BRTOS_PORT_SIM
+	usTicks = BRTOS_PortSimIdle(BRTOS_TICKLESS_IDLE ? usTicks : 1, ucMode);
+	ullPortIdleCycles += BRTOS_PortCycles() - ullStart;
+
+	return usTicks;
+#elif BRTOS_TICKLESS_IDLE
+	(void) ucMode;
+	memset(&sTimer, 0, sizeof(sTimer));
+	sTimer.it_value.tv_sec  = (usTicks*PORT_NSEC_PER_TICK)/1000000000L;
+	sTimer.it_value.tv_usec = ((usTicks*PORT_NSEC_PER_TICK)%1000000000L)/1000;
+
+	clock_gettime(CLOCK_MONOTONIC, &sBeg);
+	setitimer(ITIMER_REAL, &sTimer, 0);
+	BRTOS_PortWaitTick();
+	clock_gettime(CLOCK_MONOTONIC, &sEnd);
+	BRTOS_PortStartTick();
+
+	/* fractions of tick are kept for the next time */
+	llElapsed = (sEnd.tv_sec - sBeg.tv_sec)*1000000000LL + (sEnd.tv_nsec - sBeg.tv_nsec) + llRest;
+	llRest    = llElapsed % PORT_NSEC_PER_TICK;
+	ullPortIdleCycles += BRTOS_PortCycles() - ullStart;
+
+	return (unsigned short)(llElapsed/PORT_NSEC_PER_TICK);
+#else
+	unsigned short usElapsed;
+
+	(void) usTicks;
+	(void) ucMode;
+	usElapsed = BRTOS_PortWaitTick();
+	ullPortIdleCycles += BRTOS_PortCycles() - ullStart;
+
+	return usElapsed;
+#endif
+}
+
+/**
+Save the context of the running task and enter the scheduler (cooperative
+entry, no time processing). Called with interrupts disabled, they are
+enabled again when the task is resumed.
+*/
+void BRTOS_PortYield(void)
+{
+	iPortTick = 0;
+	BRTOS_PortSwitch(&psPortCurrent->pusStackPtr, pusPortSchedSP);
+	BRTOS_PortEnableInterrupts();
+}
+
+/**
+Scheduler loop, running in the stack of main(). It plays the role of 
+the tick interrupt of the MSP430 port: tasks are switched out by the 
+tick or when they yield, coming back here.
+*/
+void BRTOS_PortRun(void)
+{
+	struct sigaction   sAction;
+	unsigned long long ullStart;
+	unsigned long long ullIdle;
+	int                iTick;
+
+	BRTOS_PortDisableInterrupts();
+
+#if BRTOS_PORT_SIM
+	(void) sAction;
+#if !BRTOS_INSTANCES
+	if(getenv("BRTOS_SIM_SEED"))
+		BRTOS_PortSimSeed(strtoul(getenv("BRTOS_SIM_SEED"), 0, 0));
+#endif
+	ullPortSimTick = ullPortSimTime + PORT_NSEC_PER_TICK;
+#else
+	memset(&sAction, 0, sizeof(sAction));
+	sAction.sa_handler = BRTOS_PortSignal;
+	/* the virtual interrupt flag protects the kernel, the signal must not be 
+	   blocked while a task switched out in the handler is not running */
+	sAction.sa_flags   = SA_RESTART | SA_NODEFER;
+	sigemptyset(&sAction.sa_mask);
+	sigaction(SIGALRM, &sAction, 0);
+
+	BRTOS_PortStartTick();
+#endif
+
+	for(;;)
+	{
+		ullIdle  = ullPortIdleCycles;
+		ullStart = BRTOS_PortCycles();
+
+		/* the first run is a cooperative one: no time has elapsed */
+		iTick = iPortTick;
+		psPortCurrent = iTick ? BRTOS_Schedule() : BRTOS_ScheduleYield();
+
+		if(pfPortScheduleHook)
+			pfPortScheduleHook(iTick, BRTOS_PortCycles() - ullStart - (ullPortIdleCycles - ullIdle));
+
+		BRTOS_PortSwitch(&pusPortSchedSP, psPortCurrent->pusStackPtr);
+		psPortCurrent = 0;
+	}
+}
+
+#if BRTOS_INSTANCES
+/*
+Start of an instance, in its scheduler stack: the kernel is initialized
+and the scheduler loop runs from here (BRTOS_InstanceMain() never returns).
+*/
+static void BRTOS_PortInstanceEntry(unsigned long ulArg)
+{
+	(void) ulArg;
+	BRTOS_InstanceMain(BRTOS_PORT_STATE_PTR->pvData);
+}
+
+/*
+An instance never ends.
+*/
+static void BRTOS_PortInstanceEnd(void)
+{
+	abort();
+}
+
+/**
+Prepare a kernel instance: its kernel runs on the first call to 
+\ref BRTOS_PortInstanceStep(), starting at virtual time 0.
+
+@param psInstance instance (any alignment; its stacks are aligned by the type)
+@param pvData     application data of the instance, see \ref BRTOS_InstanceData()
+@param ulSeed     seed of the instance random generator (see \ref BRTOS_PortSimSeed())
+*/
+void BRTOS_PortInstanceInit(BRTOS_INSTANCE *psInstance, void *pvData, unsigned long ulSeed)
+{
+	BRTOS_KERNEL *psSaved = psBrtosKernel;
+
+	memset(&psInstance->sKernel, 0, sizeof(psInstance->sKernel));
+	memset(&psInstance->sPort, 0, sizeof(psInstance->sPort));
+
+	psBrtosKernel    = &psInstance->sKernel;
+	iPortIrqDisabled = 1;
+	ullPortSimDevice = ~0ULL;
+	BRTOS_PortSimSeed(ulSeed);
+	BRTOS_PORT_STATE_PTR->pvData = pvData;
+	pusPortResumeSP  = BRTOS_PortFrame(psInstance->aucStacks[0] + BRTOS_PORT_STACK_SIZE,
+	                                   BRTOS_PortInstanceEntry, BRTOS_PortInstanceEnd);
+	psBrtosKernel    = psSaved;
+}
+
+/**
+Run an instance until the virtual time ullUntil (ns): the calling thread 
+returns when the instance has nothing left to do before it. Each instance 
+must be stepped by one thread at a time, any thread.
+
+@param psInstance instance prepared by \ref BRTOS_PortInstanceInit()
+@param ullUntil   end of the step (virtual time)
+*/
+void BRTOS_PortInstanceStep(BRTOS_INSTANCE *psInstance, unsigned long long ullUntil)
+{
+	psBrtosKernel  = &psInstance->sKernel;
+	ullPortStepEnd = ullUntil;
+	BRTOS_PortSwitch(&pusPortWorkerSP, pusPortResumeSP);
+	psBrtosKernel  = 0;
+}
+#endif
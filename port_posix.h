@@ -0,0 +1,268 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+
+/**
+@file   port_posix.h
+
+POSIX host port (Linux, x86-64). It allows to run and measure the kernel
+without hardware:
+
+- context switch: hand written x86-64 code (port_posix.c) saving the callee
+  saved registers in the task stack and the stack pointer in the TCB, like
+  the cooperative entry of the MSP430 port does
+- system tick: SIGALRM from a periodic interval timer. The signal handler plays
+  the role of the tick interrupt, the full context of the interrupted task
+  is kept by the signal frame. Since both entries end in the same switch code,
+  a task can be resumed by any of them
+- interrupts: a virtual interrupt flag, so critical sections do not need
+  system calls. Ticks arriving while interrupts are disabled are kept pending
+- low power mode: sigsuspend(). With tickless idle, the periodic timer is
+  replaced by a one shot timer and the elapsed time is measured on wake up
+- peripherals: BRTOS_PortDeviceStart() simulates a periodic device interrupt
+  (SIGRTMIN from a POSIX timer), handled like the tick. A switch requested by
+  BRTOS_ISR_Exit() is done when the device routine returns
+
+With BRTOS_PORT_SIM, host timers are replaced by a discrete event clock
+(virtual time, in nanoseconds), so long runs take much less than the device 
+time they simulate and are deterministic:
+
+- idle (BRTOS_PortIdle()) jumps to the next event (the wake up tick with 
+  tickless idle, the next tick otherwise, or a device interrupt) at once.
+  In LPM4 (and LPM3 without tickless idle) only a device interrupt wakes up
+  the CPU and no ticks elapse
+- energy is estimated with a simple model of the MSP430 currents at 3 V:
+  the power of the CPU running (all the time not idle) or of the low power
+  mode, plus the exit latency at running power at each wake up
+- running tasks take no time, unless they call BRTOS_PortSimRun() to simulate
+  CPU work: the tick and the device interrupts arriving meanwhile are taken 
+  as usual, with preemption. A task must block or call BRTOS_PortSimRun(),
+  busy loops waiting for time to elapse never end
+- the interval between device interrupts is random, uniform between half and
+  one and a half the period given to BRTOS_PortDeviceStart(), taken from a 
+  generator seeded with BRTOS_PortSimSeed() or the BRTOS_SIM_SEED environment
+  variable. The same seed gives the same run (as long as the application
+  uses only virtual time and BRTOS_PortSimRandom())
+- the port timestamp (BRTOS_GetTimestamp()) is the virtual time
+
+With BRTOS_INSTANCES (and BRTOS_PORT_SIM), many kernels run in one process:
+each BRTOS_INSTANCE holds a kernel context, the port state and all stacks.
+BRTOS_PortInstanceInit() prepares it and BRTOS_PortInstanceStep() runs it up
+to a virtual time, in the calling thread. An instance stops where it would 
+wait for time beyond the end of the step (idle or BRTOS_PortSimRun()), so 
+any thread can continue it in the next step and the run is the same whatever
+the threads stepping it. The application gets its own data with 
+BRTOS_InstanceData() and must keep no state in static variables.
+
+Task stacks given to BRTOS_CreateTask() are not used in this port,
+since host C code needs much bigger stacks: each task gets
+BRTOS_PORT_STACK_SIZE bytes from the port. Stack painting, high water 
+marks and overflow checks apply to these stacks.
+
+The functions and variables below can also be used by host applications
+(benchmarks) to measure the kernel.
+*/
+#ifndef __PORT_POSIX_H__
+#define __PORT_POSIX_H__
+
+#include <signal.h>
+#include "brtos.h"
+
+/* stack size for each task */
+#ifndef BRTOS_PORT_STACK_SIZE
+#define BRTOS_PORT_STACK_SIZE  (32*1024)
+#endif
+
+#if BRTOS_PORT_STACK_SIZE > 0xFFFF
+#error "BRTOS_PORT_STACK_SIZE must fit in the TCB stack size (16 bits)"
+#endif
+
+/* virtual time simulation (see above) */
+#ifndef BRTOS_PORT_SIM
+#define BRTOS_PORT_SIM         0
+#endif
+
+/* system tick rate, the same used by MSP430 port */
+#define BRTOS_PORT_TICKS_PER_SECOND 2000
+
+/* low power modes, the ones of the MSP430 port: the host sleeps the same way
+   in all of them, except in virtual time, where the wake up timer stops in
+   LPM4 (and in LPM3 without tickless idle, as the MSP430 watchdog tick) and 
+   the energy spent is estimated (see BRTOS_PortSimEnergy()) */
+#define BRTOS_PORT_IDLE_LPM0       0
+#define BRTOS_PORT_IDLE_LPM3       1
+#define BRTOS_PORT_IDLE_LPM4       2
+#define BRTOS_PORT_IDLE_MODES      3
+#ifndef BRTOS_PORT_IDLE_DEFAULT
+#define BRTOS_PORT_IDLE_DEFAULT    (BRTOS_TICKLESS_IDLE ? BRTOS_PORT_IDLE_LPM3 : BRTOS_PORT_IDLE_LPM0)
+#endif
+/* exit latency (us), shortest useful sleep (us), wake up timer running */
+#define BRTOS_PORT_IDLE_MODE_TABLE { BRTOS_IDLE_MODE_INIT(0, 0, 1), \
+                                     BRTOS_IDLE_MODE_INIT(6, 50, BRTOS_TICKLESS_IDLE), \
+                                     BRTOS_IDLE_MODE_INIT(6, 0, 0) }
+
+/* brtos.c */
+BRTOS_TCB *BRTOS_Schedule(void);
+BRTOS_TCB *BRTOS_ScheduleYield(void);
+
+/* port_posix.c */
+void BRTOS_PortDisableInterrupts(void);
+void BRTOS_PortEnableInterrupts(void);
+void BRTOS_PortSwitch(unsigned short **ppusSaveSP, unsigned short *pusNewSP);
+#ifndef BRTOS_STATIC_TASKS
+void BRTOS_PortNewStack(BRTOS_TCB *psTask, unsigned char ucTask, void (*pfExit)(void));
+#else
+void BRTOS_PortStaticFrame(BRTOS_TCB *psTask, const BRTOS_TASK_CONST *psConst, void (*pfExit)(void));
+#endif
+unsigned short BRTOS_PortIdle(unsigned short usTicks, unsigned char ucMode);
+void BRTOS_PortYield(void);
+void BRTOS_PortRun(void);
+void BRTOS_PortDeviceStart(void (*pfIsr)(void), unsigned long ulPeriodUs);
+void BRTOS_PortDeviceStop(void);
+
+/** Called after each scheduler run (tick or cooperative) with the cycles spent on it, idle time excluded */
+extern void (*pfPortScheduleHook)(int iTick, unsigned long long ullCycles);
+
+/** Port state, one for each kernel instance (\ref BRTOS_INSTANCES) */
+typedef struct
+{
+	volatile unsigned long      ulInterrupts;
+	volatile unsigned long      ulDeviceInterrupts;
+	volatile sig_atomic_t       iSwitchPending;
+	volatile unsigned long long ullTickCycles;
+	unsigned long long          ullIdleCycles;
+	unsigned short             *pusSchedSP;
+	BRTOS_TCB                  *psCurrent;
+	volatile sig_atomic_t       iIrqDisabled;
+	volatile sig_atomic_t       iIrqPending;
+	int                         iTick;
+	void                      (*pfDeviceIsr)(void);
+	volatile sig_atomic_t       iDevicePending;
+	volatile sig_atomic_t       iIdle;
+#if BRTOS_PORT_SIM
+	unsigned long long          ullSimTime;
+	unsigned long long          ullSimTick;
+	unsigned long long          ullSimDevice;
+	unsigned long long          ullSimPeriod;
+	unsigned long long          ullSimState;
+	unsigned long long          aullSimIdle[BRTOS_PORT_IDLE_MODES];
+	unsigned long               aulSimWakes[BRTOS_PORT_IDLE_MODES];
+#endif
+#if BRTOS_INSTANCES
+	void                       *pvData;
+	unsigned short             *pusResumeSP;
+	unsigned short             *pusWorkerSP;
+	unsigned long long          ullStepEnd;
+#endif
+} BRTOS_PORT_STATE;
+
+#if BRTOS_INSTANCES
+#if !BRTOS_PORT_SIM
+#error "BRTOS_INSTANCES needs BRTOS_PORT_SIM: instances are stepped in virtual time"
+#endif
+
+/**
+Kernel instance: kernel and port state followed by the stacks of the 
+scheduler and of the tasks, in one block. Instances are started by 
+BRTOS_PortInstanceInit() and run by BRTOS_PortInstanceStep() from any 
+thread, one thread at a time.
+*/
+typedef struct
+{
+	BRTOS_KERNEL     sKernel;   /* first: psBrtosKernel points to the instance */
+	BRTOS_PORT_STATE sPort;
+	unsigned char    aucStacks[BRTOS_MAX_TASKS + 1][BRTOS_PORT_STACK_SIZE] __attribute__((aligned(16)));
+} BRTOS_INSTANCE;
+
+#define BRTOS_PORT_STATE_PTR   (&((BRTOS_INSTANCE *) psBrtosKernel)->sPort)
+
+void BRTOS_PortInstanceInit(BRTOS_INSTANCE *psInstance, void *pvData, unsigned long ulSeed);
+void BRTOS_PortInstanceStep(BRTOS_INSTANCE *psInstance, unsigned long long ullUntil);
+#else
+extern BRTOS_PORT_STATE sBrtosPort;
+
+#define BRTOS_PORT_STATE_PTR   (&sBrtosPort)
+#endif
+
+/** Amount of tick interrupts, including the ones in idle (CPU wake ups) */
+#define ulPortInterrupts       (BRTOS_PORT_STATE_PTR->ulInterrupts)
+/** Amount of device interrupts */
+#define ulPortDeviceInterrupts (BRTOS_PORT_STATE_PTR->ulDeviceInterrupts)
+/** Switch requested by BRTOS_ISR_Exit() */
+#define iPortSwitchPending     (BRTOS_PORT_STATE_PTR->iSwitchPending)
+/** Cycle counter at the last tick interrupt */
+#define ullPortTickCycles      (BRTOS_PORT_STATE_PTR->ullTickCycles)
+/** Cycles spent sleeping in BRTOS_PortIdle() */
+#define ullPortIdleCycles      (BRTOS_PORT_STATE_PTR->ullIdleCycles)
+
+#if BRTOS_PORT_SIM
+/** Virtual time in nanoseconds */
+#define ullPortSimTime         (BRTOS_PORT_STATE_PTR->ullSimTime)
+/** Virtual time slept in each low power mode (ns) and wake ups from it */
+#define aullPortSimIdle        (BRTOS_PORT_STATE_PTR->aullSimIdle)
+#define aulPortSimWakes        (BRTOS_PORT_STATE_PTR->aulSimWakes)
+
+void BRTOS_PortSimSeed(unsigned long ulSeed);
+unsigned long BRTOS_PortSimRandom(void);
+void BRTOS_PortSimRun(unsigned long ulUs);
+double BRTOS_PortSimEnergy(void);
+#endif
+
+/**
+Read the CPU cycle counter (time stamp counter).
+*/
+static inline unsigned long long BRTOS_PortCycles(void)
+{
+	return __builtin_ia32_rdtsc();
+}
+
+#define DisableInterrupts()    BRTOS_PortDisableInterrupts()
+#define EnableInterrupts()     BRTOS_PortEnableInterrupts()
+
+#define BRTOS_PortPendSwitch() (iPortSwitchPending = 1)
+
+/* interrupts are signals delivered to the same thread */
+#define BRTOS_PortMemoryBarrier() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+#define BRTOS_PortConfigureTick() ((void) 0)
+#if BRTOS_PORT_SIM
+/* timestamp (BRTOS_GetTimestamp(), statistics and trace): virtual time */
+#define BRTOS_PortTimestamp()      ((unsigned long) ullPortSimTime)
+#define BRTOS_PORT_TIMESTAMP_MASK  (~0UL)
+#define BRTOS_PORT_TIMESTAMP_HZ    1000000000UL
+#else
+/* timestamp (BRTOS_GetTimestamp(), statistics and trace): cycle counter, its rate is
+   only known at run time */
+#define BRTOS_PortTimestamp()      ((unsigned long) BRTOS_PortCycles())
+#define BRTOS_PORT_TIMESTAMP_MASK  (~0UL)
+#define BRTOS_PORT_TIMESTAMP_HZ    0
+#endif
+
+/* stacks given by the application are not used */
+#define BRTOS_PORT_STACK_FRAME 0
+
+#define BRTOS_PortInitStack(psTask, pusStack) \
+    BRTOS_PortNewStack((psTask), (psTask) - asBrtosTasks, BRTOS_TaskEnd)
+
+/* static task table: host stacks have the port size whatever the table
+   says, the frame is built at initialization */
+#define BRTOS_PORT_STACK_WORDS(bytes)          (BRTOS_PORT_STACK_SIZE/sizeof(unsigned short))
+#define BRTOS_PORT_STACK_ATTR                  __attribute__((aligned(16)))
+#define BRTOS_PORT_STACK_INIT(entry, bytes)    { 0 }
+#define BRTOS_PortStaticStack(psTask, psConst) BRTOS_PortStaticFrame((psTask), (psConst), BRTOS_TaskEnd)
+#define BRTOS_PortStart()      do { LeaveCriticalSection(); BRTOS_PortRun(); } while(0)
+
+#endif /* __PORT_POSIX_H__ */
@@ -0,0 +1,275 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   stackreport.c
+
+Build time stack report. It reads the call graphs written by gcc with
+-fcallgraph-info=su (one .ci file per source file, gcc 10 or later) and 
+prints the worst case stack usage of the given task entry points (or of
+every function nobody calls). The deepest call chain is shown, so the task
+stacks given to BRTOS_CreateTask() can be sized from the code instead of
+guessed.
+
+Usage: stackreport [-f bytes] [-r function ...] file.ci ...
+
+- -f bytes: added to each worst case, for the context saved by an interrupt
+  on the task stack (28 bytes for the MSP430 port, see port_msp430.h)
+- -r function: report this function (task entry point), it can be repeated
+
+Flags after a worst case:
+- '*': recursion or dynamic stack allocation, the value is only a lower bound
+- '?': calls outside the report (C library, indirect calls), not counted
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPORT_MAX_FUNCS   1024
+#define REPORT_MAX_EDGES   4096
+#define REPORT_MAX_NAME    64
+
+#define REPORT_UNKNOWN     0x01   /* external or indirect function   */
+#define REPORT_UNBOUNDED   0x02   /* recursion or dynamic allocation */
+
+typedef struct {
+	char           acName[REPORT_MAX_NAME];
+	unsigned long  ulFrame;       /* own frame in bytes               */
+	unsigned long  ulWorst;       /* frame plus deepest callee        */
+	int            iFlags;        /* REPORT_xxx of the function       */
+	int            iWorstFlags;   /* REPORT_xxx of the whole chain    */
+	int            iState;        /* 0: new, 1: visiting, 2: done     */
+	int            iCalled;       /* some function calls it           */
+	int            iDeepest;      /* callee in the deepest chain      */
+} REPORT_FUNC;
+
+typedef struct {
+	int            iFrom;
+	int            iTo;
+} REPORT_EDGE;
+
+static REPORT_FUNC asFuncs[REPORT_MAX_FUNCS];
+static REPORT_EDGE asEdges[REPORT_MAX_EDGES];
+static int iNumFuncs;
+static int iNumEdges;
+
+/**
+Find a function by name, adding it if not found (as unknown).
+*/
+static int Report_Func(const char *pcName)
+{
+	int i;
+
+	for(i = 0 ; i < iNumFuncs ; i++)
+		if(strcmp(asFuncs[i].acName, pcName) == 0)
+			return i;
+
+	if(iNumFuncs >= REPORT_MAX_FUNCS)
+	{
+		fprintf(stderr, "stackreport: too many functions\n");
+		exit(1);
+	}
+
+	strncpy(asFuncs[i].acName, pcName, REPORT_MAX_NAME - 1);
+	asFuncs[i].iFlags   = REPORT_UNKNOWN;
+	asFuncs[i].iDeepest = -1;
+	iNumFuncs++;
+
+	return i;
+}
+
+/**
+Copy the quoted string after pcKey in pcLine.
+
+@return 1 if found
+*/
+static int Report_Field(const char *pcLine, const char *pcKey, char *pcValue)
+{
+	const char *pcBeg = strstr(pcLine, pcKey);
+	const char *pcEnd;
+	size_t      uLen;
+
+	if(pcBeg == 0)
+		return 0;
+
+	pcBeg += strlen(pcKey);
+	pcEnd  = strchr(pcBeg, '"');
+	if(pcEnd == 0)
+		return 0;
+
+	uLen = pcEnd - pcBeg;
+	if(uLen >= REPORT_MAX_NAME)
+		uLen = REPORT_MAX_NAME - 1;
+	memcpy(pcValue, pcBeg, uLen);
+	pcValue[uLen] = 0;
+
+	return 1;
+}
+
+/**
+Read the nodes (functions and frames) and edges (calls) of a .ci file.
+*/
+static void Report_Read(const char *pcFile)
+{
+	char  acLine[512];
+	char  acName[REPORT_MAX_NAME];
+	char  acTarget[REPORT_MAX_NAME];
+	char *pcBytes;
+	FILE *psFile;
+	int   i;
+
+	psFile = fopen(pcFile, "r");
+	if(psFile == 0)
+	{
+		fprintf(stderr, "stackreport: cannot open %s\n", pcFile);
+		exit(1);
+	}
+
+	while(fgets(acLine, sizeof(acLine), psFile))
+	{
+		if(strncmp(acLine, "node:", 5) == 0 && Report_Field(acLine, "title: \"", acName))
+		{
+			/* functions defined in the file have their frame in the label */
+			pcBytes = strstr(acLine, " bytes (");
+			if(pcBytes == 0)
+				continue;
+			while(pcBytes > acLine && pcBytes[-1] >= '0' && pcBytes[-1] <= '9')
+				pcBytes--;
+
+			i = Report_Func(acName);
+			asFuncs[i].ulFrame = strtoul(pcBytes, 0, 10);
+			asFuncs[i].iFlags  = strstr(pcBytes, "dynamic") ? REPORT_UNBOUNDED : 0;
+		}
+		else if(strncmp(acLine, "edge:", 5) == 0 && 
+		        Report_Field(acLine, "sourcename: \"", acName) && 
+		        Report_Field(acLine, "targetname: \"", acTarget))
+		{
+			if(iNumEdges >= REPORT_MAX_EDGES)
+			{
+				fprintf(stderr, "stackreport: too many calls\n");
+				exit(1);
+			}
+			asEdges[iNumEdges].iFrom = Report_Func(acName);
+			asEdges[iNumEdges].iTo   = Report_Func(acTarget);
+			asFuncs[asEdges[iNumEdges].iTo].iCalled = 1;
+			iNumEdges++;
+		}
+	}
+
+	fclose(psFile);
+}
+
+/**
+Worst case of a function: its frame plus the deepest of its callees.
+Recursive calls are not followed.
+*/
+static void Report_Worst(int iFunc)
+{
+	REPORT_FUNC *psFunc = &asFuncs[iFunc];
+	int i, iTo;
+
+	psFunc->iState      = 1;
+	psFunc->iWorstFlags = psFunc->iFlags;
+	psFunc->ulWorst     = psFunc->ulFrame;
+
+	for(i = 0 ; i < iNumEdges ; i++)
+	{
+		if(asEdges[i].iFrom != iFunc)
+			continue;
+
+		iTo = asEdges[i].iTo;
+		if(asFuncs[iTo].iState == 1)
+		{
+			psFunc->iWorstFlags |= REPORT_UNBOUNDED;
+			continue;
+		}
+		if(asFuncs[iTo].iState == 0)
+			Report_Worst(iTo);
+
+		psFunc->iWorstFlags |= asFuncs[iTo].iWorstFlags;
+		if(psFunc->ulFrame + asFuncs[iTo].ulWorst > psFunc->ulWorst)
+		{
+			psFunc->ulWorst  = psFunc->ulFrame + asFuncs[iTo].ulWorst;
+			psFunc->iDeepest = iTo;
+		}
+	}
+
+	psFunc->iState = 2;
+}
+
+static int Report_Compare(const void *pvA, const void *pvB)
+{
+	const REPORT_FUNC *psA = &asFuncs[*(const int *) pvA];
+	const REPORT_FUNC *psB = &asFuncs[*(const int *) pvB];
+
+	return psA->ulWorst < psB->ulWorst ? 1 : psA->ulWorst > psB->ulWorst ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static int aiRoots[REPORT_MAX_FUNCS];
+	unsigned long ulExtra = 0;
+	int iNumRoots = 0;
+	int i, iFunc;
+
+	for(i = 1 ; i < argc ; i++)
+	{
+		if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			ulExtra = strtoul(argv[++i], 0, 10);
+		else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			i++;
+		else
+			Report_Read(argv[i]);
+	}
+
+	if(iNumFuncs == 0)
+	{
+		fprintf(stderr, "usage: stackreport [-f bytes] [-r function ...] file.ci ...\n");
+		return 1;
+	}
+
+	for(i = 1 ; i < argc ; i++)
+		if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			aiRoots[iNumRoots++] = Report_Func(argv[++i]);
+
+	for(i = 0 ; i < iNumFuncs ; i++)
+		if(asFuncs[i].iState == 0)
+			Report_Worst(i);
+
+	if(iNumRoots == 0)
+	{
+		for(i = 0 ; i < iNumFuncs ; i++)
+			if(!asFuncs[i].iCalled && !(asFuncs[i].iFlags & REPORT_UNKNOWN))
+				aiRoots[iNumRoots++] = i;
+		qsort(aiRoots, iNumRoots, sizeof(aiRoots[0]), Report_Compare);
+	}
+
+	printf("worst case stack usage in bytes (%lu bytes added for interrupts)\n", ulExtra);
+	for(i = 0 ; i < iNumRoots ; i++)
+	{
+		iFunc = aiRoots[i];
+		printf("%6lu%c%c %s", asFuncs[iFunc].ulWorst + ulExtra,
+		       asFuncs[iFunc].iWorstFlags & REPORT_UNBOUNDED ? '*' : ' ',
+		       asFuncs[iFunc].iWorstFlags & REPORT_UNKNOWN ? '?' : ' ',
+		       asFuncs[iFunc].acName);
+		for(iFunc = asFuncs[iFunc].iDeepest ; iFunc >= 0 ; iFunc = asFuncs[iFunc].iDeepest)
+			printf(" > %s(%lu)", asFuncs[iFunc].acName, asFuncs[iFunc].ulFrame);
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*
+Copyright 2005- Marcelo Barros de Almeida. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, 
+      this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright notice, 
+      this list of conditions and the following disclaimer in the documentation 
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE BASIC RTOS PROJECT ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE BASIC RTOS PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the authors and should not be interpreted as representing official policies, either expressed or implied, of the Basic RTOS Project.
+
+*/
+/**
+@file   tracedecode.c
+
+Host decoder for the kernel trace (BRTOS_TRACE). It reads a dump written
+by BRTOS_TraceDump() (sent by the target or saved by a debugger) and prints
+the timeline of events and a per task report: CPU usage (from the switch
+events), switches, wake ups, sleeps and waits, and the time spent in kernel
+aware interrupt routines.
+
+Usage: tracedecode [-hz rate] [-s] dump.bin
+
+- -hz rate: timestamp rate, when the dump does not have it (host port)
+- -s: only the report, without the timeline
+
+Times are relative to the oldest record. The time before the first switch
+event can not be given to any task.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../brtos.h"
+
+#define DECODE_TASKS 256
+
+typedef struct {
+	unsigned long long ullTime;       /* time running                     */
+	unsigned long      ulSwitches;    /* times switched in                */
+	unsigned long      ulWakes;       /* wake ups                         */
+	unsigned long      ulSleeps;      /* BRTOS_Sleep() calls              */
+	unsigned long      ulWaits;       /* blocking waits                   */
+} DECODE_TASK;
+
+static DECODE_TASK asTasks[DECODE_TASKS];
+static double dHz;
+
+static const char *Decode_Name(unsigned char ucEvent)
+{
+	switch(ucEvent)
+	{
+		case BRTOS_TRACE_SWITCH:    return "switch";
+		case BRTOS_TRACE_WAKE:      return "wake";
+		case BRTOS_TRACE_SLEEP:     return "sleep";
+		case BRTOS_TRACE_WAIT:      return "wait";
+		case BRTOS_TRACE_ISR_ENTER: return "isr enter";
+		case BRTOS_TRACE_ISR_EXIT:  return "isr exit";
+		default:                    return "unknown";
+	}
+}
+
+/**
+Time in microseconds, or in timestamp units when the rate is not known.
+*/
+static double Decode_Time(unsigned long long ullTime)
+{
+	return dHz > 0 ? ullTime*1000000.0/dHz : (double) ullTime;
+}
+
+int main(int argc, char *argv[])
+{
+	static unsigned char aucDump[BRTOS_TRACE_HEADER_SIZE + 65536*BRTOS_TRACE_RECORD_SIZE];
+	const char *pcUnit;
+	unsigned char *pucRecord;
+	unsigned long long ullTime = 0, ullElapsed = 0, ullSwitch = 0, ullFirst = 0;
+	unsigned long long ullIsrBeg = 0, ullIsrTime = 0;
+	unsigned long ulIsrCount = 0;
+	unsigned short usCount, usDelta;
+	unsigned char ucEvent, ucArg;
+	int iCurrent = -1;
+	int iTimeline = 1;
+	int iStarted = 0;
+	const char *pcFile = 0;
+	size_t uSize;
+	FILE *psFile;
+	int i;
+
+	for(i = 1 ; i < argc ; i++)
+	{
+		if(strcmp(argv[i], "-hz") == 0 && i + 1 < argc)
+			dHz = atof(argv[++i]);
+		else if(strcmp(argv[i], "-s") == 0)
+			iTimeline = 0;
+		else
+			pcFile = argv[i];
+	}
+
+	if(pcFile == 0)
+	{
+		fprintf(stderr, "usage: tracedecode [-hz rate] [-s] dump.bin\n");
+		return 1;
+	}
+
+	psFile = fopen(pcFile, "rb");
+	if(psFile == 0)
+	{
+		fprintf(stderr, "tracedecode: cannot open %s\n", pcFile);
+		return 1;
+	}
+	uSize = fread(aucDump, 1, sizeof(aucDump), psFile);
+	fclose(psFile);
+
+	if(uSize < BRTOS_TRACE_HEADER_SIZE || (aucDump[0] | aucDump[1] << 8) != BRTOS_TRACE_MAGIC)
+	{
+		fprintf(stderr, "tracedecode: %s is not a trace dump\n", pcFile);
+		return 1;
+	}
+
+	usCount = aucDump[2] | aucDump[3] << 8;
+	if(uSize < BRTOS_TRACE_HEADER_SIZE + (size_t) usCount*BRTOS_TRACE_RECORD_SIZE)
+	{
+		fprintf(stderr, "tracedecode: %s is truncated\n", pcFile);
+		return 1;
+	}
+	if(dHz == 0)
+		dHz = aucDump[4] | aucDump[5] << 8 | aucDump[6] << 16 | (unsigned long) aucDump[7] << 24;
+	pcUnit = dHz > 0 ? "us" : "units";
+
+	pucRecord = &aucDump[BRTOS_TRACE_HEADER_SIZE];
+	for(i = 0 ; i < usCount ; i++, pucRecord += BRTOS_TRACE_RECORD_SIZE)
+	{
+		usDelta = pucRecord[0] | pucRecord[1] << 8;
+		ucEvent = pucRecord[2];
+		ucArg   = pucRecord[3];
+
+		if(ucEvent == BRTOS_TRACE_ELAPSED)
+		{
+			ullElapsed = (unsigned long long) ucArg << 32 | (unsigned long long) usDelta << 16;
+			continue;
+		}
+
+		/* the first event is the time origin */
+		if(iStarted)
+			ullTime += ullElapsed + usDelta;
+		iStarted   = 1;
+		ullElapsed = 0;
+
+		if(iTimeline)
+		{
+			printf("%14.*f %s  %-10s", dHz > 0 ? 3 : 0, Decode_Time(ullTime), pcUnit, Decode_Name(ucEvent));
+			if(ucEvent == BRTOS_TRACE_ISR_ENTER || ucEvent == BRTOS_TRACE_ISR_EXIT)
+				printf("level %u\n", ucArg);
+			else if(ucArg == BRTOS_TASK_IDLE)
+				printf("idle\n");
+			else
+				printf("task %u\n", ucArg);
+		}
+
+		switch(ucEvent)
+		{
+			case BRTOS_TRACE_SWITCH:
+				if(iCurrent >= 0)
+					asTasks[iCurrent].ullTime += ullTime - ullSwitch;
+				else
+					ullFirst = ullTime;
+				iCurrent  = ucArg;
+				ullSwitch = ullTime;
+				asTasks[ucArg].ulSwitches++;
+				break;
+			case BRTOS_TRACE_WAKE:      asTasks[ucArg].ulWakes++;  break;
+			case BRTOS_TRACE_SLEEP:     asTasks[ucArg].ulSleeps++; break;
+			case BRTOS_TRACE_WAIT:      asTasks[ucArg].ulWaits++;  break;
+			case BRTOS_TRACE_ISR_ENTER:
+				if(ucArg == 1)
+					ullIsrBeg = ullTime;
+				break;
+			case BRTOS_TRACE_ISR_EXIT:
+				if(ucArg == 1)
+				{
+					ullIsrTime += ullTime - ullIsrBeg;
+					ulIsrCount++;
+				}
+				break;
+		}
+	}
+
+	if(iCurrent >= 0)
+		asTasks[iCurrent].ullTime += ullTime - ullSwitch;
+
+	printf("%u records, %.3f %s from the first switch\n", usCount, Decode_Time(ullTime - ullFirst), pcUnit);
+	printf("task      cpu %%  %14s   switches      wakes     sleeps      waits\n", pcUnit);
+	for(i = 0 ; i < DECODE_TASKS ; i++)
+	{
+		if(asTasks[i].ulSwitches == 0 && asTasks[i].ulWakes == 0 && asTasks[i].ulSleeps == 0 && asTasks[i].ulWaits == 0)
+			continue;
+		if(i == BRTOS_TASK_IDLE)
+			printf("idle");
+		else
+			printf("%4d", i);
+		printf("  %8.2f  %14.3f %10lu %10lu %10lu %10lu\n", 
+		       ullTime > ullFirst ? 100.0*asTasks[i].ullTime/(ullTime - ullFirst) : 0.0,
+		       Decode_Time(asTasks[i].ullTime), asTasks[i].ulSwitches, 
+		       asTasks[i].ulWakes, asTasks[i].ulSleeps, asTasks[i].ulWaits);
+	}
+	if(ulIsrCount)
+		printf("interrupt routines: %lu, %.3f %s (included in task times)\n", 
+		       ulIsrCount, Decode_Time(ullIsrTime), pcUnit);
+
+	return 0;
+}